@@ -0,0 +1,199 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*! Minimal microbenchmark harness
+ * Every benchmark is a callable that performs `ops` operations per call.
+ * The call count is calibrated so a sample takes at least `min_sample_time`, the reported time is the median of `num_samples` samples.
+ * Accuracy checks record the maximum error of an approximation against its bound, the suite fails if any bound is exceeded.
+ */
+namespace bench
+{
+
+	/*! Prevents the compiler from optimizing away the computation of `value`. */
+	template<typename T>
+	inline void DoNotOptimize(T const& value)
+	{
+#ifdef _MSC_VER
+		static char const volatile* sink;
+		sink = reinterpret_cast<char const volatile*>(&value);
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	struct Result
+	{
+		std::string name;
+		std::uint64_t iterations; // Total number of operations timed.
+		double ns_per_op; // Median.
+		double ns_per_op_min;
+	};
+
+	struct Accuracy
+	{
+		std::string name;
+		double max_error;
+		double bound;
+	};
+
+	class Suite
+	{
+		using clock = std::chrono::steady_clock;
+
+	public:
+		explicit Suite(std::string filter = "") : m_filter(std::move(filter))
+		{
+		}
+
+		/*! Times `func`. `ops` is the number of operations performed by one call and is used to report the time per operation. */
+		template<typename F>
+		void Run(std::string const& name, std::uint64_t ops, F&& func)
+		{
+			if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+			{
+				return;
+			}
+
+			// Warm up and calibrate.
+			std::uint64_t calls = 1;
+			while (true)
+			{
+				const auto time = Time(func, calls);
+				if (time >= min_sample_time || calls >= max_calls)
+				{
+					break;
+				}
+				calls *= 2;
+			}
+
+			std::vector<double> samples;
+			for (int i = 0; i < num_samples; i++)
+			{
+				const auto time = Time(func, calls);
+				samples.push_back(std::chrono::duration<double, std::nano>(time).count() / static_cast<double>(calls * ops));
+			}
+			std::sort(samples.begin(), samples.end());
+
+			Result result;
+			result.name = name;
+			result.iterations = calls * ops * num_samples;
+			result.ns_per_op = samples[samples.size() / 2];
+			result.ns_per_op_min = samples.front();
+			m_results.push_back(result);
+
+			std::cout << name << ": " << result.ns_per_op << " ns/op (min " << result.ns_per_op_min << ")" << std::endl;
+		}
+
+		/*! Records the maximum error measured by `func` and compares it against `bound`. */
+		template<typename F>
+		void Check(std::string const& name, double bound, F&& func)
+		{
+			if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+			{
+				return;
+			}
+
+			Accuracy accuracy;
+			accuracy.name = name;
+			accuracy.max_error = func();
+			accuracy.bound = bound;
+			m_accuracy.push_back(accuracy);
+
+			std::cout << name << ": max error " << accuracy.max_error << " (bound " << bound << ")"
+				<< (accuracy.max_error <= bound ? "" : " FAILED") << std::endl;
+		}
+
+		/*! Whether every accuracy check is within its bound. */
+		bool Passed() const
+		{
+			return std::all_of(m_accuracy.begin(), m_accuracy.end(), [](Accuracy const& a) { return a.max_error <= a.bound; });
+		}
+
+		/*! Writes the results and `info` (key value pairs describing the build) as JSON. */
+		void WriteJson(std::ostream& out, std::vector<std::pair<std::string, std::string>> const& info) const
+		{
+			out << "{\n";
+			for (auto const& kv : info)
+			{
+				out << "\t\"" << Escape(kv.first) << "\": \"" << Escape(kv.second) << "\",\n";
+			}
+			out << "\t\"benchmarks\": [\n";
+			for (std::size_t i = 0; i < m_results.size(); i++)
+			{
+				auto const& r = m_results[i];
+				out << "\t\t{ \"name\": \"" << Escape(r.name) << "\""
+					<< ", \"iterations\": " << r.iterations
+					<< ", \"ns_per_op\": " << r.ns_per_op
+					<< ", \"ns_per_op_min\": " << r.ns_per_op_min
+					<< ", \"ops_per_second\": " << (r.ns_per_op > 0 ? 1e9 / r.ns_per_op : 0)
+					<< " }" << (i + 1 < m_results.size() ? "," : "") << "\n";
+			}
+			out << "\t],\n";
+			out << "\t\"accuracy\": [\n";
+			for (std::size_t i = 0; i < m_accuracy.size(); i++)
+			{
+				auto const& a = m_accuracy[i];
+				out << "\t\t{ \"name\": \"" << Escape(a.name) << "\""
+					<< ", \"max_error\": " << a.max_error
+					<< ", \"bound\": " << a.bound
+					<< ", \"passed\": " << (a.max_error <= a.bound ? "true" : "false")
+					<< " }" << (i + 1 < m_accuracy.size() ? "," : "") << "\n";
+			}
+			out << "\t]\n";
+			out << "}\n";
+		}
+
+		std::vector<Result> const& GetResults() const
+		{
+			return m_results;
+		}
+
+	private:
+		template<typename F>
+		static clock::duration Time(F& func, std::uint64_t calls)
+		{
+			const auto start = clock::now();
+			for (std::uint64_t i = 0; i < calls; i++)
+			{
+				func();
+			}
+			return clock::now() - start;
+		}
+
+		static std::string Escape(std::string const& str)
+		{
+			std::string retval;
+			for (auto c : str)
+			{
+				if (c == '"' || c == '\\')
+				{
+					retval += '\\';
+				}
+				retval += c;
+			}
+			return retval;
+		}
+
+		static constexpr int num_samples = 9;
+		static constexpr std::uint64_t max_calls = 1ull << 30;
+		static constexpr clock::duration min_sample_time = std::chrono::milliseconds(20);
+
+		std::string m_filter;
+		std::vector<Result> m_results;
+		std::vector<Accuracy> m_accuracy;
+	};
+
+} /* bench */
@@ -0,0 +1,2057 @@
+#include <array>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <iostream>
+#include <filesystem>
+#include <assimp/scene.h>
+
+#include "benchmark.hpp"
+
+#include "../src/vec.hpp"
+#include "../src/vec_batch.hpp"
+#include "../src/mat.hpp"
+#include "../src/approx.hpp"
+#include "../src/bvh.hpp"
+#include "../src/static_bvh.hpp"
+#include "../src/skeleton.hpp"
+#include "../src/animation_manager.hpp"
+#include "../src/vertex_compression.hpp"
+#include "../src/obj_loader.hpp"
+#include "../src/model.hpp"
+#include "../src/scene_builder.hpp"
+#include "../src/mesh_optimizer.hpp"
+#include "../src/mesh_simplifier.hpp"
+#include "../src/texture_cache.hpp"
+#include "../src/block_compression.hpp"
+#include "../src/paged_geometry.hpp"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+namespace
+{
+
+	constexpr std::uint32_t num_triangles = 2048;
+	constexpr std::size_t num_kernel_items = 1024; // Rays and primitives per kernel benchmark call.
+	constexpr std::size_t num_scene_rays = 4096;
+
+	struct Ray
+	{
+		fm::vec3 origin;
+		fm::vec3 direction;
+	};
+
+	// Every data set is generated from a fixed seed so results are comparable across runs and versions.
+	std::vector<Vertex> MakeSceneVertices(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> dist(-10, 10);
+
+		std::vector<Vertex> vertices;
+		for (std::uint32_t i = 0; i < num_triangles; i++)
+		{
+			const fm::vec3 center(dist(rng), dist(rng), dist(rng));
+			for (int k = 0; k < 3; k++)
+			{
+				Vertex v = {};
+				v.position = center + fm::vec3(dist(rng) * 0.1f, dist(rng) * 0.1f, dist(rng) * 0.1f);
+				v.normal = fm::pvec3(0, 0, -1);
+				vertices.push_back(v);
+			}
+		}
+
+		return vertices;
+	}
+
+	std::vector<Ray> MakeCameraRays(std::mt19937& rng, std::size_t count)
+	{
+		std::uniform_real_distribution<float> dist(-1, 1);
+
+		std::vector<Ray> rays(count);
+		for (auto& ray : rays)
+		{
+			ray.origin = fm::vec3(0, 0, -30);
+			ray.direction = fm::vec3(dist(rng) * 0.4f, dist(rng) * 0.4f, 1);
+		}
+
+		return rays;
+	}
+
+	void BenchVec(bench::Suite& suite, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> dist(-10, 10);
+
+		auto run = [&](std::string const& prefix, auto tag)
+		{
+			using V = decltype(tag);
+
+			std::vector<V> a(num_kernel_items), b(num_kernel_items), out(num_kernel_items);
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				a[i] = V(dist(rng), dist(rng), dist(rng));
+				b[i] = V(dist(rng), dist(rng), dist(rng));
+			}
+
+			suite.Run(prefix + "/add", num_kernel_items, [&]()
+			{
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					out[i] = a[i] + b[i];
+				}
+				bench::DoNotOptimize(out);
+			});
+
+			suite.Run(prefix + "/dot", num_kernel_items, [&]()
+			{
+				float sum = 0;
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					sum += a[i].Dot(b[i]);
+				}
+				bench::DoNotOptimize(sum);
+			});
+
+			suite.Run(prefix + "/cross", num_kernel_items, [&]()
+			{
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					out[i] = a[i].Cross(b[i]);
+				}
+				bench::DoNotOptimize(out);
+			});
+
+			suite.Run(prefix + "/normalize", num_kernel_items, [&]()
+			{
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					out[i] = a[i].Normalized();
+				}
+				bench::DoNotOptimize(out);
+			});
+		};
+
+		run("vec/pvec3", fm::pvec3());
+		run("vec/svec3", fm::svec3());
+
+		// The SSE vectors have to match the scalar ones bit for bit. svec4 gets w = 0, which has to stay 0.
+		auto check = [&](std::string const& prefix, auto tag)
+		{
+			using V = decltype(tag);
+			constexpr bool has_w = std::is_same_v<V, fm::svec4>;
+
+			suite.Check(prefix + "/mismatches", 0, [&]()
+			{
+				// Own generator so filtering this check out doesn't change the data of later benchmarks.
+				std::mt19937 check_rng(7);
+				std::size_t mismatches = 0;
+				auto expect = [&](V v, fm::pvec3 const& expected)
+				{
+					bool same = v[0] == expected[0] && v[1] == expected[1] && v[2] == expected[2];
+					if constexpr (has_w)
+					{
+						same = same && v[3] == 0;
+					}
+					mismatches += !same;
+				};
+
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					fm::pvec3 pa(dist(check_rng), dist(check_rng), dist(check_rng));
+					fm::pvec3 pb(dist(check_rng), dist(check_rng), dist(check_rng));
+					const float scalar = dist(check_rng);
+					V a, b;
+					for (auto j = 0; j < 3; j++)
+					{
+						a[j] = pa[j];
+						b[j] = pb[j];
+					}
+
+					expect(a + b, pa + pb);
+					expect(a - b, pa - pb);
+					expect(a * b, pa * pb);
+					expect(a * scalar, pa * scalar);
+					expect(a / scalar, pa / scalar);
+					expect(V(a) += b, fm::pvec3(pa) += pb);
+					expect(V(a) -= b, fm::pvec3(pa) -= pb);
+					expect(V(a) *= b, fm::pvec3(pa) *= pb);
+					expect(a.Cross(b), pa.Cross(pb));
+					expect(a.Normalized(), pa.Normalized());
+					expect(V::Min(a, b), fm::pvec3::Min(pa, pb));
+					expect(V::Max(a, b), fm::pvec3::Max(pa, pb));
+					mismatches += a.Dot(b) != pa.Dot(pb);
+					mismatches += a.Length() != pa.Length();
+					mismatches += (a == b) != (pa == pb) || !(a == a);
+					mismatches += (a != b) != (pa != pb) || a != a;
+				}
+				return static_cast<double>(mismatches);
+			});
+		};
+
+		check("vec/accuracy/svec3", fm::svec3());
+		check("vec/accuracy/svec4", fm::svec4());
+
+		// Batches. `ops` is the number of 3D vectors so the results compare to the single vector versions.
+		auto run_batch = [&](std::string const& prefix, auto tag)
+		{
+			using B = decltype(tag);
+			constexpr std::size_t num_batches = num_kernel_items / B::width;
+
+			std::vector<fm::pvec3> aos(num_kernel_items);
+			for (auto& v : aos)
+			{
+				v = fm::pvec3(dist(rng), dist(rng), dist(rng));
+			}
+
+			std::vector<B> a(num_batches), b(num_batches);
+			for (std::size_t i = 0; i < num_batches; i++)
+			{
+				a[i] = B::Gather(aos.data() + i * B::width);
+				b[i] = B::Gather(aos.data() + (num_batches - 1 - i) * B::width);
+			}
+
+			suite.Run(prefix + "/dot", num_kernel_items, [&]()
+			{
+				typename B::Lane sum;
+				for (std::size_t i = 0; i < num_batches; i++)
+				{
+					sum += a[i].Dot(b[i]);
+				}
+				bench::DoNotOptimize(sum);
+			});
+
+			suite.Run(prefix + "/normalize", num_kernel_items, [&]()
+			{
+				B sum;
+				for (std::size_t i = 0; i < num_batches; i++)
+				{
+					sum += a[i].Normalized();
+				}
+				bench::DoNotOptimize(sum);
+			});
+
+			suite.Run(prefix + "/gather", num_kernel_items, [&]()
+			{
+				B sum;
+				for (std::size_t i = 0; i < num_batches; i++)
+				{
+					sum += B::Gather(aos.data() + i * B::width);
+				}
+				bench::DoNotOptimize(sum);
+			});
+		};
+
+		run_batch("vec/vec3x4", fm::Vec3x4());
+		run_batch("vec/vec3x8", fm::Vec3x8());
+
+		// Every lane of a batch has to match the single vector version bit for bit.
+		auto check_batch = [&](std::string const& prefix, auto tag)
+		{
+			using B = decltype(tag);
+			constexpr unsigned int width = B::width;
+
+			suite.Check(prefix + "/mismatches", 0, [&]()
+			{
+				std::mt19937 check_rng(7);
+				std::size_t mismatches = 0;
+				auto expect = [&](B const& v, unsigned int i, fm::pvec3 const& expected)
+				{
+					mismatches += v.x[i] != expected[0] || v.y[i] != expected[1] || v.z[i] != expected[2];
+				};
+
+				std::vector<fm::pvec3> pa(width), pb(width);
+				std::array<std::uint32_t, width> reversed;
+				for (std::size_t n = 0; n < num_kernel_items / width; n++)
+				{
+					for (unsigned int i = 0; i < width; i++)
+					{
+						pa[i] = fm::pvec3(dist(check_rng), dist(check_rng), dist(check_rng));
+						pb[i] = fm::pvec3(dist(check_rng), dist(check_rng), dist(check_rng));
+						reversed[i] = width - 1 - i;
+					}
+
+					const B a = B::Gather(pa.data());
+					const B b = B::Gather(pb.data());
+					const B gathered = B::Gather(pa.data(), reversed.data());
+					const auto mask = a.x < b.x;
+					const B masked = B::Gather(pa.data(), reversed.data(), mask);
+					const auto dot = a.Dot(b);
+					const B cross = a.Cross(b);
+					const B normalized = a.Normalized();
+					const B selected = B::Select(mask, a, b);
+
+					std::vector<fm::pvec3> scattered(width);
+					a.Scatter(scattered.data());
+					std::vector<fm::pvec3> masked_scattered(pb);
+					a.Scatter(masked_scattered.data(), reversed.data(), mask);
+
+					for (unsigned int i = 0; i < width; i++)
+					{
+						fm::pvec3 va = pa[i];
+						const bool lane_set = pa[i][0] < pb[i][0];
+						mismatches += mask[i] != lane_set;
+						expect(a, i, pa[i]);
+						expect(gathered, i, pa[reversed[i]]);
+						expect(masked, i, lane_set ? pa[reversed[i]] : fm::pvec3());
+						mismatches += dot[i] != va.Dot(pb[i]);
+						expect(cross, i, va.Cross(pb[i]));
+						expect(normalized, i, va.Normalized());
+						expect(selected, i, lane_set ? pa[i] : pb[i]);
+						mismatches += scattered[i] != pa[i];
+						mismatches += masked_scattered[reversed[i]] != (lane_set ? pa[i] : pb[reversed[i]]);
+					}
+				}
+				return static_cast<double>(mismatches);
+			});
+		};
+
+		check_batch("vec/accuracy/vec3x4", fm::Vec3x4());
+		check_batch("vec/accuracy/vec3x8", fm::Vec3x8());
+
+		std::vector<fm::mat4> mats(256);
+		for (auto& m : mats)
+		{
+			m = fm::mat4::Compose(fm::vec3(dist(rng), dist(rng), dist(rng)), fm::quat(dist(rng), dist(rng), dist(rng), dist(rng)).Normalized(), fm::vec3(1, 1, 1));
+		}
+
+		suite.Run("mat/mat4_multiply", mats.size(), [&]()
+		{
+			fm::mat4 result;
+			for (auto const& m : mats)
+			{
+				result = result * m;
+			}
+			bench::DoNotOptimize(result);
+		});
+
+		suite.Run("mat/inverse_affine", mats.size(), [&]()
+		{
+			for (auto& m : mats)
+			{
+				m = m.InverseAffine();
+			}
+			bench::DoNotOptimize(mats);
+		});
+
+		// The SIMD paths claim the same operations in the same order as the Assimp math they replace, so they have to match it exactly.
+		auto random_transform = [&](std::mt19937& check_rng, fm::vec3& t, fm::quat& r, fm::vec3& s)
+		{
+			std::uniform_real_distribution<float> scale_dist(0.5f, 2.f);
+			t = fm::vec3(dist(check_rng), dist(check_rng), dist(check_rng));
+			r = fm::quat(dist(check_rng), dist(check_rng), dist(check_rng), dist(check_rng)).Normalized();
+			s = fm::vec3(scale_dist(check_rng), scale_dist(check_rng), scale_dist(check_rng));
+		};
+		auto to_assimp = [](fm::vec3 const& t, fm::quat const& r, fm::vec3 const& s)
+		{
+			return aiMatrix4x4(aiVector3D(s[0], s[1], s[2]), aiQuaternion(r.w, r.x, r.y, r.z), aiVector3D(t[0], t[1], t[2]));
+		};
+
+		suite.Check("mat/accuracy/assimp_mismatches", 0, [&]()
+		{
+			std::mt19937 check_rng(7);
+			std::size_t mismatches = 0;
+			for (std::size_t i = 0; i < mats.size(); i++)
+			{
+				fm::vec3 ta, sa, tb, sb;
+				fm::quat ra, rb;
+				random_transform(check_rng, ta, ra, sa);
+				random_transform(check_rng, tb, rb, sb);
+
+				const aiMatrix4x4 ai_a = to_assimp(ta, ra, sa);
+				const aiMatrix4x4 ai_b = to_assimp(tb, rb, sb);
+				const fm::mat4 a = fm::mat4::Compose(ta, ra, sa);
+				const fm::mat4 b = fm::mat4::Compose(tb, rb, sb);
+				const aiMatrix4x4 ai_product = ai_a * ai_b;
+				mismatches += a != fm::mat4(&ai_a.a1);
+				mismatches += a * b != fm::mat4(&ai_product.a1);
+
+				for (const float t : { 0.f, 0.25f, 0.5f, 1.f })
+				{
+					aiQuaternion expected;
+					aiQuaternion::Interpolate(expected, aiQuaternion(ra.w, ra.x, ra.y, ra.z), aiQuaternion(rb.w, rb.x, rb.y, rb.z), t);
+					const fm::quat q = fm::quat::Slerp(ra, rb, t);
+					mismatches += q.x != expected.x || q.y != expected.y || q.z != expected.z || q.w != expected.w;
+				}
+			}
+			return static_cast<double>(mismatches);
+		});
+
+		// Cofactors instead of Assimp's general inverse, so only equal up to rounding.
+		suite.Check("mat/accuracy/inverse_affine", 1e-5, [&]()
+		{
+			std::mt19937 check_rng(7);
+			double max_error = 0;
+			for (std::size_t i = 0; i < mats.size(); i++)
+			{
+				fm::vec3 t, s;
+				fm::quat r;
+				random_transform(check_rng, t, r, s);
+
+				aiMatrix4x4 expected = to_assimp(t, r, s);
+				expected.Inverse();
+				const fm::mat4 inverse = fm::mat4::Compose(t, r, s).InverseAffine();
+				const fm::mat4 reference(&expected.a1);
+				for (int row = 0; row < 4; row++)
+				{
+					for (int col = 0; col < 4; col++)
+					{
+						max_error = std::max(max_error, static_cast<double>(std::abs(inverse[row][col] - reference[row][col])));
+					}
+				}
+			}
+			return max_error;
+		});
+	}
+
+	void BenchMath(bench::Suite& suite, std::mt19937& rng)
+	{
+		// Accuracy against libm, evaluated in double precision over an even sweep of the documented input range.
+		constexpr int num_accuracy_samples = 1 << 20;
+		auto sweep = [&](double begin, double end, auto&& error)
+		{
+			double max_error = 0;
+			for (int i = 0; i <= num_accuracy_samples; i++)
+			{
+				const float x = static_cast<float>(begin + (end - begin) * i / num_accuracy_samples);
+				max_error = std::max(max_error, error(x));
+			}
+			return max_error;
+		};
+
+		suite.Check("math/accuracy/exp2", 2e-7, [&]()
+		{
+			return sweep(-126, 127.4, [](float x) { const double r = std::exp2(double(x)); return std::abs(fm::FastExp2(x) - r) / r; });
+		});
+		suite.Check("math/accuracy/log2", 2e-7, [&]()
+		{
+			return sweep(-125, 127, [](float e) { const float x = std::exp2(e); return std::abs(fm::FastLog2(x) - std::log2(double(x))); });
+		});
+		suite.Check("math/accuracy/pow", 5e-7, [&]()
+		{
+			// Relative error scaled by the magnitude of the exponent, see `FastPow`.
+			return sweep(0, 100, [](float x)
+			{
+				double max_error = 0;
+				for (const float y : { 0.5f, 1.f / 2.2f, 2.2f, 8.f, 32.f, 64.f })
+				{
+					const double r = std::pow(double(x), double(y));
+					if (r > 1e-37 && r < 1e38)
+					{
+						max_error = std::max(max_error, std::abs(fm::FastPow(x, y) - r) / r / std::max(1.0, std::abs(y * std::log2(double(x)))));
+					}
+				}
+				return max_error;
+			});
+		});
+		suite.Check("math/accuracy/sincos", 2e-7, [&]()
+		{
+			return sweep(-8192, 8192, [](float x)
+			{
+				float s, c;
+				fm::FastSinCos(x, s, c);
+				return std::max(std::abs(s - std::sin(double(x))), std::abs(c - std::cos(double(x))));
+			});
+		});
+		suite.Check("math/accuracy/acos", 6e-7, [&]()
+		{
+			return sweep(-1, 1, [](float x) { return std::abs(fm::FastAcos(x) - std::acos(double(x))); });
+		});
+		suite.Check("math/accuracy/rsqrt", 1e-6, [&]()
+		{
+			return sweep(-120, 120, [](float e) { const float x = std::exp2(e); const double r = 1 / std::sqrt(double(x)); return std::abs(fm::FastRsqrt(x) - r) / r; });
+		});
+
+		// Speed. The batch versions use `Floatx8` which is what the 8 wide kernels would use.
+		std::uniform_real_distribution<float> dist(0, 1);
+		std::vector<float> xs(num_kernel_items), ys(num_kernel_items);
+		for (std::size_t i = 0; i < num_kernel_items; i++)
+		{
+			xs[i] = dist(rng);
+			ys[i] = dist(rng) * 64;
+		}
+
+		auto run = [&](std::string const& name, auto&& func)
+		{
+			suite.Run(name, num_kernel_items, [&]()
+			{
+				float sum = 0;
+				for (std::size_t i = 0; i < num_kernel_items; i++)
+				{
+					sum += func(xs[i], ys[i]);
+				}
+				bench::DoNotOptimize(sum);
+			});
+		};
+
+		auto run_batch = [&](std::string const& name, auto&& func)
+		{
+			suite.Run(name, num_kernel_items, [&]()
+			{
+				fm::Floatx8 sum(0.f);
+				for (std::size_t i = 0; i < num_kernel_items; i += 8)
+				{
+					sum += func(fm::Floatx8::Load(xs.data() + i), fm::Floatx8::Load(ys.data() + i));
+				}
+				bench::DoNotOptimize(sum);
+			});
+		};
+
+		run("math/pow_libm", [](float x, float y) { return std::pow(x, y); });
+		run("math/pow_fast", [](float x, float y) { return fm::FastPow(x, y); });
+		run_batch("math/pow_fast_x8", [](fm::Floatx8 const& x, fm::Floatx8 const& y) { return fm::FastPow(x, y); });
+
+		run("math/sincos_libm", [](float x, float) { return std::sin(x * 10) + std::cos(x * 10); });
+		run("math/sincos_fast", [](float x, float) { float s, c; fm::FastSinCos(x * 10, s, c); return s + c; });
+		run_batch("math/sincos_fast_x8", [](fm::Floatx8 const& x, fm::Floatx8 const&)
+		{
+			fm::Floatx8 s, c;
+			fm::FastSinCos(x * fm::Floatx8(10.f), s, c);
+			return s + c;
+		});
+
+		run("math/acos_libm", [](float x, float) { return std::acos(x); });
+		run("math/acos_fast", [](float x, float) { return fm::FastAcos(x); });
+		run_batch("math/acos_fast_x8", [](fm::Floatx8 const& x, fm::Floatx8 const&) { return fm::FastAcos(x); });
+
+		run("math/rsqrt_libm", [](float x, float) { return 1.f / std::sqrt(x); });
+		run("math/rsqrt_fast", [](float x, float) { return fm::FastRsqrt(x); });
+		run_batch("math/rsqrt_fast_x8", [](fm::Floatx8 const& x, fm::Floatx8 const&) { return fm::FastRsqrt(x); });
+	}
+
+	void BenchKernels(bench::Suite& suite, std::mt19937& rng, std::vector<Vertex> const& vertices)
+	{
+		const auto rays = MakeCameraRays(rng, num_kernel_items);
+
+		std::vector<Triangle> triangles(num_kernel_items);
+		std::vector<WoopTriangle> woop_triangles;
+		{
+			std::vector<std::uint16_t> indices(num_kernel_items * 3);
+			for (std::size_t i = 0; i < indices.size(); i++)
+			{
+				indices[i] = static_cast<std::uint16_t>(i);
+			}
+			auto bvh = std::make_unique<BVH<num_kernel_items>>();
+			bvh->Construct(vertices, indices);
+			bvh->BuildWoopTriangles(vertices);
+
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				triangles[i].a = vertices[bvh->big_index_buffer[i * 3]].position;
+				triangles[i].b = vertices[bvh->big_index_buffer[i * 3 + 1]].position;
+				triangles[i].c = vertices[bvh->big_index_buffer[i * 3 + 2]].position;
+			}
+			woop_triangles = bvh->woop_triangles;
+		}
+
+		suite.Run("kernel/intersect_ray_triangle", num_kernel_items, [&]()
+		{
+			float sum = 0;
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				sum += IntersectRayTriangle(rays[i].origin, rays[i].direction, triangles[i]);
+			}
+			bench::DoNotOptimize(sum);
+		});
+
+		suite.Run("kernel/intersect_ray_woop_triangle", num_kernel_items, [&]()
+		{
+			float sum = 0;
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				sum += IntersectRayWoopTriangle(rays[i].origin, rays[i].direction, woop_triangles[i]);
+			}
+			bench::DoNotOptimize(sum);
+		});
+
+		std::vector<BVHNode> nodes(num_kernel_items);
+		for (std::size_t i = 0; i < num_kernel_items; i++)
+		{
+			nodes[i].bbox[0] = triangles[i].a;
+			nodes[i].bbox[1] = triangles[i].a;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				nodes[i].bbox[0][axis] = std::min({ triangles[i].a[axis], triangles[i].b[axis], triangles[i].c[axis] }) - 0.5f;
+				nodes[i].bbox[1][axis] = std::max({ triangles[i].a[axis], triangles[i].b[axis], triangles[i].c[axis] }) + 0.5f;
+			}
+		}
+
+		suite.Run("kernel/intersect_bvh", num_kernel_items, [&]()
+		{
+			int hits = 0;
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				hits += IntersectBVH(rays[i].origin, rays[i].direction, nodes[i]) ? 1 : 0;
+			}
+			bench::DoNotOptimize(hits);
+		});
+
+		std::vector<Sphere> spheres(num_kernel_items);
+		for (std::size_t i = 0; i < num_kernel_items; i++)
+		{
+			spheres[i].center = triangles[i].a;
+			spheres[i].radius = 0.5f;
+		}
+
+		suite.Run("kernel/intersect_ray_sphere", num_kernel_items, [&]()
+		{
+			float sum = 0;
+			for (std::size_t i = 0; i < num_kernel_items; i++)
+			{
+				sum += IntersectRaySphere(rays[i].origin, rays[i].direction, spheres[i])[0];
+			}
+			bench::DoNotOptimize(sum);
+		});
+	}
+
+	// `ClosestIntersection` only exists in the shader. These are the CPU traversals over the same scene data.
+	void BenchScene(bench::Suite& suite, std::mt19937& rng, std::vector<Vertex> const& vertices, std::vector<std::uint16_t> const& indices)
+	{
+		const auto rays = MakeCameraRays(rng, num_scene_rays);
+
+		auto run = [&](std::string const& name, auto&& intersect)
+		{
+			suite.Run(name, rays.size(), [&]()
+			{
+				float sum = 0;
+				for (auto const& ray : rays)
+				{
+					sum += intersect(ray).closest_t;
+				}
+				bench::DoNotOptimize(sum);
+			});
+		};
+
+		auto bvh = std::make_unique<BVH<num_triangles>>();
+		bvh->Construct(vertices, indices);
+		bvh->BuildThreadedLayout();
+		run("scene/closest_intersection", [&](Ray const& ray) { return bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); });
+		run("scene/closest_intersection_stackless", [&](Ray const& ray) { return bvh->IntersectStackless(ray.origin, ray.direction, 0, inf, vertices); });
+
+		auto woop_bvh = std::make_unique<BVH<num_triangles>>(*bvh);
+		woop_bvh->BuildWoopTriangles(vertices);
+		run("scene/closest_intersection_woop", [&](Ray const& ray) { return woop_bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); });
+
+		auto cluster_bvh = std::make_unique<BVH<num_triangles>>(*bvh);
+		cluster_bvh->BuildClusters(vertices);
+		run("scene/closest_intersection_clusters", [&](Ray const& ray) { return cluster_bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); });
+
+		auto lazy_bvh = std::make_unique<BVH<num_triangles>>();
+		lazy_bvh->ConstructLazy(vertices, indices);
+		lazy_bvh->ExpandAll(vertices);
+		run("scene/closest_intersection_lazy", [&](Ray const& ray) { return lazy_bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); });
+
+		// Every traversal has to find the same closest hit as a stack traversal of a fresh `Construct`.
+		auto count_mismatches = [&](auto&& reference, auto&& intersect)
+		{
+			std::size_t mismatches = 0;
+			for (auto const& ray : rays)
+			{
+				mismatches += reference(ray).closest_t != intersect(ray).closest_t;
+			}
+			return static_cast<double>(mismatches);
+		};
+
+		auto reference = [&](Ray const& ray) { return bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); };
+
+		// Closest hit of all triangles without a tree.
+		auto brute_force = [](Ray const& ray, std::vector<Vertex> const& scene_vertices, std::vector<std::uint16_t> const& scene_indices)
+		{
+			Intersection closest;
+			closest.closest_t = inf;
+			for (std::size_t i = 0; i < scene_indices.size(); i += 3)
+			{
+				Triangle tri;
+				tri.a = scene_vertices[scene_indices[i]].position;
+				tri.b = scene_vertices[scene_indices[i + 1]].position;
+				tri.c = scene_vertices[scene_indices[i + 2]].position;
+				const float t = IntersectRayTriangle(ray.origin, ray.direction, tri);
+				if (t < closest.closest_t && t > 0)
+				{
+					closest.closest_t = t;
+				}
+			}
+			return closest;
+		};
+
+		// The box test of the traversal may only skip nodes no triangle inside of is hit in.
+		suite.Check("scene/accuracy/brute_force_mismatches", 0, [&]()
+		{
+			return count_mismatches(reference, [&](Ray const& ray) { return brute_force(ray, vertices, indices); });
+		});
+
+		// Traced while the rays expand it, then again fully expanded.
+		suite.Check("scene/accuracy/lazy_mismatches", 0, [&]()
+		{
+			auto lazy = std::make_unique<BVH<num_triangles>>();
+			lazy->ConstructLazy(vertices, indices);
+			auto intersect = [&](Ray const& ray) { return lazy->Intersect(ray.origin, ray.direction, 0, inf, vertices); };
+			auto mismatches = count_mismatches(reference, intersect);
+			lazy->ExpandAll(vertices);
+			return mismatches + count_mismatches(reference, intersect);
+		});
+
+		suite.Check("scene/accuracy/stackless_mismatches", 0, [&]()
+		{
+			return count_mismatches(reference, [&](Ray const& ray) { return bvh->IntersectStackless(ray.origin, ray.direction, 0, inf, vertices); });
+		});
+
+		suite.Check("scene/accuracy/cluster_mismatches", 0, [&]()
+		{
+			return count_mismatches(reference, [&](Ray const& ray) { return cluster_bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices); });
+		});
+
+		// The Woop test computes `t` from the plane equation so it's only compared up to rounding.
+		suite.Check("scene/accuracy/woop_mismatches", 0, [&]()
+		{
+			std::size_t mismatches = 0;
+			for (auto const& ray : rays)
+			{
+				const float expected = reference(ray).closest_t;
+				const float t = woop_bvh->Intersect(ray.origin, ray.direction, 0, inf, vertices).closest_t;
+				mismatches += (expected == inf) != (t == inf) || std::abs(t - expected) > 1e-5f * expected;
+			}
+			return static_cast<double>(mismatches);
+		});
+
+		// Rays falling onto the baked floor have to hit the y = 0 plane inside the 10x10 quad and miss outside of it.
+		suite.Check("scene/accuracy/debug_floor_mismatches", 0, [&]()
+		{
+			// Own generator so filtering this check out doesn't change the data of later benchmarks.
+			std::mt19937 floor_rng(7);
+			std::uniform_real_distribution<float> dist(-7, 7);
+			std::size_t mismatches = 0;
+			for (std::size_t i = 0; i < num_scene_rays; i++)
+			{
+				const fm::vec3 origin(dist(floor_rng), 10, dist(floor_rng));
+				const fm::vec3 direction(dist(floor_rng) * 0.05f, -1, dist(floor_rng) * 0.05f);
+				const float x = origin[0] + direction[0] * 10, z = origin[2] + direction[2] * 10;
+				if (std::abs(std::abs(x) - 5) < 1e-3f || std::abs(std::abs(z) - 5) < 1e-3f)
+				{
+					continue; // Too close to the edge to tell.
+				}
+
+				const float expected = std::abs(x) < 5 && std::abs(z) < 5 ? 10.f : inf;
+				const float t = IntersectStaticBVH(baked::DebugFloorBVH(), baked::DebugFloorPositions(), origin, direction, 0, inf).closest_t;
+				mismatches += (expected == inf) != (t == inf) || std::abs(t - expected) > 1e-5f * expected;
+			}
+			return static_cast<double>(mismatches);
+		});
+
+		// Inserts the scene in ranges, removes every fourth and moves every third of the rest.
+		suite.Check("scene/accuracy/dynamic_mismatches", 0, [&]()
+		{
+			constexpr std::size_t range_indices = 16 * 3;
+			auto moved = vertices;
+			auto dynamic_bvh = std::make_unique<BVH<num_triangles>>();
+			std::vector<std::int32_t> handles;
+			for (std::size_t i = 0; i < indices.size(); i += range_indices)
+			{
+				handles.push_back(dynamic_bvh->Insert(moved, std::vector<std::uint16_t>(indices.begin() + i, indices.begin() + i + range_indices)));
+			}
+
+			std::vector<std::uint16_t> remaining;
+			for (std::size_t i = 0; i < handles.size(); i++)
+			{
+				const auto first = indices.begin() + i * range_indices;
+				if (i % 4 == 0)
+				{
+					dynamic_bvh->Remove(handles[i]);
+					continue;
+				}
+				if (i % 3 == 0)
+				{
+					for (auto it = first; it != first + range_indices; it++)
+					{
+						moved[*it].position = moved[*it].position + fm::pvec3(0.5f, -0.25f, 2.f);
+					}
+					dynamic_bvh->Update(handles[i], moved);
+				}
+				remaining.insert(remaining.end(), first, first + range_indices);
+			}
+
+			auto fresh_bvh = std::make_unique<BVH<num_triangles>>();
+			fresh_bvh->Construct(moved, remaining);
+			auto reference = [&](Ray const& ray) { return fresh_bvh->Intersect(ray.origin, ray.direction, 0, inf, moved); };
+			auto dynamic = [&](Ray const& ray) { return dynamic_bvh->Intersect(ray.origin, ray.direction, 0, inf, moved); };
+
+			auto mismatches = count_mismatches(reference, dynamic);
+			dynamic_bvh->Optimize();
+			mismatches += count_mismatches(reference, dynamic);
+
+			// Removed and out of range handles have to be rejected.
+			for (auto handle : { handles[0], std::int32_t(-1), static_cast<std::int32_t>(handles.size()) })
+			{
+				try
+				{
+					dynamic_bvh->Remove(handle);
+					mismatches++;
+				}
+				catch (std::runtime_error const&)
+				{
+				}
+			}
+
+			// Every node counts the triangles of its subtree, the root all that are left.
+			mismatches += dynamic_bvh->node_pool[0].count != remaining.size() / 3;
+
+			// Removing every leaf has to leave a empty tree that takes inserts again.
+			for (std::size_t i = 1; i < handles.size(); i++)
+			{
+				if (i % 4 != 0)
+				{
+					dynamic_bvh->Remove(handles[i]);
+				}
+			}
+			for (auto const& ray : rays)
+			{
+				mismatches += dynamic(ray).closest_t != inf;
+			}
+			mismatches += dynamic_bvh->node_pool[0].count != 0;
+
+			std::vector<std::uint16_t> first_range(indices.begin(), indices.begin() + range_indices);
+			dynamic_bvh->Insert(moved, first_range);
+			for (auto const& ray : rays)
+			{
+				mismatches += dynamic(ray).closest_t != brute_force(ray, moved, first_range).closest_t;
+			}
+			return mismatches;
+		});
+
+		// Triangles at x = -1.3^i put all but one centroid on the same side of every midpoint split,
+		// so the tree gets far deeper than a balanced one. Rays along -x start between the triangles.
+		suite.Check("scene/accuracy/deep_tree_mismatches", 0, [&]()
+		{
+			constexpr std::size_t num_deep_triangles = 300;
+			std::vector<Vertex> deep_vertices;
+			std::vector<std::uint16_t> deep_indices;
+			for (std::size_t i = 0; i < num_deep_triangles; i++)
+			{
+				const float x = -std::pow(1.3f, static_cast<float>(i));
+				for (auto const& position : { fm::pvec3(x, -1, -1), fm::pvec3(x, 1, -1), fm::pvec3(x, 0, 1) })
+				{
+					Vertex vertex = {};
+					vertex.position = position;
+					deep_indices.push_back(static_cast<std::uint16_t>(deep_vertices.size()));
+					deep_vertices.push_back(vertex);
+				}
+			}
+
+			auto deep_bvh = std::make_unique<BVH<num_deep_triangles>>();
+			deep_bvh->Construct(deep_vertices, deep_indices);
+			auto lazy_deep_bvh = std::make_unique<BVH<num_deep_triangles>>();
+			lazy_deep_bvh->ConstructLazy(deep_vertices, deep_indices);
+
+			std::size_t mismatches = 0;
+			for (std::size_t i = 0; i < num_deep_triangles; i++)
+			{
+				Ray ray;
+				ray.origin = fm::pvec3(-std::pow(1.3f, static_cast<float>(i) - 0.5f), 0.1f, 0.1f);
+				ray.direction = fm::pvec3(-1, 0, 0);
+				const float expected = brute_force(ray, deep_vertices, deep_indices).closest_t;
+				mismatches += deep_bvh->Intersect(ray.origin, ray.direction, 0, inf, deep_vertices).closest_t != expected;
+				mismatches += lazy_deep_bvh->Intersect(ray.origin, ray.direction, 0, inf, deep_vertices).closest_t != expected;
+			}
+			return static_cast<double>(mismatches);
+		});
+	}
+
+	void BenchVertices(bench::Suite& suite, std::mt19937& rng, std::vector<Vertex> vertices)
+	{
+		// The scene vertices share one normal and uv, give them random ones.
+		std::uniform_real_distribution<float> dist(-1, 1);
+		for (auto& v : vertices)
+		{
+			const fm::vec3 n = fm::vec3(dist(rng), dist(rng), dist(rng) + 0.001f).Normalized();
+			v.normal = fm::pvec3(n.x, n.y, n.z);
+			v.uv = fm::vec2(dist(rng) * 4, dist(rng) * 4);
+			v.material_idx = static_cast<int>(rng() % 3);
+		}
+
+		const auto compressed = CompressVertices(vertices);
+		const fm::pvec3 step = compressed.quantization.quantization_scale;
+
+		suite.Check("vertex/accuracy/normal_radians", 1e-4, [&]()
+		{
+			double max_error = 0;
+			for (std::size_t i = 0; i < vertices.size(); i++)
+			{
+				const auto v = DecompressVertex(compressed.vertices[i], compressed.quantization);
+				// atan2 of the cross and dot products, acos isn't precise for small angles.
+				const fm::pvec3 a = vertices[i].normal;
+				const fm::pvec3 b = v.normal;
+				const double cx = double(a.y) * b.z - double(a.z) * b.y;
+				const double cy = double(a.z) * b.x - double(a.x) * b.z;
+				const double cz = double(a.x) * b.y - double(a.y) * b.x;
+				const double dot = double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z;
+				max_error = std::max(max_error, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot));
+			}
+			return max_error;
+		});
+		suite.Check("vertex/accuracy/position_steps", 0.51, [&]()
+		{
+			// In quantization steps. Rounding to the nearest step is off by at most half a step, plus the float rounding of the decode.
+			double max_error = 0;
+			for (std::size_t i = 0; i < vertices.size(); i++)
+			{
+				const auto v = DecompressVertex(compressed.vertices[i], compressed.quantization);
+				for (int k = 0; k < 3; k++)
+				{
+					max_error = std::max(max_error, std::abs(double(v.position[k]) - vertices[i].position[k]) / step[k]);
+				}
+			}
+			return max_error;
+		});
+		suite.Check("vertex/accuracy/uv_relative", 1.0 / 2048, [&]()
+		{
+			double max_error = 0;
+			for (std::size_t i = 0; i < vertices.size(); i++)
+			{
+				const auto v = DecompressVertex(compressed.vertices[i], compressed.quantization);
+				for (int k = 0; k < 2; k++)
+				{
+					const double ref = vertices[i].uv[k];
+					if (std::abs(ref) > 1e-4)
+					{
+						max_error = std::max(max_error, std::abs(v.uv[k] - ref) / std::abs(ref));
+					}
+				}
+			}
+			return max_error;
+		});
+
+		suite.Run("build/compress_vertices", vertices.size(), [&]()
+		{
+			bench::DoNotOptimize(CompressVertices(vertices));
+		});
+
+		// Attribute fetch of random hits. `ops` is the number of triangles.
+		std::vector<std::uint32_t> hits(num_kernel_items);
+		for (auto& hit : hits)
+		{
+			hit = static_cast<std::uint32_t>(rng() % (vertices.size() / 3)) * 3;
+		}
+
+		suite.Run("vertex/hit_attributes_full", hits.size(), [&]()
+		{
+			fm::pvec3 sum(0, 0, 0);
+			for (const auto hit : hits)
+			{
+				sum = sum + vertices[hit].normal + vertices[hit + 1].normal + vertices[hit + 2].normal;
+			}
+			bench::DoNotOptimize(sum);
+		});
+
+		suite.Run("vertex/hit_attributes_compressed", hits.size(), [&]()
+		{
+			fm::pvec3 sum(0, 0, 0);
+			for (const auto hit : hits)
+			{
+				for (std::uint32_t k = 0; k < 3; k++)
+				{
+					sum = sum + DecompressVertex(compressed.vertices[hit + k], compressed.quantization).normal;
+				}
+			}
+			bench::DoNotOptimize(sum);
+		});
+	}
+
+	void BenchBuild(bench::Suite& suite, std::vector<Vertex> const& vertices, std::vector<std::uint16_t> const& indices)
+	{
+		auto bvh = std::make_unique<BVH<num_triangles>>();
+
+		suite.Run("build/construct", 1, [&]()
+		{
+			bvh->Construct(vertices, indices);
+			bench::DoNotOptimize(bvh->node_pool[0]);
+		});
+
+		suite.Run("build/construct_lazy_expand_all", 1, [&]()
+		{
+			bvh->ConstructLazy(vertices, indices);
+			bvh->ExpandAll(vertices);
+			bench::DoNotOptimize(bvh->node_pool[0]);
+		});
+
+		suite.Run("build/insert_optimize", 1, [&]()
+		{
+			bvh = std::make_unique<BVH<num_triangles>>();
+			std::vector<std::uint16_t> triangle(3);
+			for (std::size_t i = 0; i < indices.size(); i += 3)
+			{
+				std::copy(indices.begin() + i, indices.begin() + i + 3, triangle.begin());
+				bvh->Insert(vertices, triangle);
+			}
+			bvh->Optimize();
+			bench::DoNotOptimize(bvh->node_pool[0]);
+		});
+
+		auto positions = std::make_unique<std::array<fm::pvec3, num_triangles * 3>>();
+		auto static_indices = std::make_unique<std::array<std::uint16_t, num_triangles * 3>>();
+		for (std::size_t i = 0; i < positions->size(); i++)
+		{
+			(*positions)[i] = vertices[i].position;
+			(*static_indices)[i] = indices[i];
+		}
+		auto static_bvh = std::make_unique<StaticBVH<num_triangles>>();
+
+		suite.Run("build/static", 1, [&]()
+		{
+			*static_bvh = BuildStaticBVH(*positions, *static_indices);
+			bench::DoNotOptimize(static_bvh->node_pool[0]);
+		});
+
+		bvh->Construct(vertices, indices);
+
+		suite.Run("build/threaded_layout", 1, [&]()
+		{
+			bvh->BuildThreadedLayout();
+			bench::DoNotOptimize(bvh->threaded_node_pool[0]);
+		});
+
+		suite.Run("build/clusters", 1, [&]()
+		{
+			bvh->BuildClusters(vertices);
+			bench::DoNotOptimize(bvh->clusters.data());
+		});
+
+		suite.Run("build/woop_triangles", 1, [&]()
+		{
+			bvh->BuildWoopTriangles(vertices);
+			bench::DoNotOptimize(bvh->woop_triangles.data());
+		});
+	}
+
+	/*! Writes a `size` x `size` grid of quads with positions, uvs and normals. */
+	std::string WriteGridObj(int size)
+	{
+		const auto path = (std::filesystem::temp_directory_path() / ("bench_grid_" + std::to_string(size) + ".obj")).string();
+		std::ofstream out(path);
+		for (int y = 0; y <= size; y++)
+		{
+			for (int x = 0; x <= size; x++)
+			{
+				out << "v " << x * 0.01f << " " << y * 0.01f << " " << std::sin(x * 0.1f) * 0.1f << "\n";
+				out << "vt " << x / float(size) << " " << y / float(size) << "\n";
+				out << "vn 0 0 1\n";
+			}
+		}
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				const int a = y * (size + 1) + x + 1;
+				const int b = a + 1;
+				const int c = a + size + 2;
+				const int d = a + size + 1;
+				out << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " "
+					<< c << "/" << c << "/" << c << " " << d << "/" << d << "/" << d << "\n";
+			}
+		}
+		return path;
+	}
+
+	void BenchLoad(bench::Suite& suite)
+	{
+		auto run = [&](std::string const& name, std::string const& path)
+		{
+			std::uint64_t num_triangles = 0;
+			try
+			{
+				num_triangles = rlr::LoadObj(path).indices.size() / 3;
+			}
+			catch (std::exception const&)
+			{
+				std::cout << name << ": skipped, can't read " << path << std::endl;
+				return;
+			}
+
+			// `ops` is the number of triangles.
+			suite.Run(name + "_native", num_triangles, [&]()
+			{
+				bench::DoNotOptimize(rlr::LoadObj(path));
+			});
+			suite.Run(name + "_native_single_thread", num_triangles, [&]()
+			{
+				bench::DoNotOptimize(rlr::LoadObj(path, 1));
+			});
+			suite.Run(name + "_assimp", num_triangles, [&]()
+			{
+				rlr::Model model;
+				rlr::Load(model, path);
+				bench::DoNotOptimize(model.meshes);
+			});
+		};
+
+		run("load/obj_spot", std::filesystem::exists("spot.obj") ? "spot.obj" : "../spot.obj");
+
+		const auto grid = WriteGridObj(500);
+		run("load/obj_grid_500k", grid);
+
+		// Every grid position is used by one position/uv/normal triplet. Parsing in chunks has to give the same mesh as one chunk.
+		suite.Check("load/accuracy/obj_grid_mismatches", 0, [&]()
+		{
+			const auto mesh = rlr::LoadObj(grid, 4);
+			const auto single = rlr::LoadObj(grid, 1);
+			std::size_t mismatches = 0;
+			mismatches += mesh.vertices.size() != 501 * 501;
+			mismatches += mesh.indices.size() != 500 * 500 * 6;
+			mismatches += mesh.indices != single.indices || mesh.vertices.size() != single.vertices.size();
+			for (std::size_t i = 0; i < std::min(mesh.vertices.size(), single.vertices.size()); i++)
+			{
+				mismatches += std::memcmp(&mesh.vertices[i], &single.vertices[i], sizeof(Vertex)) != 0;
+			}
+			return static_cast<double>(mismatches);
+		});
+		std::filesystem::remove(grid);
+
+		// A quad that is split into a fan and a triangle with relative indices that reuses one of the quad's corners.
+		suite.Check("load/accuracy/obj_small_mismatches", 0, [&]()
+		{
+			const auto path = (std::filesystem::temp_directory_path() / "bench_small.obj").string();
+			{
+				std::ofstream out(path);
+				out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+					<< "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+					<< "vn 0 0 1\n"
+					<< "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+					<< "v 0.5 0.5 -1\n"
+					<< "f -1/-4/-1 -5/-4/-1 -4/-4/-1\n";
+			}
+			const auto mesh = rlr::LoadObj(path);
+			std::filesystem::remove(path);
+
+			const fm::pvec3 positions[] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0.5f, 0.5f, -1 } };
+			const fm::vec2 uvs[] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+			const std::pair<int, int> corners[] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 0, 0 }, { 2, 2 }, { 3, 3 }, { 4, 0 }, { 0, 0 }, { 1, 0 } };
+
+			std::size_t mismatches = 0;
+			mismatches += mesh.vertices.size() != 6;
+			mismatches += mesh.indices.size() != std::size(corners);
+			for (std::size_t i = 0; i < std::min(mesh.indices.size(), std::size(corners)); i++)
+			{
+				auto const& v = mesh.vertices.at(mesh.indices[i]);
+				mismatches += v.position != positions[corners[i].first];
+				mismatches += v.uv[0] != uvs[corners[i].second][0] || v.uv[1] != uvs[corners[i].second][1];
+				mismatches += v.normal != fm::pvec3(0, 0, 1);
+			}
+			return static_cast<double>(mismatches);
+		});
+	}
+
+	/*! Model with `num_meshes` meshes of random triangles. Each mesh is placed by a node with a rotated, scaled and translated transform. */
+	rlr::Model MakeModel(std::mt19937& rng, int num_meshes, int vertices_per_mesh)
+	{
+		std::uniform_real_distribution<float> dist(-1, 1);
+		rlr::Model model;
+		for (int m = 0; m < num_meshes; m++)
+		{
+			rlr::Mesh mesh;
+			mesh.vertices.resize(vertices_per_mesh);
+			for (auto& v : mesh.vertices)
+			{
+				v.m_pos = fm::vec3(dist(rng), dist(rng), dist(rng)) * 10.f;
+				v.m_normal = fm::vec3(dist(rng), dist(rng), dist(rng) + 0.001f).Normalized();
+				v.m_texCoord = fm::vec2(dist(rng), dist(rng));
+			}
+			mesh.indices.resize(vertices_per_mesh * 3);
+			for (auto& index : mesh.indices)
+			{
+				index = rng() % vertices_per_mesh;
+			}
+			const fm::quat rotation = fm::quat(dist(rng), dist(rng), dist(rng), dist(rng)).Normalized();
+			const auto node = model.scene_graph.AddNode(-1, fm::mat4::Compose(fm::vec3(dist(rng), dist(rng), dist(rng)) * 5.f, rotation, fm::vec3(1.f, 2.f, 0.5f)));
+			model.scene_graph.AddInstance(node, static_cast<std::uint32_t>(m));
+			model.meshes.push_back(std::make_shared<const rlr::Mesh>(std::move(mesh)));
+		}
+		return model;
+	}
+
+	void BenchSceneBuilder(bench::Suite& suite, std::mt19937& rng)
+	{
+		// 16 bit indices limit the scene to 64k vertices.
+		constexpr int num_meshes = 8;
+		constexpr int vertices_per_mesh = 8000;
+		const auto model = MakeModel(rng, num_meshes, vertices_per_mesh);
+		const auto material = [](std::size_t mesh_idx, rlr::Mesh const&) { return static_cast<int>(mesh_idx % 3); };
+
+		std::vector<Vertex> vertices;
+		std::vector<INDICES_TYPE> indices;
+
+		// What `main` used to do.
+		suite.Run("scene_builder/push_back", num_meshes * vertices_per_mesh, [&]()
+		{
+			std::vector<Vertex> scene_vertices;
+			std::vector<INDICES_TYPE> scene_indices;
+			std::size_t vertex_offset = 0;
+			for (std::size_t m = 0; m < model.meshes.size(); m++)
+			{
+				for (auto const& pv : model.meshes[m]->vertices)
+				{
+					Vertex v;
+					v.material_idx = static_cast<int>(m % 3);
+					v.normal = pv.m_normal;
+					v.position = pv.m_pos;
+					v.uv = pv.m_texCoord;
+					scene_vertices.push_back(v);
+				}
+				for (auto index : model.meshes[m]->indices)
+				{
+					scene_indices.push_back(static_cast<INDICES_TYPE>(index + vertex_offset));
+				}
+				vertex_offset += model.meshes[m]->vertices.size();
+			}
+			bench::DoNotOptimize(scene_vertices.data());
+			bench::DoNotOptimize(scene_indices.data());
+		});
+
+		for (bool transforms : { false, true })
+		{
+			SceneBuilder builder;
+			builder.AddModel(model, material, transforms);
+			vertices.resize(builder.NumVertices());
+			indices.resize(builder.NumIndices());
+
+			const std::string name = std::string("scene_builder/build") + (transforms ? "_transformed" : "");
+			suite.Run(name + "_single_thread", num_meshes * vertices_per_mesh, [&]()
+			{
+				builder.Build(vertices.data(), indices.data(), 1);
+				bench::DoNotOptimize(vertices.data());
+			});
+			suite.Run(name, num_meshes * vertices_per_mesh, [&]()
+			{
+				builder.Build(vertices.data(), indices.data());
+				bench::DoNotOptimize(vertices.data());
+			});
+		}
+
+		// Compare the transformed build against the scalar matrix code.
+		suite.Check("scene_builder/accuracy/transformed", 1e-5, [&]()
+		{
+			// Built here since the benchmarks above may be filtered out.
+			SceneBuilder builder;
+			builder.AddModel(model, material, true);
+			vertices.resize(builder.NumVertices());
+			indices.resize(builder.NumIndices());
+			builder.Build(vertices.data(), indices.data());
+
+			double max_error = 0;
+			std::size_t vertex_offset = 0;
+			std::size_t index_offset = 0;
+			for (std::size_t m = 0; m < model.meshes.size(); m++)
+			{
+				auto const& mesh = *model.meshes[m];
+				const fm::mat3x4 transform(model.scene_graph.GetWorldTransform(static_cast<std::int32_t>(m)));
+				const fm::mat3x4 inverse = transform.InverseAffine();
+				for (std::size_t i = 0; i < mesh.vertices.size(); i++)
+				{
+					Vertex const& v = vertices[vertex_offset + i];
+					const fm::vec3 p = transform.TransformPoint(mesh.vertices[i].m_pos);
+					const fm::vec3 n = mesh.vertices[i].m_normal;
+					fm::vec3 tn(
+						inverse[0][0] * n.x + inverse[1][0] * n.y + inverse[2][0] * n.z,
+						inverse[0][1] * n.x + inverse[1][1] * n.y + inverse[2][1] * n.z,
+						inverse[0][2] * n.x + inverse[1][2] * n.y + inverse[2][2] * n.z);
+					tn = tn.Normalized();
+					for (int k = 0; k < 3; k++)
+					{
+						max_error = std::max(max_error, std::abs(double(v.position[k]) - p[k]) / (1.0 + std::abs(p[k])));
+						max_error = std::max(max_error, std::abs(double(v.normal[k]) - tn[k]));
+					}
+					for (int k = 0; k < 2; k++)
+					{
+						max_error = std::max(max_error, std::abs(double(v.uv[k]) - mesh.vertices[i].m_texCoord[k]));
+					}
+					if (v.material_idx != static_cast<int>(m % 3) || v.padding0 != 0 || v.padding1.x != 0 || v.padding1.y != 0)
+					{
+						max_error = std::numeric_limits<double>::infinity();
+					}
+				}
+				for (std::size_t i = 0; i < mesh.indices.size(); i++)
+				{
+					if (indices[index_offset + i] != mesh.indices[i] + vertex_offset)
+					{
+						max_error = std::numeric_limits<double>::infinity();
+					}
+				}
+				vertex_offset += mesh.vertices.size();
+				index_offset += mesh.indices.size();
+			}
+			return max_error;
+		});
+
+		// Copies share the immutable meshes, only the scene graph and the bones are copied.
+		suite.Run("model/copy", num_meshes, [&]()
+		{
+			rlr::Model copy = model;
+			bench::DoNotOptimize(copy.meshes.data());
+		});
+		std::cout << "model/vertex_bytes: " << sizeof(rlr::Vertex) << std::endl;
+		suite.Check("model/copy_unshared_meshes", 0, [&]()
+		{
+			const rlr::Model copy = model;
+			double unshared = 0;
+			for (std::size_t m = 0; m < model.meshes.size(); m++)
+			{
+				unshared += copy.meshes[m] != model.meshes[m];
+			}
+			return unshared;
+		});
+	}
+
+	/*! Triangle soup of a `size` x `size` grid, every triangle has its own vertices like a scanned STL file. The triangles are shuffled. */
+	rlr::Mesh MakeTriangleSoup(std::mt19937& rng, int size, float jitter)
+	{
+		std::uniform_real_distribution<float> dist(-jitter, jitter);
+		std::vector<std::array<int, 3>> triangles;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				const int a = y * (size + 1) + x;
+				triangles.push_back({ a, a + 1, a + size + 2 });
+				triangles.push_back({ a, a + size + 2, a + size + 1 });
+			}
+		}
+		std::shuffle(triangles.begin(), triangles.end(), rng);
+
+		rlr::Mesh mesh;
+		for (auto const& triangle : triangles)
+		{
+			for (int corner : triangle)
+			{
+				const float x = corner % (size + 1);
+				const float y = corner / (size + 1);
+				rlr::Vertex v;
+				v.m_pos = fm::vec3(x * 0.01f + dist(rng), y * 0.01f + dist(rng), std::sin(x * 0.1f) * 0.1f);
+				v.m_normal = fm::vec3(0, 0, 1);
+				v.m_texCoord = fm::vec2(x / size, y / size);
+				mesh.indices.push_back(static_cast<std::uint32_t>(mesh.vertices.size()));
+				mesh.vertices.push_back(v);
+			}
+		}
+		return mesh;
+	}
+
+	/*! Average distance between consecutive vertex fetches of the index buffer, in vertices. */
+	double FetchDistance(rlr::Mesh const& mesh)
+	{
+		double sum = 0;
+		for (std::size_t i = 1; i < mesh.indices.size(); i++)
+		{
+			sum += std::abs(double(mesh.indices[i]) - double(mesh.indices[i - 1]));
+		}
+		return sum / std::max<std::size_t>(1, mesh.indices.size() - 1);
+	}
+
+	void BenchMeshOptimizer(bench::Suite& suite, std::mt19937& rng)
+	{
+		constexpr int size = 200;
+		constexpr std::size_t grid_vertices = (size + 1) * (size + 1);
+		const auto soup = MakeTriangleSoup(rng, size, 0);
+		const auto noisy_soup = MakeTriangleSoup(rng, size, 1e-6f);
+		const std::uint64_t num_vertices = soup.vertices.size();
+
+		rlr::Mesh mesh;
+		suite.Run("mesh_optimizer/weld_exact", num_vertices, [&]()
+		{
+			mesh = soup;
+			rlr::WeldVertices(mesh);
+		});
+		suite.Check("mesh_optimizer/weld_exact_extra_vertices", 0, [&]()
+		{
+			return std::abs(double(mesh.vertices.size()) - grid_vertices);
+		});
+
+		suite.Run("mesh_optimizer/weld_near", num_vertices, [&]()
+		{
+			mesh = noisy_soup;
+			rlr::WeldVertices(mesh, 1e-4f);
+		});
+		suite.Check("mesh_optimizer/weld_near_extra_vertices", 0, [&]()
+		{
+			return std::abs(double(mesh.vertices.size()) - grid_vertices);
+		});
+
+		mesh = soup;
+		rlr::WeldVertices(mesh);
+		const auto welded = mesh;
+		suite.Run("mesh_optimizer/reorder", num_vertices, [&]()
+		{
+			mesh = welded;
+			rlr::ReorderTriangles(mesh);
+			rlr::ReorderVertices(mesh);
+		});
+		mesh = welded;
+		rlr::ReorderTriangles(mesh);
+		rlr::ReorderVertices(mesh);
+		std::cout << "mesh_optimizer/fetch_distance: " << FetchDistance(welded) << " before, " << FetchDistance(mesh) << " after reordering" << std::endl;
+
+		suite.Check("mesh_optimizer/reorder_lost_triangles", 0, [&]()
+		{
+			// Compare the sorted triangle corner positions before and after.
+			auto corners = [](rlr::Mesh const& m)
+			{
+				std::vector<std::array<float, 9>> retval;
+				for (std::size_t i = 0; i < m.indices.size(); i += 3)
+				{
+					std::array<std::array<float, 3>, 3> triangle;
+					for (int k = 0; k < 3; k++)
+					{
+						auto const& p = m.vertices[m.indices[i + k]].m_pos;
+						triangle[k] = { p.x, p.y, p.z };
+					}
+					// Rotate the smallest corner first, the winding has to be kept.
+					std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+					std::array<float, 9> flat;
+					for (int k = 0; k < 9; k++)
+					{
+						flat[k] = triangle[k / 3][k % 3];
+					}
+					retval.push_back(flat);
+				}
+				std::sort(retval.begin(), retval.end());
+				return retval;
+			};
+			return corners(welded) == corners(mesh) ? 0.0 : 1.0;
+		});
+
+		// What a hot reload pays per unchanged mesh instead of `OptimizeMesh`.
+		std::uint64_t hash = 0;
+		suite.Run("mesh_optimizer/hash", num_vertices, [&]()
+		{
+			hash = rlr::HashMesh(soup);
+		});
+		suite.Check("mesh_optimizer/hash_misses_edits", 0, [&]()
+		{
+			// Any single attribute edit has to change the hash.
+			double misses = 0;
+			rlr::Mesh edited = soup;
+			edited.vertices[1234].m_texCoord.y += 1e-6f;
+			misses += rlr::HashMesh(edited) == rlr::HashMesh(soup);
+			edited = soup;
+			std::swap(edited.indices[3], edited.indices[4]);
+			misses += rlr::HashMesh(edited) == rlr::HashMesh(soup);
+			edited = soup;
+			edited.material_idx++;
+			misses += rlr::HashMesh(edited) == rlr::HashMesh(soup);
+			misses += rlr::HashMesh(soup) != hash;
+			return misses;
+		});
+	}
+
+	void BenchSceneGraph(bench::Suite& suite, std::mt19937& rng)
+	{
+		// Random tree, every node has one of the earlier nodes as its parent.
+		constexpr int num_nodes = 10000;
+		std::uniform_real_distribution<float> dist(-1, 1);
+		auto random_transform = [&]()
+		{
+			const fm::quat rotation = fm::quat(dist(rng), dist(rng), dist(rng), dist(rng)).Normalized();
+			return fm::mat4::Compose(fm::vec3(dist(rng), dist(rng), dist(rng)), rotation, fm::vec3(1, 1, 1));
+		};
+
+		rlr::SceneGraph graph;
+		for (int i = 0; i < num_nodes; i++)
+		{
+			graph.AddNode(i == 0 ? -1 : static_cast<std::int32_t>(rng() % i), random_transform());
+		}
+
+		std::vector<std::int32_t> moved(16);
+		for (auto& node : moved)
+		{
+			node = static_cast<std::int32_t>(num_nodes / 2 + rng() % (num_nodes / 2));
+		}
+		const auto moved_transform = random_transform();
+
+		// `ops` is the number of nodes in the graph.
+		suite.Run("scene_graph/update_few_dirty", num_nodes, [&]()
+		{
+			for (auto node : moved)
+			{
+				graph.SetLocalTransform(node, moved_transform);
+			}
+			bench::DoNotOptimize(graph.UpdateWorldTransforms());
+		});
+		suite.Run("scene_graph/update_all_dirty", num_nodes, [&]()
+		{
+			graph.SetLocalTransform(0, moved_transform);
+			bench::DoNotOptimize(graph.UpdateWorldTransforms());
+		});
+
+		suite.Check("scene_graph/accuracy/incremental_update", 0, [&]()
+		{
+			// An incremental update has to match rebuilding the graph from scratch.
+			for (auto node : moved)
+			{
+				graph.SetLocalTransform(node, random_transform());
+			}
+			graph.UpdateWorldTransforms();
+
+			rlr::SceneGraph rebuilt;
+			for (int i = 0; i < num_nodes; i++)
+			{
+				rebuilt.AddNode(graph.GetParent(i), graph.GetLocalTransform(i));
+			}
+			double max_error = 0;
+			for (int i = 0; i < num_nodes; i++)
+			{
+				max_error = std::max(max_error, graph.GetWorldTransform(i) == rebuilt.GetWorldTransform(i) ? 0.0 : 1.0);
+			}
+			return max_error;
+		});
+	}
+
+	/*! Indexed `size` x `size` height field with a few waves, uvs and per vertex normals. */
+	rlr::Mesh MakeHeightField(int size)
+	{
+		auto height = [size](float x, float y)
+		{
+			return 0.05f * std::sin(x * 6.f / size) * std::cos(y * 4.f / size) + 0.01f * std::sin((x + y) * 20.f / size);
+		};
+
+		rlr::Mesh mesh;
+		for (int y = 0; y <= size; y++)
+		{
+			for (int x = 0; x <= size; x++)
+			{
+				rlr::Vertex v;
+				v.m_pos = fm::vec3(float(x) / size, float(y) / size, height(float(x), float(y)));
+				const float dx = (height(x + 0.5f, float(y)) - height(x - 0.5f, float(y))) * size;
+				const float dy = (height(float(x), y + 0.5f) - height(float(x), y - 0.5f)) * size;
+				v.m_normal = fm::vec3(-dx, -dy, 1.f).Normalized();
+				v.m_texCoord = fm::vec2(float(x) / size, float(y) / size);
+				mesh.vertices.push_back(v);
+			}
+		}
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				const std::uint32_t a = y * (size + 1) + x;
+				mesh.indices.insert(mesh.indices.end(), { a, a + 1, a + size + 2, a, a + size + 2, a + size + 1 });
+			}
+		}
+		return mesh;
+	}
+
+	/*! Distance from `p` to the triangle `a`, `b`, `c` (Ericson, Real-Time Collision Detection 5.1.5). */
+	float PointTriangleDistance(fm::vec3 p, fm::vec3 a, fm::vec3 b, fm::vec3 c)
+	{
+		const fm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		const float d1 = ab.Dot(ap), d2 = ac.Dot(ap);
+		if (d1 <= 0 && d2 <= 0) return fm::vec3(p - a).Length();
+		const fm::vec3 bp = p - b;
+		const float d3 = ab.Dot(bp), d4 = ac.Dot(bp);
+		if (d3 >= 0 && d4 <= d3) return fm::vec3(p - b).Length();
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) return fm::vec3(p - (a + fm::vec3(ab) * (d1 / (d1 - d3)))).Length();
+		const fm::vec3 cp = p - c;
+		const float d5 = ab.Dot(cp), d6 = ac.Dot(cp);
+		if (d6 >= 0 && d5 <= d6) return fm::vec3(p - c).Length();
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) return fm::vec3(p - (a + fm::vec3(ac) * (d2 / (d2 - d6)))).Length();
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) return fm::vec3(p - (b + fm::vec3(c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))))).Length();
+		const float denom = 1.f / (va + vb + vc);
+		return fm::vec3(p - (a + fm::vec3(ab) * (vb * denom) + fm::vec3(ac) * (vc * denom))).Length();
+	}
+
+	void BenchLod(bench::Suite& suite)
+	{
+		constexpr int size = 64;
+		const auto source = MakeHeightField(size);
+		const std::uint64_t num_triangles = source.indices.size() / 3;
+
+		rlr::Mesh mesh = source;
+		suite.Run("lod/generate", num_triangles, [&]()
+		{
+			rlr::GenerateLods(mesh);
+		});
+		rlr::GenerateLods(mesh);
+
+		std::cout << "lod/levels:";
+		for (auto const& lod : mesh.lods)
+		{
+			std::cout << " " << lod.indices.size() / 3 << " (error " << lod.error << ")";
+		}
+		std::cout << std::endl;
+
+		// Every original vertex has to be within the reported error of the simplified surface.
+		// The quadric error is an estimate, not a bound, so allow twice the reported error and the float rounding.
+		for (std::size_t level = 0; level < std::min<std::size_t>(mesh.lods.size(), 3); level++)
+		{
+			suite.Check("lod/accuracy/level" + std::to_string(level + 1) + "_distance_over_error", 2.0, [&]()
+			{
+				auto const& lod = mesh.lods[level];
+				double max_distance = 0;
+				for (auto const& v : source.vertices)
+				{
+					float distance = std::numeric_limits<float>::max();
+					for (std::size_t i = 0; i < lod.indices.size(); i += 3)
+					{
+						distance = std::min(distance, PointTriangleDistance(v.m_pos, mesh.vertices[lod.indices[i]].m_pos,
+							mesh.vertices[lod.indices[i + 1]].m_pos, mesh.vertices[lod.indices[i + 2]].m_pos));
+					}
+					max_distance = std::max<double>(max_distance, distance);
+				}
+				return max_distance / (lod.error + 1e-6);
+			});
+		}
+
+		suite.Check("lod/accuracy/select_full_detail_up_close", 0, [&]()
+		{
+			return double(rlr::SelectLod(mesh, 0.f, 0.001f));
+		});
+	}
+
+	void BenchTextureCache(bench::Suite& suite, std::mt19937& rng)
+	{
+		constexpr std::uint32_t size = 1024;
+		std::vector<std::uint32_t> pixels(size * size);
+		for (auto& pixel : pixels)
+		{
+			pixel = static_cast<std::uint32_t>(rng());
+		}
+		const auto path = (std::filesystem::temp_directory_path() / "bench_texture.rlrt").string();
+		rlr::SaveTiledTexture(path, size, size, pixels);
+
+		// Texel centers of mip 0 have to return the stored texel exactly.
+		auto texel_error = [&](rlr::TextureCache& cache, rlr::TextureId texture, std::uint32_t x, std::uint32_t y)
+		{
+			const fm::vec4 c = cache.SampleLevel(texture, fm::vec2((x + 0.5f) / size, (y + 0.5f) / size), 0);
+			const std::uint32_t p = pixels[y * size + x];
+			double error = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				error = std::max<double>(error, std::abs(c[i] * 255.f - float((p >> (8 * i)) & 0xFF)));
+			}
+			return error;
+		};
+
+		// A 256x256 view of the whole texture, the differentials pick mip 2.
+		constexpr int view = 256;
+		fm::vec2 duv_dx(1.f / view, 0), duv_dy(0, 1.f / view);
+		auto render = [&](rlr::TextureCache& cache, rlr::TextureId texture, bool force_mip0)
+		{
+			fm::vec4 sum;
+			for (int y = 0; y < view; y++)
+			{
+				for (int x = 0; x < view; x++)
+				{
+					const fm::vec2 uv((x + 0.5f) / view, (y + 0.5f) / view);
+					sum += force_mip0 ? cache.SampleLevel(texture, uv, 0) : cache.Sample(texture, uv, duv_dx, duv_dy);
+				}
+			}
+			cache.NextFrame();
+			return sum;
+		};
+
+		rlr::TextureCache large(64 << 20);
+		const auto large_texture = large.AddTexture(path);
+		suite.Run("texture_cache/sample_hit", view * view, [&]()
+		{
+			bench::DoNotOptimize(render(large, large_texture, false));
+		});
+
+		// 1 MiB holds 62 tiles. Mip 0 has 256, so every frame evicts all of them.
+		constexpr std::size_t small_budget = 1 << 20;
+		rlr::TextureCache small(small_budget);
+		const auto small_texture = small.AddTexture(path);
+		suite.Run("texture_cache/sample_evicting", view * view, [&]()
+		{
+			bench::DoNotOptimize(render(small, small_texture, true));
+		});
+		std::cout << "texture_cache/evicting: " << small.NumMisses() << " misses, " << small.NumEvictions() << " evictions, "
+			<< small.NumResidentTiles() << " of " << small.NumSlots() << " slots" << std::endl;
+
+		suite.Check("texture_cache/accuracy/memory_over_budget", 1, [&]()
+		{
+			return double(small.MemoryUsage()) / small_budget;
+		});
+
+		suite.Check("texture_cache/accuracy/texel_error", 1e-3, [&]()
+		{
+			double error = 0;
+			for (std::uint32_t y = 0; y < size; y += 7)
+			{
+				for (std::uint32_t x = 0; x < size; x++)
+				{
+					error = std::max(error, texel_error(small, small_texture, x, y));
+				}
+			}
+			return error;
+		});
+
+		// Several threads sampling random texels through the small cache, so tiles get evicted while other threads read.
+		suite.Check("texture_cache/accuracy/threaded_texel_error", 1e-3, [&]()
+		{
+			std::vector<std::future<double>> tasks;
+			for (unsigned int t = 0; t < 4; t++)
+			{
+				tasks.push_back(std::async(std::launch::async, [&, t]()
+				{
+					std::mt19937 thread_rng(t);
+					double error = 0;
+					for (int i = 0; i < 100000; i++)
+					{
+						error = std::max(error, texel_error(small, small_texture, thread_rng() % size, thread_rng() % size));
+					}
+					return error;
+				}));
+			}
+			double error = 0;
+			for (auto& task : tasks)
+			{
+				error = std::max(error, task.get());
+			}
+			return error;
+		});
+
+		suite.Check("texture_cache/accuracy/lod_from_differentials", 1e-5, [&]()
+		{
+			return std::abs(large.ComputeLod(large_texture, duv_dx, duv_dy) - 2.f);
+		});
+
+		std::filesystem::remove(path);
+	}
+
+	void BenchBlockCompression(bench::Suite& suite)
+	{
+		// Smooth colors with some detail, random texels wouldn't say anything about the encoders.
+		constexpr std::uint32_t size = 512;
+		std::vector<std::uint32_t> pixels(size * size);
+		for (std::uint32_t y = 0; y < size; y++)
+		{
+			for (std::uint32_t x = 0; x < size; x++)
+			{
+				const float u = float(x) / size, v = float(y) / size;
+				const auto r = static_cast<std::uint32_t>(127.5f + 127.5f * std::sin(u * 12.f + v * 3.f));
+				const auto g = static_cast<std::uint32_t>(255.f * u * v);
+				const auto b = static_cast<std::uint32_t>(127.5f + 127.5f * std::cos(v * 9.f));
+				const auto a = static_cast<std::uint32_t>(255.f * (1.f - u));
+				pixels[y * size + x] = r | (g << 8) | (b << 16) | (a << 24);
+			}
+		}
+
+		const std::pair<std::string, rlr::TextureFormat> formats[] = {
+			{ "rgba8", rlr::TextureFormat::rgba8 },
+			{ "bc1", rlr::TextureFormat::bc1 },
+			{ "bc5", rlr::TextureFormat::bc5 },
+			{ "bc7", rlr::TextureFormat::bc7 } };
+
+		constexpr std::size_t budget = 16 << 20;
+		std::size_t rgba8_slots = 0;
+		for (auto const& [name, format] : formats)
+		{
+			const auto path = (std::filesystem::temp_directory_path() / ("bench_texture_" + name + ".rlrt")).string();
+			rlr::SaveTiledTexture(path, size, size, pixels, rlr::default_tile_size, format);
+			rlr::TextureCache cache(budget, rlr::default_tile_size, format);
+			const auto texture = cache.AddTexture(path);
+
+			rgba8_slots = format == rlr::TextureFormat::rgba8 ? cache.NumSlots() : rgba8_slots;
+			std::cout << "texture/" << name << ": " << cache.NumSlots() << " tiles in " << (budget >> 20) << " MiB, "
+				<< double(cache.NumSlots()) / rgba8_slots << "x rgba8" << std::endl;
+
+			// Bilinear samples between texel centers of mip 0, so most of the 4 texels share a block.
+			suite.Run("texture/sample_" + name, size * size / 4, [&]()
+			{
+				fm::vec4 sum;
+				for (std::uint32_t y = 0; y < size; y += 2)
+				{
+					for (std::uint32_t x = 0; x < size; x += 2)
+					{
+						sum += cache.SampleLevel(texture, fm::vec2((x + 1.f) / size, (y + 1.f) / size), 0);
+					}
+				}
+				bench::DoNotOptimize(sum);
+			});
+
+			// Mean absolute error per channel in 8 bit units. BC1 has no alpha and BC5 only stores red and green.
+			const int num_channels = format == rlr::TextureFormat::bc1 ? 3 : format == rlr::TextureFormat::bc5 ? 2 : 4;
+			const double bound = format == rlr::TextureFormat::rgba8 ? 1e-3 : format == rlr::TextureFormat::bc1 ? 4 : 2;
+			suite.Check("texture/accuracy/" + name + "_mean_error", bound, [&]()
+			{
+				double error = 0;
+				for (std::uint32_t y = 0; y < size; y++)
+				{
+					for (std::uint32_t x = 0; x < size; x++)
+					{
+						const fm::vec4 c = cache.SampleLevel(texture, fm::vec2((x + 0.5f) / size, (y + 0.5f) / size), 0);
+						for (int i = 0; i < num_channels; i++)
+						{
+							error += std::abs(c[i] * 255.f - float((pixels[y * size + x] >> (8 * i)) & 0xFF));
+						}
+					}
+				}
+				return error / (double(size) * size * num_channels);
+			});
+
+			if (format != rlr::TextureFormat::rgba8)
+			{
+				std::vector<std::uint8_t> blocks(rlr::BlockBytes(format) * 1024);
+				for (std::size_t i = 0; i < 1024; i++)
+				{
+					const std::uint32_t bx = (i % 32) * 4, by = (i / 32) * 4;
+					std::uint32_t block[16];
+					for (std::uint32_t j = 0; j < 16; j++)
+					{
+						block[j] = pixels[(by + j / 4) * size + bx + j % 4];
+					}
+					rlr::EncodeBlock(format, block, &blocks[i * rlr::BlockBytes(format)]);
+				}
+				suite.Run("texture/decode_" + name, 1024, [&]()
+				{
+					std::uint32_t texels[16];
+					for (std::size_t i = 0; i < 1024; i++)
+					{
+						rlr::DecodeBlock(format, &blocks[i * rlr::BlockBytes(format)], texels);
+						bench::DoNotOptimize(texels[i % 16]);
+					}
+				});
+			}
+
+			std::filesystem::remove(path);
+		}
+	}
+
+	void BenchPagedGeometry(bench::Suite& suite)
+	{
+		// Four instances of a 256x256 height field, 512k triangles.
+		rlr::Model model;
+		model.meshes.push_back(std::make_shared<const rlr::Mesh>(MakeHeightField(256)));
+		for (int i = 0; i < 4; i++)
+		{
+			const auto node = model.scene_graph.AddNode(-1, fm::mat4::Compose(fm::vec3(float(i % 2), float(i / 2), 0.f), fm::quat(), fm::vec3(1.f, 1.f, 1.f)));
+			model.scene_graph.AddInstance(node, 0);
+		}
+		model.scene_graph.UpdateWorldTransforms();
+		const auto material = [](std::size_t, rlr::Mesh const&) { return 1; };
+
+		const auto path = (std::filesystem::temp_directory_path() / "bench_geometry.rlrg").string();
+		suite.Run("paged_geometry/save", 4 * model.meshes[0]->indices.size() / 3, [&]()
+		{
+			SavePagedGeometry(path, model, material);
+		});
+		SavePagedGeometry(path, model, material);
+		const auto file_size = static_cast<std::size_t>(std::filesystem::file_size(path));
+
+		// Slightly tilted rays from above in scanline order, every frame reaches every page.
+		constexpr int view = 128;
+		const fm::vec3 direction = fm::vec3(0.3f, 0.2f, -1.f).Normalized();
+		auto ray_origin = [&](int x, int y)
+		{
+			return fm::vec3(2.f * (x + 0.5f) / view - 0.3f, 2.f * (y + 0.5f) / view - 0.2f, 1.f);
+		};
+		auto render = [&](PagedGeometry& geometry, std::vector<PagedHit>& hits)
+		{
+			hits.resize(view * view);
+			for (int y = 0; y < view; y++)
+			{
+				for (int x = 0; x < view; x++)
+				{
+					hits[y * view + x] = geometry.Intersect(ray_origin(x, y), direction, 0.f, 10.f);
+				}
+			}
+			geometry.NextFrame();
+		};
+		auto mismatches = [](std::vector<PagedHit> const& a, std::vector<PagedHit> const& b)
+		{
+			double count = 0;
+			for (std::size_t i = 0; i < a.size(); i++)
+			{
+				count += a[i].hit != b[i].hit || a[i].t != b[i].t || a[i].page != b[i].page || a[i].triangle != b[i].triangle;
+			}
+			return count;
+		};
+
+		std::vector<PagedHit> resident_hits, paged_hits;
+		PagedGeometry resident(path, file_size + (1 << 20));
+		suite.Run("paged_geometry/intersect_resident", view * view, [&]()
+		{
+			render(resident, resident_hits);
+		});
+
+		// A quarter of the file, so every frame evicts every page.
+		const std::size_t small_budget = file_size / 4;
+		PagedGeometry paged(path, small_budget);
+		suite.Run("paged_geometry/intersect_paged", view * view, [&]()
+		{
+			render(paged, paged_hits);
+		});
+		auto const& cache = paged.GetPageCache();
+		std::cout << "paged_geometry/paged: " << paged.NumPages() << " pages of " << cache.PageBytes() << " bytes, " << cache.NumSlots() << " slots, "
+			<< cache.NumMisses() << " misses, " << cache.NumEvictions() << " evictions" << std::endl;
+
+		suite.Check("paged_geometry/accuracy/memory_over_budget", 1, [&]()
+		{
+			return double(cache.MemoryUsage()) / small_budget;
+		});
+
+		suite.Check("paged_geometry/accuracy/paged_mismatches", 0, [&]()
+		{
+			render(resident, resident_hits);
+			render(paged, paged_hits);
+			return mismatches(resident_hits, paged_hits);
+		});
+
+		// Threads tracing interleaved rows, so pages get evicted while other threads traverse them.
+		suite.Check("paged_geometry/accuracy/threaded_mismatches", 0, [&]()
+		{
+			std::vector<PagedHit> hits(view * view);
+			std::vector<std::future<void>> tasks;
+			for (int t = 0; t < 4; t++)
+			{
+				tasks.push_back(std::async(std::launch::async, [&, t]()
+				{
+					for (int y = t; y < view; y += 4)
+					{
+						for (int x = 0; x < view; x++)
+						{
+							hits[y * view + x] = paged.Intersect(ray_origin(x, y), direction, 0.f, 10.f);
+						}
+					}
+				}));
+			}
+			for (auto& task : tasks)
+			{
+				task.get();
+			}
+			return mismatches(resident_hits, hits);
+		});
+
+		// Closest hit of every triangle of every instance.
+		suite.Check("paged_geometry/accuracy/brute_force_t", 1e-5, [&]()
+		{
+			auto const& mesh = *model.meshes[0];
+			double error = 0;
+			for (int i = 0; i < view * view; i += 61)
+			{
+				const fm::vec3 origin = ray_origin(i % view, i / view);
+				float closest = 10.f;
+				for (auto const& instance : model.scene_graph.GetInstances())
+				{
+					const fm::mat3x4 transform(model.scene_graph.GetWorldTransform(instance.node));
+					for (std::size_t j = 0; j < mesh.indices.size(); j += 3)
+					{
+						const fm::vec3 p0 = transform.TransformPoint(mesh.vertices[mesh.indices[j]].m_pos);
+						const fm::vec3 e1 = transform.TransformPoint(mesh.vertices[mesh.indices[j + 1]].m_pos) - p0;
+						const fm::vec3 e2 = transform.TransformPoint(mesh.vertices[mesh.indices[j + 2]].m_pos) - p0;
+						const fm::vec3 p = direction.Cross(e2);
+						const float inv_det = 1.f / e1.Dot(p);
+						const fm::vec3 s = origin - p0;
+						const fm::vec3 q = s.Cross(e1);
+						const float u = s.Dot(p) * inv_det, v = direction.Dot(q) * inv_det, t = e2.Dot(q) * inv_det;
+						if (u >= 0 && v >= 0 && u + v <= 1 && t >= 0 && t < closest)
+						{
+							closest = t;
+						}
+					}
+				}
+				const auto& hit = resident_hits[i];
+				error = std::max<double>(error, hit.hit ? std::abs(hit.t - closest) : (closest < 10.f ? 1 : 0));
+			}
+			return error;
+		});
+
+		std::filesystem::remove(path);
+	}
+
+	void BenchSkeleton(bench::Suite& suite, std::mt19937& rng)
+	{
+		constexpr int num_bones = 64;
+		constexpr int num_keys = 30;
+		std::uniform_real_distribution<float> dist(-1, 1);
+
+		std::vector<rlr::Bone> bones;
+		for (int i = 0; i < num_bones; i++)
+		{
+			rlr::Bone bone(nullptr, i, "bone" + std::to_string(i), fm::mat4());
+			bone.parent_idx = i == 0 ? -1 : (i - 1) / 2;
+			for (int k = 0; k < num_keys; k++)
+			{
+				bone.position_times.push_back(k);
+				bone.positions.push_back(fm::vec3(dist(rng), dist(rng), dist(rng)));
+				bone.rotation_times.push_back(k);
+				bone.rotations.push_back(fm::quat(dist(rng), dist(rng), dist(rng), dist(rng)).Normalized());
+			}
+			bones.push_back(bone);
+		}
+
+		rlr::Skeleton skeleton(bones, fm::mat4());
+		rlr::Animation animation("bench", 0, num_keys - 1, 0, 30);
+		skeleton.PlayAnimation(&animation);
+
+		suite.Run("animation/skeleton_update", num_bones, [&]()
+		{
+			skeleton.Update(1.f / 60.f);
+			bench::DoNotOptimize(skeleton.bone_mats.data());
+		});
+	}
+
+} /* anonymous */
+
+/*! Usage: bench [output.json] [filter]
+ * Only benchmarks containing `filter` in their name are run.
+ */
+int main(int argc, char* argv[])
+{
+	const std::string output = argc > 1 ? argv[1] : "bench_results.json";
+	bench::Suite suite(argc > 2 ? argv[2] : "");
+
+	std::mt19937 rng(1337);
+	const auto vertices = MakeSceneVertices(rng);
+	std::vector<std::uint16_t> indices(vertices.size());
+	for (std::size_t i = 0; i < indices.size(); i++)
+	{
+		indices[i] = static_cast<std::uint16_t>(i);
+	}
+
+	BenchVec(suite, rng);
+	BenchMath(suite, rng);
+	BenchKernels(suite, rng, vertices);
+	BenchScene(suite, rng, vertices, indices);
+	BenchBuild(suite, vertices, indices);
+	BenchVertices(suite, rng, vertices);
+	BenchSceneBuilder(suite, rng);
+	BenchMeshOptimizer(suite, rng);
+	BenchLod(suite);
+	BenchTextureCache(suite, rng);
+	BenchBlockCompression(suite);
+	BenchPagedGeometry(suite);
+	BenchSkeleton(suite, rng);
+	BenchSceneGraph(suite, rng);
+	BenchLoad(suite);
+
+	std::ofstream file(output);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << output << std::endl;
+		return 1;
+	}
+
+	suite.WriteJson(file, {
+		{ "version", BENCH_VERSION },
+#if defined(_MSC_VER)
+		{ "compiler", "msvc " + std::to_string(_MSC_VER) },
+#elif defined(__clang__)
+		{ "compiler", "clang " __clang_version__ },
+#elif defined(__GNUC__)
+		{ "compiler", "gcc " __VERSION__ },
+#endif
+		{ "fm_use_simd", fm::use_simd ? "true" : "false" },
+		{ "fm_sse41", FM_SSE41_AVAILABLE ? "true" : "false" },
+		{ "fm_avx", FM_AVX_AVAILABLE ? "true" : "false" },
+	});
+
+	if (!suite.Passed())
+	{
+		std::cerr << "Accuracy checks failed" << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
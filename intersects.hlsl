@@ -1,3 +1,7 @@
+#ifndef GPU
+#pragma once
+#endif
+
 struct Intersection
 {
 	Triangle closest;
@@ -14,7 +18,7 @@ FUNC bool IntersectBVH(float3 orig, float3 dir, BVHNode node)
 {
     float tmin, tmax, tymin, tymax, tzmin, tzmax; 
  
-	float3 invdir = 1 / dir; 
+	float3 invdir = float3(1 / dir.x, 1 / dir.y, 1 / dir.z); 
 	int sign[3];
 	sign[0] = (invdir.x < 0); 
     sign[1] = (invdir.y < 0); 
@@ -66,7 +70,7 @@ FUNC float2 IntersectRaySphere(float3 origin, float3 direction, Sphere sphere)
 }
 
 
-FUNC float2 IntersectRayTriangle(float3 orig, float3 dir, Triangle tri) 
+FUNC float IntersectRayTriangle(float3 orig, float3 dir, Triangle tri) 
 { 
    	const float3 v0v1 = tri.b - tri.a; 
     const float3 v0v2 = tri.c - tri.a; 
@@ -74,19 +78,39 @@ FUNC float2 IntersectRayTriangle(float3 orig, float3 dir, Triangle tri)
     const float det = dot(v0v1, pvec); 
  
     // ray and triangle are parallel if det is close to 0
-    if (abs(det) < epsilon) return float2(inf, inf); 
+    if (abs(det) < epsilon) return inf; 
  
     const float invDet = 1 / det; 
  
     const float3 tvec = orig - tri.a; 
     const float u = dot(tvec, pvec) * invDet; 
-    if (u < 0 || u > 1) return float2(inf, inf); 
+    if (u < 0 || u > 1) return inf; 
  
     const float3 qvec = cross(tvec, v0v1); 
     const float v = dot(dir, qvec) * invDet; 
-    if (v < 0 || u + v > 1) return float2(inf, inf); 
+    if (v < 0 || u + v > 1) return inf; 
  
     const float t = dot(v0v2, qvec) * invDet; 
  
-    return (t > 0) ? float2(t, t) : float2(inf, inf); 
-} 
\ No newline at end of file
+    return (t > 0) ? t : inf; 
+}
+
+// Same as `IntersectRayTriangle` using a precomputed `WoopTriangle`.
+// Transforms the ray into unit triangle space where the hit test only needs a few dot products.
+FUNC float IntersectRayWoopTriangle(float3 orig, float3 dir, WoopTriangle tri)
+{
+	// `row2` is the unnormalized plane normal so this is the determinant of `IntersectRayTriangle` with the sign flipped.
+	const float dz = dot(tri.row2, dir);
+	if (abs(dz) < epsilon) return inf; // parallel or degenerate triangle
+
+	const float t = -(dot(tri.row2, orig) + tri.offset2) / dz;
+	if (!(t > 0)) return inf;
+
+	const float u = dot(tri.row0, orig) + tri.offset0 + t * dot(tri.row0, dir);
+	if (u < 0 || u > 1) return inf;
+
+	const float v = dot(tri.row1, orig) + tri.offset1 + t * dot(tri.row1, dir);
+	if (v < 0 || u + v > 1) return inf;
+
+	return t;
+}
@@ -3,14 +3,18 @@
 #endif
 
 #include "structs.hlsl"
-#ifdef GPU
 #include "intersects.hlsl"
 #include "random.hlsl"
+#ifdef GPU
 #include "util.hlsl"
 #endif
 
 //#define REFLECTIONS
 //#define USE_BVH
+//#define USE_THREADED_BVH // Stackless traversal. Requires the BVH to be uploaded using `BVH::BuildThreadedLayout`.
+//#define USE_CLUSTERED_LEAVES // Requires `USE_THREADED_BVH` and the clusters created by `BVH::BuildClusters`.
+//#define USE_WOOP_TRIANGLES // Requires the records created by `BVH::BuildWoopTriangles`. Not used by clustered leaves.
+//#define USE_COMPRESSED_VERTICES // Requires the streams created by `CompressVertices`.
 #define REFLECTION_RECURSION 0
 
 #ifdef GPU
@@ -81,7 +85,7 @@ FUNC float3 ComputeLighting(float3 pont, float3 N, float3 V, Material material,
 			const float n_dot_l = dot(N, vec_l);
 			if (n_dot_l > 0)
 			{
-				intensity += slight.intensity * n_dot_l / (length_n * length(vec_l));
+				intensity += ShadingDivideByLengths(slight.intensity * n_dot_l, length_n, vec_l);
 				//intensity += light.intensity * n_dot_l;
 			}
 
@@ -92,7 +96,7 @@ FUNC float3 ComputeLighting(float3 pont, float3 N, float3 V, Material material,
 				const float r_dot_v = dot(vec_r, V);
 				if (r_dot_v > 0)
 				{
-					intensity += slight.intensity * pow(r_dot_v / (length(vec_r) * length_v), material.specular);
+					intensity += slight.intensity * ShadingPow(ShadingDivideByLengths(r_dot_v, length_v, vec_r), material.specular);
 				}
 			}
 		}
@@ -102,6 +106,123 @@ FUNC float3 ComputeLighting(float3 pont, float3 N, float3 V, Material material,
 	return float3(intensity, intensity, intensity);
 }
 
+#ifdef USE_COMPRESSED_VERTICES
+// Shading attributes of a vertex. The position is the quantized one, intersection uses `LoadPosition`.
+FUNC Vertex LoadVertex(uint idx)
+{
+	const CompressedVertex cv = compressed_vertices[idx];
+	const uint3 q = uint3(cv.position_xy & 0xffff, cv.position_xy >> 16, cv.position_z_material & 0xffff);
+
+	Vertex v;
+	v.position = quantization_min + float3(q) * quantization_scale;
+	v.material_idx = cv.position_z_material >> 16;
+	v.normal = DecodeOctahedral(cv.normal);
+	v.uv = f16tof32(uint2(cv.uv, cv.uv >> 16));
+	return v;
+}
+
+FUNC float3 LoadPosition(uint idx)
+{
+	return vertex_positions[idx];
+}
+#else
+FUNC Vertex LoadVertex(uint idx)
+{
+	return vertices[idx];
+}
+
+FUNC float3 LoadPosition(uint idx)
+{
+	return vertices[idx].position;
+}
+#endif
+
+FUNC void IntersectTriangles(float3 origin, float3 direction, float min_t, float max_t, int indices_start, int indices_end, inout float closest_t, inout Triangle closest_triangle)
+{
+	for (int i = indices_start; i < indices_end; i += 3)
+	{
+#ifdef USE_WOOP_TRIANGLES
+		const float t = IntersectRayWoopTriangle(origin, direction, woop_triangles[i / 3]);
+		if (t < closest_t && t > min_t && t < max_t)
+		{
+			// Only hits need the indices and vertices.
+			const uint3 tri_vertices = Load3x16BitIndices(i*2);
+			const Vertex v0 = LoadVertex(tri_vertices.x);
+			const Vertex v1 = LoadVertex(tri_vertices.y);
+			const Vertex v2 = LoadVertex(tri_vertices.z);
+
+			Triangle tri;
+			tri.a = v0.position;
+			tri.b = v1.position;
+			tri.c = v2.position;
+			tri.normal = normalize(v0.normal + v1.normal + v2.normal);
+			tri.material_idx = v1.material_idx;
+
+			closest_t = t;
+			closest_triangle = tri;
+		}
+#else
+		const uint3 tri_vertices = Load3x16BitIndices(i*2);
+
+		Triangle tri;
+		tri.a = LoadPosition(tri_vertices.x);
+		tri.b = LoadPosition(tri_vertices.y);
+		tri.c = LoadPosition(tri_vertices.z);
+
+		const float t = IntersectRayTriangle(origin, direction, tri);
+		if (t < closest_t && t > min_t && t < max_t)
+		{
+			// Only hits need the shading attributes.
+			const Vertex v0 = LoadVertex(tri_vertices.x);
+			const Vertex v1 = LoadVertex(tri_vertices.y);
+			const Vertex v2 = LoadVertex(tri_vertices.z);
+			tri.normal = normalize(v0.normal + v1.normal + v2.normal);
+			tri.material_idx = v1.material_idx;
+
+			closest_t = t;
+			closest_triangle = tri;
+		}
+#endif
+	}
+}
+
+FUNC void IntersectClusters(float3 origin, float3 direction, float min_t, float max_t, int first_cluster, int num_triangles, inout float closest_t, inout Triangle closest_triangle)
+{
+	for (int c = first_cluster; num_triangles > 0; c++)
+	{
+		const BVHCluster cluster = clusters[c];
+
+		for (uint i = 0; i < cluster.num_triangles; i++)
+		{
+			const uint3 local_indices = Load3x8BitIndices(cluster.index_offset + i * 3);
+			const ClusterVertex cv0 = cluster_vertices[cluster.vertex_offset + local_indices.x];
+			const ClusterVertex cv1 = cluster_vertices[cluster.vertex_offset + local_indices.y];
+			const ClusterVertex cv2 = cluster_vertices[cluster.vertex_offset + local_indices.z];
+
+			Triangle tri;
+			tri.a = cv0.position;
+			tri.b = cv1.position;
+			tri.c = cv2.position;
+
+			const float t = IntersectRayTriangle(origin, direction, tri);
+			if (t < closest_t && t > min_t && t < max_t)
+			{
+				// Only hits need the full vertices.
+				const Vertex v0 = LoadVertex(cv0.vertex_idx);
+				const Vertex v1 = LoadVertex(cv1.vertex_idx);
+				const Vertex v2 = LoadVertex(cv2.vertex_idx);
+				tri.normal = normalize(v0.normal + v1.normal + v2.normal);
+				tri.material_idx = v1.material_idx;
+
+				closest_t = t;
+				closest_triangle = tri;
+			}
+		}
+
+		num_triangles -= cluster.num_triangles;
+	}
+}
+
 FUNC Intersection ClosestIntersection(float3 origin, float3 direction, float min_t, float max_t)
 {
 	float closest_t = inf;
@@ -110,7 +231,36 @@ FUNC Intersection ClosestIntersection(float3 origin, float3 direction, float min
 	int bvh_num_indices = -1;
 	int indices_start = -1;
 	
-#ifdef USE_BVH
+#if defined(USE_THREADED_BVH)
+	// Depth first walk using the hit (next node) and miss links. No stack required.
+	int node_idx = 0;
+	while (node_idx != -1)
+	{
+		const BVHNode node = bvh_nodes[node_idx];
+
+		if (!IntersectBVH(origin, direction, node))
+		{
+			node_idx = node.miss_link;
+		}
+		else if (node.left_first == -1) // is a end node.
+		{
+#ifdef USE_CLUSTERED_LEAVES
+			IntersectClusters(origin, direction, min_t, max_t, node.first_cluster, (node.num_indices - node.bib_start) / 3, closest_t, closest_triangle);
+#else
+			IntersectTriangles(origin, direction, min_t, max_t, node.bib_start, node.num_indices, closest_t, closest_triangle);
+#endif
+			node_idx = node.miss_link;
+		}
+		else
+		{
+			node_idx = node_idx + 1;
+		}
+	}
+
+	// Everything has been intersected already.
+	bvh_num_indices = 0;
+	indices_start = 0;
+#elif defined(USE_BVH)
 	int left_child = -1;
 
 	// Intersect root node.
@@ -194,33 +344,7 @@ FUNC Intersection ClosestIntersection(float3 origin, float3 direction, float min
 	indices_start = 0;
 #endif
 
-	for (int i = indices_start; i < bvh_num_indices; i += 3)
-	{
-		const uint3 tri_vertices = Load3x16BitIndices(i*2);
-		const Vertex v0 = vertices[tri_vertices.x];
-		const Vertex v1 = vertices[tri_vertices.y];
-		const Vertex v2 = vertices[tri_vertices.z];
-
-		Triangle tri;
-		tri.a = v0.position;
-		tri.b = v1.position;
-		tri.c = v2.position;
-		tri.normal = normalize(v0.normal + v1.normal + v2.normal);
-		tri.material_idx = v1.material_idx;
-		
-
-		const float2 ts = IntersectRayTriangle(origin, direction, tri);
-		if (ts[0] < closest_t && ts[0] > min_t && ts[0] < max_t)
-		{
-			closest_t = ts[0];
-			closest_triangle = tri;
-		}
-		if (ts[1] < closest_t && ts[1] > min_t && ts[1] < max_t)
-		{
-			closest_t = ts[1];
-			closest_triangle = tri;
-		}
-	}
+	IntersectTriangles(origin, direction, min_t, max_t, indices_start, bvh_num_indices, closest_t, closest_triangle);
 
 	Intersection retval;
 	retval.closest = closest_triangle;
@@ -390,6 +514,7 @@ float4 main(VS_OUTPUT input) : SV_TARGET
 #undef cbuffer
 #undef length(v) {}
 #undef dot(a, b) {}
+#undef cross
 #undef normalize(a) {}
 #undef clamp
 
@@ -0,0 +1,455 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "vec.hpp"
+#include "vec_batch.hpp"
+
+/*! Fast Math approximations
+ * Polynomial approximations of the transcendental functions used by the shading code.
+ * Every function has a scalar and a `Floatx<N>` version. With SSE both run the same SSE kernel so they return identical results.
+ * The polynomials are evaluated with Estrin's scheme to keep the dependency chains short.
+ * Error bounds against libm (checked by the `bench` target):
+ *  - `FastExp2`: relative error < 2e-7 for x in [-126, 127.5]. Smaller inputs return 0, larger inputs are clamped.
+ *  - `FastLog2`: absolute error < 2e-7 for normal positive x. Returns -inf for x <= 0.
+ *  - `FastPow`: relative error < 5e-7 * max(1, |y * log2(x)|) for x >= 0. Negative bases are not supported.
+ *  - `FastSinCos`: absolute error < 2e-7 for |x| <= 8192.
+ *  - `FastAcos`: absolute error < 6e-7 for x in [-1, 1].
+ *  - `FastRsqrt`: relative error < 1e-6 for positive normal x (1e-5 without SSE).
+ */
+namespace fm
+{
+
+	namespace detail
+	{
+		inline std::uint32_t FloatBits(float value)
+		{
+			std::uint32_t retval;
+			std::memcpy(&retval, &value, sizeof(float));
+			return retval;
+		}
+
+		inline float BitsFloat(std::uint32_t value)
+		{
+			float retval;
+			std::memcpy(&retval, &value, sizeof(float));
+			return retval;
+		}
+
+		constexpr float inv_pi_2 = 0.636619772367581343f; // 2 / pi
+		// pi / 2 split in three so `j * pio2_1` and `j * pio2_2` are exact.
+		constexpr float pio2_1 = 1.5703125f;
+		constexpr float pio2_2 = 4.837512969970703125e-4f;
+		constexpr float pio2_3 = 7.54978995489188216e-8f;
+
+		// exp2 on [-0.5, 0.5] (Cephes exp2f).
+		constexpr float exp2_p0 = 1.535336188319500e-4f;
+		constexpr float exp2_p1 = 1.339887440266574e-3f;
+		constexpr float exp2_p2 = 9.618437357674640e-3f;
+		constexpr float exp2_p3 = 5.550332471162809e-2f;
+		constexpr float exp2_p4 = 2.402264791363012e-1f;
+		constexpr float exp2_p5 = 6.931472028550421e-1f;
+
+		// log(1 + t) for 1 + t in [sqrt(0.5), sqrt(2)] (Cephes logf).
+		constexpr float log_p0 = 7.0376836292e-2f;
+		constexpr float log_p1 = -1.1514610310e-1f;
+		constexpr float log_p2 = 1.1676998740e-1f;
+		constexpr float log_p3 = -1.2420140846e-1f;
+		constexpr float log_p4 = 1.4249322787e-1f;
+		constexpr float log_p5 = -1.6668057665e-1f;
+		constexpr float log_p6 = 2.0000714765e-1f;
+		constexpr float log_p7 = -2.4999993993e-1f;
+		constexpr float log_p8 = 3.3333331174e-1f;
+		constexpr float log2e = 1.44269504088896341f;
+		constexpr float sqrt2 = 1.41421356237309505f;
+
+		// sin and cos on [-pi/4, pi/4] (Cephes sinf/cosf).
+		constexpr float sin_p0 = -1.9515295891e-4f;
+		constexpr float sin_p1 = 8.3321608736e-3f;
+		constexpr float sin_p2 = -1.6666654611e-1f;
+		constexpr float cos_p0 = 2.443315711809948e-5f;
+		constexpr float cos_p1 = -1.388731625493765e-3f;
+		constexpr float cos_p2 = 4.166664568298827e-2f;
+
+		// acos on [0, 1] (Abramowitz and Stegun 4.4.46).
+		constexpr float acos_p0 = 1.5707963050f;
+		constexpr float acos_p1 = -0.2145988016f;
+		constexpr float acos_p2 = 0.0889789874f;
+		constexpr float acos_p3 = -0.0501743046f;
+		constexpr float acos_p4 = 0.0308918810f;
+		constexpr float acos_p5 = -0.0170881256f;
+		constexpr float acos_p6 = 0.0066700901f;
+		constexpr float acos_p7 = -0.0012624911f;
+		constexpr float pi = 3.14159265358979323846f;
+
+		// Scalar reference implementations. Used when SSE isn't available. Same operations in the same order as the SSE kernels.
+
+		inline float Exp2Scalar(float x)
+		{
+			const float clamped = std::fmin(std::fmax(x, -126.f), 127.49998f);
+			const float j = std::nearbyint(clamped);
+			const float f = clamped - j;
+
+			const float f2 = f * f;
+			const float a = exp2_p0 * f + exp2_p1;
+			const float b = exp2_p2 * f + exp2_p3;
+			const float c = exp2_p4 * f + exp2_p5;
+			float p = (a * f2 + b) * f2 + c;
+			p = p * f;
+			p = p + 1.f;
+
+			const float scale = BitsFloat(static_cast<std::uint32_t>(static_cast<std::int32_t>(j) + 127) << 23);
+			return x < -126.f ? 0.f : p * scale;
+		}
+
+		inline float Log2Scalar(float x)
+		{
+			const std::uint32_t bits = FloatBits(x);
+			std::int32_t e = static_cast<std::int32_t>(bits >> 23) - 127;
+			float m = BitsFloat((bits & 0x007fffffu) | 0x3f800000u);
+			if (m > sqrt2)
+			{
+				m = m * 0.5f;
+				e = e + 1;
+			}
+
+			const float t = m - 1.f;
+			const float z = t * t;
+
+			const float z2 = z * z;
+			const float a = log_p7 * t + log_p8;
+			const float b = log_p5 * t + log_p6;
+			const float c = log_p3 * t + log_p4;
+			const float d = log_p1 * t + log_p2;
+			const float lo = b * z + a;
+			const float hi = d * z + c;
+			const float p = (log_p0 * z2 + hi) * z2 + lo;
+
+			float y = t * (z * p);
+			y = y - 0.5f * z;
+			const float ln = t + y;
+			const float retval = ln * log2e + static_cast<float>(e);
+			return x > 0.f ? retval : -HUGE_VALF;
+		}
+
+		inline void SinCosScalar(float x, float& s, float& c)
+		{
+			const std::int32_t j = static_cast<std::int32_t>(std::nearbyint(x * inv_pi_2));
+			const float fj = static_cast<float>(j);
+			const float r = ((x - fj * pio2_1) - fj * pio2_2) - fj * pio2_3;
+			const float z = r * r;
+
+			float ps = sin_p0;
+			ps = ps * z + sin_p1;
+			ps = ps * z + sin_p2;
+			const float sin_r = ps * z * r + r;
+
+			float pc = cos_p0;
+			pc = pc * z + cos_p1;
+			pc = pc * z + cos_p2;
+			const float cos_r = (pc * z * z - 0.5f * z) + 1.f;
+
+			const std::uint32_t q = static_cast<std::uint32_t>(j);
+			const float s_abs = (q & 1) ? cos_r : sin_r;
+			const float c_abs = (q & 1) ? sin_r : cos_r;
+			s = BitsFloat(FloatBits(s_abs) ^ ((q & 2) << 30));
+			c = BitsFloat(FloatBits(c_abs) ^ (((q + 1) & 2) << 30));
+		}
+
+		inline float AcosScalar(float x)
+		{
+			const float a = std::fmin(std::fabs(x), 1.f);
+
+			const float a2 = a * a;
+			const float a4 = a2 * a2;
+			const float h3 = acos_p7 * a + acos_p6;
+			const float h2 = acos_p5 * a + acos_p4;
+			const float h1 = acos_p3 * a + acos_p2;
+			const float h0 = acos_p1 * a + acos_p0;
+			const float p = (h3 * a2 + h2) * a4 + (h1 * a2 + h0);
+
+			const float r = std::sqrt(1.f - a) * p;
+			return x < 0.f ? pi - r : r;
+		}
+
+		inline float RsqrtScalar(float x)
+		{
+			float y = BitsFloat(0x5f3759dfu - (FloatBits(x) >> 1));
+			const float half = 0.5f * x;
+			y = y * (1.5f - half * (y * y));
+			y = y * (1.5f - half * (y * y));
+			return y;
+		}
+
+#if FM_SIMD_AVAILABLE
+		inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		inline __m128 Exp2Sse(__m128 x)
+		{
+			const __m128 clamped = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.49998f));
+			const __m128i j = _mm_cvtps_epi32(clamped); // Rounds to nearest even like `std::nearbyint`.
+			const __m128 f = _mm_sub_ps(clamped, _mm_cvtepi32_ps(j));
+
+			const __m128 f2 = _mm_mul_ps(f, f);
+			const __m128 a = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(exp2_p0), f), _mm_set1_ps(exp2_p1));
+			const __m128 b = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(exp2_p2), f), _mm_set1_ps(exp2_p3));
+			const __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(exp2_p4), f), _mm_set1_ps(exp2_p5));
+			__m128 p = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, f2), b), f2), c);
+			p = _mm_mul_ps(p, f);
+			p = _mm_add_ps(p, _mm_set1_ps(1.f));
+
+			const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(j, _mm_set1_epi32(127)), 23));
+			return _mm_andnot_ps(_mm_cmplt_ps(x, _mm_set1_ps(-126.f)), _mm_mul_ps(p, scale));
+		}
+
+		inline __m128 Log2Sse(__m128 x)
+		{
+			const __m128i bits = _mm_castps_si128(x);
+			__m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+			__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+
+			const __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(sqrt2));
+			m = Select(big, _mm_mul_ps(m, _mm_set1_ps(0.5f)), m);
+			e = _mm_sub_epi32(e, _mm_castps_si128(big)); // The mask is -1.
+
+			const __m128 t = _mm_sub_ps(m, _mm_set1_ps(1.f));
+			const __m128 z = _mm_mul_ps(t, t);
+
+			const __m128 z2 = _mm_mul_ps(z, z);
+			const __m128 a = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(log_p7), t), _mm_set1_ps(log_p8));
+			const __m128 b = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(log_p5), t), _mm_set1_ps(log_p6));
+			const __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(log_p3), t), _mm_set1_ps(log_p4));
+			const __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(log_p1), t), _mm_set1_ps(log_p2));
+			const __m128 lo = _mm_add_ps(_mm_mul_ps(b, z), a);
+			const __m128 hi = _mm_add_ps(_mm_mul_ps(d, z), c);
+			const __m128 p = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(log_p0), z2), hi), z2), lo);
+
+			__m128 y = _mm_mul_ps(t, _mm_mul_ps(z, p));
+			y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+			const __m128 ln = _mm_add_ps(t, y);
+			const __m128 retval = _mm_add_ps(_mm_mul_ps(ln, _mm_set1_ps(log2e)), _mm_cvtepi32_ps(e));
+			return Select(_mm_cmpgt_ps(x, _mm_setzero_ps()), retval, _mm_set1_ps(-HUGE_VALF));
+		}
+
+		inline void SinCosSse(__m128 x, __m128& s, __m128& c)
+		{
+			const __m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(inv_pi_2)));
+			const __m128 fj = _mm_cvtepi32_ps(j);
+			__m128 r = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(pio2_1)));
+			r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(pio2_2)));
+			r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(pio2_3)));
+			const __m128 z = _mm_mul_ps(r, r);
+
+			__m128 ps = _mm_set1_ps(sin_p0);
+			ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(sin_p1));
+			ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(sin_p2));
+			const __m128 sin_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), r), r);
+
+			__m128 pc = _mm_set1_ps(cos_p0);
+			pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(cos_p1));
+			pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(cos_p2));
+			const __m128 cos_r = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(pc, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+
+			const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+			const __m128 s_abs = Select(swap, cos_r, sin_r);
+			const __m128 c_abs = Select(swap, sin_r, cos_r);
+			const __m128i s_sign = _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), 30);
+			const __m128i c_sign = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30);
+			s = _mm_xor_ps(s_abs, _mm_castsi128_ps(s_sign));
+			c = _mm_xor_ps(c_abs, _mm_castsi128_ps(c_sign));
+		}
+
+		inline __m128 AcosSse(__m128 x)
+		{
+			const __m128 a = _mm_min_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), x), _mm_set1_ps(1.f));
+
+			const __m128 a2 = _mm_mul_ps(a, a);
+			const __m128 a4 = _mm_mul_ps(a2, a2);
+			const __m128 h3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(acos_p7), a), _mm_set1_ps(acos_p6));
+			const __m128 h2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(acos_p5), a), _mm_set1_ps(acos_p4));
+			const __m128 h1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(acos_p3), a), _mm_set1_ps(acos_p2));
+			const __m128 h0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(acos_p1), a), _mm_set1_ps(acos_p0));
+			const __m128 p = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(h3, a2), h2), a4), _mm_add_ps(_mm_mul_ps(h1, a2), h0));
+
+			const __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.f), a)), p);
+			return Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(pi), r), r);
+		}
+
+		inline __m128 RsqrtSse(__m128 x)
+		{
+			const __m128 y = _mm_rsqrt_ps(x);
+			const __m128 half = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+			return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(half, _mm_mul_ps(y, y))));
+		}
+
+		inline __m128 PowSse(__m128 x, __m128 y)
+		{
+			const __m128 retval = Exp2Sse(_mm_mul_ps(y, Log2Sse(x)));
+			// 0^y is 0, except 0^0 which is 1 like `std::pow`.
+			const __m128 zero_base = Select(_mm_cmpeq_ps(y, _mm_setzero_ps()), _mm_set1_ps(1.f), _mm_setzero_ps());
+			return Select(_mm_cmpgt_ps(x, _mm_setzero_ps()), retval, zero_base);
+		}
+#endif
+
+		inline float PowScalar(float x, float y)
+		{
+			const float retval = Exp2Scalar(y * Log2Scalar(x));
+			return x > 0.f ? retval : (y == 0.f ? 1.f : 0.f);
+		}
+	}
+
+	/*! 2^x */
+	inline float FastExp2(float x)
+	{
+#if FM_SIMD_AVAILABLE
+		return _mm_cvtss_f32(detail::Exp2Sse(_mm_set_ss(x)));
+#else
+		return detail::Exp2Scalar(x);
+#endif
+	}
+
+	/*! log2(x) */
+	inline float FastLog2(float x)
+	{
+#if FM_SIMD_AVAILABLE
+		return _mm_cvtss_f32(detail::Log2Sse(_mm_set_ss(x)));
+#else
+		return detail::Log2Scalar(x);
+#endif
+	}
+
+	/*! x^y for x >= 0. */
+	inline float FastPow(float x, float y)
+	{
+#if FM_SIMD_AVAILABLE
+		return _mm_cvtss_f32(detail::PowSse(_mm_set_ss(x), _mm_set_ss(y)));
+#else
+		return detail::PowScalar(x, y);
+#endif
+	}
+
+	/*! sin(x) and cos(x) at the cost of one. */
+	inline void FastSinCos(float x, float& s, float& c)
+	{
+#if FM_SIMD_AVAILABLE
+		__m128 vs, vc;
+		detail::SinCosSse(_mm_set_ss(x), vs, vc);
+		s = _mm_cvtss_f32(vs);
+		c = _mm_cvtss_f32(vc);
+#else
+		detail::SinCosScalar(x, s, c);
+#endif
+	}
+
+	inline float FastSin(float x)
+	{
+		float s, c;
+		FastSinCos(x, s, c);
+		return s;
+	}
+
+	inline float FastCos(float x)
+	{
+		float s, c;
+		FastSinCos(x, s, c);
+		return c;
+	}
+
+	/*! acos(x) for x in [-1, 1]. */
+	inline float FastAcos(float x)
+	{
+#if FM_SIMD_AVAILABLE
+		return _mm_cvtss_f32(detail::AcosSse(_mm_set_ss(x)));
+#else
+		return detail::AcosScalar(x);
+#endif
+	}
+
+	/*! 1 / sqrt(x) */
+	inline float FastRsqrt(float x)
+	{
+#if FM_SIMD_AVAILABLE
+		return _mm_cvtss_f32(detail::RsqrtSse(_mm_set_ss(x)));
+#else
+		return detail::RsqrtScalar(x);
+#endif
+	}
+
+	// Batch versions.
+
+#if FM_SIMD_AVAILABLE
+#define FM_APPROX_SSE_LOOP(kernel)                                                \
+		for (; i + 4 <= N; i += 4)                                                \
+		{                                                                         \
+			_mm_storeu_ps(retval.data + i, kernel(_mm_loadu_ps(x.data + i)));     \
+		}
+#else
+#define FM_APPROX_SSE_LOOP(kernel)
+#endif
+
+	/*! Batch version of a unary function: runs the SSE kernel on 4 lanes at a time and the scalar function on the rest. */
+#define FM_APPROX_UNARY(name, kernel)                                             \
+	template<unsigned int N>                                                      \
+	inline Floatx<N> name(Floatx<N> const& x)                                     \
+	{                                                                             \
+		Floatx<N> retval;                                                         \
+		unsigned int i = 0;                                                       \
+		FM_APPROX_SSE_LOOP(kernel)                                                \
+		for (; i < N; i++)                                                        \
+		{                                                                         \
+			retval.data[i] = name(x.data[i]);                                     \
+		}                                                                         \
+		return retval;                                                            \
+	}
+
+	FM_APPROX_UNARY(FastExp2, detail::Exp2Sse)
+	FM_APPROX_UNARY(FastLog2, detail::Log2Sse)
+	FM_APPROX_UNARY(FastAcos, detail::AcosSse)
+	FM_APPROX_UNARY(FastRsqrt, detail::RsqrtSse)
+
+#undef FM_APPROX_UNARY
+#undef FM_APPROX_SSE_LOOP
+
+	template<unsigned int N>
+	inline Floatx<N> FastPow(Floatx<N> const& x, Floatx<N> const& y)
+	{
+		Floatx<N> retval;
+		unsigned int i = 0;
+#if FM_SIMD_AVAILABLE
+		for (; i + 4 <= N; i += 4)
+		{
+			_mm_storeu_ps(retval.data + i, detail::PowSse(_mm_loadu_ps(x.data + i), _mm_loadu_ps(y.data + i)));
+		}
+#endif
+		for (; i < N; i++)
+		{
+			retval.data[i] = FastPow(x.data[i], y.data[i]);
+		}
+		return retval;
+	}
+
+	template<unsigned int N>
+	inline void FastSinCos(Floatx<N> const& x, Floatx<N>& s, Floatx<N>& c)
+	{
+		unsigned int i = 0;
+#if FM_SIMD_AVAILABLE
+		for (; i + 4 <= N; i += 4)
+		{
+			__m128 vs, vc;
+			detail::SinCosSse(_mm_loadu_ps(x.data + i), vs, vc);
+			_mm_storeu_ps(s.data + i, vs);
+			_mm_storeu_ps(c.data + i, vc);
+		}
+#endif
+		for (; i < N; i++)
+		{
+			FastSinCos(x.data[i], s.data[i], c.data[i]);
+		}
+	}
+
+} /* fm */
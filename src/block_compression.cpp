@@ -0,0 +1,783 @@
+#include "block_compression.hpp"
+
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include "vec.hpp"
+
+namespace rlr
+{
+
+	namespace
+	{
+
+		constexpr std::uint8_t weights2[4] = { 0, 21, 43, 64 };
+		constexpr std::uint8_t weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+		constexpr std::uint8_t weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// BC7 partitions of the two subset modes. Bit i is the subset of texel i.
+		constexpr std::uint16_t bc7_partitions2[64] = {
+			0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+			0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+			0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+			0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+		};
+
+		// BC7 partitions of the three subset modes. Two bits per texel, texel 0 in the lowest bits.
+		constexpr std::uint32_t bc7_partitions3[64] = {
+			0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+			0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+			0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+			0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+			0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+			0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+			0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+			0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+		};
+
+		// Anchor texel of subset 1 of the two subset partitions. The anchor of subset 0 is always texel 0.
+		constexpr std::uint8_t bc7_anchors2[64] = {
+			15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+			15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+			15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+			6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+		};
+
+		// Anchor texels of subset 1 and 2 of the three subset partitions.
+		constexpr std::uint8_t bc7_anchors3[2][64] = {
+			{
+				3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+				3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+				8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+				3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+			},
+			{
+				15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+				15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+				15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+				15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+			}
+		};
+
+		std::uint8_t Channel(std::uint32_t texel, int channel)
+		{
+			return static_cast<std::uint8_t>(texel >> (8 * channel));
+		}
+
+		std::uint8_t Interpolate(int e0, int e1, int weight)
+		{
+			return static_cast<std::uint8_t>(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+		}
+
+		/*! Reads and writes the bit stream of a block, starting at the lowest bit of the first byte. */
+		class BitStream
+		{
+		public:
+			BitStream() = default;
+			explicit BitStream(std::uint8_t const* block)
+			{
+				std::memcpy(m_bits, block, sizeof(m_bits));
+			}
+
+			/*! Reads up to 32 bits. */
+			std::uint32_t Read(unsigned int num_bits)
+			{
+				const unsigned int word = m_pos / 64, shift = m_pos % 64;
+				std::uint64_t value = m_bits[word] >> shift;
+				if (word == 0 && shift + num_bits > 64)
+				{
+					value |= m_bits[1] << (64 - shift);
+				}
+				m_pos += num_bits;
+				return static_cast<std::uint32_t>(value & ((1ull << num_bits) - 1));
+			}
+
+			void Write(std::uint32_t value, unsigned int num_bits)
+			{
+				for (unsigned int i = 0; i < num_bits; i++, m_pos++)
+				{
+					m_bits[m_pos / 64] |= std::uint64_t((value >> i) & 1) << (m_pos % 64);
+				}
+			}
+
+			void Store(std::uint8_t* block) const
+			{
+				std::memcpy(block, m_bits, sizeof(m_bits));
+			}
+
+		private:
+			std::uint64_t m_bits[2] = {};
+			unsigned int m_pos = 0;
+		};
+
+		/*! Looks up every texel's channel `c` in `tables[c]` with the index `indices[c][texel]` and packs the result. */
+		void Resolve(std::uint8_t const (&tables)[4][16], std::uint8_t const* const (&indices)[4], std::uint32_t* texels)
+		{
+#if FM_SSE41_AVAILABLE
+			__m128i channels[4];
+			for (int c = 0; c < 4; c++)
+			{
+				channels[c] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(tables[c])),
+					_mm_loadu_si128(reinterpret_cast<__m128i const*>(indices[c])));
+			}
+			const __m128i rg_lo = _mm_unpacklo_epi8(channels[0], channels[1]);
+			const __m128i rg_hi = _mm_unpackhi_epi8(channels[0], channels[1]);
+			const __m128i ba_lo = _mm_unpacklo_epi8(channels[2], channels[3]);
+			const __m128i ba_hi = _mm_unpackhi_epi8(channels[2], channels[3]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(texels), _mm_unpacklo_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(texels + 4), _mm_unpackhi_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(texels + 8), _mm_unpacklo_epi16(rg_hi, ba_hi));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(texels + 12), _mm_unpackhi_epi16(rg_hi, ba_hi));
+#else
+			for (int i = 0; i < 16; i++)
+			{
+				texels[i] = std::uint32_t(tables[0][indices[0][i]]) | (std::uint32_t(tables[1][indices[1][i]]) << 8)
+					| (std::uint32_t(tables[2][indices[2][i]]) << 16) | (std::uint32_t(tables[3][indices[3][i]]) << 24);
+			}
+#endif
+		}
+
+		/*! Principal axis of `num_channels` channels of the texels by power iteration. Returns the mean through `mean`. */
+		fm::vec4 PrincipalAxis(std::uint32_t const* texels, int num_channels, fm::vec4& mean)
+		{
+			float points[16][4] = {};
+			mean = fm::vec4();
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < num_channels; c++)
+				{
+					points[i][c] = Channel(texels[i], c);
+					mean[c] += points[i][c] / 16.f;
+				}
+			}
+
+			float covariance[4][4] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				for (int a = 0; a < num_channels; a++)
+				{
+					for (int b = 0; b < num_channels; b++)
+					{
+						covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+					}
+				}
+			}
+
+			fm::vec4 axis(1, 1, 1, num_channels > 3 ? 1.f : 0.f);
+			for (int iteration = 0; iteration < 8; iteration++)
+			{
+				fm::vec4 next;
+				for (int a = 0; a < num_channels; a++)
+				{
+					for (int b = 0; b < num_channels; b++)
+					{
+						next[a] += covariance[a][b] * axis[b];
+					}
+				}
+				float length = 0;
+				for (int c = 0; c < num_channels; c++)
+				{
+					length = std::max(length, std::abs(next[c]));
+				}
+				if (length == 0)
+				{
+					return fm::vec4();
+				}
+				axis = next * (1.f / length);
+			}
+			return axis;
+		}
+
+		/*! The two points of the texels' extent along their principal axis. */
+		void FitEndpoints(std::uint32_t const* texels, int num_channels, float (&e0)[4], float (&e1)[4])
+		{
+			fm::vec4 mean;
+			fm::vec4 axis = PrincipalAxis(texels, num_channels, mean);
+
+			float t_min = std::numeric_limits<float>::max(), t_max = std::numeric_limits<float>::lowest();
+			for (int i = 0; i < 16; i++)
+			{
+				float t = 0;
+				for (int c = 0; c < num_channels; c++)
+				{
+					t += (Channel(texels[i], c) - mean[c]) * axis[c];
+				}
+				t_min = std::min(t_min, t);
+				t_max = std::max(t_max, t);
+			}
+
+			float axis_length = 0;
+			for (int c = 0; c < num_channels; c++)
+			{
+				axis_length += axis[c] * axis[c];
+			}
+			const float scale = axis_length > 0 ? 1.f / axis_length : 0.f;
+			for (int c = 0; c < 4; c++)
+			{
+				e0[c] = std::clamp(mean[c] + axis[c] * t_max * scale, 0.f, 255.f);
+				e1[c] = std::clamp(mean[c] + axis[c] * t_min * scale, 0.f, 255.f);
+			}
+		}
+
+		/*! Index of the palette entry closest to every texel in `num_channels` channels from `first_channel` on. */
+		int PickIndices(std::uint32_t const* texels, std::uint8_t const (&tables)[4][16], int num_entries, int first_channel, int num_channels,
+			std::uint8_t* indices)
+		{
+			int total_error = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				int best_error = std::numeric_limits<int>::max();
+				for (int k = 0; k < num_entries; k++)
+				{
+					int error = 0;
+					for (int c = first_channel; c < first_channel + num_channels; c++)
+					{
+						const int d = int(Channel(texels[i], c)) - tables[c][k];
+						error += d * d;
+					}
+					if (error < best_error)
+					{
+						best_error = error;
+						indices[i] = static_cast<std::uint8_t>(k);
+					}
+				}
+				total_error += best_error;
+			}
+			return total_error;
+		}
+
+		/*! Least squares endpoints for fixed indices. `weights[index]` is the interpolation weight of an index in [0, 1].
+		 * Returns false if the indices don't constrain both endpoints.
+		 */
+		bool RefineEndpoints(std::uint32_t const* texels, std::uint8_t const* indices, float const* weights, int num_channels,
+			float (&e0)[4], float (&e1)[4])
+		{
+			float aa = 0, ab = 0, bb = 0;
+			float xa[4] = {}, xb[4] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				const float t = weights[indices[i]];
+				aa += (1 - t) * (1 - t);
+				ab += (1 - t) * t;
+				bb += t * t;
+				for (int c = 0; c < num_channels; c++)
+				{
+					xa[c] += (1 - t) * Channel(texels[i], c);
+					xb[c] += t * Channel(texels[i], c);
+				}
+			}
+
+			const float det = aa * bb - ab * ab;
+			if (std::abs(det) < 1e-6f)
+			{
+				return false;
+			}
+			for (int c = 0; c < num_channels; c++)
+			{
+				e0[c] = std::clamp((bb * xa[c] - ab * xb[c]) / det, 0.f, 255.f);
+				e1[c] = std::clamp((aa * xb[c] - ab * xa[c]) / det, 0.f, 255.f);
+			}
+			return true;
+		}
+
+		std::uint16_t Pack565(float const (&color)[4])
+		{
+			const auto r = static_cast<std::uint16_t>(std::lround(color[0] * 31.f / 255.f));
+			const auto g = static_cast<std::uint16_t>(std::lround(color[1] * 63.f / 255.f));
+			const auto b = static_cast<std::uint16_t>(std::lround(color[2] * 31.f / 255.f));
+			return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		void BC1Palette(std::uint16_t c0, std::uint16_t c1, std::uint8_t (&tables)[4][16])
+		{
+			const int e[2][3] = {
+				{ ((c0 >> 11) << 3) | (c0 >> 13), (((c0 >> 5) & 63) << 2) | ((c0 >> 9) & 3), ((c0 & 31) << 3) | ((c0 >> 2) & 7) },
+				{ ((c1 >> 11) << 3) | (c1 >> 13), (((c1 >> 5) & 63) << 2) | ((c1 >> 9) & 3), ((c1 & 31) << 3) | ((c1 >> 2) & 7) } };
+
+			for (int c = 0; c < 3; c++)
+			{
+				tables[c][0] = static_cast<std::uint8_t>(e[0][c]);
+				tables[c][1] = static_cast<std::uint8_t>(e[1][c]);
+				if (c0 > c1)
+				{
+					tables[c][2] = static_cast<std::uint8_t>((2 * e[0][c] + e[1][c]) / 3);
+					tables[c][3] = static_cast<std::uint8_t>((e[0][c] + 2 * e[1][c]) / 3);
+				}
+				else
+				{
+					tables[c][2] = static_cast<std::uint8_t>((e[0][c] + e[1][c]) / 2);
+					tables[c][3] = 0;
+				}
+			}
+			tables[3][0] = tables[3][1] = tables[3][2] = 255;
+			tables[3][3] = c0 > c1 ? 255 : 0;
+		}
+
+		void BC4Palette(int a0, int a1, std::uint8_t* table)
+		{
+			table[0] = static_cast<std::uint8_t>(a0);
+			table[1] = static_cast<std::uint8_t>(a1);
+			if (a0 > a1)
+			{
+				for (int k = 1; k < 7; k++)
+				{
+					table[k + 1] = static_cast<std::uint8_t>(((7 - k) * a0 + k * a1 + 3) / 7);
+				}
+			}
+			else
+			{
+				for (int k = 1; k < 5; k++)
+				{
+					table[k + 1] = static_cast<std::uint8_t>(((5 - k) * a0 + k * a1 + 2) / 5);
+				}
+				table[6] = 0;
+				table[7] = 255;
+			}
+		}
+
+		/*! Quantizes the endpoints and picks the indices. Returns the squared error. */
+		int EncodeBC1Endpoints(std::uint32_t const* texels, float const (&e0)[4], float const (&e1)[4],
+			std::uint16_t& c0, std::uint16_t& c1, std::uint8_t (&indices)[16])
+		{
+			c0 = Pack565(e0);
+			c1 = Pack565(e1);
+			if (c0 < c1)
+			{
+				std::swap(c0, c1);
+			}
+
+			// Equal endpoints would select the 3 color mode with transparent black, use index 0 only.
+			std::uint8_t tables[4][16] = {};
+			BC1Palette(c0, c1, tables);
+			if (c0 == c1)
+			{
+				std::fill(indices, indices + 16, std::uint8_t(0));
+				return PickIndices(texels, tables, 1, 0, 3, indices);
+			}
+			return PickIndices(texels, tables, 4, 0, 3, indices);
+		}
+
+		void EncodeBC1(std::uint32_t const* texels, std::uint8_t* block)
+		{
+			constexpr float weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+			float e0[4], e1[4];
+			FitEndpoints(texels, 3, e0, e1);
+			std::uint16_t c0, c1;
+			std::uint8_t indices[16];
+			const int error = EncodeBC1Endpoints(texels, e0, e1, c0, c1, indices);
+
+			// One least squares pass on the chosen indices. Kept if it lowers the error.
+			std::uint16_t refined_c0, refined_c1;
+			std::uint8_t refined_indices[16];
+			if (c0 != c1 && RefineEndpoints(texels, indices, weights, 3, e0, e1)
+				&& EncodeBC1Endpoints(texels, e0, e1, refined_c0, refined_c1, refined_indices) < error)
+			{
+				c0 = refined_c0;
+				c1 = refined_c1;
+				std::copy(refined_indices, refined_indices + 16, indices);
+			}
+
+			std::uint32_t bits = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				bits |= std::uint32_t(indices[i]) << (2 * i);
+			}
+			std::memcpy(block, &c0, 2);
+			std::memcpy(block + 2, &c1, 2);
+			std::memcpy(block + 4, &bits, 4);
+		}
+
+		void EncodeBC4(std::uint32_t const* texels, int channel, std::uint8_t* block)
+		{
+			int a0 = 0, a1 = 255;
+			for (int i = 0; i < 16; i++)
+			{
+				a0 = std::max<int>(a0, Channel(texels[i], channel));
+				a1 = std::min<int>(a1, Channel(texels[i], channel));
+			}
+
+			std::uint8_t indices[16] = {};
+			if (a0 != a1)
+			{
+				std::uint8_t tables[4][16] = {};
+				BC4Palette(a0, a1, tables[channel]);
+				PickIndices(texels, tables, 8, channel, 1, indices);
+			}
+
+			std::uint64_t bits = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				bits |= std::uint64_t(indices[i]) << (3 * i);
+			}
+			block[0] = static_cast<std::uint8_t>(a0);
+			block[1] = static_cast<std::uint8_t>(a1);
+			std::memcpy(block + 2, &bits, 6);
+		}
+
+		void DecodeBC4(std::uint8_t const* block, std::uint8_t* table, std::uint8_t* indices)
+		{
+			BC4Palette(block[0], block[1], table);
+			std::uint64_t bits = 0;
+			std::memcpy(&bits, block + 2, 6);
+			for (int i = 0; i < 16; i++)
+			{
+				indices[i] = static_cast<std::uint8_t>((bits >> (3 * i)) & 7);
+			}
+		}
+
+		/*! Quantizes BC7 mode 6 endpoints and picks the indices. Returns the squared error.
+		 * Each endpoint picks the closer p-bit, which is the lowest bit of all four channels.
+		 */
+		int EncodeBC7Endpoints(std::uint32_t const* texels, float const (&fit)[2][4], int (&endpoints)[2][4], int (&pbits)[2], std::uint8_t (&indices)[16])
+		{
+			for (int e = 0; e < 2; e++)
+			{
+				float best_error = std::numeric_limits<float>::max();
+				for (int p = 0; p < 2; p++)
+				{
+					int q[4];
+					float error = 0;
+					for (int c = 0; c < 4; c++)
+					{
+						q[c] = std::clamp(int(std::lround((fit[e][c] - p) / 2.f)), 0, 127);
+						const float d = float((q[c] << 1) | p) - fit[e][c];
+						error += d * d;
+					}
+					if (error < best_error)
+					{
+						best_error = error;
+						pbits[e] = p;
+						std::copy(q, q + 4, endpoints[e]);
+					}
+				}
+			}
+
+			std::uint8_t tables[4][16];
+			for (int c = 0; c < 4; c++)
+			{
+				for (int k = 0; k < 16; k++)
+				{
+					tables[c][k] = Interpolate((endpoints[0][c] << 1) | pbits[0], (endpoints[1][c] << 1) | pbits[1], weights4[k]);
+				}
+			}
+			return PickIndices(texels, tables, 16, 0, 4, indices);
+		}
+
+		/*! BC7 mode 6: one subset, 7 bit RGBA endpoints with a p-bit each and 4 bit indices. */
+		void EncodeBC7(std::uint32_t const* texels, std::uint8_t* block)
+		{
+			float weights[16];
+			for (int k = 0; k < 16; k++)
+			{
+				weights[k] = weights4[k] / 64.f;
+			}
+
+			float fit[2][4];
+			FitEndpoints(texels, 4, fit[0], fit[1]);
+			int endpoints[2][4], pbits[2];
+			std::uint8_t indices[16];
+			const int error = EncodeBC7Endpoints(texels, fit, endpoints, pbits, indices);
+
+			// One least squares pass on the chosen indices. Kept if it lowers the error.
+			int refined_endpoints[2][4], refined_pbits[2];
+			std::uint8_t refined_indices[16];
+			if (RefineEndpoints(texels, indices, weights, 4, fit[0], fit[1])
+				&& EncodeBC7Endpoints(texels, fit, refined_endpoints, refined_pbits, refined_indices) < error)
+			{
+				std::copy(&refined_endpoints[0][0], &refined_endpoints[0][0] + 8, &endpoints[0][0]);
+				std::copy(refined_pbits, refined_pbits + 2, pbits);
+				std::copy(refined_indices, refined_indices + 16, indices);
+			}
+
+			// The first texel's index has an implicit 0 as its highest bit.
+			if (indices[0] & 8)
+			{
+				std::swap(endpoints[0], endpoints[1]);
+				std::swap(pbits[0], pbits[1]);
+				for (auto& index : indices)
+				{
+					index = static_cast<std::uint8_t>(15 - index);
+				}
+			}
+
+			BitStream bits;
+			bits.Write(1 << 6, 7);
+			for (int c = 0; c < 4; c++)
+			{
+				bits.Write(endpoints[0][c], 7);
+				bits.Write(endpoints[1][c], 7);
+			}
+			bits.Write(pbits[0], 1);
+			bits.Write(pbits[1], 1);
+			for (int i = 0; i < 16; i++)
+			{
+				bits.Write(indices[i], i == 0 ? 3 : 4);
+			}
+			bits.Store(block);
+		}
+
+		/*! BC7 modes 0 to 3 and 7: two or three subsets with their own endpoints, picked per texel by a partition table.
+		 * The palette depends on the subset so the texels are resolved one by one.
+		 */
+		void DecodeBC7Partitioned(int mode, BitStream& bits, std::uint32_t* texels)
+		{
+			struct Mode
+			{
+				int num_subsets;
+				int partition_bits;
+				int color_bits;
+				int alpha_bits; // 0 for opaque modes.
+				int pbits; // 0: none, 1: one per subset, 2: one per endpoint.
+				int index_bits;
+			};
+			constexpr Mode modes[8] = {
+				{ 3, 4, 4, 0, 2, 3 },
+				{ 2, 6, 6, 0, 1, 3 },
+				{ 3, 6, 5, 0, 0, 2 },
+				{ 2, 6, 7, 0, 2, 2 },
+				{}, {}, {},
+				{ 2, 6, 5, 5, 2, 2 },
+			};
+			auto const& info = modes[mode];
+
+			const int partition = bits.Read(info.partition_bits);
+			auto subset = [&](int i)
+			{
+				return info.num_subsets == 2 ? (bc7_partitions2[partition] >> i) & 1 : (bc7_partitions3[partition] >> (2 * i)) & 3;
+			};
+			auto is_anchor = [&](int i)
+			{
+				return i == 0 || (info.num_subsets == 2 ? i == bc7_anchors2[partition] : i == bc7_anchors3[0][partition] || i == bc7_anchors3[1][partition]);
+			};
+
+			int endpoints[3][2][4] = {};
+			const int num_channels = info.alpha_bits > 0 ? 4 : 3;
+			for (int c = 0; c < num_channels; c++)
+			{
+				for (int s = 0; s < info.num_subsets; s++)
+				{
+					for (int e = 0; e < 2; e++)
+					{
+						endpoints[s][e][c] = bits.Read(c < 3 ? info.color_bits : info.alpha_bits);
+					}
+				}
+			}
+
+			int pbits[3][2] = {};
+			for (int s = 0; s < info.num_subsets && info.pbits > 0; s++)
+			{
+				pbits[s][0] = bits.Read(1);
+				pbits[s][1] = info.pbits == 2 ? bits.Read(1) : pbits[s][0];
+			}
+
+			std::uint8_t palette[3][4][8];
+			for (int s = 0; s < info.num_subsets; s++)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					int expanded[2];
+					for (int e = 0; e < 2; e++)
+					{
+						const int num_bits = (c < 3 ? info.color_bits : info.alpha_bits) + (info.pbits > 0 ? 1 : 0);
+						const int value = info.pbits > 0 ? (endpoints[s][e][c] << 1) | pbits[s][e] : endpoints[s][e][c];
+						expanded[e] = c < num_channels ? (value << (8 - num_bits)) | (value >> (2 * num_bits - 8)) : 255;
+					}
+					for (int k = 0; k < (1 << info.index_bits); k++)
+					{
+						palette[s][c][k] = Interpolate(expanded[0], expanded[1], (info.index_bits == 3 ? weights3 : weights2)[k]);
+					}
+				}
+			}
+
+			// Anchor texels have an implicit 0 as their highest index bit.
+			for (int i = 0; i < 16; i++)
+			{
+				const int index = bits.Read(is_anchor(i) ? info.index_bits - 1 : info.index_bits);
+				auto const& p = palette[subset(i)];
+				texels[i] = std::uint32_t(p[0][index]) | (std::uint32_t(p[1][index]) << 8) | (std::uint32_t(p[2][index]) << 16) | (std::uint32_t(p[3][index]) << 24);
+			}
+		}
+
+		void DecodeBC7(std::uint8_t const* block, std::uint32_t* texels)
+		{
+			BitStream bits(block);
+			int mode = 0;
+			while (mode < 8 && !bits.Read(1))
+			{
+				mode++;
+			}
+			if (mode == 8)
+			{
+				std::fill(texels, texels + 16, 0u); // Reserved.
+				return;
+			}
+			if (mode < 4 || mode == 7)
+			{
+				DecodeBC7Partitioned(mode, bits, texels);
+				return;
+			}
+
+			std::uint8_t tables[4][16];
+			std::uint8_t color_indices[16], alpha_indices[16];
+			std::uint8_t const* indices[4] = { color_indices, color_indices, color_indices, color_indices };
+
+			if (mode == 6)
+			{
+				int endpoints[2][4];
+				for (int c = 0; c < 4; c++)
+				{
+					endpoints[0][c] = bits.Read(7) << 1;
+					endpoints[1][c] = bits.Read(7) << 1;
+				}
+				const int p0 = bits.Read(1), p1 = bits.Read(1);
+				for (int c = 0; c < 4; c++)
+				{
+					endpoints[0][c] |= p0;
+					endpoints[1][c] |= p1;
+					for (int k = 0; k < 16; k++)
+					{
+						tables[c][k] = Interpolate(endpoints[0][c], endpoints[1][c], weights4[k]);
+					}
+				}
+				for (int i = 0; i < 16; i++)
+				{
+					color_indices[i] = static_cast<std::uint8_t>(bits.Read(i == 0 ? 3 : 4));
+				}
+			}
+			else
+			{
+				// Mode 4 and 5: separate color and alpha indices, optionally with alpha swapped into a color channel.
+				const int rotation = bits.Read(2);
+				const int index_mode = mode == 4 ? bits.Read(1) : 0;
+				const int color_bits = mode == 4 ? 5 : 7;
+				const int alpha_bits = mode == 4 ? 6 : 8;
+
+				int endpoints[2][4];
+				for (int c = 0; c < 4; c++)
+				{
+					const int num_bits = c < 3 ? color_bits : alpha_bits;
+					for (int e = 0; e < 2; e++)
+					{
+						const int value = bits.Read(num_bits);
+						endpoints[e][c] = (value << (8 - num_bits)) | (value >> (2 * num_bits - 8));
+					}
+				}
+
+				// The first set always has 2 bit indices. The second has 3 bit indices in mode 4 and 2 bit indices in mode 5.
+				std::uint8_t first[16], second[16];
+				const int second_bits = mode == 4 ? 3 : 2;
+				for (int i = 0; i < 16; i++)
+				{
+					first[i] = static_cast<std::uint8_t>(bits.Read(i == 0 ? 1 : 2));
+				}
+				for (int i = 0; i < 16; i++)
+				{
+					second[i] = static_cast<std::uint8_t>(bits.Read(i == 0 ? second_bits - 1 : second_bits));
+				}
+
+				// Mode 4 can swap the sets so color gets the 3 bit indices.
+				const bool swap_sets = index_mode == 1;
+				std::memcpy(color_indices, swap_sets ? second : first, 16);
+				std::memcpy(alpha_indices, swap_sets ? first : second, 16);
+				const int color_index_bits = swap_sets ? second_bits : 2;
+				const int alpha_index_bits = swap_sets ? 2 : second_bits;
+
+				for (int c = 0; c < 4; c++)
+				{
+					const int index_bits = c < 3 ? color_index_bits : alpha_index_bits;
+					for (int k = 0; k < 16; k++)
+					{
+						tables[c][k] = k < (1 << index_bits) ? Interpolate(endpoints[0][c], endpoints[1][c], (index_bits == 3 ? weights3 : weights2)[k]) : 0;
+					}
+				}
+				indices[3] = alpha_indices;
+
+				if (rotation > 0)
+				{
+					std::swap(tables[rotation - 1], tables[3]);
+					std::swap(indices[rotation - 1], indices[3]);
+				}
+			}
+
+			Resolve(tables, indices, texels);
+		}
+
+	} /* anonymous */
+
+	std::size_t BlockBytes(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::bc1: return 8;
+		case TextureFormat::bc5: return 16;
+		case TextureFormat::bc7: return 16;
+		default: return 4;
+		}
+	}
+
+	void EncodeBlock(TextureFormat format, std::uint32_t const* texels, std::uint8_t* block)
+	{
+		switch (format)
+		{
+		case TextureFormat::bc1:
+			EncodeBC1(texels, block);
+			break;
+		case TextureFormat::bc5:
+			EncodeBC4(texels, 0, block);
+			EncodeBC4(texels, 1, block + 8);
+			break;
+		case TextureFormat::bc7:
+			EncodeBC7(texels, block);
+			break;
+		default:
+			std::memcpy(block, texels, 4);
+			break;
+		}
+	}
+
+	void DecodeBlock(TextureFormat format, std::uint8_t const* block, std::uint32_t* texels)
+	{
+		if (format == TextureFormat::bc7)
+		{
+			DecodeBC7(block, texels);
+			return;
+		}
+
+		std::uint8_t tables[4][16] = {};
+		std::uint8_t color_indices[16], green_indices[16];
+		std::uint8_t const* indices[4] = { color_indices, color_indices, color_indices, color_indices };
+
+		if (format == TextureFormat::bc1)
+		{
+			std::uint16_t c0, c1;
+			std::uint32_t bits;
+			std::memcpy(&c0, block, 2);
+			std::memcpy(&c1, block + 2, 2);
+			std::memcpy(&bits, block + 4, 4);
+			BC1Palette(c0, c1, tables);
+			for (int i = 0; i < 16; i++)
+			{
+				color_indices[i] = static_cast<std::uint8_t>((bits >> (2 * i)) & 3);
+			}
+		}
+		else if (format == TextureFormat::bc5)
+		{
+			DecodeBC4(block, tables[0], color_indices);
+			DecodeBC4(block + 8, tables[1], green_indices);
+			indices[1] = green_indices;
+			std::fill(tables[3], tables[3] + 16, std::uint8_t(255)); // Blue stays 0.
+		}
+		else
+		{
+			std::memcpy(texels, block, 4);
+			return;
+		}
+
+		Resolve(tables, indices, texels);
+	}
+
+} /* rlr */
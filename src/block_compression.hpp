@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rlr
+{
+
+	/*! Texel storage of tiled textures. The BCn formats store 4x4 texel blocks in the layout the GPU reads. */
+	enum class TextureFormat : std::uint32_t
+	{
+		rgba8 = 0,
+		bc1 = 1, // RGB 5:6:5 endpoints, 4 bits per texel. Alpha is dropped.
+		bc5 = 2, // Two BC4 channels (red and green), 8 bits per texel. For normal maps.
+		bc7 = 3, // RGBA, 8 bits per texel.
+	};
+
+	/*! Bytes of one 4x4 block, or of one texel for `rgba8`. */
+	std::size_t BlockBytes(TextureFormat format);
+
+	/*! Compresses 16 RGBA8 texels (red in the lowest byte, row major) into one block of `BlockBytes(format)` bytes.
+	 * The endpoints are fit along the principal axis of the texel colors. BC7 is always written as mode 6 (one subset, 4 bit indices).
+	 */
+	void EncodeBlock(TextureFormat format, std::uint32_t const* texels, std::uint8_t* block);
+
+	/*! Decompresses one block into 16 RGBA8 texels.
+	 * BC5 decodes to (red, green, 0, 255). BC7 decodes every mode, blocks with the reserved mode decode to transparent black.
+	 * The palette lookup uses SSSE3 shuffles when SSE4.1 is available.
+	 */
+	void DecodeBlock(TextureFormat format, std::uint8_t const* block, std::uint32_t* texels);
+
+} /* rlr */
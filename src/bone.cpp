@@ -10,29 +10,17 @@ namespace rlr
 	{
 	}
 
-	Bone::Bone(Mesh* mesh, unsigned int id, std::string name, aiMatrix4x4 offset_mat) : mesh(mesh), id(id), name(name), offset_matrix(offset_mat)
+	Bone::Bone(Mesh const* mesh, unsigned int id, std::string name, fm::mat4 offset_mat) : mesh(mesh), id(id), name(name), offset_matrix(offset_mat)
 	{
 	}
 
-	aiMatrix4x4 Bone::GetParentTransforms()
+	fm::mat4 Bone::GetParentTransforms()
 	{
-		Bone* b = parent_bone;
-
-		// Gather Transforms
-		std::vector<aiMatrix4x4> mats;
-		while (b != nullptr)
-		{
-			aiMatrix4x4 tmp_mat = b->node->mTransformation;
-			mats.push_back(tmp_mat);
-
-			b = b->parent_bone;
-		}
-
 		// Combine Transforms
-		aiMatrix4x4 concatenated_transforms = aiMatrix4x4();
-		for (int i = 0; i < mats.size(); i++)
+		fm::mat4 concatenated_transforms;
+		for (Bone* b = parent_bone; b != nullptr; b = b->parent_bone)
 		{
-			concatenated_transforms *= mats.at(i);
+			concatenated_transforms *= b->local_transform;
 		}
 
 		return concatenated_transforms;
@@ -40,9 +28,9 @@ namespace rlr
 
 	unsigned int Bone::FindPosition(float time)
 	{
-		for (unsigned int i = 0; i < anim_node->mNumPositionKeys - 1; i++)
+		for (unsigned int i = 0; i < position_times.size() - 1; i++)
 		{
-			if (time < (float)anim_node->mPositionKeys[i + 1].mTime)
+			if (time < (float)position_times[i + 1])
 			{
 				return i;
 			}
@@ -53,20 +41,20 @@ namespace rlr
 
 	unsigned int Bone::FindRotation(float time)
 	{
-		for (unsigned int i = 0; i < anim_node->mNumRotationKeys - 1; i++)
+		for (unsigned int i = 0; i < rotation_times.size() - 1; i++)
 		{
-			if (time < (float)anim_node->mRotationKeys[i + 1].mTime)
+			if (time < (float)rotation_times[i + 1])
 				return i;
 		}
 
 		return 0;
 	}
 
-	aiVector3D Bone::CalcInterpolatedPosition(float time, float last_time, float next_time)
+	fm::vec3 Bone::CalcInterpolatedPosition(float time, float last_time, float next_time)
 	{
-		if (anim_node->mNumPositionKeys == 1)
+		if (positions.size() == 1)
 		{
-			return  anim_node->mPositionKeys[0].mValue;
+			return positions[0];
 		}
 
 		unsigned int PositionIndex = FindPosition(time);
@@ -78,24 +66,20 @@ namespace rlr
 			NextPositionIndex = FindRotation(next_time);
 		}
 
-		float delta = anim_node->mPositionKeys[NextPositionIndex].mTime - anim_node->mPositionKeys[PositionIndex].mTime;
-		float factor = (time - (float)anim_node->mPositionKeys[PositionIndex].mTime) / delta;
+		float delta = position_times[NextPositionIndex] - position_times[PositionIndex];
+		float factor = (time - (float)position_times[PositionIndex]) / delta;
 
-		const aiVector3D start = anim_node->mPositionKeys[PositionIndex].mValue;
-		const aiVector3D end = anim_node->mPositionKeys[NextPositionIndex].mValue;
+		const fm::vec3 start = positions[PositionIndex];
+		const fm::vec3 end = positions[NextPositionIndex];
 
-		aiVector3D retval;
-		Assimp::Interpolator<aiVector3D> inter;
-		inter(retval, start, end, factor);
-
-		return retval;
+		return start + (end - start) * factor;
 	}
 
-	aiQuaternion Bone::CalcInterpolatedRotation(float time, float last_time, float next_time)
+	fm::quat Bone::CalcInterpolatedRotation(float time, float last_time, float next_time)
 	{
-		if (anim_node->mNumRotationKeys == 1)
+		if (rotations.size() == 1)
 		{
-			return anim_node->mRotationKeys[0].mValue;
+			return rotations[0];
 		}
 
 		unsigned int RotationIndex = FindRotation(time);
@@ -107,42 +91,28 @@ namespace rlr
 			NextRotationIndex = FindRotation(next_time);
 		}
 
-		float delta = anim_node->mRotationKeys[NextRotationIndex].mTime - anim_node->mRotationKeys[RotationIndex].mTime;
-		float factor = (time - (float)anim_node->mRotationKeys[RotationIndex].mTime) / delta;
-
-		const aiQuaternion& start = anim_node->mRotationKeys[RotationIndex].mValue;
-		const aiQuaternion& end = anim_node->mRotationKeys[NextRotationIndex].mValue;
+		float delta = rotation_times[NextRotationIndex] - rotation_times[RotationIndex];
+		float factor = (time - (float)rotation_times[RotationIndex]) / delta;
 
-		aiQuaternion retval;
-		Assimp::Interpolator<aiQuaternion> inter;
-		inter(retval, start, end, factor);
+		const fm::quat& start = rotations[RotationIndex];
+		const fm::quat& end = rotations[NextRotationIndex];
 
-		return retval;
+		return fm::quat::Slerp(start, end, factor);
 	}
 
 	void Bone::UpdateKeyframeTransform(float time, float last_time, float next_time)
 	{
-		if (anim_node == nullptr)
+		if (positions.empty() || rotations.empty())
 		{
-			node->mTransformation = aiMatrix4x4(); // No animation? Use a identity matrix.
+			local_transform = fm::mat4(); // No animation? Use a identity matrix.
 			return;
 		}
 
 		pos = CalcInterpolatedPosition(time, last_time, next_time);
 		rot = CalcInterpolatedRotation(time, last_time, next_time);
-		scale = aiVector3D(1.0, 1.0, 1.0);
-
-		aiMatrix4x4 pos_mat = aiMatrix4x4::Translation(pos, pos_mat);
-		aiMatrix4x4 rot_mat = aiMatrix4x4(rot.GetMatrix());
-		aiMatrix4x4 scale_mat = aiMatrix4x4::Scaling(scale, scale_mat);
-
-		aiMatrix4x4 mat = aiMatrix4x4();
-		mat *= pos_mat;
-		mat *= rot_mat;
-		mat *= scale_mat;
-		mat = mat.Transpose();
+		scale = fm::vec3(1.0, 1.0, 1.0);
 
-		node->mTransformation = mat;
+		local_transform = fm::mat4::Compose(pos, rot, scale).Transposed();
 	}
 
 } /* rlr */
\ No newline at end of file
@@ -2,10 +2,12 @@
 
 #include <string>
 #include <vector>
-
-#include <assimp/scene.h>
+#include <cstdint>
 #include <iostream>
 
+#include "vec.hpp"
+#include "mat.hpp"
+
 namespace rlr
 {
 
@@ -19,28 +21,35 @@ namespace rlr
 	{
 	public:
 		Bone();
-		Bone(Mesh* mesh, unsigned int id, std::string name, aiMatrix4x4 offset_mat);
+		Bone(Mesh const* mesh, unsigned int id, std::string name, fm::mat4 offset_mat);
 
 		int id;
 		std::string name;
-		Mesh* mesh = nullptr;
-		aiNode* node = nullptr;
+		Mesh const* mesh = nullptr;
+		std::int32_t node = -1; // Scene graph node of the bone.
 
-		aiNodeAnim* anim_node = nullptr;
 		Bone* parent_bone = nullptr;
-		aiMatrix4x4 parent_transforms = aiMatrix4x4();
-		aiMatrix4x4 offset_matrix = aiMatrix4x4();
+		int parent_idx = -1; // Index of `parent_bone` in the owning bone list.
+		fm::mat4 parent_transforms;
+		fm::mat4 offset_matrix;
+		fm::mat4 local_transform; // Starts as the node transformation, replaced by the keyframe transform.
 		Skeleton* parent_skeleton = nullptr;
 
-		aiVector3D pos;
-		aiQuaternion rot;
-		aiVector3D scale;
+		// Keyframes converted from the bone's animation channel at import.
+		std::vector<double> position_times;
+		std::vector<fm::vec3> positions;
+		std::vector<double> rotation_times;
+		std::vector<fm::quat> rotations;
+
+		fm::vec3 pos;
+		fm::quat rot;
+		fm::vec3 scale;
 
-		aiMatrix4x4 GetParentTransforms();
+		fm::mat4 GetParentTransforms();
 		unsigned int FindPosition(float time);
-		aiVector3D CalcInterpolatedPosition(float time, float last_time, float next_time);
+		fm::vec3 CalcInterpolatedPosition(float time, float last_time, float next_time);
 		unsigned int FindRotation(float time);
-		aiQuaternion CalcInterpolatedRotation(float time, float last_time, float next_time);
+		fm::quat CalcInterpolatedRotation(float time, float last_time, float next_time);
 
 		void UpdateKeyframeTransform(float time, float last_time = -1, float next_time = -1);
 
@@ -2,13 +2,25 @@
 
 #include <array>
 #include <cstdint>
+#include <vector>
+#include <limits>
+#include <queue>
+#include <future>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
+#include "mat.hpp"
 #include "../structs.hlsl"
 #include "../raytracer.hlsl"
 
 template<std::uint32_t N>
 class BVH
 {
+	using Bounds = decltype(BVHNode::bbox);
+
 public:
 	BVH() = default;
 	~BVH() = default;
@@ -22,40 +34,642 @@ public:
 
 		node_pool_ptr = 1; // 2 because allignment I believe.
 
+		m_parents.fill(-1);
+		m_node_handles.fill(-1);
+		m_handle_nodes.clear();
+		m_free_handles.clear();
+		m_free_pairs.clear();
+		m_dead_indices = 0;
+		m_empty = scene_indices.empty();
+		m_lazy = false;
+		m_use_clusters = false;
+		m_use_woop = false;
+		big_index_buffer.clear();
+
 		BVHNode root;
 		root.left_first = 0;
-		root.count = N;
+		root.count = scene_indices.size() / 3;
 		node_pool[0] = root;
 		Subdivide(node_pool[0], scene_vertices, scene_indices/*, root.left_first, root.count*/);
 	}
 
+	/*! Prepares the tree for lazy construction.
+	 * The root starts out as a unbuilt leaf containing every primitive.
+	 * Nodes are subdivided the first time a ray passed to `Intersect` enters them so subtrees that are never visited are never built.
+	 * The dynamic operations (`Insert`, `Remove`, `Update`) require a fully built tree, see `ExpandAll`.
+	 */
+	void ConstructLazy(std::vector<Vertex> const& scene_vertices, std::vector<std::uint16_t> const& scene_indices)
+	{
+		node_pool_ptr = 1;
+
+		m_parents.fill(-1);
+		m_node_handles.fill(-1);
+		m_handle_nodes.clear();
+		m_free_handles.clear();
+		m_free_pairs.clear();
+		m_dead_indices = 0;
+		m_empty = scene_indices.empty();
+		m_lazy = true;
+		m_use_clusters = false;
+		m_use_woop = false;
+		big_index_buffer = scene_indices;
+
+		BVHNode root;
+		root.bbox = CalculateBoundingBox(scene_vertices, scene_indices);
+		root.left_first = -1;
+		root.count = scene_indices.size() / 3;
+		root.bib_start = 0;
+		root.num_indices = scene_indices.size();
+		node_pool[0] = root;
+		m_node_states[0].value.store(NodeState::unbuilt, std::memory_order_release);
+	}
+
+	/*! Expands every unbuilt node of a lazily constructed tree. */
+	void ExpandAll(std::vector<Vertex> const& scene_vertices)
+	{
+		if (!m_lazy || m_empty)
+		{
+			return;
+		}
+
+		std::vector<std::int32_t> stack = { 0 };
+		while (!stack.empty())
+		{
+			auto idx = stack.back();
+			stack.pop_back();
+
+			EnsureBuilt(idx, scene_vertices);
+			auto const& node = node_pool[idx];
+			if (!IsLeaf(node))
+			{
+				stack.push_back(static_cast<std::int32_t>(node.left_first));
+				stack.push_back(static_cast<std::int32_t>(node.left_first) + 1);
+			}
+		}
+
+		m_lazy = false;
+	}
+
+	/*! Finds the closest triangle hit by a ray.
+	 * Safe to call from multiple threads at the same time, also on a lazily constructed tree.
+	 */
+	Intersection Intersect(fm::vec3 origin, fm::vec3 direction, float min_t, float max_t, std::vector<Vertex> const& scene_vertices)
+	{
+		Intersection retval;
+		retval.closest_t = inf;
+
+		if (m_empty)
+		{
+			return retval;
+		}
+
+		// Every node is pushed at most once, so a stack as large as the node pool can't overflow however deep the tree gets.
+		const RayBoxTest ray(origin, direction);
+		std::array<std::int32_t, N * 2 - 1> stack;
+		std::uint32_t stack_ptr = 0;
+		stack[stack_ptr++] = 0;
+
+		while (stack_ptr > 0)
+		{
+			auto idx = stack[--stack_ptr];
+
+			// Only read the bounds. Another thread may be expanding this node which writes the other members.
+			if (!ray.Intersect(node_pool[idx].bbox))
+			{
+				continue;
+			}
+
+			if (m_lazy)
+			{
+				EnsureBuilt(idx, scene_vertices);
+			}
+
+			auto const& node = node_pool[idx];
+			if (!IsLeaf(node))
+			{
+				stack[stack_ptr++] = static_cast<std::int32_t>(node.left_first);
+				stack[stack_ptr++] = static_cast<std::int32_t>(node.left_first) + 1;
+				continue;
+			}
+
+			IntersectLeaf(origin, direction, min_t, max_t, node, scene_vertices, retval);
+		}
+
+		return retval;
+	}
+
+	/*! Emits the tree in depth first order into `threaded_node_pool` for stackless traversal.
+	 * In this layout the hit link of a interior node is always the next node (`left_first` is set to it)
+	 * and `miss_link` points to the node to continue with when the ray misses the node or finished its subtree (-1 ends the traversal).
+	 * Has to be called again after the tree changed. Lazily constructed trees have to be expanded first, see `ExpandAll`.
+	 */
+	void BuildThreadedLayout()
+	{
+		threaded_node_pool.fill(BVHNode{});
+		if (m_empty)
+		{
+			threaded_node_pool[0].left_first = -1;
+			threaded_node_pool[0].miss_link = -1;
+			return;
+		}
+
+		// Subtree sizes are needed to know where the right child ends up before the left subtree is emitted.
+		std::vector<std::int32_t> subtree_sizes(node_pool.size(), 1);
+		std::vector<std::int32_t> stack = { 0 };
+		std::vector<std::int32_t> pre_order;
+		while (!stack.empty())
+		{
+			auto idx = stack.back();
+			stack.pop_back();
+			pre_order.push_back(idx);
+
+			if (!IsLeaf(node_pool[idx]))
+			{
+				stack.push_back(static_cast<std::int32_t>(node_pool[idx].left_first));
+				stack.push_back(static_cast<std::int32_t>(node_pool[idx].left_first) + 1);
+			}
+		}
+		for (auto it = pre_order.rbegin(); it != pre_order.rend(); it++)
+		{
+			if (!IsLeaf(node_pool[*it]))
+			{
+				subtree_sizes[*it] = 1 + subtree_sizes[static_cast<std::int32_t>(node_pool[*it].left_first)] + subtree_sizes[static_cast<std::int32_t>(node_pool[*it].left_first) + 1];
+			}
+		}
+
+		std::int32_t next = 0;
+		std::vector<std::pair<std::int32_t, std::int32_t>> emit_stack = { { 0, -1 } }; // { node, miss link }
+		while (!emit_stack.empty())
+		{
+			auto [idx, miss] = emit_stack.back();
+			emit_stack.pop_back();
+
+			auto threaded_idx = next++;
+			auto& node = threaded_node_pool[threaded_idx];
+			node = node_pool[idx];
+			node.miss_link = miss;
+
+			if (!IsLeaf(node))
+			{
+				std::int32_t left = node_pool[idx].left_first;
+				node.left_first = threaded_idx + 1;
+
+				// The right subtree starts directly after the left subtree.
+				const std::int32_t right_threaded_idx = threaded_idx + 1 + subtree_sizes[left];
+				emit_stack.push_back({ left + 1, miss });
+				emit_stack.push_back({ left, right_threaded_idx });
+			}
+		}
+	}
+
+	/*! Converts the leaves to the clustered leaf format.
+	 * Every leaf is split into clusters of at most `max_cluster_vertices` vertices and `max_cluster_triangles` triangles.
+	 * A cluster stores a copy of its vertex positions and 8 bit indices local to that block
+	 * so a leaf can be intersected without touching `big_index_buffer` or `scene_vertices`.
+	 * Once built, `Intersect` and `IntersectStackless` use the clusters until the tree is modified.
+	 * Call this before `BuildThreadedLayout` since the threaded layout copies `first_cluster`.
+	 */
+	void BuildClusters(std::vector<Vertex> const& scene_vertices)
+	{
+		clusters.clear();
+		cluster_vertices.clear();
+		cluster_indices.clear();
+		m_use_clusters = false;
+
+		if (m_empty)
+		{
+			return;
+		}
+
+		std::vector<std::int32_t> stack = { 0 };
+		while (!stack.empty())
+		{
+			auto idx = stack.back();
+			stack.pop_back();
+
+			auto& node = node_pool[idx];
+			if (!IsLeaf(node))
+			{
+				stack.push_back(static_cast<std::int32_t>(node.left_first));
+				stack.push_back(static_cast<std::int32_t>(node.left_first) + 1);
+				continue;
+			}
+
+			node.first_cluster = clusters.size();
+
+			std::unordered_map<std::uint16_t, std::uint8_t> local_indices;
+			BVHCluster cluster = {};
+			auto flush = [&]()
+			{
+				if (cluster.num_triangles == 0)
+				{
+					return;
+				}
+
+				clusters.push_back(cluster);
+				cluster_indices.resize((cluster_indices.size() + 3) & ~3); // Keep every cluster dword aligned.
+				local_indices.clear();
+				cluster = {};
+			};
+
+			for (auto i = static_cast<std::size_t>(node.bib_start); i < static_cast<std::size_t>(node.num_indices); i += 3)
+			{
+				std::uint32_t new_vertices = 0;
+				for (auto j = i; j < i + 3; j++)
+				{
+					new_vertices += local_indices.count(big_index_buffer[j]) == 0 ? 1 : 0;
+				}
+
+				if (cluster.num_vertices + new_vertices > max_cluster_vertices || cluster.num_triangles == max_cluster_triangles)
+				{
+					flush();
+				}
+
+				if (cluster.num_triangles == 0)
+				{
+					cluster.vertex_offset = cluster_vertices.size();
+					cluster.index_offset = cluster_indices.size();
+				}
+
+				for (auto j = i; j < i + 3; j++)
+				{
+					auto it = local_indices.find(big_index_buffer[j]);
+					if (it == local_indices.end())
+					{
+						ClusterVertex cluster_vertex;
+						cluster_vertex.position = scene_vertices[big_index_buffer[j]].position;
+						cluster_vertex.vertex_idx = big_index_buffer[j];
+						cluster_vertices.push_back(cluster_vertex);
+
+						it = local_indices.emplace(big_index_buffer[j], static_cast<std::uint8_t>(cluster.num_vertices++)).first;
+					}
+					cluster_indices.push_back(it->second);
+				}
+				cluster.num_triangles++;
+			}
+			flush();
+		}
+
+		// `Load3x8BitIndices` always reads 8 bytes.
+		cluster_indices.resize(cluster_indices.size() + 4);
+
+		m_use_clusters = true;
+	}
+
+	/*! Precomputes a `WoopTriangle` for every triangle in `big_index_buffer`.
+	 * The record of the triangle starting at index `i` is `woop_triangles[i / 3]`.
+	 * Once built, `Intersect` and `IntersectStackless` use the records until the tree is modified. Clustered leaves take precedence.
+	 * A lazily constructed tree is expanded first since expanding reorders `big_index_buffer`.
+	 */
+	void BuildWoopTriangles(std::vector<Vertex> const& scene_vertices)
+	{
+		ExpandAll(scene_vertices);
+
+		woop_triangles.resize(big_index_buffer.size() / 3);
+		for (std::size_t i = 0; i + 2 < big_index_buffer.size(); i += 3)
+		{
+			woop_triangles[i / 3] = MakeWoopTriangle(
+				scene_vertices[big_index_buffer[i]].position,
+				scene_vertices[big_index_buffer[i + 1]].position,
+				scene_vertices[big_index_buffer[i + 2]].position);
+		}
+
+		m_use_woop = true;
+	}
+
+	/*! Stackless version of `Intersect` using the layout emitted by `BuildThreadedLayout`. */
+	Intersection IntersectStackless(fm::vec3 origin, fm::vec3 direction, float min_t, float max_t, std::vector<Vertex> const& scene_vertices) const
+	{
+		Intersection retval;
+		retval.closest_t = inf;
+
+		const RayBoxTest ray(origin, direction);
+		std::int32_t idx = m_empty ? -1 : 0;
+		while (idx != -1)
+		{
+			auto const& node = threaded_node_pool[idx];
+
+			if (!ray.Intersect(node.bbox))
+			{
+				idx = static_cast<std::int32_t>(node.miss_link);
+				continue;
+			}
+
+			if (!IsLeaf(node))
+			{
+				idx = idx + 1;
+				continue;
+			}
+
+			IntersectLeaf(origin, direction, min_t, max_t, node, scene_vertices, retval);
+			idx = static_cast<std::int32_t>(node.miss_link);
+		}
+
+		return retval;
+	}
+
+	/*! Inserts a primitive range into the tree without rebuilding it.
+	 * `indices` is a triangle list referencing `scene_vertices` and is appended to `big_index_buffer`.
+	 * The new leaf is placed next to the sibling that adds the least surface area (SAH branch and bound)
+	 * after which the ancestors are refitted and locally rotated.
+	 * Returns a handle that can be passed to `Remove` and `Update`.
+	 */
+	std::int32_t Insert(std::vector<Vertex> const& scene_vertices, std::vector<std::uint16_t> const& indices)
+	{
+		BVHNode leaf;
+		leaf.bbox = CalculateBoundingBox(scene_vertices, indices.data(), indices.size());
+		leaf.left_first = -1;
+		leaf.count = indices.size() / 3;
+		leaf.bib_start = big_index_buffer.size();
+		leaf.num_indices = leaf.bib_start + indices.size();
+		big_index_buffer.insert(big_index_buffer.end(), indices.begin(), indices.end());
+
+		std::int32_t handle;
+		if (!m_free_handles.empty())
+		{
+			handle = m_free_handles.back();
+			m_free_handles.pop_back();
+		}
+		else
+		{
+			handle = m_handle_nodes.size();
+			m_handle_nodes.push_back(-1);
+		}
+
+		InsertLeaf(leaf, handle);
+
+		return handle;
+	}
+
+	/*! Removes a primitive range previously added with `Insert`. Throws `std::runtime_error` if `handle` isn't live.
+	 * The leaf's sibling is collapsed into their parent. The indices stay in `big_index_buffer` until the next `Optimize`.
+	 */
+	void Remove(std::int32_t handle)
+	{
+		auto leaf_idx = HandleLeaf(handle);
+		m_dead_indices += static_cast<std::uint32_t>(node_pool[leaf_idx].num_indices - node_pool[leaf_idx].bib_start);
+
+		DetachLeaf(leaf_idx);
+
+		m_handle_nodes[handle] = -1;
+		m_free_handles.push_back(handle);
+	}
+
+	/*! Updates the bounds of a primitive range after its vertices moved and re-inserts it at the best position. Throws `std::runtime_error` if `handle` isn't live. */
+	void Update(std::int32_t handle, std::vector<Vertex> const& scene_vertices)
+	{
+		auto leaf_idx = HandleLeaf(handle);
+		BVHNode leaf = node_pool[leaf_idx];
+		auto start = static_cast<std::size_t>(leaf.bib_start);
+		leaf.bbox = CalculateBoundingBox(scene_vertices, big_index_buffer.data() + start, static_cast<std::size_t>(leaf.num_indices) - start);
+
+		DetachLeaf(leaf_idx);
+		InsertLeaf(leaf, handle);
+	}
+
+	/*! Re-optimizes the tree after a series of dynamic operations.
+	 * Compacts `big_index_buffer` by dropping removed ranges and runs a bottom-up rotation pass over every node.
+	 */
+	void Optimize()
+	{
+		m_use_clusters = false;
+		m_use_woop = false;
+
+		if (m_empty)
+		{
+			big_index_buffer.clear();
+			m_dead_indices = 0;
+			return;
+		}
+
+		// Compact the index buffer in depth first order.
+		std::vector<std::uint16_t> compacted;
+		compacted.reserve(big_index_buffer.size() - m_dead_indices);
+		std::vector<std::int32_t> stack = { 0 };
+		std::vector<std::int32_t> post_order;
+		while (!stack.empty())
+		{
+			auto idx = stack.back();
+			stack.pop_back();
+
+			auto& node = node_pool[idx];
+			if (IsLeaf(node))
+			{
+				auto start = compacted.size();
+				compacted.insert(compacted.end(), big_index_buffer.begin() + static_cast<std::size_t>(node.bib_start), big_index_buffer.begin() + static_cast<std::size_t>(node.num_indices));
+				node.bib_start = start;
+				node.num_indices = compacted.size();
+				continue;
+			}
+
+			post_order.push_back(idx);
+			stack.push_back(static_cast<std::int32_t>(node.left_first) + 1);
+			stack.push_back(static_cast<std::int32_t>(node.left_first));
+		}
+		big_index_buffer = std::move(compacted);
+		m_dead_indices = 0;
+
+		// Parents were pushed before their childeren so walking backwards visits the childeren first.
+		for (auto it = post_order.rbegin(); it != post_order.rend(); it++)
+		{
+			Rotate(*it);
+		}
+	}
+
+	/*! Runs `Optimize` on a copy of the tree on a background thread.
+	 * The caller can keep tracing the current tree and swap in the result once it is ready.
+	 */
+	std::future<BVH> OptimizeAsync() const
+	{
+		return std::async(std::launch::async, [copy = *this]() mutable
+		{
+			copy.Optimize();
+			return copy;
+		});
+	}
+
+	/*! Returns the amount of indices in `big_index_buffer` that belong to removed ranges. */
+	std::uint32_t GetDeadIndices() const
+	{
+		return m_dead_indices;
+	}
+
 private:
-	inline std::array<fm::vec3, 2> CalculateBoundingBox(std::vector<Vertex> const& scene_vertices, std::vector<std::uint16_t> const& scene_indices)
-	{
-		float min_x = std::numeric_limits<float>::infinity();
-		float max_x = std::numeric_limits<float>::lowest();
-		float min_y = std::numeric_limits<float>::infinity();
-		float max_y = std::numeric_limits<float>::lowest();
-		float min_z = std::numeric_limits<float>::infinity();
-		float max_z = std::numeric_limits<float>::lowest();
-		for (auto idx : scene_indices)
-		{
-			if (scene_vertices[idx].position.x < min_x) min_x = scene_vertices[idx].position.x;
-			if (scene_vertices[idx].position.x > max_x) max_x = scene_vertices[idx].position.x;
-			if (scene_vertices[idx].position.y < min_y) min_y = scene_vertices[idx].position.y;
-			if (scene_vertices[idx].position.y > max_y) max_y = scene_vertices[idx].position.y;
-			if (scene_vertices[idx].position.z < min_z) min_z = scene_vertices[idx].position.z;
-			if (scene_vertices[idx].position.z > max_z) max_z = scene_vertices[idx].position.z;
-		}
-
-		std::array<fm::vec3, 2> bounds;
-
-		bounds[0].x = min_x;
-		bounds[0].y = min_y;
-		bounds[0].z = min_z;
-		bounds[1].x = max_x;
-		bounds[1].y = max_y;
-		bounds[1].z = max_z;
+	static inline bool IsLeaf(BVHNode const& node)
+	{
+		return node.left_first == -1;
+	}
+
+	inline void IntersectLeaf(fm::vec3 origin, fm::vec3 direction, float min_t, float max_t, BVHNode const& node, std::vector<Vertex> const& scene_vertices, Intersection& closest) const
+	{
+		if (m_use_clusters)
+		{
+			IntersectLeafClusters(origin, direction, min_t, max_t, node, scene_vertices, closest);
+			return;
+		}
+
+		for (auto i = static_cast<std::size_t>(node.bib_start); i < static_cast<std::size_t>(node.num_indices); i += 3)
+		{
+			auto const& v0 = scene_vertices[big_index_buffer[i]];
+			auto const& v1 = scene_vertices[big_index_buffer[i + 1]];
+			auto const& v2 = scene_vertices[big_index_buffer[i + 2]];
+
+			Triangle tri;
+			float t;
+			if (m_use_woop)
+			{
+				t = IntersectRayWoopTriangle(origin, direction, woop_triangles[i / 3]);
+			}
+			else
+			{
+				tri.a = v0.position;
+				tri.b = v1.position;
+				tri.c = v2.position;
+				t = IntersectRayTriangle(origin, direction, tri);
+			}
+
+			if (t < closest.closest_t && t > min_t && t < max_t)
+			{
+				tri.a = v0.position;
+				tri.b = v1.position;
+				tri.c = v2.position;
+				tri.normal = fm::vec3::Normalize(v0.normal + v1.normal + v2.normal);
+				tri.material_idx = v1.material_idx;
+				closest.closest_t = t;
+				closest.closest = tri;
+			}
+		}
+	}
+
+	/*! Builds the record for `IntersectRayWoopTriangle`. Degenerate triangles get a record that never hits. */
+	static inline WoopTriangle MakeWoopTriangle(fm::pvec3 a, fm::pvec3 b, fm::pvec3 c)
+	{
+		const fm::pvec3 e1 = b - a;
+		const fm::pvec3 e2 = c - a;
+		const fm::pvec3 n = e1.Cross(e2);
+
+		WoopTriangle retval = {};
+		if (n.Dot(n) == 0)
+		{
+			return retval;
+		}
+
+		// Columns: the two edges, the normal and the translation to `a`.
+		fm::mat3x4 to_world;
+		for (int i = 0; i < 3; i++)
+		{
+			to_world[i][0] = e1[i];
+			to_world[i][1] = e2[i];
+			to_world[i][2] = n[i];
+			to_world[i][3] = a[i];
+		}
+
+		const fm::mat3x4 to_unit = to_world.InverseAffine();
+		retval.row0 = fm::pvec3(to_unit[0][0], to_unit[0][1], to_unit[0][2]);
+		retval.offset0 = to_unit[0][3];
+		retval.row1 = fm::pvec3(to_unit[1][0], to_unit[1][1], to_unit[1][2]);
+		retval.offset1 = to_unit[1][3];
+		// The plane row is left unnormalized so `dot(row2, dir)` is `-det` of `IntersectRayTriangle` and gets the same epsilon test.
+		retval.row2 = n;
+		retval.offset2 = -n.Dot(a);
+		return retval;
+	}
+
+	inline void IntersectLeafClusters(fm::vec3 origin, fm::vec3 direction, float min_t, float max_t, BVHNode const& node, std::vector<Vertex> const& scene_vertices, Intersection& closest) const
+	{
+		auto num_triangles = static_cast<std::uint32_t>(node.num_indices - node.bib_start) / 3;
+		for (auto c = static_cast<std::size_t>(node.first_cluster); num_triangles > 0; c++)
+		{
+			auto const& cluster = clusters[c];
+			auto const* block = cluster_vertices.data() + cluster.vertex_offset;
+			auto const* local_indices = cluster_indices.data() + cluster.index_offset;
+
+			for (std::uint32_t i = 0; i < cluster.num_triangles * 3; i += 3)
+			{
+				auto const& cv0 = block[local_indices[i]];
+				auto const& cv1 = block[local_indices[i + 1]];
+				auto const& cv2 = block[local_indices[i + 2]];
+
+				Triangle tri;
+				tri.a = cv0.position;
+				tri.b = cv1.position;
+				tri.c = cv2.position;
+
+				const float t = IntersectRayTriangle(origin, direction, tri);
+				if (t < closest.closest_t && t > min_t && t < max_t)
+				{
+					auto const& v0 = scene_vertices[cv0.vertex_idx];
+					auto const& v1 = scene_vertices[cv1.vertex_idx];
+					auto const& v2 = scene_vertices[cv2.vertex_idx];
+					tri.normal = fm::vec3::Normalize(v0.normal + v1.normal + v2.normal);
+					tri.material_idx = v1.material_idx;
+					closest.closest_t = t;
+					closest.closest = tri;
+				}
+			}
+
+			num_triangles -= cluster.num_triangles;
+		}
+	}
+
+	/*! CPU version of `IntersectBVH` with the ray in SSE registers and the reciprocal direction computed once per ray.
+	 * Same slab test: the box is hit if the largest entry distance isn't past the smallest exit distance.
+	 */
+	struct RayBoxTest
+	{
+		fm::svec3 origin;
+		fm::svec3 inv_direction;
+
+		RayBoxTest(fm::vec3 const& o, fm::vec3 const& d)
+			: origin(o[0], o[1], o[2]), inv_direction(1 / d[0], 1 / d[1], 1 / d[2])
+		{
+		}
+
+		inline bool Intersect(Bounds const& bbox) const
+		{
+			const fm::svec3 t0 = (fm::svec3(bbox[0]) - origin) * inv_direction;
+			const fm::svec3 t1 = (fm::svec3(bbox[1]) - origin) * inv_direction;
+			const fm::svec3 t_near = fm::svec3::Min(t0, t1);
+			const fm::svec3 t_far = fm::svec3::Max(t0, t1);
+			return std::max({ t_near[0], t_near[1], t_near[2] }) <= std::min({ t_far[0], t_far[1], t_far[2] });
+		}
+	};
+
+	static inline Bounds Union(Bounds const& a, Bounds const& b)
+	{
+		Bounds retval;
+		retval[0] = fm::svec3::Min(fm::svec3(a[0]), fm::svec3(b[0]));
+		retval[1] = fm::svec3::Max(fm::svec3(a[1]), fm::svec3(b[1]));
+		return retval;
+	}
+
+	static inline float SurfaceArea(Bounds const& bbox)
+	{
+		auto extent = bbox[1] - bbox[0];
+		return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	inline Bounds CalculateBoundingBox(std::vector<Vertex> const& scene_vertices, std::vector<std::uint16_t> const& scene_indices)
+	{
+		return CalculateBoundingBox(scene_vertices, scene_indices.data(), scene_indices.size());
+	}
+
+	inline Bounds CalculateBoundingBox(std::vector<Vertex> const& scene_vertices, std::uint16_t const* scene_indices, std::size_t num_indices)
+	{
+		constexpr float highest = std::numeric_limits<float>::infinity();
+		constexpr float lowest = std::numeric_limits<float>::lowest();
+		fm::svec3 min(highest, highest, highest);
+		fm::svec3 max(lowest, lowest, lowest);
+		for (std::size_t i = 0; i < num_indices; i++)
+		{
+			const fm::svec3 position(scene_vertices[scene_indices[i]].position);
+			min = fm::svec3::Min(min, position);
+			max = fm::svec3::Max(max, position);
+		}
+
+		Bounds bounds;
+		bounds[0] = min;
+		bounds[1] = max;
 		return bounds;
 	}
 
@@ -114,7 +728,6 @@ private:
 					big_index_buffer.push_back(i);
 				}
 				target.left_first = -1;
-				target.count = 0;
 			}
 			q++;
 			return;
@@ -125,15 +738,414 @@ private:
 			target.bib_start = 0;
 		}
 
+		std::int32_t target_idx = &target - node_pool.data();
+		m_parents[target.left_first] = target_idx;
+		m_parents[target.left_first + 1] = target_idx;
+
 		node_pool[target.left_first].count = p.first.size() / 3;
 		node_pool[target.left_first + 1].count = p.second.size() / 3;
 		Subdivide(node_pool[target.left_first], scene_vertices, p.first);
 		Subdivide(node_pool[target.left_first + 1], scene_vertices, p.second);
 	}
 
+	/*! Subdivides a unbuilt node of a lazily constructed tree exactly once.
+	 * The childeren are fully written before the node is published as built so other threads never see a half built node.
+	 */
+	inline void EnsureBuilt(std::int32_t idx, std::vector<Vertex> const& scene_vertices)
+	{
+		if (m_node_states[idx].value.load(std::memory_order_acquire) == NodeState::built)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_expand_lock.mutex);
+		if (m_node_states[idx].value.load(std::memory_order_relaxed) == NodeState::built)
+		{
+			return; // Another thread expanded the node while we were waiting.
+		}
+
+		auto& node = node_pool[idx];
+		const auto first = static_cast<std::size_t>(node.bib_start);
+		const auto last = static_cast<std::size_t>(node.num_indices);
+		const auto num_triangles = (last - first) / 3;
+
+		if (num_triangles > lazy_leaf_size)
+		{
+			auto mid = PartitionRange(scene_vertices, first, last);
+
+			auto pair = AllocatePair();
+			for (auto child = 0; child < 2; child++)
+			{
+				const auto child_first = child == 0 ? first : mid;
+				const auto child_last = child == 0 ? mid : last;
+
+				BVHNode child_node;
+				child_node.bbox = CalculateBoundingBox(scene_vertices, big_index_buffer.data() + child_first, child_last - child_first);
+				child_node.left_first = -1;
+				child_node.count = (child_last - child_first) / 3;
+				child_node.bib_start = child_first;
+				child_node.num_indices = child_last;
+
+				node_pool[pair + child] = child_node;
+				m_parents[pair + child] = idx;
+				m_node_states[pair + child].value.store(NodeState::unbuilt, std::memory_order_relaxed);
+			}
+
+			// Don't touch the bounds, they might be read by a ray testing this node.
+			node.left_first = pair;
+			node.num_indices = 0;
+			node.bib_start = 0;
+		}
+
+		m_node_states[idx].value.store(NodeState::built, std::memory_order_release);
+	}
+
+	/*! Reorders the triangles in `big_index_buffer[first, last)` around the centroid midpoint of the largest axis.
+	 * Returns the index of the first triangle of the right partition. Falls back to a even split if all centroids end up on one side.
+	 */
+	inline std::size_t PartitionRange(std::vector<Vertex> const& scene_vertices, std::size_t first, std::size_t last)
+	{
+		auto centroid = [&](std::size_t i)
+		{
+			return (fm::svec3(scene_vertices[big_index_buffer[i]].position) + fm::svec3(scene_vertices[big_index_buffer[i + 1]].position)
+				+ fm::svec3(scene_vertices[big_index_buffer[i + 2]].position)) * (1.f / 3.f);
+		};
+
+		fm::svec3 min(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+		fm::svec3 max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+		for (auto i = first; i < last; i += 3)
+		{
+			auto c = centroid(i);
+			min = fm::svec3::Min(min, c);
+			max = fm::svec3::Max(max, c);
+		}
+
+		auto extent = max - min;
+		auto axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		const float split = min[axis] + extent[axis] * 0.5f;
+
+		auto mid = first;
+		for (auto i = first; i < last; i += 3)
+		{
+			if (centroid(i)[axis] < split)
+			{
+				std::swap_ranges(big_index_buffer.begin() + i, big_index_buffer.begin() + i + 3, big_index_buffer.begin() + mid);
+				mid += 3;
+			}
+		}
+
+		if (mid == first || mid == last)
+		{
+			mid = first + ((last - first) / 6) * 3;
+		}
+
+		return mid;
+	}
+
+	/*! Returns the leaf of a handle returned by `Insert`. Throws if the handle is out of range or was removed. */
+	inline std::int32_t HandleLeaf(std::int32_t handle) const
+	{
+		if (handle < 0 || static_cast<std::size_t>(handle) >= m_handle_nodes.size() || m_handle_nodes[handle] == -1)
+		{
+			throw std::runtime_error("Invalid BVH handle");
+		}
+
+		return m_handle_nodes[handle];
+	}
+
+	/*! Returns the first node of an unused pair of sibling nodes. */
+	inline std::int32_t AllocatePair()
+	{
+		if (!m_free_pairs.empty())
+		{
+			auto pair = m_free_pairs.back();
+			m_free_pairs.pop_back();
+			return pair;
+		}
+
+		if (node_pool_ptr + 2 > node_pool.size())
+		{
+			throw std::runtime_error("BVH node pool exhausted");
+		}
+
+		std::int32_t pair = node_pool_ptr;
+		node_pool_ptr += 2;
+		return pair;
+	}
+
+	/*! Moves the node in slot `from` to slot `to` and fixes the references to it. */
+	inline void MoveNode(std::int32_t from, std::int32_t to)
+	{
+		node_pool[to] = node_pool[from];
+		SetNodeHandle(to, m_node_handles[from]);
+		m_node_handles[from] = -1;
+
+		if (!IsLeaf(node_pool[to]))
+		{
+			m_parents[node_pool[to].left_first] = to;
+			m_parents[node_pool[to].left_first + 1] = to;
+		}
+	}
+
+	inline void SetNodeHandle(std::int32_t node_idx, std::int32_t handle)
+	{
+		m_node_handles[node_idx] = handle;
+		if (handle != -1)
+		{
+			m_handle_nodes[handle] = node_idx;
+		}
+	}
+
+	/*! Finds the node that results in the lowest SAH cost when paired with a leaf with bounds `bbox`. */
+	inline std::int32_t FindBestSibling(Bounds const& bbox)
+	{
+		using Candidate = std::pair<float, std::int32_t>; // { inherited cost, node }
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+
+		const float leaf_area = SurfaceArea(bbox);
+		float best_cost = std::numeric_limits<float>::infinity();
+		std::int32_t best = 0;
+
+		queue.push({ 0.f, 0 });
+		while (!queue.empty())
+		{
+			auto [inherited_cost, idx] = queue.top();
+			queue.pop();
+
+			if (inherited_cost + leaf_area >= best_cost)
+			{
+				break; // Nothing left in the queue can beat the current best.
+			}
+
+			auto const& node = node_pool[idx];
+			const float direct_cost = SurfaceArea(Union(node.bbox, bbox));
+			const float cost = direct_cost + inherited_cost;
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best = idx;
+			}
+
+			if (IsLeaf(node))
+			{
+				continue;
+			}
+
+			const float child_inherited_cost = inherited_cost + direct_cost - SurfaceArea(node.bbox);
+			if (child_inherited_cost + leaf_area < best_cost)
+			{
+				queue.push({ child_inherited_cost, static_cast<std::int32_t>(node.left_first) });
+				queue.push({ child_inherited_cost, static_cast<std::int32_t>(node.left_first + 1) });
+			}
+		}
+
+		return best;
+	}
+
+	inline void InsertLeaf(BVHNode const& leaf, std::int32_t handle)
+	{
+		m_use_clusters = false;
+		m_use_woop = false;
+
+		if (m_empty)
+		{
+			node_pool[0] = leaf;
+			m_parents[0] = -1;
+			SetNodeHandle(0, handle);
+			m_empty = false;
+			return;
+		}
+
+		auto sibling = FindBestSibling(leaf.bbox);
+
+		// The sibling moves down one level and its slot becomes the new parent of the sibling and the leaf.
+		auto pair = AllocatePair();
+		MoveNode(sibling, pair);
+		node_pool[pair + 1] = leaf;
+		SetNodeHandle(pair + 1, handle);
+		m_parents[pair] = sibling;
+		m_parents[pair + 1] = sibling;
+
+		auto& parent = node_pool[sibling];
+		parent.left_first = pair;
+		parent.num_indices = 0;
+		parent.bib_start = 0;
+		Refit(sibling);
+
+		RefitAncestors(m_parents[sibling]);
+	}
+
+	inline void DetachLeaf(std::int32_t leaf_idx)
+	{
+		m_use_clusters = false;
+		m_use_woop = false;
+
+		m_node_handles[leaf_idx] = -1;
+
+		if (leaf_idx == 0)
+		{
+			// Leave a valid empty leaf behind so nothing reads the removed range.
+			constexpr float highest = std::numeric_limits<float>::infinity();
+			constexpr float lowest = std::numeric_limits<float>::lowest();
+			BVHNode empty;
+			empty.bbox[0] = fm::vec3(highest, highest, highest);
+			empty.bbox[1] = fm::vec3(lowest, lowest, lowest);
+			empty.left_first = -1;
+			empty.count = 0;
+			empty.bib_start = 0;
+			empty.num_indices = 0;
+			node_pool[0] = empty;
+			m_empty = true;
+			return;
+		}
+
+		// Collapse the parent by moving the sibling into its slot.
+		auto parent = m_parents[leaf_idx];
+		std::int32_t pair = node_pool[parent].left_first;
+		auto sibling = leaf_idx == pair ? pair + 1 : pair;
+
+		MoveNode(sibling, parent);
+		m_free_pairs.push_back(pair);
+
+		RefitAncestors(m_parents[parent]);
+	}
+
+	/*! Recalculates the bounds and primitive count of a interior node from its childeren. */
+	inline void Refit(std::int32_t idx)
+	{
+		auto& node = node_pool[idx];
+		auto const& left = node_pool[node.left_first];
+		auto const& right = node_pool[node.left_first + 1];
+
+		node.bbox = Union(left.bbox, right.bbox);
+		node.count = left.count + right.count;
+	}
+
+	inline void RefitAncestors(std::int32_t idx)
+	{
+		while (idx != -1)
+		{
+			Refit(idx);
+			Rotate(idx);
+			idx = m_parents[idx];
+		}
+	}
+
+	/*! Applies the tree rotation that reduces the surface area of a child of `idx` the most (if any).
+	 * A rotation swaps a child of `idx` with one of the childeren of its sibling.
+	 */
+	inline void Rotate(std::int32_t idx)
+	{
+		if (IsLeaf(node_pool[idx]))
+		{
+			return;
+		}
+
+		std::int32_t pair = node_pool[idx].left_first;
+
+		float best_gain = 0;
+		std::int32_t best_child = -1;
+		std::int32_t best_grandchild = -1;
+
+		for (auto child = pair; child < pair + 2; child++)
+		{
+			auto sibling = child == pair ? pair + 1 : pair;
+			auto const& sibling_node = node_pool[sibling];
+			if (IsLeaf(sibling_node))
+			{
+				continue;
+			}
+
+			const float sibling_area = SurfaceArea(sibling_node.bbox);
+			for (std::int32_t grandchild = sibling_node.left_first; grandchild < sibling_node.left_first + 2; grandchild++)
+			{
+				// After swapping, the sibling contains `child` and the other grandchild.
+				auto other = grandchild == sibling_node.left_first ? grandchild + 1 : grandchild - 1;
+				const float gain = sibling_area - SurfaceArea(Union(node_pool[child].bbox, node_pool[other].bbox));
+				if (gain > best_gain)
+				{
+					best_gain = gain;
+					best_child = child;
+					best_grandchild = grandchild;
+				}
+			}
+		}
+
+		if (best_child == -1)
+		{
+			return;
+		}
+
+		std::swap(node_pool[best_child], node_pool[best_grandchild]);
+		auto child_handle = m_node_handles[best_child];
+		SetNodeHandle(best_child, m_node_handles[best_grandchild]);
+		SetNodeHandle(best_grandchild, child_handle);
+
+		for (auto moved : { best_child, best_grandchild })
+		{
+			if (!IsLeaf(node_pool[moved]))
+			{
+				m_parents[node_pool[moved].left_first] = moved;
+				m_parents[node_pool[moved].left_first + 1] = moved;
+			}
+		}
+
+		Refit(m_parents[best_grandchild]);
+	}
+
 	std::array<std::uint16_t, N> m_indices;
-	std::uint32_t node_pool_ptr;
+	std::uint32_t node_pool_ptr = 1;
+
+	// Dynamic update state.
+	std::array<std::int32_t, N * 2 - 1> m_parents;
+	std::array<std::int32_t, N * 2 - 1> m_node_handles;
+	std::vector<std::int32_t> m_handle_nodes;
+	std::vector<std::int32_t> m_free_handles;
+	std::vector<std::int32_t> m_free_pairs;
+	std::uint32_t m_dead_indices = 0;
+	bool m_empty = true;
+
+	// Lazy construction state. The wrappers make the atomics and mutex copyable so the tree itself stays copyable.
+	struct NodeState
+	{
+		static constexpr std::uint8_t built = 0;
+		static constexpr std::uint8_t unbuilt = 1;
+
+		std::atomic<std::uint8_t> value = { built };
+
+		NodeState() = default;
+		NodeState(NodeState const& other) : value(other.value.load()) {}
+		NodeState& operator=(NodeState const& other) { value.store(other.value.load()); return *this; }
+	};
+
+	struct ExpandLock
+	{
+		std::mutex mutex;
+
+		ExpandLock() = default;
+		ExpandLock(ExpandLock const&) {}
+		ExpandLock& operator=(ExpandLock const&) { return *this; }
+	};
+
+	static constexpr std::size_t lazy_leaf_size = 4;
+	std::array<NodeState, N * 2 - 1> m_node_states;
+	ExpandLock m_expand_lock;
+	bool m_lazy = false;
+
+	static constexpr std::uint32_t max_cluster_vertices = 64;
+	static constexpr std::uint32_t max_cluster_triangles = 128;
+	bool m_use_clusters = false;
+	bool m_use_woop = false;
 public:
 	std::array<BVHNode, N * 2 - 1> node_pool;
+	std::array<BVHNode, N * 2 - 1> threaded_node_pool;
 	std::vector<std::uint16_t> big_index_buffer;
-};
\ No newline at end of file
+
+	// Clustered leaf format. See `BuildClusters`.
+	std::vector<BVHCluster> clusters;
+	std::vector<ClusterVertex> cluster_vertices;
+	std::vector<std::uint8_t> cluster_indices;
+
+	// Precomputed triangles. See `BuildWoopTriangles`.
+	std::vector<WoopTriangle> woop_triangles;
+};
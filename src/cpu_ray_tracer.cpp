@@ -68,6 +68,7 @@ void CPURayTracer::UpdateGeometry(Viewer* viewer, std::array<Triangle, 1> geomet
 void CPURayTracer::UpdateSettings(Viewer* viewer, RTProperties properties)
 {
 	m_properties = properties;
+	fast_math = properties.fast_math;
 
 	/*camera_pos = properties.camera_pos;
 	sky_color = properties.sky_color;
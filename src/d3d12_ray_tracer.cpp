@@ -20,6 +20,12 @@ void D3D12RayTracer::Initialize(Viewer* viewer)
 	m_vertices_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(Vertex) * NUM_VERTICES);
 	m_indices_buffer = d3d12_viewer->CreateByteAddressBuffer<1>(sizeof(INDICES_TYPE) * (NUM_INDICES));
 	m_bvh_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(BVHNode) * BVH_NODES);
+	m_clusters_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(BVHCluster) * NUM_CLUSTERS);
+	m_cluster_vertices_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(ClusterVertex) * NUM_CLUSTER_VERTICES);
+	m_cluster_indices_buffer = d3d12_viewer->CreateByteAddressBuffer<1>(NUM_CLUSTER_INDEX_BYTES);
+	m_woop_triangles_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(WoopTriangle) * NUM_WOOP_TRIANGLES);
+	m_compressed_vertices_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(CompressedVertex) * NUM_VERTICES);
+	m_vertex_positions_buffer = d3d12_viewer->CreateStructuredBuffer<1>(sizeof(fm::pvec3) * NUM_VERTICES);
 
 	// Create the SRV to the structured buffers.
 	//auto handle = (CD3DX12_CPU_DESCRIPTOR_HANDLE)d3d12_viewer->m_main_srv_desc_heap->GetCPUDescriptorHandleForHeapStart();
@@ -31,6 +37,7 @@ void D3D12RayTracer::Initialize(Viewer* viewer)
 	//d3d12_viewer->CreateByteAddressBufferSRV(m_indices_buffer.first, handle, NUM_INDICES / (sizeof(std::uint32_t) / sizeof(INDICES_TYPE))); // device the number of indices by 2 since 1 position in the buffer is 32 bit and our index type is 16 bit.
 
 	m_material_const_buffer = d3d12_viewer->CreateConstantBuffer<1>(sizeof(RTMaterials));
+	m_quantization_const_buffer = d3d12_viewer->CreateConstantBuffer<1>(sizeof(RTVertexQuantization));
 
 	m_initialized = true;
 }
@@ -44,6 +51,13 @@ void D3D12RayTracer::TracePixel(Viewer* viewer, std::uint32_t x, std::uint32_t y
 	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(2, m_vertices_buffer.first[0]->GetGPUVirtualAddress());
 	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(3, m_indices_buffer.first[0]->GetGPUVirtualAddress());
 	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(4, m_bvh_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(6, m_clusters_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(7, m_cluster_vertices_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(8, m_cluster_indices_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(9, m_woop_triangles_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootConstantBufferView(10, m_quantization_const_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(11, m_compressed_vertices_buffer.first[0]->GetGPUVirtualAddress());
+	d3d12_viewer->m_cmd_list->SetGraphicsRootShaderResourceView(12, m_vertex_positions_buffer.first[0]->GetGPUVirtualAddress());
 	d3d12_viewer->m_cmd_list->DrawInstanced(4, 1, 0, 0);
 }
 
@@ -51,7 +65,7 @@ void D3D12RayTracer::UpdateGeometry(Viewer* viewer, std::array<Triangle, 1> geom
 {
 }
 
-void D3D12RayTracer::UpdateVertices(Viewer * viewer, std::vector<Vertex> vertices, bool all_frames)
+void D3D12RayTracer::UpdateVertices(Viewer * viewer, std::vector<Vertex> const& vertices, bool all_frames)
 {
 	auto d3d12_viewer = static_cast<D3D12Viewer*>(viewer);
 	size_t size = sizeof(Vertex) * NUM_VERTICES;
@@ -69,6 +83,19 @@ void D3D12RayTracer::UpdateVertices(Viewer * viewer, std::vector<Vertex> vertice
 	}
 }
 
+void D3D12RayTracer::UpdateVertices(Viewer* viewer, std::vector<Vertex> const& vertices, std::size_t first, std::size_t count)
+{
+	if (first > NUM_VERTICES || count > NUM_VERTICES - first)
+	{
+		throw std::runtime_error("Vertices don't fit in the vertex buffer");
+	}
+
+	for (auto i = 0; i < m_vertices_buffer.first.size(); i++)
+	{
+		memcpy(GET_CB_ADDRESS(m_vertices_buffer, i) + sizeof(Vertex) * first, vertices.data() + first, sizeof(Vertex) * count);
+	}
+}
+
 void D3D12RayTracer::UpdateBVH(Viewer * viewer, std::array<BVHNode, BVH_NODES> nodes)
 {
 	auto d3d12_viewer = static_cast<D3D12Viewer*>(viewer);
@@ -80,7 +107,7 @@ void D3D12RayTracer::UpdateBVH(Viewer * viewer, std::array<BVHNode, BVH_NODES> n
 	}
 }
 
-void D3D12RayTracer::UpdateIndices(Viewer * viewer, std::vector<INDICES_TYPE> indices, bool all_frames)
+void D3D12RayTracer::UpdateIndices(Viewer * viewer, std::vector<INDICES_TYPE> const& indices, bool all_frames)
 {
 	auto d3d12_viewer = static_cast<D3D12Viewer*>(viewer);
 	size_t size = sizeof(INDICES_TYPE) * indices.size();
@@ -98,6 +125,51 @@ void D3D12RayTracer::UpdateIndices(Viewer * viewer, std::vector<INDICES_TYPE> in
 	}
 }
 
+void D3D12RayTracer::UpdateClusters(Viewer* viewer, std::vector<BVHCluster> const& clusters, std::vector<ClusterVertex> const& cluster_vertices, std::vector<std::uint8_t> const& cluster_indices)
+{
+	if (clusters.size() > NUM_CLUSTERS || cluster_vertices.size() > NUM_CLUSTER_VERTICES || cluster_indices.size() > NUM_CLUSTER_INDEX_BYTES)
+	{
+		throw std::runtime_error("Clustered BVH leaves don't fit in the cluster buffers");
+	}
+
+	memcpy(GET_CB_ADDRESS(m_clusters_buffer, 0), clusters.data(), sizeof(BVHCluster) * clusters.size());
+	memcpy(GET_CB_ADDRESS(m_cluster_vertices_buffer, 0), cluster_vertices.data(), sizeof(ClusterVertex) * cluster_vertices.size());
+	memcpy(GET_CB_ADDRESS(m_cluster_indices_buffer, 0), cluster_indices.data(), cluster_indices.size());
+}
+
+void D3D12RayTracer::UpdateWoopTriangles(Viewer* viewer, std::vector<WoopTriangle> const& woop_triangles)
+{
+	if (woop_triangles.size() > NUM_WOOP_TRIANGLES)
+	{
+		throw std::runtime_error("Woop triangles don't fit in the triangle buffer");
+	}
+
+	memcpy(GET_CB_ADDRESS(m_woop_triangles_buffer, 0), woop_triangles.data(), sizeof(WoopTriangle) * woop_triangles.size());
+}
+
+void D3D12RayTracer::UpdateCompressedVertices(Viewer* viewer, CompressedVertices const& compressed_vertices)
+{
+	if (compressed_vertices.vertices.size() > NUM_VERTICES)
+	{
+		throw std::runtime_error("Compressed vertices don't fit in the vertex buffer");
+	}
+
+	memcpy(GET_CB_ADDRESS(m_compressed_vertices_buffer, 0), compressed_vertices.vertices.data(), sizeof(CompressedVertex) * compressed_vertices.vertices.size());
+	memcpy(GET_CB_ADDRESS(m_vertex_positions_buffer, 0), compressed_vertices.positions.data(), sizeof(fm::pvec3) * compressed_vertices.positions.size());
+	memcpy(GET_CB_ADDRESS(m_quantization_const_buffer, 0), &compressed_vertices.quantization, sizeof(RTVertexQuantization));
+}
+
+void D3D12RayTracer::UpdateCompressedVertices(Viewer* viewer, CompressedVertices const& compressed_vertices, std::size_t first, std::size_t count)
+{
+	if (first > compressed_vertices.vertices.size() || count > compressed_vertices.vertices.size() - first || first + count > NUM_VERTICES)
+	{
+		throw std::runtime_error("Compressed vertices don't fit in the vertex buffer");
+	}
+
+	memcpy(GET_CB_ADDRESS(m_compressed_vertices_buffer, 0) + sizeof(CompressedVertex) * first, compressed_vertices.vertices.data() + first, sizeof(CompressedVertex) * count);
+	memcpy(GET_CB_ADDRESS(m_vertex_positions_buffer, 0) + sizeof(fm::pvec3) * first, compressed_vertices.positions.data() + first, sizeof(fm::pvec3) * count);
+}
+
 void D3D12RayTracer::UpdateMaterials(Viewer * viewer, RTMaterials geometry, int num_materials, bool all_frames)
 {
 	auto d3d12_viewer = static_cast<D3D12Viewer*>(viewer);
@@ -8,8 +8,13 @@
 #include <d3d12.h>
 
 #include "d3d12_viewer.hpp"
+#include "vertex_compression.hpp"
 
 #define BVH_NODES 59
+#define NUM_CLUSTERS BVH_NODES // Every leaf has at least one cluster.
+#define NUM_CLUSTER_VERTICES NUM_INDICES
+#define NUM_CLUSTER_INDEX_BYTES (NUM_INDICES + 3 * NUM_CLUSTERS + 4) // Clusters are dword aligned plus 4 bytes for the last `Load2`.
+#define NUM_WOOP_TRIANGLES (NUM_INDICES / 3)
 
 class Viewer;
 
@@ -22,9 +27,16 @@ public:
 	void Initialize(Viewer* viewer) override;
 	void TracePixel(Viewer* viewer, std::uint32_t x, std::uint32_t y) override;
 	void UpdateGeometry(Viewer* viewer, std::array<Triangle, 1> geometry, bool all_frames = false) override;
-	void UpdateVertices(Viewer* viewer, std::vector<Vertex> vertices, bool all_frames = false);
+	void UpdateVertices(Viewer* viewer, std::vector<Vertex> const& vertices, bool all_frames = false);
+	/*! Uploads `vertices[first, first + count)` to every frame's buffer, for hot reloads that only changed some meshes. Throws `std::runtime_error` if the range runs past `NUM_VERTICES`. */
+	void UpdateVertices(Viewer* viewer, std::vector<Vertex> const& vertices, std::size_t first, std::size_t count);
 	void UpdateBVH(Viewer* viewer, std::array<BVHNode, BVH_NODES> nodes);
-	void UpdateIndices(Viewer* viewer, std::vector<INDICES_TYPE> indices, bool all_frames = false);
+	void UpdateIndices(Viewer* viewer, std::vector<INDICES_TYPE> const& indices, bool all_frames = false);
+	void UpdateClusters(Viewer* viewer, std::vector<BVHCluster> const& clusters, std::vector<ClusterVertex> const& cluster_vertices, std::vector<std::uint8_t> const& cluster_indices);
+	void UpdateWoopTriangles(Viewer* viewer, std::vector<WoopTriangle> const& woop_triangles);
+	void UpdateCompressedVertices(Viewer* viewer, CompressedVertices const& compressed_vertices);
+	/*! Uploads `[first, first + count)` of both compressed streams. The quantization has to match the one uploaded last. */
+	void UpdateCompressedVertices(Viewer* viewer, CompressedVertices const& compressed_vertices, std::size_t first, std::size_t count);
 	void UpdateMaterials(Viewer* viewer, RTMaterials geometry, int num_materials, bool all_frames = false);
 	void UpdateSettings(Viewer* viewer, RTProperties properties) override;
 
@@ -33,5 +45,12 @@ public:
 	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_vertices_buffer;
 	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_indices_buffer;
 	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_bvh_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_clusters_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_cluster_vertices_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_cluster_indices_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_woop_triangles_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_compressed_vertices_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_vertex_positions_buffer;
+	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_quantization_const_buffer;
 	std::pair<std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, 1>, std::array<UINT8*, 1>> m_material_const_buffer;
 };
\ No newline at end of file
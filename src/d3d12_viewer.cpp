@@ -38,7 +38,7 @@ D3D12Viewer::D3D12Viewer(Application& app) : Viewer(app)
 	m_main_srv_desc_heap = CreateSRVHeap(1);
 
 	// Create Screen Squad Vertex Buffer;
-	std::vector<fm::vec3> vertices =
+	std::vector<fm::pvec3> vertices =
 	{
 		{ -1.f, -1.f, 0.f },
 		{ 1.f, -1.f, 0.f },
@@ -457,13 +457,20 @@ ComPtr<ID3D12RootSignature> D3D12Viewer::CreateBasicRootSignature()
 	CD3DX12_DESCRIPTOR_RANGE desc_range;
 	desc_range.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 0);
 
-	std::array<CD3DX12_ROOT_PARAMETER, 6> parameters;
+	std::array<CD3DX12_ROOT_PARAMETER, 13> parameters;
 	parameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 	parameters[1].InitAsConstantBufferView(1, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 	parameters[2].InitAsShaderResourceView(3, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 	parameters[3].InitAsShaderResourceView(4, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 	parameters[4].InitAsShaderResourceView(5, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 	parameters[5].InitAsDescriptorTable(1, &desc_range, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[6].InitAsShaderResourceView(6, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[7].InitAsShaderResourceView(7, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[8].InitAsShaderResourceView(8, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[9].InitAsShaderResourceView(9, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[10].InitAsConstantBufferView(2, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[11].InitAsShaderResourceView(10, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+	parameters[12].InitAsShaderResourceView(11, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	CD3DX12_ROOT_SIGNATURE_DESC root_signature_desc;
 	root_signature_desc.Init(parameters.size(),
@@ -627,7 +634,7 @@ ComPtr<ID3D12DescriptorHeap> D3D12Viewer::CreateSRVHeap(std::uint8_t num)
 	return heap;
 }
 
-D3D12Viewer::VertexBuffer D3D12Viewer::CreateVertexBuffer(std::vector<fm::vec3> vertices)
+D3D12Viewer::VertexBuffer D3D12Viewer::CreateVertexBuffer(std::vector<fm::pvec3> vertices)
 {
 	auto vertex_buffer_size = vertices.size() * sizeof(decltype(vertices[0]));
 	ComPtr<ID3D12Resource> buffer;
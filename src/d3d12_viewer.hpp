@@ -124,7 +124,7 @@ private:
 	[[nodiscard]] inline std::wstring GetUTF16(std::string_view const str, int codepage);
 	[[nodiscard]] inline std::variant<std::pair<ID3DBlob*, D3D12_SHADER_BYTECODE>, std::string> LoadShader(std::string_view path, std::string_view entry, std::string_view type);
 	[[nodiscard]] ComPtr<ID3D12DescriptorHeap> CreateSRVHeap(std::uint8_t num);
-	[[nodiscard]] VertexBuffer CreateVertexBuffer(std::vector<fm::vec3> vertices);
+	[[nodiscard]] VertexBuffer CreateVertexBuffer(std::vector<fm::pvec3> vertices);
 	template<const std::uint16_t N>
 	[[nodiscard]] std::pair<std::array<ComPtr<ID3D12Resource>, N>, std::array<UINT8*, N>> CreateConstantBuffer(size_t unaligned_size);
 	template<const std::uint16_t N>
@@ -0,0 +1,98 @@
+#include "file_watcher.hpp"
+
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+FileWatcher::FileWatcher(std::string const& path)
+	: m_path(std::filesystem::absolute(path)), m_last_poll(std::chrono::steady_clock::now())
+{
+#ifdef __linux__
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_fd < 0)
+	{
+		throw std::runtime_error("Failed to initialize inotify");
+	}
+	m_watch = inotify_add_watch(m_fd, m_path.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+	if (m_watch < 0)
+	{
+		close(m_fd);
+		throw std::runtime_error("Failed to watch " + m_path.parent_path().string());
+	}
+#else
+	std::error_code error;
+	m_time = std::filesystem::last_write_time(m_path, error);
+	m_size = std::filesystem::file_size(m_path, error);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	inotify_rm_watch(m_fd, m_watch);
+	close(m_fd);
+#endif
+}
+
+bool FileWatcher::HasChanged()
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_last_poll < poll_interval)
+	{
+		return false;
+	}
+	m_last_poll = now;
+
+	// Report a change one quiet interval after the last event.
+	if (Poll())
+	{
+		m_pending = true;
+		return false;
+	}
+	if (m_pending && std::filesystem::exists(m_path))
+	{
+		m_pending = false;
+		return true;
+	}
+	return false;
+}
+
+bool FileWatcher::Poll()
+{
+#ifdef __linux__
+	bool changed = false;
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		const auto size = read(m_fd, buffer, sizeof(buffer));
+		if (size <= 0)
+		{
+			return changed;
+		}
+		for (ssize_t offset = 0; offset < size;)
+		{
+			auto event = reinterpret_cast<inotify_event const*>(buffer + offset);
+			if (event->len > 0 && m_path.filename() == event->name)
+			{
+				changed = true;
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+#else
+	std::error_code error;
+	const auto time = std::filesystem::last_write_time(m_path, error);
+	const auto size = std::filesystem::file_size(m_path, error);
+	if (time == m_time && size == m_size)
+	{
+		return false;
+	}
+	m_time = time;
+	m_size = size;
+	return true;
+#endif
+}
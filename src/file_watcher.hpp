@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+
+/*! Reports when a file was rewritten, for hot reloading.
+ * On Linux the file's directory is watched with inotify so files replaced by a rename (as most exporters save) are seen too.
+ * Elsewhere the modification time and size are polled, at most every `poll_interval`.
+ * A change is only reported once the file stopped changing for one interval, so a half written file is never reloaded.
+ */
+class FileWatcher
+{
+public:
+	static constexpr std::chrono::milliseconds poll_interval{ 250 };
+
+	/*! Throws `std::runtime_error` if the watch can't be set up. The file itself doesn't have to exist yet. */
+	explicit FileWatcher(std::string const& path);
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	/*! Returns true once per change. Never blocks, call it every frame. */
+	bool HasChanged();
+
+private:
+	/*! Whether anything happened to the file since the last call. */
+	bool Poll();
+
+	std::filesystem::path m_path;
+	std::chrono::steady_clock::time_point m_last_poll;
+	bool m_pending = false;
+#ifdef __linux__
+	int m_fd = -1;
+	int m_watch = -1;
+#else
+	std::filesystem::file_time_type m_time;
+	std::uintmax_t m_size = 0;
+#endif
+};
@@ -2,12 +2,14 @@
 
 #include <memory>
 #include <chrono>
+#include <cstring>
 
 #include "bvh.hpp"
 #include "window.hpp"
 #include "d3d12_viewer.hpp"
 #include "d3d12_ray_tracer.hpp"
-#include "model.hpp"
+#include "scene_loader.hpp"
+#include "file_watcher.hpp"
 //#include "cpu_ray_tracer.hpp"
 #ifdef ENABLE_IMGUI
 #include "imgui\imgui.h"
@@ -21,6 +23,7 @@ static fm::vec3 rt_camera_pos = { 0, 2, -6 };
 static fm::vec3 rt_sky_color = { 190.f / 255.f, 240.f / 255.f, 1 };
 static fm::vec3 rt_floor_color = { 1, 1, 1 };
 static bool rt_use_cpu = false;
+static bool rt_fast_math = false;
 static float rt_gamma = 2.2f;
 static float rt_exposure = 1.f;
 
@@ -52,8 +55,6 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 	std::chrono::time_point<std::chrono::high_resolution_clock> last_sec;
 	std::chrono::time_point<std::chrono::high_resolution_clock> last_frame;
 
-	std::vector<Vertex> scene_vertices;
-	std::vector<INDICES_TYPE> scene_indices;
 	RTMaterials materials;
 
 	materials.materials[0].color = { 1, 1, 1 };
@@ -66,41 +67,66 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 	materials.materials[2].metal = 0.4;
 	materials.materials[2].specular = 10;
 
-	{ /* LOAD MODEL AND CONVERT TO CRAPPY TRIANGLES*/
-		rlr::Model* model = new rlr::Model();
-		rlr::Load(*model, "scene.fbx");
+	// Loads in the background, the scene is uploaded whenever the loader published a new snapshot.
+	// Re-exporting the file reloads the meshes that changed.
+	SceneLoader scene_loader;
+	FileWatcher scene_watcher("scene.fbx");
+	std::shared_ptr<const SceneSnapshot> scene;
+	scene_loader.Load("scene.fbx", [&materials](std::size_t mesh_idx, rlr::Mesh const&)
+	{
+		return static_cast<int>(mesh_idx % materials.materials.size());
+	});
 
-		int vertex_offset = 0;
-		for (auto m = 0; m < model->meshes.size(); m++)
+#ifdef USE_COMPRESSED_VERTICES
+	RTVertexQuantization quantization = {};
+#endif
+	// `patch` uploads only the vertices that changed since the base snapshot, which has to be the one uploaded last.
+	auto upload_scene = [&](SceneSnapshot const& snapshot, bool patch)
+	{
+		auto& bvh = *snapshot.bvh;
+		if (patch)
 		{
-			for (auto i = 0; i < model->meshes[m].vertices.size(); i++)
+			for (auto const& range : snapshot.changed_vertices)
 			{
-				auto pv = model->meshes[m].vertices[i];
-				Vertex v;
-				v.material_idx = m % 3;
-				v.normal = pv.m_normal;
-				v.position = pv.m_pos;
-				v.uv = pv.m_texCoord;
-
-				scene_vertices.push_back(v);
+				ray_tracer->UpdateVertices(viewer.get(), snapshot.vertices, range.first, range.second - range.first);
 			}
-
-			for (auto i = 0; i < model->meshes[m].indices.size(); i++)
+		}
+		else
+		{
+			ray_tracer->UpdateVertices(viewer.get(), snapshot.vertices, true);
+		}
+		ray_tracer->UpdateIndices(viewer.get(), bvh.big_index_buffer, true);
+#ifdef USE_CLUSTERED_LEAVES
+		ray_tracer->UpdateClusters(viewer.get(), bvh.clusters, bvh.cluster_vertices, bvh.cluster_indices);
+#endif
+#ifdef USE_WOOP_TRIANGLES
+		ray_tracer->UpdateWoopTriangles(viewer.get(), bvh.woop_triangles);
+#endif
+#ifdef USE_COMPRESSED_VERTICES
+		// A patch that moved the scene bounds requantizes every position, so only then everything is uploaded again.
+		// The padding isn't part of the scene and would stretch the bounds to include the origin.
+		auto compressed = CompressVertices(snapshot.vertices.data(), snapshot.num_vertices);
+		if (patch && memcmp(&compressed.quantization, &quantization, sizeof(RTVertexQuantization)) == 0)
+		{
+			for (auto const& range : snapshot.changed_vertices)
 			{
-				scene_indices.push_back((int)model->meshes[m].indices[i] + vertex_offset);
+				ray_tracer->UpdateCompressedVertices(viewer.get(), compressed, range.first, range.second - range.first);
 			}
-			vertex_offset += model->meshes[m].vertices.size();
 		}
-	}
-	scene_vertices.resize(NUM_VERTICES);
-
-	BVH<90/3> bvh;
-	bvh.Construct(scene_vertices, scene_indices);
+		else
+		{
+			ray_tracer->UpdateCompressedVertices(viewer.get(), compressed);
+			quantization = compressed.quantization;
+		}
+#endif
+#ifdef USE_THREADED_BVH
+		ray_tracer->UpdateBVH(viewer.get(), bvh.threaded_node_pool);
+#else
+		ray_tracer->UpdateBVH(viewer.get(), bvh.node_pool);
+#endif
+	};
 
-	ray_tracer->UpdateVertices(viewer.get(), scene_vertices, true);
-	ray_tracer->UpdateIndices(viewer.get(), bvh.big_index_buffer, true);
 	ray_tracer->UpdateMaterials(viewer.get(), materials, materials.materials.size(), true);
-	ray_tracer->UpdateBVH(viewer.get(), bvh.node_pool);
 
 	while (app->IsRunning())
 	{
@@ -126,6 +152,19 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 
 		app->PollEvents();
 
+		if (scene_watcher.HasChanged())
+		{
+			scene_loader.Reload();
+		}
+
+		auto latest_scene = scene_loader.GetSnapshot();
+		if (latest_scene && latest_scene != scene)
+		{
+			const bool patch = scene && latest_scene->base_version == scene->version;
+			scene = latest_scene;
+			upload_scene(*scene, patch);
+		}
+
 		viewer->NewFrame();
 
 		// ImGui
@@ -133,6 +172,10 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 		ImGui::Begin("Raytracer Properties", &imgui_show_properties);
 		ImGui::Text("Framerate: %d", fps);
 		ImGui::Text("CPU Frametime: %f (Mu)", cpu_frame_time);
+		if (scene && !scene->complete)
+		{
+			ImGui::Text("Loading: %d / %d meshes", (int)scene->num_meshes, (int)scene->total_meshes);
+		}
 		viewer->ImGui_RenderSystemInfo();
 		ImGui::Separator();
 		ImGui::PushItemWidth(100);
@@ -141,6 +184,7 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 		ImGui::DragFloat("Viewport Size", &rt_viewport_size, 0.01f, 0);
 		ImGui::DragFloat2("Canvas Size", rt_canvas_size.data);
 		ImGui::Checkbox("Use CPU", &rt_use_cpu);
+		ImGui::Checkbox("Fast Math", &rt_fast_math);
 		ImGui::PopItemWidth();
 		ImGui::Separator();
 		ImGui::DragFloat3("Camera Position", rt_camera_pos.data, 0.1f);
@@ -171,6 +215,7 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int cmd_show)
 		properties.epsilon = rt_epsilon;
 		properties.camera_pos = rt_camera_pos;
 		properties.use_cpu = rt_use_cpu;
+		properties.fast_math = rt_fast_math;
 		properties.sky_color = rt_sky_color;
 		properties.gamma = rt_gamma;
 		properties.exposure = rt_exposure;
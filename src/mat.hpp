@@ -0,0 +1,455 @@
+#pragma once
+
+#include <cmath>
+
+#include "vec.hpp"
+
+/*! Fast Math matrices
+ * Row major 4x4 and 3x4 matrices and a quaternion.
+ * Uses the same conventions as Assimp (`aiMatrix4x4`/`aiQuaternion`) so values can be converted member by member:
+ * `m[row][col]`, column vectors (translation in the last column) and `a * b` applies `b` first.
+ * The SIMD paths perform the same IEEE operations in the same order as the scalar code so the results are identical.
+ */
+namespace fm
+{
+
+	class mat4;
+
+	/*! Quaternion stored as x, y, z, w. Defaults to the identity rotation. */
+	class alignas(16) quat
+	{
+	public:
+		union
+		{
+			float data[4];
+			struct { float x, y, z, w; };
+#if FM_SIMD_AVAILABLE
+			__m128 simd;
+#endif
+		};
+
+		quat() : data{ 0, 0, 0, 1 }
+		{
+		}
+
+		quat(float x, float y, float z, float w) : data{ x, y, z, w }
+		{
+		}
+
+		/*! 4D Dot product, summed as ((x + y) + z) + w. */
+		float Dot(const quat& other) const
+		{
+#if FM_SIMD_AVAILABLE
+			const __m128 products = _mm_mul_ps(simd, other.simd);
+			__m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+			sum = _mm_add_ss(sum, _mm_movehl_ps(products, products));
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(3, 3, 3, 3)));
+			return _mm_cvtss_f32(sum);
+#else
+			return x * other.x + y * other.y + z * other.z + w * other.w;
+#endif
+		}
+
+		/*! Negates all components (same rotation). */
+		quat operator-() const
+		{
+			return quat(-x, -y, -z, -w);
+		}
+
+		/*! Returns a normalized version of itself. */
+		quat Normalized() const
+		{
+			const float l = std::sqrt(Dot(*this));
+			quat retval;
+#if FM_SIMD_AVAILABLE
+			retval.simd = _mm_div_ps(simd, _mm_set1_ps(l));
+#else
+			for (int i = 0; i < 4; i++)
+			{
+				retval.data[i] = data[i] / l;
+			}
+#endif
+			return retval;
+		}
+
+		/*! Returns `a * sa + b * sb` component wise. */
+		static quat Blend(const quat& a, float sa, const quat& b, float sb)
+		{
+			quat retval;
+#if FM_SIMD_AVAILABLE
+			retval.simd = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sa), a.simd), _mm_mul_ps(_mm_set1_ps(sb), b.simd));
+#else
+			for (int i = 0; i < 4; i++)
+			{
+				retval.data[i] = sa * a.data[i] + sb * b.data[i];
+			}
+#endif
+			return retval;
+		}
+
+		/*! Normalized linear interpolation along the shortest path. */
+		static quat Nlerp(const quat& a, const quat& b, float t)
+		{
+			const float sb = a.Dot(b) < 0 ? -t : t;
+			return Blend(a, 1 - t, b, sb).Normalized();
+		}
+
+		/*! Spherical linear interpolation along the shortest path. Matches `aiQuaternion::Interpolate`. */
+		static quat Slerp(const quat& a, const quat& b, float t)
+		{
+			float cosom = a.Dot(b);
+			quat end = b;
+			if (cosom < 0)
+			{
+				cosom = -cosom;
+				end = -end;
+			}
+
+			float sclp, sclq;
+			if ((1 - cosom) > 0.0001f)
+			{
+				const float omega = std::acos(cosom);
+				const float sinom = std::sin(omega);
+				sclp = std::sin((1 - t) * omega) / sinom;
+				sclq = std::sin(t * omega) / sinom;
+			}
+			else
+			{
+				// Very close, do a linear interpolation.
+				sclp = 1 - t;
+				sclq = t;
+			}
+
+			return Blend(a, sclp, end, sclq);
+		}
+	};
+
+	/*! Affine 3x4 matrix. The implicit last row is (0, 0, 0, 1). */
+	class alignas(16) mat3x4
+	{
+	public:
+		union
+		{
+			float m[3][4];
+#if FM_SIMD_AVAILABLE
+			__m128 rows[3];
+#endif
+		};
+
+		/*! Default constructor initializes the matrix to identity */
+		mat3x4() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } }
+		{
+		}
+
+		/*! Drops the last row of a 4x4 matrix. */
+		explicit mat3x4(const mat4& other);
+
+		float* operator[](int row)
+		{
+			return m[row];
+		}
+
+		float const* operator[](int row) const
+		{
+			return m[row];
+		}
+
+		/*! Matrix multiplication. `a * b` applies `b` first. */
+		mat3x4 operator*(const mat3x4& rhs) const
+		{
+			mat3x4 retval;
+#if FM_SIMD_AVAILABLE
+			const __m128 last_row = _mm_setr_ps(0, 0, 0, 1);
+			for (int i = 0; i < 3; i++)
+			{
+				__m128 r = _mm_mul_ps(_mm_set1_ps(m[i][0]), rhs.rows[0]);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][1]), rhs.rows[1]));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][2]), rhs.rows[2]));
+				retval.rows[i] = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][3]), last_row));
+			}
+#else
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					retval.m[i][j] = m[i][0] * rhs.m[0][j] + m[i][1] * rhs.m[1][j] + m[i][2] * rhs.m[2][j] + m[i][3] * (j == 3 ? 1.f : 0.f);
+				}
+			}
+#endif
+			return retval;
+		}
+
+		mat3x4& operator*=(const mat3x4& rhs)
+		{
+			return *this = *this * rhs;
+		}
+
+		/*! Transforms a point (w = 1). */
+		template<bool SIMD>
+		Vec<float, 3, SIMD> TransformPoint(const Vec<float, 3, SIMD>& p) const
+		{
+			return Vec<float, 3, SIMD>(
+				m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+				m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+				m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+		}
+
+		/*! Inverse of an affine matrix. The upper 3x3 doesn't have to be orthonormal. */
+		mat3x4 InverseAffine() const
+		{
+			mat3x4 retval;
+#if FM_SIMD_AVAILABLE
+			// The columns of the inverse are the cross products of the rows divided by the determinant.
+			const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+			const __m128 r0 = _mm_and_ps(rows[0], xyz_mask);
+			const __m128 r1 = _mm_and_ps(rows[1], xyz_mask);
+			const __m128 r2 = _mm_and_ps(rows[2], xyz_mask);
+
+			const auto cross = [](__m128 a, __m128 b)
+			{
+				const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+				const __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+				const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+				const __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+				return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+			};
+
+			__m128 c0 = cross(r1, r2);
+			__m128 c1 = cross(r2, r0);
+			__m128 c2 = cross(r0, r1);
+
+			const __m128 det_products = _mm_mul_ps(r0, c0);
+			__m128 det = _mm_add_ss(det_products, _mm_shuffle_ps(det_products, det_products, _MM_SHUFFLE(1, 1, 1, 1)));
+			det = _mm_add_ss(det, _mm_movehl_ps(det_products, det_products));
+			const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), _mm_shuffle_ps(det, det, 0));
+
+			c0 = _mm_mul_ps(c0, inv_det);
+			c1 = _mm_mul_ps(c1, inv_det);
+			c2 = _mm_mul_ps(c2, inv_det);
+
+			// -(R^-1 * t)
+			__m128 t = _mm_mul_ps(c0, _mm_set1_ps(m[0][3]));
+			t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(m[1][3])));
+			t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(m[2][3])));
+			t = _mm_sub_ps(_mm_setzero_ps(), t);
+
+			_MM_TRANSPOSE4_PS(c0, c1, c2, t);
+			retval.rows[0] = c0;
+			retval.rows[1] = c1;
+			retval.rows[2] = c2;
+#else
+			const float c[3][3] = {
+				{ m[1][1] * m[2][2] - m[1][2] * m[2][1], m[1][2] * m[2][0] - m[1][0] * m[2][2], m[1][0] * m[2][1] - m[1][1] * m[2][0] },
+				{ m[2][1] * m[0][2] - m[2][2] * m[0][1], m[2][2] * m[0][0] - m[2][0] * m[0][2], m[2][0] * m[0][1] - m[2][1] * m[0][0] },
+				{ m[0][1] * m[1][2] - m[0][2] * m[1][1], m[0][2] * m[1][0] - m[0][0] * m[1][2], m[0][0] * m[1][1] - m[0][1] * m[1][0] },
+			};
+			const float det = m[0][0] * c[0][0] + m[0][1] * c[0][1] + m[0][2] * c[0][2];
+			const float inv_det = 1.f / det;
+
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					retval.m[i][j] = c[j][i] * inv_det;
+				}
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				retval.m[i][3] = 0 - (c[0][i] * inv_det * m[0][3] + c[1][i] * inv_det * m[1][3] + c[2][i] * inv_det * m[2][3]);
+			}
+#endif
+			return retval;
+		}
+
+		/*! Composes translation * rotation * scale without multiplying three matrices. */
+		template<bool SIMD>
+		static mat3x4 Compose(const Vec<float, 3, SIMD>& translation, const quat& rotation, const Vec<float, 3, SIMD>& scale)
+		{
+			// Same expressions as `aiQuaternion::GetMatrix`.
+			const quat& q = rotation;
+			const float r[3][3] = {
+				{ 1.f - 2.f * (q.y * q.y + q.z * q.z), 2.f * (q.x * q.y - q.z * q.w), 2.f * (q.x * q.z + q.y * q.w) },
+				{ 2.f * (q.x * q.y + q.z * q.w), 1.f - 2.f * (q.x * q.x + q.z * q.z), 2.f * (q.y * q.z - q.x * q.w) },
+				{ 2.f * (q.x * q.z - q.y * q.w), 2.f * (q.y * q.z + q.x * q.w), 1.f - 2.f * (q.x * q.x + q.y * q.y) },
+			};
+
+			mat3x4 retval;
+#if FM_SIMD_AVAILABLE
+			const __m128 s = _mm_setr_ps(scale[0], scale[1], scale[2], 0);
+			for (int i = 0; i < 3; i++)
+			{
+				retval.rows[i] = _mm_mul_ps(_mm_setr_ps(r[i][0], r[i][1], r[i][2], 0), s);
+				retval.m[i][3] = translation[i];
+			}
+#else
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					retval.m[i][j] = r[i][j] * scale[j];
+				}
+				retval.m[i][3] = translation[i];
+			}
+#endif
+			return retval;
+		}
+	};
+
+	/*! 4x4 matrix. */
+	class alignas(16) mat4
+	{
+	public:
+		union
+		{
+			float m[4][4];
+#if FM_SIMD_AVAILABLE
+			__m128 rows[4];
+#endif
+		};
+
+		/*! Default constructor initializes the matrix to identity */
+		mat4() : m{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } }
+		{
+		}
+
+		/*! Constructs a matrix from 16 row major values. */
+		explicit mat4(float const* values)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				m[i / 4][i % 4] = values[i];
+			}
+		}
+
+		/*! Adds the (0, 0, 0, 1) row to an affine matrix. */
+		explicit mat4(const mat3x4& other)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					m[i][j] = other.m[i][j];
+				}
+			}
+			m[3][0] = 0;
+			m[3][1] = 0;
+			m[3][2] = 0;
+			m[3][3] = 1;
+		}
+
+		float* operator[](int row)
+		{
+			return m[row];
+		}
+
+		float const* operator[](int row) const
+		{
+			return m[row];
+		}
+
+		/*! Matrix multiplication. `a * b` applies `b` first. Sums in the same order as `aiMatrix4x4::operator*=`. */
+		mat4 operator*(const mat4& rhs) const
+		{
+			mat4 retval;
+#if FM_SIMD_AVAILABLE
+			for (int i = 0; i < 4; i++)
+			{
+				__m128 r = _mm_mul_ps(_mm_set1_ps(m[i][0]), rhs.rows[0]);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][1]), rhs.rows[1]));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][2]), rhs.rows[2]));
+				retval.rows[i] = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m[i][3]), rhs.rows[3]));
+			}
+#else
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					retval.m[i][j] = m[i][0] * rhs.m[0][j] + m[i][1] * rhs.m[1][j] + m[i][2] * rhs.m[2][j] + m[i][3] * rhs.m[3][j];
+				}
+			}
+#endif
+			return retval;
+		}
+
+		mat4& operator*=(const mat4& rhs)
+		{
+			return *this = *this * rhs;
+		}
+
+		bool operator==(const mat4& other) const
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					if (m[i][j] != other.m[i][j])
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		bool operator!=(const mat4& other) const
+		{
+			return !(*this == other);
+		}
+
+		/*! Returns the transposed matrix. */
+		mat4 Transposed() const
+		{
+			mat4 retval = *this;
+#if FM_SIMD_AVAILABLE
+			_MM_TRANSPOSE4_PS(retval.rows[0], retval.rows[1], retval.rows[2], retval.rows[3]);
+#else
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					retval.m[i][j] = m[j][i];
+				}
+			}
+#endif
+			return retval;
+		}
+
+		/*! Inverse of an affine matrix. The last row is assumed to be (0, 0, 0, 1). */
+		mat4 InverseAffine() const
+		{
+			return mat4(mat3x4(*this).InverseAffine());
+		}
+
+		/*! Transforms a point (w = 1). The last row is ignored. */
+		template<bool SIMD>
+		Vec<float, 3, SIMD> TransformPoint(const Vec<float, 3, SIMD>& p) const
+		{
+			return mat3x4(*this).TransformPoint(p);
+		}
+
+		/*! Composes translation * rotation * scale without multiplying three matrices. */
+		template<bool SIMD>
+		static mat4 Compose(const Vec<float, 3, SIMD>& translation, const quat& rotation, const Vec<float, 3, SIMD>& scale)
+		{
+			return mat4(mat3x4::Compose(translation, rotation, scale));
+		}
+	};
+
+	inline mat3x4::mat3x4(const mat4& other)
+	{
+#if FM_SIMD_AVAILABLE
+		rows[0] = other.rows[0];
+		rows[1] = other.rows[1];
+		rows[2] = other.rows[2];
+#else
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				m[i][j] = other.m[i][j];
+			}
+		}
+#endif
+	}
+
+} /* fm */
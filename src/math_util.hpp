@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <random>
+#include <algorithm>
 
 #include "vec.hpp"
 
@@ -0,0 +1,279 @@
+#include "mesh_optimizer.hpp"
+
+#include "parallel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+namespace rlr
+{
+
+	namespace
+	{
+
+		constexpr std::uint32_t no_vertex = std::numeric_limits<std::uint32_t>::max();
+
+		bool Near(fm::vec3 const& a, fm::vec3 const& b, float tolerance)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				if (!(std::abs(a[i] - b[i]) <= tolerance))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool CanWeld(Vertex const& a, Vertex const& b, float distance, float tolerance)
+		{
+			const float dx = a.m_pos.x - b.m_pos.x;
+			const float dy = a.m_pos.y - b.m_pos.y;
+			const float dz = a.m_pos.z - b.m_pos.z;
+			if (!(dx * dx + dy * dy + dz * dz <= distance * distance))
+			{
+				return false;
+			}
+			if (!Near(a.m_normal, b.m_normal, tolerance))
+			{
+				return false;
+			}
+			if (!(std::abs(a.m_texCoord.x - b.m_texCoord.x) <= tolerance && std::abs(a.m_texCoord.y - b.m_texCoord.y) <= tolerance))
+			{
+				return false;
+			}
+			for (int i = 0; i < 4; i++)
+			{
+				if (a.id[i] != b.id[i] || a.weight[i] != b.weight[i])
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		std::uint64_t CellKey(std::int64_t x, std::int64_t y, std::int64_t z)
+		{
+			return static_cast<std::uint64_t>(x) * 73856093ull ^ static_cast<std::uint64_t>(y) * 19349663ull ^ static_cast<std::uint64_t>(z) * 83492791ull;
+		}
+
+		// Key of the exact position. Adding 0 turns -0 into 0 so both land in the same cell.
+		std::uint64_t PositionKey(fm::vec3 const& p)
+		{
+			std::uint32_t bits[3];
+			for (int i = 0; i < 3; i++)
+			{
+				const float value = p[i] + 0.f;
+				std::memcpy(&bits[i], &value, sizeof(float));
+			}
+			return CellKey(bits[0], bits[1], bits[2]);
+		}
+
+		// Spreads the low 10 bits of `value` so there are two zero bits between each of them.
+		std::uint32_t Part1By2(std::uint32_t value)
+		{
+			value &= 0x3ff;
+			value = (value | (value << 16)) & 0x030000ff;
+			value = (value | (value << 8)) & 0x0300f00f;
+			value = (value | (value << 4)) & 0x030c30c3;
+			value = (value | (value << 2)) & 0x09249249;
+			return value;
+		}
+
+	} /* anonymous */
+
+	std::size_t WeldVertices(Mesh& mesh, float weld_distance, float weld_tolerance)
+	{
+		auto const& vertices = mesh.vertices;
+		const bool exact = weld_distance <= 0;
+		const float inv_cell_size = exact ? 0 : 1.f / weld_distance;
+
+		// Every cell points at its most recently added vertex, `next_in_cell` links to the previous ones.
+		std::unordered_map<std::uint64_t, std::uint32_t> cells;
+		cells.reserve(vertices.size());
+		std::vector<std::uint32_t> next_in_cell;
+		next_in_cell.reserve(vertices.size());
+
+		std::vector<Vertex> welded;
+		welded.reserve(vertices.size());
+		std::vector<std::uint32_t> remap(vertices.size());
+
+		for (std::size_t i = 0; i < vertices.size(); i++)
+		{
+			Vertex const& v = vertices[i];
+			std::uint32_t match = no_vertex;
+
+			const auto search = [&](std::uint64_t key)
+			{
+				auto it = cells.find(key);
+				for (auto j = it != cells.end() ? it->second : no_vertex; j != no_vertex && match == no_vertex; j = next_in_cell[j])
+				{
+					if (CanWeld(welded[j], v, weld_distance, weld_tolerance))
+					{
+						match = j;
+					}
+				}
+			};
+
+			std::uint64_t key;
+			if (exact)
+			{
+				key = PositionKey(v.m_pos);
+				search(key);
+			}
+			else
+			{
+				const auto cx = static_cast<std::int64_t>(std::floor(v.m_pos.x * inv_cell_size));
+				const auto cy = static_cast<std::int64_t>(std::floor(v.m_pos.y * inv_cell_size));
+				const auto cz = static_cast<std::int64_t>(std::floor(v.m_pos.z * inv_cell_size));
+				key = CellKey(cx, cy, cz);
+				for (int z = -1; z <= 1 && match == no_vertex; z++)
+				{
+					for (int y = -1; y <= 1 && match == no_vertex; y++)
+					{
+						for (int x = -1; x <= 1 && match == no_vertex; x++)
+						{
+							search(CellKey(cx + x, cy + y, cz + z));
+						}
+					}
+				}
+			}
+
+			if (match == no_vertex)
+			{
+				match = static_cast<std::uint32_t>(welded.size());
+				welded.push_back(v);
+				auto it = cells.try_emplace(key, no_vertex).first;
+				next_in_cell.push_back(it->second);
+				it->second = match;
+			}
+			remap[i] = match;
+		}
+
+		const std::size_t removed = vertices.size() - welded.size();
+		mesh.vertices = std::move(welded);
+		mesh.lods.clear();
+
+		// Remap the indices and drop the triangles that collapsed.
+		auto& indices = mesh.indices;
+		std::size_t num_indices = 0;
+		for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const auto a = remap[indices[i]];
+			const auto b = remap[indices[i + 1]];
+			const auto c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c)
+			{
+				continue;
+			}
+			indices[num_indices++] = a;
+			indices[num_indices++] = b;
+			indices[num_indices++] = c;
+		}
+		indices.resize(num_indices);
+
+		return removed;
+	}
+
+	void ReorderTriangles(Mesh& mesh)
+	{
+		auto& indices = mesh.indices;
+		auto const& vertices = mesh.vertices;
+		const std::size_t num_triangles = indices.size() / 3;
+		if (num_triangles < 2)
+		{
+			return;
+		}
+
+		std::vector<fm::vec3> centroids(num_triangles);
+		const float big = std::numeric_limits<float>::max();
+		fm::vec3 min(big, big, big);
+		fm::vec3 max(-big, -big, -big);
+		for (std::size_t i = 0; i < num_triangles; i++)
+		{
+			auto const& a = vertices[indices[i * 3]].m_pos;
+			auto const& b = vertices[indices[i * 3 + 1]].m_pos;
+			auto const& c = vertices[indices[i * 3 + 2]].m_pos;
+			for (int k = 0; k < 3; k++)
+			{
+				centroids[i][k] = (a[k] + b[k] + c[k]) * (1.f / 3.f);
+				min[k] = std::min(min[k], centroids[i][k]);
+				max[k] = std::max(max[k], centroids[i][k]);
+			}
+		}
+
+		fm::vec3 scale;
+		for (int k = 0; k < 3; k++)
+		{
+			const float extent = max[k] - min[k];
+			scale[k] = extent > 0 ? 1023.f / extent : 0.f;
+		}
+
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> keys(num_triangles); // { morton code, triangle }
+		for (std::size_t i = 0; i < num_triangles; i++)
+		{
+			std::uint32_t code = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const auto q = static_cast<std::uint32_t>(std::clamp((centroids[i][k] - min[k]) * scale[k], 0.f, 1023.f));
+				code |= Part1By2(q) << k;
+			}
+			keys[i] = { code, static_cast<std::uint32_t>(i) };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<std::uint32_t> sorted(num_triangles * 3);
+		for (std::size_t i = 0; i < num_triangles; i++)
+		{
+			const std::size_t triangle = keys[i].second;
+			std::copy(indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3, sorted.begin() + i * 3);
+		}
+		indices = std::move(sorted);
+	}
+
+	void ReorderVertices(Mesh& mesh)
+	{
+		std::vector<std::uint32_t> remap(mesh.vertices.size(), no_vertex);
+		std::vector<Vertex> reordered;
+		reordered.reserve(mesh.vertices.size());
+
+		for (auto& index : mesh.indices)
+		{
+			if (remap[index] == no_vertex)
+			{
+				remap[index] = static_cast<std::uint32_t>(reordered.size());
+				reordered.push_back(mesh.vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		mesh.vertices = std::move(reordered);
+		mesh.lods.clear();
+	}
+
+	void OptimizeMesh(Mesh& mesh, MeshOptimizeSettings const& settings)
+	{
+		WeldVertices(mesh, settings.weld_distance, settings.weld_tolerance);
+		if (settings.reorder_triangles)
+		{
+			ReorderTriangles(mesh);
+		}
+		if (settings.reorder_vertices)
+		{
+			ReorderVertices(mesh);
+		}
+	}
+
+	void OptimizeMeshes(std::vector<Mesh>& meshes, MeshOptimizeSettings const& settings)
+	{
+		ParallelFor(meshes.size(), [&](std::size_t i)
+		{
+			OptimizeMesh(meshes[i], settings);
+		});
+	}
+
+} /* rlr */
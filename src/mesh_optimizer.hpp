@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "model.hpp"
+
+namespace rlr
+{
+
+	struct MeshOptimizeSettings
+	{
+		float weld_distance = 0; // Vertices closer than this are merged. 0 only merges exact duplicates.
+		float weld_tolerance = 0; // Largest difference of a normal or uv component for vertices to be merged.
+		bool reorder_triangles = true;
+		bool reorder_vertices = true;
+	};
+
+	/*! Merges duplicate vertices and rewrites the indices. Bone ids and weights have to match exactly.
+	 * Candidates are found with a spatial hash of `weld_distance` sized cells (or the exact position when it is 0),
+	 * so welding is linear in the vertex count. Returns the number of removed vertices.
+	 */
+	std::size_t WeldVertices(Mesh& mesh, float weld_distance = 0, float weld_tolerance = 0);
+
+	/*! Sorts the triangles along a Morton curve through their centroids so neighbouring triangles are close in the index buffer. */
+	void ReorderTriangles(Mesh& mesh);
+
+	/*! Renumbers the vertices in the order the index buffer first uses them and drops unreferenced vertices.
+	 * Run after `ReorderTriangles` so vertex fetches during shading are mostly sequential.
+	 */
+	void ReorderVertices(Mesh& mesh);
+
+	/*! Welds, then reorders triangles and vertices as enabled by `settings`.
+	 * The vertices are renumbered so `mesh.lods` is cleared, generate the levels afterwards.
+	 */
+	void OptimizeMesh(Mesh& mesh, MeshOptimizeSettings const& settings = {});
+
+	/*! `OptimizeMesh` for every mesh. The meshes are optimized in parallel. */
+	void OptimizeMeshes(std::vector<Mesh>& meshes, MeshOptimizeSettings const& settings = {});
+
+} /* rlr */
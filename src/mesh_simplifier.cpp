@@ -0,0 +1,439 @@
+#include "mesh_simplifier.hpp"
+
+#include "parallel.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
+namespace rlr
+{
+
+	namespace
+	{
+
+		constexpr std::uint32_t no_vertex = std::numeric_limits<std::uint32_t>::max();
+
+		// Border planes are weighted up so borders don't shrink.
+		constexpr double border_weight = 10;
+
+		// Symmetric 4x4 matrix (a00 a01 a02 a03 a11 a12 a13 a22 a23 a33) of the summed plane equations.
+		// `weight` is the summed triangle area, the error is divided by it so it is a squared distance.
+		struct Quadric
+		{
+			std::array<double, 10> q = {};
+			double weight = 0;
+
+			void AddPlane(double nx, double ny, double nz, double d, double w)
+			{
+				q[0] += w * nx * nx; q[1] += w * nx * ny; q[2] += w * nx * nz; q[3] += w * nx * d;
+				q[4] += w * ny * ny; q[5] += w * ny * nz; q[6] += w * ny * d;
+				q[7] += w * nz * nz; q[8] += w * nz * d;
+				q[9] += w * d * d;
+			}
+
+			void Add(Quadric const& other)
+			{
+				for (std::size_t i = 0; i < q.size(); i++)
+				{
+					q[i] += other.q[i];
+				}
+				weight += other.weight;
+			}
+
+			double Evaluate(fm::vec3 const& p) const
+			{
+				const double x = p.x, y = p.y, z = p.z;
+				const double r = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+					+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+					+ q[7] * z * z + 2 * q[8] * z
+					+ q[9];
+				return weight > 0 ? std::max(0.0, r) / weight : std::max(0.0, r);
+			}
+		};
+
+		struct Collapse
+		{
+			double cost;
+			std::uint32_t from;
+			std::uint32_t to;
+
+			bool operator<(Collapse const& other) const
+			{
+				return cost < other.cost;
+			}
+		};
+
+		std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+		{
+			return (static_cast<std::uint64_t>(a) << 32) | b;
+		}
+
+		fm::vec3 TriangleNormal(fm::vec3 const& a, fm::vec3 const& b, fm::vec3 const& c)
+		{
+			return fm::vec3(b - a).Cross(c - a);
+		}
+
+		// Every vertex gets the index of the first vertex at the same position.
+		std::vector<std::uint32_t> FindPositionGroups(std::vector<Vertex> const& vertices)
+		{
+			std::size_t table_size = 1;
+			while (table_size < vertices.size() * 2)
+			{
+				table_size *= 2;
+			}
+			std::vector<std::uint32_t> table(table_size, no_vertex);
+
+			std::vector<std::uint32_t> retval(vertices.size());
+			for (std::size_t i = 0; i < vertices.size(); i++)
+			{
+				// Adding 0 turns -0 into 0 so both hash the same.
+				std::uint32_t bits[3];
+				for (int k = 0; k < 3; k++)
+				{
+					const float value = vertices[i].m_pos[k] + 0.f;
+					std::memcpy(&bits[k], &value, sizeof(float));
+				}
+				std::size_t slot = ((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u)) & (table_size - 1);
+				for (;; slot = (slot + 1) & (table_size - 1))
+				{
+					const auto other = table[slot];
+					if (other == no_vertex)
+					{
+						table[slot] = static_cast<std::uint32_t>(i);
+						retval[i] = static_cast<std::uint32_t>(i);
+						break;
+					}
+					auto const& p = vertices[other].m_pos;
+					if (p.x == vertices[i].m_pos.x && p.y == vertices[i].m_pos.y && p.z == vertices[i].m_pos.z)
+					{
+						retval[i] = other;
+						break;
+					}
+				}
+			}
+			return retval;
+		}
+
+	} /* anonymous */
+
+	std::vector<std::uint32_t> SimplifyIndices(std::vector<Vertex> const& vertices, std::vector<std::uint32_t> const& indices,
+		std::size_t target_triangles, float max_error, float attribute_weight, float* error)
+	{
+		const std::size_t num_vertices = vertices.size();
+		std::vector<std::uint32_t> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+		double max_cost = 0;
+
+		const auto position = FindPositionGroups(vertices);
+		std::vector<std::uint32_t> group_size(num_vertices, 0);
+		for (auto p : position)
+		{
+			group_size[p]++;
+		}
+		auto is_seam = [&](std::uint32_t v) { return group_size[position[v]] > 1; };
+
+		// Attribute differences are scaled to the mesh size so the weight doesn't depend on the units.
+		const float big = std::numeric_limits<float>::max();
+		fm::vec3 min(big, big, big);
+		fm::vec3 max(-big, -big, -big);
+		for (auto index : result)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				min[k] = std::min(min[k], vertices[index].m_pos[k]);
+				max[k] = std::max(max[k], vertices[index].m_pos[k]);
+			}
+		}
+		const double extent = result.empty() ? 0.0 : fm::vec3(max - min).Length();
+		const double attribute_scale = (attribute_weight * extent) * (attribute_weight * extent);
+
+		// Directed edges between positions. An edge without its reverse is on the border.
+		std::unordered_set<std::uint64_t> edges;
+		auto build_edges = [&]()
+		{
+			edges.clear();
+			edges.reserve(result.size());
+			for (std::size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					edges.insert(EdgeKey(position[result[i + k]], position[result[i + (k + 1) % 3]]));
+				}
+			}
+		};
+		auto is_border_edge = [&](std::uint32_t a, std::uint32_t b)
+		{
+			return edges.count(EdgeKey(position[a], position[b])) != edges.count(EdgeKey(position[b], position[a]));
+		};
+
+		build_edges();
+		std::vector<std::uint8_t> border(num_vertices, 0);
+		std::vector<Quadric> quadrics(num_vertices);
+		for (std::size_t i = 0; i < result.size(); i += 3)
+		{
+			fm::vec3 normal = TriangleNormal(vertices[result[i]].m_pos, vertices[result[i + 1]].m_pos, vertices[result[i + 2]].m_pos);
+			const double area = normal.Length() * 0.5;
+			if (area <= 0)
+			{
+				continue;
+			}
+			normal = normal / static_cast<float>(area * 2);
+			const fm::vec3 p0 = vertices[result[i]].m_pos;
+			const double d = -normal.Dot(p0);
+
+			for (int k = 0; k < 3; k++)
+			{
+				auto& quadric = quadrics[position[result[i + k]]];
+				quadric.AddPlane(normal.x, normal.y, normal.z, d, area);
+				quadric.weight += area;
+			}
+
+			// A plane through each border edge, perpendicular to the triangle.
+			for (int k = 0; k < 3; k++)
+			{
+				const auto a = result[i + k];
+				const auto b = result[i + (k + 1) % 3];
+				if (!is_border_edge(a, b))
+				{
+					continue;
+				}
+				border[position[a]] = border[position[b]] = 1;
+
+				const fm::vec3 edge = fm::vec3(vertices[b].m_pos) - vertices[a].m_pos;
+				fm::vec3 side = edge.Cross(normal);
+				const float length = side.Length();
+				if (length <= 0)
+				{
+					continue;
+				}
+				side = side / length;
+				const double side_d = -side.Dot(vertices[a].m_pos);
+				const double w = border_weight * edge.Dot(edge);
+				quadrics[position[a]].AddPlane(side.x, side.y, side.z, side_d, w);
+				quadrics[position[b]].AddPlane(side.x, side.y, side.z, side_d, w);
+			}
+		}
+
+		std::vector<std::uint32_t> adjacency_offsets(num_vertices + 1);
+		std::vector<std::uint32_t> adjacency;
+		std::vector<std::uint32_t> remap(num_vertices);
+		std::vector<std::uint8_t> touched(num_vertices);
+		std::vector<Collapse> collapses;
+
+		// Each pass collapses the cheapest edges that don't share a neighbourhood, then rebuilds the index buffer.
+		while (result.size() / 3 > target_triangles)
+		{
+			const std::size_t num_triangles = result.size() / 3;
+
+			std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+			for (auto index : result)
+			{
+				adjacency_offsets[index + 1]++;
+			}
+			for (std::size_t i = 0; i < num_vertices; i++)
+			{
+				adjacency_offsets[i + 1] += adjacency_offsets[i];
+			}
+			adjacency.resize(result.size());
+			{
+				auto fill = adjacency_offsets;
+				for (std::size_t i = 0; i < result.size(); i++)
+				{
+					adjacency[fill[result[i]]++] = static_cast<std::uint32_t>(i / 3);
+				}
+			}
+
+			// Seam vertices are locked. Border vertices may only slide along the border.
+			collapses.clear();
+			for (std::size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int k = 0; k < 6; k++)
+				{
+					// Both directions of the three edges.
+					const int corner = k % 3;
+					const auto from = result[i + corner];
+					const auto to = result[i + (k < 3 ? (corner + 1) % 3 : (corner + 2) % 3)];
+					if (position[from] == position[to] || is_seam(from))
+					{
+						continue;
+					}
+					if (border[position[from]] && !is_border_edge(from, to))
+					{
+						continue;
+					}
+
+					Vertex const& a = vertices[from];
+					Vertex const& b = vertices[to];
+					const fm::vec3 dn = fm::vec3(a.m_normal) - b.m_normal;
+					const float du = a.m_texCoord.x - b.m_texCoord.x;
+					const float dv = a.m_texCoord.y - b.m_texCoord.y;
+					const double cost = quadrics[position[from]].Evaluate(b.m_pos) + attribute_scale * (dn.Dot(dn) + du * du + dv * dv);
+					collapses.push_back({ cost, from, to });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end());
+
+			for (std::size_t i = 0; i < num_vertices; i++)
+			{
+				remap[i] = static_cast<std::uint32_t>(i);
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+
+			const double max_cost_allowed = double(max_error) * max_error;
+			std::size_t removed = 0;
+			bool collapsed = false;
+			for (auto const& collapse : collapses)
+			{
+				if (collapse.cost > max_cost_allowed || num_triangles - removed <= target_triangles)
+				{
+					break;
+				}
+
+				const auto from = collapse.from;
+				const auto to = collapse.to;
+				if (touched[position[from]] || touched[position[to]])
+				{
+					continue;
+				}
+
+				// Reject the collapse if a remaining triangle around `from` would flip or become degenerate.
+				bool flips = false;
+				std::size_t collapsed_triangles = 0;
+				for (auto t = adjacency_offsets[from]; t < adjacency_offsets[from + 1] && !flips; t++)
+				{
+					const auto triangle = adjacency[t] * 3;
+					std::array<fm::vec3, 3> p;
+					bool contains_to = false;
+					for (int k = 0; k < 3; k++)
+					{
+						p[k] = vertices[result[triangle + k]].m_pos;
+						contains_to |= position[result[triangle + k]] == position[to];
+					}
+					if (contains_to)
+					{
+						collapsed_triangles++;
+						continue;
+					}
+
+					const fm::vec3 before = TriangleNormal(p[0], p[1], p[2]);
+					for (int k = 0; k < 3; k++)
+					{
+						if (result[triangle + k] == from)
+						{
+							p[k] = vertices[to].m_pos;
+						}
+					}
+					const fm::vec3 after = TriangleNormal(p[0], p[1], p[2]);
+					flips = before.Dot(after) <= 0;
+				}
+				if (flips)
+				{
+					continue;
+				}
+
+				// Lock the whole neighbourhood, the flip test of a later collapse would look at stale triangles otherwise.
+				for (auto t = adjacency_offsets[from]; t < adjacency_offsets[from + 1]; t++)
+				{
+					const auto triangle = adjacency[t] * 3;
+					for (int k = 0; k < 3; k++)
+					{
+						touched[position[result[triangle + k]]] = 1;
+					}
+				}
+				touched[position[to]] = 1;
+
+				remap[from] = to;
+				quadrics[position[to]].Add(quadrics[position[from]]);
+				max_cost = std::max(max_cost, collapse.cost);
+				removed += collapsed_triangles;
+				collapsed = true;
+			}
+
+			if (!collapsed)
+			{
+				break;
+			}
+
+			std::size_t num_indices = 0;
+			for (std::size_t i = 0; i < result.size(); i += 3)
+			{
+				const auto a = remap[result[i]];
+				const auto b = remap[result[i + 1]];
+				const auto c = remap[result[i + 2]];
+				if (position[a] == position[b] || position[b] == position[c] || position[a] == position[c])
+				{
+					continue;
+				}
+				result[num_indices++] = a;
+				result[num_indices++] = b;
+				result[num_indices++] = c;
+			}
+			result.resize(num_indices);
+
+			build_edges();
+		}
+
+		if (error)
+		{
+			*error = static_cast<float>(std::sqrt(max_cost));
+		}
+		return result;
+	}
+
+	void GenerateLods(Mesh& mesh, LodSettings const& settings)
+	{
+		mesh.lods.clear();
+
+		float error = 0;
+		for (std::size_t level = 0; level < settings.max_levels; level++)
+		{
+			auto const& indices = mesh.lods.empty() ? mesh.indices : mesh.lods.back().indices;
+			const std::size_t num_triangles = indices.size() / 3;
+			const auto target = static_cast<std::size_t>(num_triangles * settings.reduction);
+			if (target < settings.min_triangles)
+			{
+				break;
+			}
+
+			// Each level is simplified from the previous one, so the errors add up.
+			float level_error = 0;
+			auto lod = SimplifyIndices(mesh.vertices, indices, target, settings.max_error - error, settings.attribute_weight, &level_error);
+			if (lod.size() / 3 > num_triangles - num_triangles / 20)
+			{
+				break;
+			}
+
+			error += level_error;
+			mesh.lods.push_back({ std::move(lod), error });
+		}
+	}
+
+	void GenerateLods(std::vector<Mesh>& meshes, LodSettings const& settings)
+	{
+		ParallelFor(meshes.size(), [&](std::size_t i)
+		{
+			GenerateLods(meshes[i], settings);
+		});
+	}
+
+	std::size_t SelectLod(Mesh const& mesh, float distance, float cone_spread, float tolerance)
+	{
+		const float allowed_error = tolerance * distance * cone_spread;
+		for (auto lod = mesh.lods.size(); lod > 0; lod--)
+		{
+			if (mesh.lods[lod - 1].error <= allowed_error)
+			{
+				return lod;
+			}
+		}
+		return 0;
+	}
+
+	std::vector<std::uint32_t> const& GetLodIndices(Mesh const& mesh, std::size_t lod)
+	{
+		return lod == 0 ? mesh.indices : mesh.lods[lod - 1].indices;
+	}
+
+} /* rlr */
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+#include "model.hpp"
+
+namespace rlr
+{
+
+	struct LodSettings
+	{
+		float reduction = 0.5f; // Triangle count of a level relative to the previous one.
+		std::size_t min_triangles = 64; // No level is generated below this.
+		std::size_t max_levels = 8;
+		float max_error = std::numeric_limits<float>::infinity(); // Object space. Levels above this error aren't generated.
+		float attribute_weight = 0.01f; // Cost of a collapse that changes the normal or uv by 1, relative to the mesh size.
+	};
+
+	/*! Quadric error metric simplification (Garland and Heckbert) with half edge collapses.
+	 * Collapsing a vertex onto a neighbour keeps the neighbour's attributes, so the result indexes the original `vertices`.
+	 * Vertices on uv or normal seams (several vertices at one position) are locked, border vertices only move along the border
+	 * and collapses that flip a triangle are rejected. Normal and uv differences are added to the geometric error.
+	 * Stops at `target_triangles` or when the next collapse would exceed `max_error`.
+	 * `error` receives the estimated distance between the result and `indices` in object space.
+	 */
+	std::vector<std::uint32_t> SimplifyIndices(std::vector<Vertex> const& vertices, std::vector<std::uint32_t> const& indices,
+		std::size_t target_triangles, float max_error = std::numeric_limits<float>::infinity(), float attribute_weight = 0.01f, float* error = nullptr);
+
+	/*! Replaces `mesh.lods` with a chain of simplified index buffers. Stops early when a level barely reduces the triangle count. */
+	void GenerateLods(Mesh& mesh, LodSettings const& settings = {});
+
+	/*! `GenerateLods` for every mesh. The meshes are simplified in parallel. */
+	void GenerateLods(std::vector<Mesh>& meshes, LodSettings const& settings = {});
+
+	/*! Coarsest level whose error covers less than `tolerance` ray cone widths at `distance`. 0 is the full detail mesh, `i` is `lods[i - 1]`.
+	 * `cone_spread` is the angle between neighbouring primary rays (viewport size / canvas width / z near for the pinhole camera),
+	 * so a tolerance of 1 is an error below one pixel. Secondary rays can pass their wider ray cone.
+	 */
+	std::size_t SelectLod(Mesh const& mesh, float distance, float cone_spread, float tolerance = 1.f);
+
+	/*! Index buffer of level `lod` as returned by `SelectLod`. */
+	std::vector<std::uint32_t> const& GetLodIndices(Mesh const& mesh, std::size_t lod);
+
+} /* rlr */
@@ -3,54 +3,109 @@
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <string_view>
 #include <sstream>
 #include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include "animation_manager.hpp"
 #include "bone.hpp"
+#include "parallel.hpp"
 
 namespace rlr
 {
 
-	aiNodeAnim* FindAiNodeAnim(Model& model, std::string const& name)
+	// Assimp math types are only used at import. Convert them here.
+	fm::mat4 ToMat4(aiMatrix4x4 const& mat)
 	{
-		for (int i = 0; i < model.ai_nodes_anim.size(); i++)
-		{
-			if (model.ai_nodes_anim.at(i)->mNodeName.data == name)
-			{
-				return model.ai_nodes_anim.at(i);
-			}
-		}
+		return fm::mat4(&mat.a1);
+	}
 
-		return nullptr;
+	fm::vec3 ToVec3(aiVector3D const& v)
+	{
+		return fm::vec3(v.x, v.y, v.z);
 	}
 
-	aiNode* FindAiNode(Model& model, std::string const& name)
+	fm::quat ToQuat(aiQuaternion const& q)
 	{
-		for (int i = 0; i < model.ai_nodes.size(); i++)
+		return fm::quat(q.x, q.y, q.z, q.w);
+	}
+
+	// Copy the keyframes out of the animation node.
+	void ConvertKeyframes(Bone& bone, aiNodeAnim const* anim_node)
+	{
+		if (anim_node == nullptr)
+			return;
+
+		bone.position_times.resize(anim_node->mNumPositionKeys);
+		bone.positions.resize(anim_node->mNumPositionKeys);
+		for (unsigned int i = 0; i < anim_node->mNumPositionKeys; i++)
 		{
-			if (model.ai_nodes.at(i)->mName.data == name)
-				return model.ai_nodes.at(i);
+			bone.position_times[i] = anim_node->mPositionKeys[i].mTime;
+			bone.positions[i] = ToVec3(anim_node->mPositionKeys[i].mValue);
 		}
 
-		return nullptr;
+		bone.rotation_times.resize(anim_node->mNumRotationKeys);
+		bone.rotations.resize(anim_node->mNumRotationKeys);
+		for (unsigned int i = 0; i < anim_node->mNumRotationKeys; i++)
+		{
+			bone.rotation_times[i] = anim_node->mRotationKeys[i].mTime;
+			bone.rotations[i] = ToQuat(anim_node->mRotationKeys[i].mValue);
+		}
 	}
 
-	Bone* FindBone(Model& model, std::string const& name)
+	// Assimp objects referenced during one import. Node `i` is scene graph node `i`.
+	struct ImportNodes
+	{
+		std::vector<aiNode const*> nodes;
+		std::vector<aiNodeAnim const*> nodes_anim;
+	};
+
+	// Name lookups built once per import. The keys point into the aiScene and `Model::bones`, no strings are copied.
+	// Duplicate names resolve to the first occurrence.
+	struct ImportLookup
+	{
+		std::unordered_map<std::string_view, std::int32_t> nodes;
+		std::unordered_map<std::string_view, aiNodeAnim const*> nodes_anim;
+		std::unordered_map<std::string_view, std::size_t> bones;
+	};
+
+	std::string_view ToStringView(aiString const& str)
 	{
-		for (int i = 0; i < model.bones.size(); i++)
+		return std::string_view(str.data, str.length);
+	}
+
+	ImportLookup BuildNodeLookup(ImportNodes const& import)
+	{
+		ImportLookup lookup;
+		lookup.nodes.reserve(import.nodes.size());
+		for (std::size_t i = 0; i < import.nodes.size(); i++)
+		{
+			lookup.nodes.emplace(ToStringView(import.nodes[i]->mName), static_cast<std::int32_t>(i));
+		}
+
+		lookup.nodes_anim.reserve(import.nodes_anim.size());
+		for (auto node_anim : import.nodes_anim)
 		{
-			if (model.bones.at(i).name == name)
-				return &model.bones.at(i);
+			lookup.nodes_anim.emplace(ToStringView(node_anim->mNodeName), node_anim);
 		}
 
-		return nullptr;
+		return lookup;
+	}
+
+	template<typename T>
+	T Find(std::unordered_map<std::string_view, T> const& map, std::string_view name, T fallback)
+	{
+		auto it = map.find(name);
+		return it != map.end() ? it->second : fallback;
 	}
 
 	// Gather animation nodes and store them in a model
-	void GatherAnimationNodes(Model& model, const aiScene *scene)
+	void GatherAnimationNodes(Model& model, const aiScene *scene, ImportNodes& import)
 	{
 		if (scene->mNumAnimations == 0)
 			return;
@@ -64,176 +119,279 @@ namespace rlr
 		}
 
 		for (int i = 0; i < scene->mAnimations[0]->mNumChannels; i++)
-			model.ai_nodes_anim.push_back(scene->mAnimations[0]->mChannels[i]);
+			import.nodes_anim.push_back(scene->mAnimations[0]->mChannels[i]);
 
 	}
 
 	// Gather all bones and convert them to something usable.
-	void GatherBonesAsCustom(Model& model, const aiScene *scene)
+	// `mesh_indices` maps a scene mesh to its offset from `first_mesh` in `model.meshes`, -1 for meshes no node references.
+	void GatherBonesAsCustom(Model& model, const aiScene *scene, ImportNodes const& import, ImportLookup& lookup, std::vector<std::int32_t> const& mesh_indices, std::size_t first_mesh)
 	{
 		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 		{
-			for (unsigned int j = 0; j < scene->mMeshes[i]->mNumBones; j++)
+			if (mesh_indices[i] < 0)
 			{
-				std::string b_name = scene->mMeshes[i]->mBones[j]->mName.data;
-				aiMatrix4x4 b_mat = scene->mMeshes[i]->mBones[j]->mOffsetMatrix.Transpose();
+				continue;
+			}
+			Mesh const* mesh = model.meshes[first_mesh + mesh_indices[i]].get();
 
-				Bone bone(&model.meshes.at(i), i, b_name, b_mat);
-				bone.node = FindAiNode(model, b_name);
-				bone.anim_node = FindAiNodeAnim(model, b_name);
+			for (unsigned int j = 0; j < scene->mMeshes[i]->mNumBones; j++)
+			{
+				aiBone const* ai_bone = scene->mMeshes[i]->mBones[j];
+				const std::string_view b_name = ToStringView(ai_bone->mName);
+				aiMatrix4x4 b_mat = ai_bone->mOffsetMatrix.Transpose();
+
+				Bone bone(mesh, i, std::string(b_name), ToMat4(b_mat));
+				bone.node = Find<std::int32_t>(lookup.nodes, b_name, -1);
+				auto anim_node = Find<aiNodeAnim const*>(lookup.nodes_anim, b_name, nullptr);
+				// A bone without a node of the same name keeps the identity transform and no parent.
+				if (bone.node >= 0)
+				{
+					bone.local_transform = ToMat4(import.nodes[bone.node]->mTransformation);
+				}
+				ConvertKeyframes(bone, anim_node);
 
 				model.bones.push_back(bone);
 
-				if (bone.anim_node == nullptr)
+				if (anim_node == nullptr)
 				{
 					// std::cout << "No Animations were found for " + b_name << std::endl;
 				}
 			}
 		}
 
-		// Now we have all the bones and their nodes we can set the parent.
-		for (int i = 0; i < model.bones.size(); i++)
+		// `model.bones` doesn't grow anymore so the names can be keys.
+		lookup.bones.reserve(model.bones.size());
+		for (std::size_t i = 0; i < model.bones.size(); i++)
 		{
-			std::string b_name = model.bones.at(i).name;
-			aiNode* b_node = FindAiNode(model, b_name);
-			std::string parent_name = b_node->mParent->mName.data;
+			lookup.bones.emplace(model.bones[i].name, i);
+		}
 
-			Bone* p_bone = FindBone(model, parent_name);
+		// Now we have all the bones and their nodes we can set the parent.
+		for (auto& bone : model.bones)
+		{
+			auto parent = bone.node >= 0 ? import.nodes[bone.node]->mParent : nullptr;
+			const auto parent_idx = parent ? Find<std::size_t>(lookup.bones, ToStringView(parent->mName), model.bones.size()) : model.bones.size();
 
-			model.bones.at(i).parent_bone = p_bone;
+			bone.parent_bone = parent_idx < model.bones.size() ? &model.bones[parent_idx] : nullptr;
+			bone.parent_idx = bone.parent_bone ? static_cast<int>(parent_idx) : -1;
 
-			if (p_bone == nullptr)
+			if (bone.parent_bone == nullptr)
 			{
-				// std::cout << "Parent Bone for " << b_name << " does not exist (is nullptr)" << std::endl;
+				// std::cout << "Parent Bone for " << bone.name << " does not exist (is nullptr)" << std::endl;
 			}
 		}
 	}
 
-	Mesh ProcessMesh(Model& model, aiMesh *mesh, const aiScene *scene)
+	// Converts one mesh into `out`. Only touches `out` so meshes can be converted in parallel.
+	void ProcessMesh(aiMesh const* mesh, int id_offset, Mesh& out)
 	{
-		// data to fill
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
+		out.material_idx = mesh->mMaterialIndex;
+
+		auto& vertices = out.vertices;
+		auto& indices = out.indices;
 
 		// Walk through each of the mesh's vertices and set the position, normal, texcorods and etc.
+		vertices.resize(mesh->mNumVertices);
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
-			Vertex vertex;
-			fm::vec3 vector;
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.m_pos = vector;
-			// normals
-			vector.x = mesh->mNormals[i].x;
-			vector.y = mesh->mNormals[i].y;
-			vector.z = mesh->mNormals[i].z;
-			vertex.m_normal = vector;
+			Vertex& vertex = vertices[i];
+			vertex.m_pos = ToVec3(mesh->mVertices[i]);
+			vertex.m_normal = ToVec3(mesh->mNormals[i]);
 			// texture coordinates
 			if (mesh->mTextureCoords[0])
 			{
-				fm::vec2 vec;
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.m_texCoord = vec;
+				vertex.m_texCoord = fm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 			}
 			else
 			{
 				vertex.m_texCoord = fm::vec2(0.0f, 0.0f);
 			}
-
-			// tangent
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].z;
-			vertex.m_tangent = vector;
-			// bitangent
-			vector.x = mesh->mBitangents[i].x;
-			vector.y = mesh->mBitangents[i].y;
-			vector.z = mesh->mBitangents[i].z;
-			vertex.m_bitangent = vector;
-
-			vertices.push_back(vertex);
 		}
 
 		// Find and add all indicies to the mesh's indices vector.
+		std::size_t num_indices = 0;
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			aiFace face = mesh->mFaces[i];
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+			num_indices += mesh->mFaces[i].mNumIndices;
+		}
+		indices.resize(num_indices);
+		auto index = indices.begin();
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			aiFace const& face = mesh->mFaces[i];
+			index = std::copy(face.mIndices, face.mIndices + face.mNumIndices, index);
 		}
 
-		std::vector<float> bone_weights;
-		bone_weights.resize(mesh->mNumVertices * WEIGHTS_PER_VERTEX);
-
-		for (auto i = 0; i < bone_weights.size(); i++)
-			bone_weights[i] = 0;
-
-		// Go through all the bones and set the correct weight and id.
-		for (int i = 0; i < mesh->mNumBones; i++)
+		// Go through all the bones and set the weight and id in the first free slot.
+		for (unsigned int i = 0; i < mesh->mNumBones; i++)
 		{
-			aiBone* ai_bone = mesh->mBones[i];
-			for (int j = 0; j < ai_bone->mNumWeights; j++)
+			aiBone const* ai_bone = mesh->mBones[i];
+			for (unsigned int j = 0; j < ai_bone->mNumWeights; j++)
 			{
-				aiVertexWeight weight = ai_bone->mWeights[j];
-				unsigned int vertexStart = weight.mVertexId * WEIGHTS_PER_VERTEX;
+				aiVertexWeight const& weight = ai_bone->mWeights[j];
+				Vertex& vertex = vertices.at(weight.mVertexId);
 				for (int k = 0; k < WEIGHTS_PER_VERTEX; k++)
 				{
-					if (bone_weights.at(vertexStart + k) == 0)
+					if (vertex.weight[k] == 0)
 					{
-						bone_weights.at(vertexStart + k) = weight.mWeight;
-						vertices.at(weight.mVertexId).id[k] = i + model.id_offset;
-						vertices.at(weight.mVertexId).weight[k] = weight.mWeight;
+						vertex.id[k] = i + id_offset;
+						vertex.weight[k] = weight.mWeight;
 						break;
 					}
 				}
 			}
 		}
-
-		model.id_offset = mesh->mNumBones;
-
-		// return a mesh object created from the extracted mesh data
-		return Mesh{ vertices, indices /*, textures*/ };
 	}
 
-	void ProcessNode(Model& model, aiNode* node, const aiScene* scene)
+	struct MeshWorkItem
+	{
+		aiMesh const* mesh;
+		int id_offset;
+	};
+
+	// Builds the scene graph and collects every referenced mesh once, in the order of its first reference.
+	// The conversion happens in `ProcessMeshes`.
+	void ProcessNode(Model& model, aiNode const* node, std::int32_t parent, const aiScene* scene, ImportNodes& import, std::vector<std::int32_t>& mesh_indices, std::vector<MeshWorkItem>& work)
 	{
-		model.ai_nodes.push_back(node);
+		import.nodes.push_back(node);
+		const auto node_idx = model.scene_graph.AddNode(parent, ToMat4(node->mTransformation));
 
-		// process all the node's meshes (if any)
 		for (unsigned int i = 0; i < node->mNumMeshes; i++)
 		{
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			model.meshes.push_back(ProcessMesh(model, mesh, scene));
+			const auto scene_mesh_idx = node->mMeshes[i];
+			aiMesh const* mesh = scene->mMeshes[scene_mesh_idx];
+			if (mesh_indices[scene_mesh_idx] < 0)
+			{
+				mesh_indices[scene_mesh_idx] = static_cast<std::int32_t>(work.size());
+				work.push_back({ mesh, model.id_offset });
+			}
+			model.id_offset = mesh->mNumBones;
+			model.scene_graph.AddInstance(node_idx, static_cast<std::uint32_t>(model.meshes.size() + mesh_indices[scene_mesh_idx]));
 		}
 		// then do the same for each of its children
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			ProcessNode(model, node->mChildren[i], scene);
+			ProcessNode(model, node->mChildren[i], node_idx, scene, import, mesh_indices, work);
+		}
+	}
+
+	// Converts the meshes in parallel. The largest meshes are started first so the import takes about as long as the largest mesh.
+	void ProcessMeshes(Model& model, std::vector<MeshWorkItem> const& work)
+	{
+		std::vector<Mesh> meshes(work.size());
+
+		std::vector<std::size_t> order(work.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&work](std::size_t a, std::size_t b)
+		{
+			return work[a].mesh->mNumVertices + work[a].mesh->mNumFaces > work[b].mesh->mNumVertices + work[b].mesh->mNumFaces;
+		});
+
+		ParallelFor(order.size(), [&](std::size_t i)
+		{
+			auto const& item = work[order[i]];
+			ProcessMesh(item.mesh, item.id_offset, meshes[order[i]]);
+		});
+
+		for (auto& mesh : meshes)
+		{
+			model.meshes.push_back(std::make_shared<const Mesh>(std::move(mesh)));
 		}
 	}
 
 	void Load(Model& model, std::string const& path)
 	{
-		const aiScene *scene = model.importer.ReadFile(path, aiProcess_GenSmoothNormals | aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+		// Everything is converted before `importer` goes out of scope and frees the aiScene.
+		Assimp::Importer importer;
+		const aiScene *scene = importer.ReadFile(path, aiProcess_GenSmoothNormals | aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
-			std::cout << "ERROR::ASSIMP::" << model.importer.GetErrorString() << std::endl;
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
 			return;
 		}
 		model.directory = path.substr(0, path.find_last_of('/'));
 
-		GatherAnimationNodes(model, scene);
-		model.global_invere_transform = scene->mRootNode->mTransformation.Inverse();
+		ImportNodes import;
+		GatherAnimationNodes(model, scene, import);
+		model.global_invere_transform = ToMat4(scene->mRootNode->mTransformation.Inverse());
 
-		ProcessNode(model, scene->mRootNode, scene);
+		const auto first_mesh = model.meshes.size();
+		std::vector<std::int32_t> mesh_indices(scene->mNumMeshes, -1);
+		std::vector<MeshWorkItem> work;
+		ProcessNode(model, scene->mRootNode, -1, scene, import, mesh_indices, work);
+		ProcessMeshes(model, work);
 
-		GatherBonesAsCustom(model, scene);
+		auto lookup = BuildNodeLookup(import);
+		GatherBonesAsCustom(model, scene, import, lookup, mesh_indices, first_mesh);
 
 		if (model.meshes.size() > 0)
-			model.meshes[0].skeleton.Init(model.bones, model.global_invere_transform);
+			model.skeleton.Init(model.bones, model.global_invere_transform);
+	}
+
+	namespace
+	{
+
+		/*! Word at a time hash with a multiply and rotate per word, the final mix is SplitMix64's. */
+		class MeshHasher
+		{
+		public:
+			void Add(std::uint64_t word)
+			{
+				m_state = (m_state ^ word) * 0x9E3779B97F4A7C15ull;
+				m_state = (m_state << 31) | (m_state >> 33);
+			}
+
+			void Add(float a, float b)
+			{
+				std::uint32_t bits[2];
+				std::memcpy(&bits[0], &a, sizeof(float));
+				std::memcpy(&bits[1], &b, sizeof(float));
+				Add((std::uint64_t(bits[1]) << 32) | bits[0]);
+			}
+
+			std::uint64_t Finish() const
+			{
+				std::uint64_t z = m_state;
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				return z ^ (z >> 31);
+			}
+
+		private:
+			std::uint64_t m_state = 0x243F6A8885A308D3ull;
+		};
+
+	} /* anonymous */
+
+	std::uint64_t HashMesh(Mesh const& mesh)
+	{
+		// Members are hashed one by one, the vector types can have padding.
+		MeshHasher hasher;
+		hasher.Add(mesh.vertices.size());
+		for (auto const& v : mesh.vertices)
+		{
+			hasher.Add(v.m_pos[0], v.m_pos[1]);
+			hasher.Add(v.m_pos[2], v.m_normal[0]);
+			hasher.Add(v.m_normal[1], v.m_normal[2]);
+			hasher.Add(v.m_texCoord[0], v.m_texCoord[1]);
+			hasher.Add(v.weight[0], v.weight[1]);
+			hasher.Add(v.weight[2], v.weight[3]);
+			hasher.Add((std::uint64_t(v.id[1]) << 32) | v.id[0]);
+			hasher.Add((std::uint64_t(v.id[3]) << 32) | v.id[2]);
+		}
+		hasher.Add(mesh.indices.size());
+		for (std::size_t i = 0; i + 1 < mesh.indices.size(); i += 2)
+		{
+			hasher.Add((std::uint64_t(mesh.indices[i + 1]) << 32) | mesh.indices[i]);
+		}
+		if (mesh.indices.size() % 2 != 0)
+		{
+			hasher.Add(mesh.indices.back());
+		}
+		hasher.Add(mesh.material_idx);
+		return hasher.Finish();
 	}
 
 	Model::Model()
@@ -248,14 +406,26 @@ namespace rlr
 
 	Model::Model(const Model& rhs)
 	{
-		this->ai_nodes = rhs.ai_nodes;
-		this->ai_nodes_anim = rhs.ai_nodes_anim;
+		*this = rhs;
+	}
+
+	Model& Model::operator=(const Model& rhs)
+	{
 		this->animations = rhs.animations;
 		this->bones = rhs.bones;
 		this->directory = rhs.directory;
 		this->global_invere_transform = rhs.global_invere_transform;
 		this->id_offset = rhs.id_offset;
-		this->meshes = rhs.meshes;
+		this->meshes = rhs.meshes; // Shares the meshes.
+		this->scene_graph = rhs.scene_graph;
+		this->skeleton = rhs.skeleton;
+
+		// Point the parents at our own copy of the bones.
+		for (auto& bone : bones)
+		{
+			bone.parent_bone = bone.parent_idx >= 0 ? &bones[bone.parent_idx] : nullptr;
+		}
+		return *this;
 	}
 
 } /* rlr */
@@ -3,56 +3,75 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <assimp/Importer.hpp>
+#include <memory>
+#include <cstdint>
 
 #include "vec.hpp"
+#include "mat.hpp"
 #include "bone.hpp"
 #include "skeleton.hpp"
+#include "scene_graph.hpp"
 
 namespace rlr
 {
 
+	/*! Only what the tracer and the skinning use. Tangents aren't imported, nothing reads them. */
 	struct Vertex
 	{
 		fm::vec3 m_pos;
 		fm::vec3 m_normal;
 		fm::vec2 m_texCoord;
-		fm::vec3 m_tangent;
-		fm::vec3 m_bitangent;
 		float weight[4] = { 0, 0, 0, 0 };
 		uint32_t id[4] = { 0, 0, 0, 0 };
 	};
 
 	struct Animation;
 
+	/*! Simplified version of a mesh. Shares the vertices of the full detail mesh. */
+	struct MeshLod
+	{
+		std::vector<uint32_t> indices;
+		float error; // Largest distance between this level and the full detail surface, in object space.
+	};
+
 	static int WEIGHTS_PER_VERTEX = 4;
 
 	struct Mesh
 	{
 		std::vector<Vertex> vertices;
 		std::vector<uint32_t> indices;
-
-		Skeleton skeleton;
+		unsigned int material_idx = 0; // Index into the imported scene's materials.
+		std::vector<MeshLod> lods; // Coarser with every level, see `GenerateLods`.
 	};
 
+	/*! Everything the runtime needs from an imported scene. `Load` converts the Assimp scene into it and frees the importer.
+	 * The meshes are immutable and shared between copies of a model, so copying a model doesn't copy its geometry.
+	 * To change a mesh, replace its pointer with a modified copy.
+	 */
 	struct Model
 	{
 		Model();
 		~Model();
 		Model(const Model& rhs);
+		Model& operator=(const Model& rhs);
 
 		int id_offset = 0;
 
-		std::vector<Mesh> meshes;
+		std::vector<std::shared_ptr<const Mesh>> meshes; // Each mesh is stored once, `scene_graph` places it as often as the scene references it.
+		SceneGraph scene_graph;
+		Skeleton skeleton;
 		std::vector<Bone> bones;
 		std::vector<Animation*> animations;
-		aiMatrix4x4 global_invere_transform;
-		std::vector<aiNode*> ai_nodes;
-		std::vector<aiNodeAnim*> ai_nodes_anim;
+		fm::mat4 global_invere_transform;
 		std::string directory;
-		Assimp::Importer importer;
 	};
 
+	/*! Imports `path` with Assimp. The importer only lives for the duration of the call. */
 	void Load(Model& model, std::string const & path);
 
+	/*! 64 bit hash of everything `Load` imports for a mesh (vertex attributes, bone weights, indices and material).
+	 * Used to find the meshes that changed between two imports of the same file, LODs are not included.
+	 */
+	std::uint64_t HashMesh(Mesh const& mesh);
+
 } /* rlr */
@@ -0,0 +1,475 @@
+#include "obj_loader.hpp"
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rlr
+{
+
+	namespace
+	{
+
+		constexpr std::size_t min_chunk_size = 1 << 16; // Smaller files aren't worth a thread.
+
+		/*! Read only mapping of a whole file. */
+		class MappedFile
+		{
+		public:
+			explicit MappedFile(std::string const& path)
+			{
+#ifdef _WIN32
+				m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+				if (m_file == INVALID_HANDLE_VALUE)
+				{
+					throw std::runtime_error("Failed to open " + path);
+				}
+
+				LARGE_INTEGER size;
+				GetFileSizeEx(m_file, &size);
+				m_size = static_cast<std::size_t>(size.QuadPart);
+				if (m_size == 0)
+				{
+					return;
+				}
+
+				m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				m_data = m_mapping ? static_cast<char const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+				if (!m_data)
+				{
+					Close();
+					throw std::runtime_error("Failed to map " + path);
+				}
+#else
+				m_file = open(path.c_str(), O_RDONLY);
+				if (m_file < 0)
+				{
+					throw std::runtime_error("Failed to open " + path);
+				}
+
+				struct stat info;
+				fstat(m_file, &info);
+				m_size = static_cast<std::size_t>(info.st_size);
+				if (m_size == 0)
+				{
+					return;
+				}
+
+				void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+				if (data == MAP_FAILED)
+				{
+					Close();
+					throw std::runtime_error("Failed to map " + path);
+				}
+				m_data = static_cast<char const*>(data);
+				madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+			}
+
+			~MappedFile()
+			{
+				Close();
+			}
+
+			MappedFile(MappedFile const&) = delete;
+			MappedFile& operator=(MappedFile const&) = delete;
+
+			char const* Data() const
+			{
+				return m_data;
+			}
+
+			std::size_t Size() const
+			{
+				return m_data ? m_size : 0;
+			}
+
+		private:
+			void Close()
+			{
+#ifdef _WIN32
+				if (m_data) UnmapViewOfFile(m_data);
+				if (m_mapping) CloseHandle(m_mapping);
+				if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+				m_mapping = nullptr;
+				m_file = INVALID_HANDLE_VALUE;
+#else
+				if (m_data) munmap(const_cast<char*>(m_data), m_size);
+				if (m_file >= 0) close(m_file);
+				m_file = -1;
+#endif
+				m_data = nullptr;
+			}
+
+			char const* m_data = nullptr;
+			std::size_t m_size = 0;
+#ifdef _WIN32
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+			HANDLE m_mapping = nullptr;
+#else
+			int m_file = -1;
+#endif
+		};
+
+		/*! Face corner. 0 based indices, -1 when the attribute is missing. */
+		struct Corner
+		{
+			std::int32_t v;
+			std::int32_t vt;
+			std::int32_t vn;
+
+			bool operator==(Corner const& other) const
+			{
+				return v == other.v && vt == other.vt && vn == other.vn;
+			}
+		};
+
+		/*! Result of parsing one chunk. Positive OBJ indices are already absolute,
+		 * negative (relative) ones are relative to the chunk and listed in `relative` until the chunk offsets are known.
+		 */
+		struct Chunk
+		{
+			std::vector<fm::pvec3> positions;
+			std::vector<fm::vec2> uvs;
+			std::vector<fm::pvec3> normals;
+			std::vector<Corner> corners; // 3 per triangle.
+			std::vector<std::pair<std::uint32_t, std::uint8_t>> relative; // Corner and attribute (0 v, 1 vt, 2 vn).
+		};
+
+		[[noreturn]] void ThrowMalformed()
+		{
+			throw std::runtime_error("Malformed OBJ file");
+		}
+
+		inline void SkipSpaces(char const*& p, char const* end)
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			{
+				p++;
+			}
+		}
+
+		inline float ParseFloat(char const*& p, char const* end)
+		{
+			SkipSpaces(p, end);
+			if (p < end && *p == '+')
+			{
+				p++;
+			}
+
+			float value;
+			const auto result = std::from_chars(p, end, value);
+			if (result.ec != std::errc())
+			{
+				ThrowMalformed();
+			}
+			p = result.ptr;
+			return value;
+		}
+
+		/*! Parses one `v/vt/vn` corner. Returns false at the end of the line. */
+		inline bool ParseCorner(char const*& p, char const* end, Chunk& chunk, std::int32_t (&corner)[3], bool (&relative)[3])
+		{
+			SkipSpaces(p, end);
+			if (p == end)
+			{
+				return false;
+			}
+
+			const std::int32_t counts[3] = {
+				static_cast<std::int32_t>(chunk.positions.size()),
+				static_cast<std::int32_t>(chunk.uvs.size()),
+				static_cast<std::int32_t>(chunk.normals.size())
+			};
+
+			for (int i = 0; i < 3; i++)
+			{
+				corner[i] = -1;
+				relative[i] = false;
+
+				if (i > 0)
+				{
+					if (p == end || *p != '/')
+					{
+						continue;
+					}
+					p++;
+					if (p < end && *p == '/') // `v//vn`
+					{
+						continue;
+					}
+				}
+
+				std::int32_t value;
+				const auto result = std::from_chars(p, end, value);
+				if (result.ec != std::errc() || value == 0)
+				{
+					if (i > 0 && result.ec != std::errc())
+					{
+						continue; // `v/` with a missing index.
+					}
+					ThrowMalformed();
+				}
+				p = result.ptr;
+
+				if (value > 0)
+				{
+					corner[i] = value - 1;
+				}
+				else
+				{
+					corner[i] = counts[i] + value;
+					relative[i] = true;
+				}
+			}
+
+			return true;
+		}
+
+		void ParseFace(char const* p, char const* end, Chunk& chunk)
+		{
+			std::int32_t first[3] = {}, previous[3] = {}, current[3] = {};
+			bool first_relative[3] = {}, previous_relative[3] = {}, current_relative[3] = {};
+
+			int count = 0;
+			while (ParseCorner(p, end, chunk, current, current_relative))
+			{
+				if (count == 0)
+				{
+					std::copy(current, current + 3, first);
+					std::copy(current_relative, current_relative + 3, first_relative);
+				}
+				else if (count >= 2)
+				{
+					// Fan triangulation.
+					auto add = [&chunk](std::int32_t const (&c)[3], bool const (&rel)[3])
+					{
+						const auto idx = static_cast<std::uint32_t>(chunk.corners.size());
+						chunk.corners.push_back({ c[0], c[1], c[2] });
+						for (std::uint8_t k = 0; k < 3; k++)
+						{
+							if (rel[k])
+							{
+								chunk.relative.emplace_back(idx, k);
+							}
+						}
+					};
+					add(first, first_relative);
+					add(previous, previous_relative);
+					add(current, current_relative);
+				}
+
+				std::copy(current, current + 3, previous);
+				std::copy(current_relative, current_relative + 3, previous_relative);
+				count++;
+			}
+
+			if (count < 3)
+			{
+				ThrowMalformed();
+			}
+		}
+
+		void ParseChunk(char const* begin, char const* end, Chunk& chunk)
+		{
+			char const* p = begin;
+			while (p < end)
+			{
+				auto line_end = static_cast<char const*>(std::memchr(p, '\n', end - p));
+				if (!line_end)
+				{
+					line_end = end;
+				}
+
+				SkipSpaces(p, line_end);
+				if (line_end - p >= 2)
+				{
+					if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+					{
+						p += 2;
+						const float x = ParseFloat(p, line_end);
+						const float y = ParseFloat(p, line_end);
+						const float z = ParseFloat(p, line_end);
+						chunk.positions.emplace_back(x, y, z);
+					}
+					else if (p[0] == 'v' && p[1] == 't')
+					{
+						p += 2;
+						const float u = ParseFloat(p, line_end);
+						SkipSpaces(p, line_end);
+						const float v = p < line_end ? ParseFloat(p, line_end) : 0.f;
+						chunk.uvs.emplace_back(u, 1.f - v); // Flipped like `aiProcess_FlipUVs`.
+					}
+					else if (p[0] == 'v' && p[1] == 'n')
+					{
+						p += 2;
+						const float x = ParseFloat(p, line_end);
+						const float y = ParseFloat(p, line_end);
+						const float z = ParseFloat(p, line_end);
+						chunk.normals.emplace_back(x, y, z);
+					}
+					else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+					{
+						ParseFace(p + 2, line_end, chunk);
+					}
+				}
+
+				p = line_end + 1;
+			}
+		}
+
+		inline std::uint32_t HashCorner(Corner const& c)
+		{
+			std::uint32_t h = static_cast<std::uint32_t>(c.v) * 0x9e3779b1u;
+			h ^= static_cast<std::uint32_t>(c.vt) * 0x85ebca77u;
+			h ^= static_cast<std::uint32_t>(c.vn) * 0xc2b2ae3du;
+			return h ^ (h >> 15);
+		}
+
+	} /* anonymous */
+
+	ObjMesh LoadObj(std::string const& path, unsigned int num_threads)
+	{
+		MappedFile file(path);
+		char const* data = file.Data();
+		const std::size_t size = file.Size();
+
+		if (num_threads == 0)
+		{
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		const std::size_t num_chunks = std::max<std::size_t>(1, std::min<std::size_t>(num_threads, size / min_chunk_size));
+
+		// Split on line boundaries.
+		std::vector<char const*> bounds = { data };
+		for (std::size_t i = 1; i < num_chunks; i++)
+		{
+			char const* p = std::max(bounds.back(), data + size * i / num_chunks);
+			auto line_end = static_cast<char const*>(std::memchr(p, '\n', data + size - p));
+			bounds.push_back(line_end ? line_end + 1 : data + size);
+		}
+		bounds.push_back(data + size);
+
+		// Parse errors are rethrown here.
+		std::vector<Chunk> chunks(num_chunks);
+		ParallelFor(num_chunks, [&](std::size_t i)
+		{
+			ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+		}, num_threads);
+
+		// Merge the chunks.
+		std::vector<fm::pvec3> positions;
+		std::vector<fm::vec2> uvs;
+		std::vector<fm::pvec3> normals;
+		std::vector<Corner> corners;
+		for (auto& chunk : chunks)
+		{
+			const std::int32_t offsets[3] = {
+				static_cast<std::int32_t>(positions.size()),
+				static_cast<std::int32_t>(uvs.size()),
+				static_cast<std::int32_t>(normals.size())
+			};
+			for (auto const& rel : chunk.relative)
+			{
+				auto& corner = chunk.corners[rel.first];
+				(rel.second == 0 ? corner.v : rel.second == 1 ? corner.vt : corner.vn) += offsets[rel.second];
+			}
+
+			positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+			uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+			normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+			corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+			chunk = Chunk();
+		}
+
+		bool missing_normals = false;
+		for (auto const& c : corners)
+		{
+			if (c.v < 0 || c.v >= static_cast<std::int32_t>(positions.size())
+				|| c.vt < -1 || c.vt >= static_cast<std::int32_t>(uvs.size())
+				|| c.vn < -1 || c.vn >= static_cast<std::int32_t>(normals.size()))
+			{
+				throw std::runtime_error("OBJ face index out of range");
+			}
+			missing_normals |= c.vn == -1;
+		}
+
+		// Smooth normals for corners without one.
+		std::vector<fm::pvec3> smooth_normals;
+		if (missing_normals)
+		{
+			smooth_normals.assign(positions.size(), fm::pvec3(0, 0, 0));
+			for (std::size_t i = 0; i + 2 < corners.size(); i += 3)
+			{
+				const fm::pvec3 a = positions[corners[i].v];
+				const fm::pvec3 b = positions[corners[i + 1].v];
+				const fm::pvec3 c = positions[corners[i + 2].v];
+				const fm::pvec3 n = (b - a).Cross(c - a); // Area weighted.
+				for (std::size_t k = 0; k < 3; k++)
+				{
+					smooth_normals[corners[i + k].v] = smooth_normals[corners[i + k].v] + n;
+				}
+			}
+			for (auto& n : smooth_normals)
+			{
+				const float length = n.Length();
+				n = length > 0 ? n / length : fm::pvec3(0, 0, 1);
+			}
+		}
+
+		// Merge identical corners with an open addressing hash table. Slots store the vertex index + 1.
+		ObjMesh mesh;
+		mesh.indices.reserve(corners.size());
+
+		std::size_t capacity = 16;
+		while (capacity < corners.size() * 2)
+		{
+			capacity *= 2;
+		}
+		std::vector<std::uint32_t> slots(capacity, 0);
+		std::vector<Corner> unique;
+
+		for (auto const& c : corners)
+		{
+			std::size_t slot = HashCorner(c) & (capacity - 1);
+			while (slots[slot] != 0 && !(unique[slots[slot] - 1] == c))
+			{
+				slot = (slot + 1) & (capacity - 1);
+			}
+
+			if (slots[slot] == 0)
+			{
+				unique.push_back(c);
+				slots[slot] = static_cast<std::uint32_t>(unique.size());
+
+				::Vertex vertex = {};
+				vertex.position = positions[c.v];
+				vertex.normal = c.vn >= 0 ? normals[c.vn] : smooth_normals[c.v];
+				vertex.uv = c.vt >= 0 ? uvs[c.vt] : fm::vec2(0, 0);
+				vertex.material_idx = 0;
+				mesh.vertices.push_back(vertex);
+			}
+
+			mesh.indices.push_back(slots[slot] - 1);
+		}
+
+		return mesh;
+	}
+
+} /* rlr */
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "../raytracer.hlsl"
+
+namespace rlr
+{
+
+	/*! Triangle mesh in the tracer's vertex format. */
+	struct ObjMesh
+	{
+		std::vector<::Vertex> vertices;
+		std::vector<std::uint32_t> indices;
+	};
+
+	/*! Loads a Wavefront OBJ file without Assimp.
+	 * The file is memory mapped, split into chunks on line boundaries and the chunks are parsed in parallel.
+	 * Polygons are triangulated as fans and identical position/uv/normal triplets are merged into one vertex.
+	 * Missing normals are generated by averaging the face normals around a position and uvs are flipped,
+	 * which matches what `Load` gets from Assimp. Materials, groups and smoothing groups are ignored.
+	 * `num_threads` 0 uses the hardware concurrency.
+	 * Throws `std::runtime_error` if the file can't be read or is malformed.
+	 */
+	ObjMesh LoadObj(std::string const& path, unsigned int num_threads = 0);
+
+} /* rlr */
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "vec.hpp"
+
+/*! Fast Math packing
+ * Conversions between floats and the compact formats used by GPU buffers.
+ * The unpack functions match the HLSL decoders (`f16tof32`, `DecodeOctahedral`) so CPU and GPU see the same values.
+ */
+namespace fm
+{
+
+	/*! Float to IEEE 754 half. Rounds to nearest even, overflows to infinity and keeps subnormals. */
+	inline std::uint16_t FloatToHalf(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(float));
+
+		const std::uint32_t sign = (bits >> 16) & 0x8000u;
+		const std::uint32_t abs = bits & 0x7fffffffu;
+
+		if (abs >= 0x7f800000u) // Inf or NaN.
+		{
+			return static_cast<std::uint16_t>(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+		}
+		if (abs >= 0x477ff000u) // Rounds to a value larger than the largest half.
+		{
+			return static_cast<std::uint16_t>(sign | 0x7c00u);
+		}
+		if (abs < 0x38800000u) // Subnormal half or zero.
+		{
+			if (abs < 0x33000000u)
+			{
+				return static_cast<std::uint16_t>(sign);
+			}
+			const std::uint32_t exponent = abs >> 23;
+			const std::uint32_t mantissa = (abs & 0x007fffffu) | 0x00800000u;
+			const std::uint32_t shift = 126 - exponent; // 14 + 112 - exponent
+			const std::uint32_t half = mantissa >> shift;
+			const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+			const std::uint32_t midway = 1u << (shift - 1);
+			const std::uint32_t rounded = half + ((rest > midway || (rest == midway && (half & 1))) ? 1 : 0);
+			return static_cast<std::uint16_t>(sign | rounded);
+		}
+
+		const std::uint32_t rebased = abs - 0x38000000u; // Exponent bias 127 to 15.
+		const std::uint32_t rounded = rebased + 0x0fffu + ((rebased >> 13) & 1);
+		return static_cast<std::uint16_t>(sign | (rounded >> 13));
+	}
+
+	/*! IEEE 754 half to float. Exact. */
+	inline float HalfToFloat(std::uint16_t value)
+	{
+		const std::uint32_t sign = (value & 0x8000u) << 16;
+		const std::uint32_t exponent = (value >> 10) & 0x1f;
+		const std::uint32_t mantissa = value & 0x3ffu;
+
+		std::uint32_t bits;
+		if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000u | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else if (mantissa != 0)
+		{
+			const float retval = static_cast<float>(mantissa) * (1.f / 16777216.f); // mantissa * 2^-24
+			return sign ? -retval : retval;
+		}
+		else
+		{
+			bits = sign;
+		}
+
+		float retval;
+		std::memcpy(&retval, &bits, sizeof(float));
+		return retval;
+	}
+
+	/*! Two halfs in one uint. `x` is in the low bits like HLSL's `f16tof32(packed)`. */
+	inline std::uint32_t PackHalf2(float x, float y)
+	{
+		return static_cast<std::uint32_t>(FloatToHalf(x)) | (static_cast<std::uint32_t>(FloatToHalf(y)) << 16);
+	}
+
+	/*! Maps [0, 1] to a 16 bit unsigned normalized integer. */
+	inline std::uint32_t PackUnorm16(float value)
+	{
+		return static_cast<std::uint32_t>(std::lround(std::clamp(value, 0.f, 1.f) * 65535.f));
+	}
+
+	/*! Maps [-1, 1] to a 16 bit signed normalized integer (in the low 16 bits). */
+	inline std::uint32_t PackSnorm16(float value)
+	{
+		return static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f))) & 0xffffu;
+	}
+
+	inline float UnpackSnorm16(std::uint32_t value)
+	{
+		return static_cast<float>(static_cast<std::int16_t>(static_cast<std::uint16_t>(value))) / 32767.f;
+	}
+
+	/*! Octahedral encoding of a unit vector as two 16 bit snorms. x is in the low bits.
+	 * The sphere is projected onto the octahedron |x| + |y| + |z| = 1 and the lower half is folded over the upper one.
+	 */
+	inline std::uint32_t PackOctahedral(fm::vec3 const& n)
+	{
+		const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		float x = n.x / l1;
+		float y = n.y / l1;
+		if (n.z < 0)
+		{
+			const float fx = (1.f - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+			const float fy = (1.f - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+			x = fx;
+			y = fy;
+		}
+
+		return PackSnorm16(x) | (PackSnorm16(y) << 16);
+	}
+
+	inline fm::vec3 UnpackOctahedral(std::uint32_t packed)
+	{
+		const float x = UnpackSnorm16(packed);
+		const float y = UnpackSnorm16(packed >> 16);
+		fm::vec3 n(x, y, 1.f - std::abs(x) - std::abs(y));
+		const float t = std::clamp(-n.z, 0.f, 1.f);
+		n.x += n.x >= 0 ? -t : t;
+		n.y += n.y >= 0 ? -t : t;
+		return n.Normalized();
+	}
+
+} /* fm */
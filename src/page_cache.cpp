@@ -0,0 +1,188 @@
+#include "page_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rlr
+{
+
+	PageCache::PageCache(std::size_t budget_bytes, std::size_t page_bytes)
+		: m_page_bytes(page_bytes), m_page_words((page_bytes + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t))
+	{
+		m_num_slots = m_page_words > 0 ? budget_bytes / (m_page_words * sizeof(std::uint64_t)) : 0;
+		if (m_num_slots < min_slots)
+		{
+			throw std::runtime_error("Page cache budget is too small for its page size");
+		}
+
+		m_data = std::make_unique<std::uint64_t[]>(m_num_slots * m_page_words);
+		m_slots = std::make_unique<Slot[]>(m_num_slots);
+	}
+
+	std::uint32_t PageCache::AddFile(std::string const& path, std::uint64_t offset, std::uint32_t num_pages)
+	{
+		auto file = std::make_unique<File>();
+		file->stream.open(path, std::ios::binary);
+		if (!file->stream)
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		file->offset = offset;
+		file->page_table = std::make_unique<std::atomic<std::uint32_t>[]>(num_pages);
+		for (std::uint32_t i = 0; i < num_pages; i++)
+		{
+			file->page_table[i].store(no_slot, std::memory_order_relaxed);
+		}
+
+		m_files.push_back(std::move(file));
+		return static_cast<std::uint32_t>(m_files.size() - 1);
+	}
+
+	std::uint32_t PageCache::Acquire(std::uint32_t file, std::uint32_t page)
+	{
+		auto& entry = m_files[file]->page_table[page];
+		const std::uint64_t key = (std::uint64_t(file) << 32) | page;
+
+		for (;;)
+		{
+			const auto slot = entry.load(std::memory_order_acquire);
+			if (slot != no_slot)
+			{
+				auto& s = m_slots[slot];
+				// A slot that is being replaced is locked, a pinned slot can't be replaced, so checking the owner after pinning is enough.
+				if (s.pins.fetch_add(1, std::memory_order_acquire) < locked && s.owner.load(std::memory_order_relaxed) == key)
+				{
+					const auto frame = m_frame.load(std::memory_order_relaxed);
+					if (s.last_used.load(std::memory_order_relaxed) != frame)
+					{
+						s.last_used.store(frame, std::memory_order_relaxed);
+					}
+					return slot;
+				}
+				s.pins.fetch_sub(1, std::memory_order_release);
+			}
+
+			Load(file, page);
+		}
+	}
+
+	void PageCache::Release(std::uint32_t slot)
+	{
+		m_slots[slot].pins.fetch_sub(1, std::memory_order_release);
+	}
+
+	void const* PageCache::GetData(std::uint32_t slot) const
+	{
+		return &m_data[slot * m_page_words];
+	}
+
+	void PageCache::NextFrame()
+	{
+		m_frame.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::size_t PageCache::PageBytes() const
+	{
+		return m_page_bytes;
+	}
+
+	std::size_t PageCache::NumSlots() const
+	{
+		return m_num_slots;
+	}
+
+	std::size_t PageCache::NumResidentPages() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_num_used;
+	}
+
+	std::size_t PageCache::NumMisses() const
+	{
+		return m_num_misses.load(std::memory_order_relaxed);
+	}
+
+	std::size_t PageCache::NumEvictions() const
+	{
+		return m_num_evictions.load(std::memory_order_relaxed);
+	}
+
+	std::size_t PageCache::MemoryUsage() const
+	{
+		return m_num_slots * m_page_words * sizeof(std::uint64_t);
+	}
+
+	void PageCache::Load(std::uint32_t file, std::uint32_t page)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto& f = *m_files[file];
+		if (f.page_table[page].load(std::memory_order_acquire) != no_slot)
+		{
+			return;
+		}
+
+		const auto slot = FindVictim();
+		auto& s = m_slots[slot];
+		const auto old = s.owner.load(std::memory_order_relaxed);
+		if (old != ~0ull)
+		{
+			m_files[old >> 32]->page_table[static_cast<std::uint32_t>(old)].store(no_slot, std::memory_order_relaxed);
+			s.owner.store(~0ull, std::memory_order_relaxed);
+			m_num_evictions.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		f.stream.seekg(static_cast<std::streamoff>(f.offset + std::uint64_t(page) * m_page_bytes));
+		f.stream.read(reinterpret_cast<char*>(&m_data[slot * m_page_words]), static_cast<std::streamsize>(m_page_bytes));
+		if (!f.stream)
+		{
+			f.stream.clear();
+			s.pins.fetch_sub(locked, std::memory_order_release); // Left empty, it is the oldest slot for the next miss.
+			throw std::runtime_error("Failed to read a page");
+		}
+
+		s.owner.store((std::uint64_t(file) << 32) | page, std::memory_order_relaxed);
+		s.last_used.store(m_frame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		s.pins.fetch_sub(locked, std::memory_order_release);
+		f.page_table[page].store(slot, std::memory_order_release);
+		m_num_misses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::uint32_t PageCache::FindVictim()
+	{
+		// Slots that were never used first. Nothing points to them so locking can't fail.
+		if (m_num_used < m_num_slots)
+		{
+			const auto slot = static_cast<std::uint32_t>(m_num_used++);
+			m_slots[slot].pins.fetch_add(locked, std::memory_order_acquire);
+			return slot;
+		}
+
+		const std::size_t num_candidates = std::min(eviction_candidates, m_num_slots);
+		for (;;)
+		{
+			std::uint32_t best = no_slot;
+			std::uint32_t best_frame = 0;
+			for (std::size_t i = 0; i < num_candidates; i++)
+			{
+				auto& s = m_slots[m_clock_hand];
+				const auto frame = s.last_used.load(std::memory_order_relaxed);
+				if (s.pins.load(std::memory_order_relaxed) == 0 && (best == no_slot || frame < best_frame))
+				{
+					best = static_cast<std::uint32_t>(m_clock_hand);
+					best_frame = frame;
+				}
+				m_clock_hand = (m_clock_hand + 1) % m_num_slots;
+			}
+
+			// Fails if a reader pinned the slot since the scan. Scan the next candidates then.
+			std::uint32_t expected = 0;
+			if (best != no_slot && m_slots[best].pins.compare_exchange_strong(expected, locked, std::memory_order_acquire))
+			{
+				return best;
+			}
+		}
+	}
+
+} /* rlr */
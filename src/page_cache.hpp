@@ -0,0 +1,98 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+
+namespace rlr
+{
+
+	/*! Fixed size cache of equally sized file pages shared by all render threads.
+	 * Pages are read from disk the first time they are acquired, so the memory stays within the budget however large the files are.
+	 * Lookups don't lock: every file has a page table from page to cache slot and a reading thread pins the slot while it reads the data.
+	 * Misses are serialized by a mutex. They evict the least recently used unpinned slot, approximated by the oldest
+	 * of the next `eviction_candidates` slots after a clock hand. Recency is counted in frames (`NextFrame`).
+	 */
+	class PageCache
+	{
+	public:
+		static constexpr std::size_t eviction_candidates = 64;
+		static constexpr std::uint32_t min_slots = 16;
+
+		/*! Throws `std::runtime_error` if `budget_bytes` holds fewer than `min_slots` pages. */
+		PageCache(std::size_t budget_bytes, std::size_t page_bytes);
+
+		PageCache(const PageCache&) = delete;
+		PageCache& operator=(const PageCache&) = delete;
+
+		/*! Registers `num_pages` consecutive pages starting at byte `offset` of `path`. Nothing is read yet.
+		 * Not thread safe, add the files before acquiring pages.
+		 * Throws `std::runtime_error` if the file can't be opened.
+		 */
+		std::uint32_t AddFile(std::string const& path, std::uint64_t offset, std::uint32_t num_pages);
+
+		/*! Pins the slot holding `page` of `file`, reading it on a miss. Throws `std::runtime_error` if the read fails.
+		 * Every `Acquire` needs a `Release`. A thread must not hold more than one pin while it can miss,
+		 * otherwise the cache can run out of unpinned slots.
+		 */
+		std::uint32_t Acquire(std::uint32_t file, std::uint32_t page);
+		void Release(std::uint32_t slot);
+
+		/*! Data of a pinned slot, 8 byte aligned. */
+		void const* GetData(std::uint32_t slot) const;
+
+		/*! Advances the recency counter. Pages acquired before the call are older than the ones acquired after it. */
+		void NextFrame();
+
+		std::size_t PageBytes() const;
+		std::size_t NumSlots() const;
+		std::size_t NumResidentPages() const;
+		std::size_t NumMisses() const;
+		std::size_t NumEvictions() const;
+		/*! Bytes of page memory, which is allocated up front. */
+		std::size_t MemoryUsage() const;
+
+	private:
+		static constexpr std::uint32_t no_slot = ~0u;
+		static constexpr std::uint32_t locked = 1u << 31; // Added to `Slot::pins` while the slot is being replaced.
+
+		struct File
+		{
+			std::ifstream stream;
+			std::uint64_t offset;
+			std::unique_ptr<std::atomic<std::uint32_t>[]> page_table; // Cache slot of every page or `no_slot`.
+		};
+
+		struct Slot
+		{
+			std::atomic<std::uint64_t> owner = ~0ull; // File in the high and page in the low 32 bits.
+			std::atomic<std::uint32_t> pins = 0;
+			std::atomic<std::uint32_t> last_used = 0;
+		};
+
+		/*! Miss path, called without any pins held. Returns once `page` is resident (or was loaded by another thread meanwhile). */
+		void Load(std::uint32_t file, std::uint32_t page);
+		std::uint32_t FindVictim();
+
+		std::size_t m_page_bytes;
+		std::size_t m_page_words; // Size of a slot in 64 bit words, `m_page_bytes` rounded up.
+		std::size_t m_num_slots;
+		std::unique_ptr<std::uint64_t[]> m_data;
+		std::unique_ptr<Slot[]> m_slots;
+		std::vector<std::unique_ptr<File>> m_files;
+
+		std::atomic<std::uint32_t> m_frame = 1;
+
+		mutable std::mutex m_mutex; // Held by the miss path.
+		std::size_t m_num_used = 0;
+		std::size_t m_clock_hand = 0;
+		std::atomic<std::size_t> m_num_misses = 0;
+		std::atomic<std::size_t> m_num_evictions = 0;
+	};
+
+} /* rlr */
@@ -0,0 +1,537 @@
+#include "paged_geometry.hpp"
+
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+
+	constexpr std::uint32_t magic = 0x47524C52; // "RLRG"
+	constexpr std::uint32_t version = 1;
+	constexpr int max_depth = 64;
+
+	/*! The pages start at `page_bytes`, the top level nodes follow the last page. */
+	struct PagedGeometryHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t page_bytes;
+		std::uint32_t num_pages;
+		std::uint32_t num_nodes;
+		std::uint32_t padding;
+		std::uint64_t num_triangles;
+		std::uint64_t nodes_offset;
+	};
+
+	/*! Followed by `num_nodes` nodes, `num_vertices` vertices and `3 * num_triangles` 16 bit indices. Node 0 is the root. */
+	struct PageHeader
+	{
+		std::uint32_t num_nodes;
+		std::uint32_t num_vertices;
+		std::uint32_t num_triangles;
+		std::uint32_t padding;
+	};
+
+	static_assert(sizeof(PagedNode) == 32 && sizeof(PageHeader) == 16, "Written to the file as is");
+
+	struct PageTriangle
+	{
+		std::uint32_t v[3]; // Into the transformed vertices.
+		fm::vec3 centroid;
+	};
+
+	fm::mat3x4 NormalTransform(fm::mat3x4 const& transform)
+	{
+		const fm::mat3x4 inverse = transform.InverseAffine();
+		fm::mat3x4 retval;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				retval[i][j] = inverse[j][i];
+			}
+			retval[i][3] = 0;
+		}
+		return retval;
+	}
+
+	std::size_t NumNodes(std::size_t num_triangles, std::size_t leaf_triangles)
+	{
+		return num_triangles <= leaf_triangles ? 1 : 1 + NumNodes(num_triangles / 2, leaf_triangles) + NumNodes(num_triangles - num_triangles / 2, leaf_triangles);
+	}
+
+	class Writer
+	{
+	public:
+		Writer(std::vector<Vertex> const& vertices, std::vector<PageTriangle>& triangles, PagedGeometrySettings const& settings, std::ofstream& file)
+			: m_vertices(vertices), m_triangles(triangles), m_settings(settings), m_file(file), m_page(settings.page_bytes)
+		{
+		}
+
+		/*! Writes the pages under `node` and fills in the top level node. */
+		void BuildTop(std::size_t node, std::size_t begin, std::size_t end)
+		{
+			SetBounds(m_top[node], begin, end);
+
+			if (PageSize(begin, end) <= m_settings.page_bytes)
+			{
+				m_top[node].first = static_cast<std::uint32_t>(m_num_pages);
+				m_top[node].count = static_cast<std::uint32_t>(end - begin);
+				WritePage(begin, end);
+				return;
+			}
+			if (end - begin == 1)
+			{
+				throw std::runtime_error("A triangle doesn't fit in a geometry page");
+			}
+
+			const auto mid = Split(begin, end);
+			const auto children = m_top.size();
+			m_top[node].first = static_cast<std::uint32_t>(children);
+			m_top[node].count = 0;
+			m_top.resize(children + 2);
+			BuildTop(children, begin, mid);
+			BuildTop(children + 1, mid, end);
+		}
+
+		std::vector<PagedNode> m_top = std::vector<PagedNode>(1);
+		std::size_t m_num_pages = 0;
+
+	private:
+		void SetBounds(PagedNode& node, std::size_t begin, std::size_t end) const
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				node.min[k] = std::numeric_limits<float>::max();
+				node.max[k] = -std::numeric_limits<float>::max();
+			}
+			for (auto i = begin; i < end; i++)
+			{
+				for (auto v : m_triangles[i].v)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						node.min[k] = std::min(node.min[k], m_vertices[v].position[k]);
+						node.max[k] = std::max(node.max[k], m_vertices[v].position[k]);
+					}
+				}
+			}
+		}
+
+		/*! Partitions `[begin, end)` at the centroid median of the largest axis. */
+		std::size_t Split(std::size_t begin, std::size_t end)
+		{
+			fm::vec3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			fm::vec3 max = min * -1.f;
+			for (auto i = begin; i < end; i++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					min[k] = std::min(min[k], m_triangles[i].centroid[k]);
+					max[k] = std::max(max[k], m_triangles[i].centroid[k]);
+				}
+			}
+			const fm::vec3 extent = max - min;
+			const int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+
+			const auto mid = begin + (end - begin) / 2;
+			std::nth_element(m_triangles.begin() + begin, m_triangles.begin() + mid, m_triangles.begin() + end, [axis](PageTriangle const& a, PageTriangle const& b)
+			{
+				return a.centroid[axis] < b.centroid[axis];
+			});
+			return mid;
+		}
+
+		/*! Sorted vertices of `[begin, end)`, their position is the local index. */
+		std::vector<std::uint32_t> const& UniqueVertices(std::size_t begin, std::size_t end)
+		{
+			m_unique.clear();
+			for (auto i = begin; i < end; i++)
+			{
+				m_unique.insert(m_unique.end(), std::begin(m_triangles[i].v), std::end(m_triangles[i].v));
+			}
+			std::sort(m_unique.begin(), m_unique.end());
+			m_unique.erase(std::unique(m_unique.begin(), m_unique.end()), m_unique.end());
+			return m_unique;
+		}
+
+		std::size_t PageSize(std::size_t begin, std::size_t end)
+		{
+			const auto num_triangles = end - begin;
+			const auto num_vertices = UniqueVertices(begin, end).size();
+			if (num_vertices > std::numeric_limits<std::uint16_t>::max() + std::size_t(1))
+			{
+				return std::numeric_limits<std::size_t>::max();
+			}
+			return sizeof(PageHeader) + NumNodes(num_triangles, m_settings.leaf_triangles) * sizeof(PagedNode)
+				+ num_vertices * sizeof(Vertex) + num_triangles * 3 * sizeof(std::uint16_t);
+		}
+
+		/*! Builds the BVH inside a page. Reorders the triangles so every leaf is a contiguous range, `first` is relative to `base`. */
+		void BuildLocal(PagedNode* nodes, std::size_t& num_nodes, std::size_t node, std::size_t base, std::size_t begin, std::size_t end)
+		{
+			SetBounds(nodes[node], begin, end);
+			if (end - begin <= m_settings.leaf_triangles)
+			{
+				nodes[node].first = static_cast<std::uint32_t>(begin - base);
+				nodes[node].count = static_cast<std::uint32_t>(end - begin);
+				return;
+			}
+
+			const auto mid = Split(begin, end);
+			const auto children = num_nodes;
+			num_nodes += 2;
+			nodes[node].first = static_cast<std::uint32_t>(children);
+			nodes[node].count = 0;
+			BuildLocal(nodes, num_nodes, children, base, begin, mid);
+			BuildLocal(nodes, num_nodes, children + 1, base, mid, end);
+		}
+
+		void WritePage(std::size_t begin, std::size_t end)
+		{
+			std::fill(m_page.begin(), m_page.end(), std::uint8_t(0));
+
+			const auto num_triangles = end - begin;
+			PageHeader header{};
+			header.num_nodes = static_cast<std::uint32_t>(NumNodes(num_triangles, m_settings.leaf_triangles));
+			header.num_triangles = static_cast<std::uint32_t>(num_triangles);
+
+			auto nodes = reinterpret_cast<PagedNode*>(m_page.data() + sizeof(PageHeader));
+			std::size_t num_nodes = 1;
+			BuildLocal(nodes, num_nodes, 0, begin, begin, end);
+
+			auto const& unique = UniqueVertices(begin, end);
+			header.num_vertices = static_cast<std::uint32_t>(unique.size());
+			auto vertices = reinterpret_cast<Vertex*>(nodes + header.num_nodes);
+			for (std::size_t i = 0; i < unique.size(); i++)
+			{
+				vertices[i] = m_vertices[unique[i]];
+			}
+
+			auto indices = reinterpret_cast<std::uint16_t*>(vertices + header.num_vertices);
+			for (auto i = begin; i < end; i++)
+			{
+				for (auto v : m_triangles[i].v)
+				{
+					*indices++ = static_cast<std::uint16_t>(std::lower_bound(unique.begin(), unique.end(), v) - unique.begin());
+				}
+			}
+
+			std::memcpy(m_page.data(), &header, sizeof(header));
+			m_file.write(reinterpret_cast<char const*>(m_page.data()), m_page.size());
+			m_num_pages++;
+		}
+
+		std::vector<Vertex> const& m_vertices;
+		std::vector<PageTriangle>& m_triangles;
+		PagedGeometrySettings const& m_settings;
+		std::ofstream& m_file;
+		std::vector<std::uint8_t> m_page;
+		std::vector<std::uint32_t> m_unique;
+	};
+
+	/*! Entry distance of the ray into the node's box, infinity if it misses or enters beyond `max_t`. */
+	float IntersectBox(PagedNode const& node, fm::vec3 const& origin, fm::vec3 const& inv_direction, float min_t, float max_t)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			float t0 = (node.min[k] - origin[k]) * inv_direction[k];
+			float t1 = (node.max[k] - origin[k]) * inv_direction[k];
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+			min_t = std::max(min_t, t0);
+			max_t = std::min(max_t, t1);
+		}
+		return min_t <= max_t ? min_t : std::numeric_limits<float>::infinity();
+	}
+
+	/*! Moeller-Trumbore, both faces. Updates `t`, `u` and `v` if the hit is closer than `t`. */
+	bool IntersectTriangle(fm::vec3 const& origin, fm::vec3 const& direction, fm::vec3 const& p0, fm::vec3 const& p1, fm::vec3 const& p2, float min_t, float& t, float& u, float& v)
+	{
+		const fm::vec3 e1 = p1 - p0;
+		const fm::vec3 e2 = p2 - p0;
+		const fm::vec3 p = direction.Cross(e2);
+		const float det = e1.Dot(p);
+		if (std::abs(det) < 1e-12f)
+		{
+			return false;
+		}
+		const float inv_det = 1.f / det;
+		const fm::vec3 s = origin - p0;
+		const float hit_u = s.Dot(p) * inv_det;
+		if (hit_u < 0 || hit_u > 1)
+		{
+			return false;
+		}
+		const fm::vec3 q = s.Cross(e1);
+		const float hit_v = direction.Dot(q) * inv_det;
+		if (hit_v < 0 || hit_u + hit_v > 1)
+		{
+			return false;
+		}
+		const float hit_t = e2.Dot(q) * inv_det;
+		if (hit_t < min_t || hit_t >= t)
+		{
+			return false;
+		}
+		t = hit_t;
+		u = hit_u;
+		v = hit_v;
+		return true;
+	}
+
+} /* anonymous */
+
+void SavePagedGeometry(std::string const& path, rlr::Model const& model, SceneBuilder::MaterialCallback const& material, PagedGeometrySettings const& settings)
+{
+	std::vector<Vertex> vertices;
+	std::vector<PageTriangle> triangles;
+	auto add_mesh = [&](std::size_t mesh_idx, fm::mat3x4 const& transform)
+	{
+		auto const& mesh = *model.meshes[mesh_idx];
+		const auto normal_transform = NormalTransform(transform);
+		const auto material_idx = material(mesh_idx, mesh);
+		const auto first_vertex = static_cast<std::uint32_t>(vertices.size());
+		for (auto const& v : mesh.vertices)
+		{
+			Vertex out;
+			out.position = fm::pvec3(transform.TransformPoint(v.m_pos));
+			out.material_idx = material_idx;
+			out.normal = fm::pvec3(normal_transform.TransformPoint(v.m_normal).Normalized());
+			out.padding0 = 0;
+			out.uv = v.m_texCoord;
+			out.padding1 = fm::vec2(0, 0);
+			vertices.push_back(out);
+		}
+		for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			PageTriangle triangle;
+			fm::vec3 centroid;
+			for (int k = 0; k < 3; k++)
+			{
+				triangle.v[k] = first_vertex + mesh.indices[i + k];
+				centroid += fm::vec3(vertices[triangle.v[k]].position);
+			}
+			triangle.centroid = centroid / 3.f;
+			triangles.push_back(triangle);
+		}
+	};
+
+	if (model.scene_graph.GetInstances().empty())
+	{
+		for (std::size_t i = 0; i < model.meshes.size(); i++)
+		{
+			add_mesh(i, fm::mat3x4(fm::mat4()));
+		}
+	}
+	for (auto const& instance : model.scene_graph.GetInstances())
+	{
+		add_mesh(instance.mesh, fm::mat3x4(model.scene_graph.GetWorldTransform(instance.node)));
+	}
+
+	if (settings.page_bytes < sizeof(PagedGeometryHeader) || settings.leaf_triangles == 0)
+	{
+		throw std::runtime_error("Invalid paged geometry settings");
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	// The header is written last, once the page count is known.
+	const std::vector<char> first_page(settings.page_bytes, 0);
+	file.write(first_page.data(), first_page.size());
+
+	Writer writer(vertices, triangles, settings, file);
+	if (!triangles.empty())
+	{
+		writer.BuildTop(0, 0, triangles.size());
+	}
+	else
+	{
+		writer.m_top.clear();
+	}
+
+	PagedGeometryHeader header{};
+	header.magic = magic;
+	header.version = version;
+	header.page_bytes = settings.page_bytes;
+	header.num_pages = static_cast<std::uint32_t>(writer.m_num_pages);
+	header.num_nodes = static_cast<std::uint32_t>(writer.m_top.size());
+	header.num_triangles = triangles.size();
+	header.nodes_offset = std::uint64_t(settings.page_bytes) * (writer.m_num_pages + 1);
+
+	file.write(reinterpret_cast<char const*>(writer.m_top.data()), writer.m_top.size() * sizeof(PagedNode));
+	file.seekp(0);
+	file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
+
+PagedGeometry::PagedGeometry(std::string const& path, std::size_t budget_bytes)
+{
+	std::ifstream file(path, std::ios::binary);
+	PagedGeometryHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != magic || header.version != version)
+	{
+		throw std::runtime_error(path + " is not a paged geometry file");
+	}
+
+	m_nodes.resize(header.num_nodes);
+	file.seekg(static_cast<std::streamoff>(header.nodes_offset));
+	file.read(reinterpret_cast<char*>(m_nodes.data()), m_nodes.size() * sizeof(PagedNode));
+	if (!file)
+	{
+		throw std::runtime_error("Failed to read " + path);
+	}
+
+	m_num_pages = header.num_pages;
+	m_num_triangles = header.num_triangles;
+	m_pages = std::make_unique<rlr::PageCache>(budget_bytes, header.page_bytes);
+	m_file = m_pages->AddFile(path, header.page_bytes, header.num_pages);
+}
+
+PagedHit PagedGeometry::Intersect(fm::vec3 const& origin, fm::vec3 const& direction, float min_t, float max_t) const
+{
+	PagedHit hit;
+	if (m_nodes.empty())
+	{
+		return hit;
+	}
+
+	const fm::vec3 inv_direction(1.f / direction[0], 1.f / direction[1], 1.f / direction[2]);
+
+	// Near child first, nodes behind the closest hit are skipped when they are popped.
+	std::pair<std::uint32_t, float> stack[max_depth];
+	int size = 0;
+	float closest = max_t;
+	const float entry = IntersectBox(m_nodes[0], origin, inv_direction, min_t, closest);
+	if (entry != std::numeric_limits<float>::infinity())
+	{
+		stack[size++] = { 0, entry };
+	}
+
+	while (size > 0)
+	{
+		const auto top = stack[--size];
+		if (top.second > closest)
+		{
+			continue;
+		}
+
+		PagedNode const& node = m_nodes[top.first];
+		if (node.count == 0)
+		{
+			const float t0 = IntersectBox(m_nodes[node.first], origin, inv_direction, min_t, closest);
+			const float t1 = IntersectBox(m_nodes[node.first + 1], origin, inv_direction, min_t, closest);
+			const bool swap = t1 < t0;
+			const std::pair<std::uint32_t, float> near(node.first + (swap ? 1 : 0), swap ? t1 : t0);
+			const std::pair<std::uint32_t, float> far(node.first + (swap ? 0 : 1), swap ? t0 : t1);
+			if (far.second != std::numeric_limits<float>::infinity())
+			{
+				stack[size++] = far;
+			}
+			if (near.second != std::numeric_limits<float>::infinity())
+			{
+				stack[size++] = near;
+			}
+			continue;
+		}
+
+		// One pin at a time, held until the attributes of a hit in this page are read.
+		const auto slot = m_pages->Acquire(m_file, node.first);
+		auto data = static_cast<std::uint8_t const*>(m_pages->GetData(slot));
+		PageHeader page;
+		std::memcpy(&page, data, sizeof(page));
+		auto nodes = reinterpret_cast<PagedNode const*>(data + sizeof(PageHeader));
+		auto vertices = reinterpret_cast<Vertex const*>(nodes + page.num_nodes);
+		auto indices = reinterpret_cast<std::uint16_t const*>(vertices + page.num_vertices);
+
+		std::uint32_t local_stack[max_depth];
+		int local_size = 0;
+		std::uint32_t hit_triangle = ~0u;
+		float u = 0, v = 0;
+		if (IntersectBox(nodes[0], origin, inv_direction, min_t, closest) != std::numeric_limits<float>::infinity())
+		{
+			local_stack[local_size++] = 0;
+		}
+		while (local_size > 0)
+		{
+			PagedNode const& local = nodes[local_stack[--local_size]];
+			if (local.count == 0)
+			{
+				const float t0 = IntersectBox(nodes[local.first], origin, inv_direction, min_t, closest);
+				const float t1 = IntersectBox(nodes[local.first + 1], origin, inv_direction, min_t, closest);
+				const bool swap = t1 < t0;
+				if ((swap ? t0 : t1) != std::numeric_limits<float>::infinity())
+				{
+					local_stack[local_size++] = local.first + (swap ? 0 : 1);
+				}
+				if ((swap ? t1 : t0) != std::numeric_limits<float>::infinity())
+				{
+					local_stack[local_size++] = local.first + (swap ? 1 : 0);
+				}
+				continue;
+			}
+
+			for (auto i = local.first; i < local.first + local.count; i++)
+			{
+				std::uint16_t const* tri = &indices[i * 3];
+				if (IntersectTriangle(origin, direction, fm::vec3(vertices[tri[0]].position), fm::vec3(vertices[tri[1]].position), fm::vec3(vertices[tri[2]].position), min_t, closest, u, v))
+				{
+					hit_triangle = i;
+				}
+			}
+		}
+
+		if (hit_triangle != ~0u)
+		{
+			std::uint16_t const* tri = &indices[hit_triangle * 3];
+			Vertex const& a = vertices[tri[0]];
+			Vertex const& b = vertices[tri[1]];
+			Vertex const& c = vertices[tri[2]];
+			const float w = 1.f - u - v;
+			fm::vec2 uv_a = a.uv, uv_b = b.uv, uv_c = c.uv;
+			hit.hit = true;
+			hit.t = closest;
+			hit.normal = (fm::vec3(a.normal) * w + fm::vec3(b.normal) * u + fm::vec3(c.normal) * v).Normalized();
+			hit.uv = uv_a * w + uv_b * u + uv_c * v;
+			hit.material_idx = a.material_idx;
+			hit.page = node.first;
+			hit.triangle = hit_triangle;
+		}
+		m_pages->Release(slot);
+	}
+
+	return hit;
+}
+
+void PagedGeometry::NextFrame()
+{
+	m_pages->NextFrame();
+}
+
+rlr::PageCache const& PagedGeometry::GetPageCache() const
+{
+	return *m_pages;
+}
+
+std::size_t PagedGeometry::NumPages() const
+{
+	return m_num_pages;
+}
+
+std::size_t PagedGeometry::NumTriangles() const
+{
+	return m_num_triangles;
+}
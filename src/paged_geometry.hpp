@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vec.hpp"
+#include "model.hpp"
+#include "page_cache.hpp"
+#include "ray_tracer.hpp"
+#include "scene_builder.hpp"
+
+struct PagedGeometrySettings
+{
+	std::uint32_t page_bytes = 64 << 10;
+	std::uint32_t leaf_triangles = 4; // Triangles per leaf of the BVH inside a page.
+};
+
+/*! Node of the top level BVH (leaves point to a page) and of the BVH inside each page (leaves point to a range of triangles).
+ * `count` 0 marks an interior node with the children at `first` and `first + 1`.
+ */
+struct PagedNode
+{
+	float min[3];
+	std::uint32_t first;
+	float max[3];
+	std::uint32_t count;
+};
+
+struct PagedHit
+{
+	bool hit = false;
+	float t = 0;
+	fm::vec3 normal;
+	fm::vec2 uv;
+	int material_idx = 0;
+	std::uint32_t page = 0;
+	std::uint32_t triangle = 0; // Index inside the page.
+};
+
+/*! Writes every instance of `model` (moved by its node's world transform, see `SceneBuilder::AddModel`) to a paged geometry file.
+ * The triangles are split at the centroid median of their largest axis until a group fits in one page. Each page holds the group's
+ * tracer vertices, 16 bit local indices and a BVH over them, so it can be traced on its own. The BVH over the pages is stored once at the end.
+ * A model without instances is written with every mesh once. The conversion runs in memory, it is meant as an offline step.
+ * Throws `std::runtime_error` if a single triangle doesn't fit in a page or the file can't be written.
+ */
+void SavePagedGeometry(std::string const& path, rlr::Model const& model, SceneBuilder::MaterialCallback const& material, PagedGeometrySettings const& settings = {});
+
+/*! Traces rays against a paged geometry file without loading it.
+ * Only the top level BVH is resident. Pages are read through a `rlr::PageCache` the first time a ray reaches them
+ * and evicted when the budget is full, so scenes several times larger than the memory can be traced.
+ * `Intersect` is thread safe.
+ */
+class PagedGeometry
+{
+public:
+	/*! Throws `std::runtime_error` if the file can't be read or `budget_bytes` holds fewer than `rlr::PageCache::min_slots` pages. */
+	PagedGeometry(std::string const& path, std::size_t budget_bytes);
+
+	/*! Closest hit in `[min_t, max_t]`. The attributes are interpolated while the page is pinned. */
+	PagedHit Intersect(fm::vec3 const& origin, fm::vec3 const& direction, float min_t, float max_t) const;
+
+	/*! Ages the resident pages, see `rlr::PageCache::NextFrame`. */
+	void NextFrame();
+
+	rlr::PageCache const& GetPageCache() const;
+	std::size_t NumPages() const;
+	std::size_t NumTriangles() const;
+
+private:
+	std::vector<PagedNode> m_nodes;
+	std::uint32_t m_num_pages = 0;
+	std::uint64_t m_num_triangles = 0;
+	std::uint32_t m_file = 0;
+	std::unique_ptr<rlr::PageCache> m_pages;
+};
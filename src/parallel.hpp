@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace rlr
+{
+
+	/*! Calls `fn(i)` for every `i` in [0, count) on up to `num_threads` threads (0 uses every hardware thread).
+	 * The calling thread does its share of the work. Indices are handed out one at a time so uneven items balance out.
+	 * Returns once every call finished. An exception thrown by `fn` is rethrown on the calling thread.
+	 */
+	template<typename F>
+	void ParallelFor(std::size_t count, F&& fn, unsigned int num_threads = 0)
+	{
+		std::atomic<std::size_t> next = 0;
+		auto worker = [&]()
+		{
+			for (auto i = next++; i < count; i = next++)
+			{
+				fn(i);
+			}
+		};
+
+		if (num_threads == 0)
+		{
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		num_threads = static_cast<unsigned int>(std::min<std::size_t>(num_threads, count));
+
+		std::vector<std::future<void>> tasks;
+		for (unsigned int i = 1; i < num_threads; i++)
+		{
+			tasks.push_back(std::async(std::launch::async, worker));
+		}
+		worker();
+		for (auto& task : tasks)
+		{
+			task.get();
+		}
+	}
+
+} /* rlr */
@@ -0,0 +1,275 @@
+#include "scene_builder.hpp"
+
+#include "mesh_simplifier.hpp"
+#include "parallel.hpp"
+
+#include <limits>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+static_assert(sizeof(Vertex) == 48, "The tracer vertex layout has to match the HLSL structured buffer");
+static_assert(offsetof(Vertex, material_idx) == offsetof(Vertex, position) + 12
+	&& offsetof(Vertex, padding0) == offsetof(Vertex, normal) + 12
+	&& offsetof(Vertex, padding1) == offsetof(Vertex, uv) + 8, "The vertex is written as three 16 byte blocks");
+
+namespace
+{
+
+	// Large meshes are split so the threads finish at about the same time.
+	constexpr std::size_t vertices_per_chunk = 16 * 1024;
+	constexpr std::size_t indices_per_chunk = 64 * 1024;
+
+	struct Chunk
+	{
+		std::size_t instance;
+		std::size_t begin;
+		std::size_t end;
+		bool indices;
+	};
+
+	fm::mat3x4 NormalTransform(fm::mat3x4 const& transform)
+	{
+		const fm::mat3x4 inverse = transform.InverseAffine();
+		fm::mat3x4 retval;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				retval[i][j] = inverse[j][i];
+			}
+			retval[i][3] = 0;
+		}
+		return retval;
+	}
+
+	// Writes `[begin, end)` of `src` to `dst`. Each vertex is written as three 16 byte blocks (position + material, normal + padding, uv + padding)
+	// so a write combined upload buffer only sees full, sequential writes.
+	void ConvertVertices(rlr::Vertex const* src, std::size_t begin, std::size_t end, fm::mat3x4 const& transform, fm::mat3x4 const& normal_transform, bool identity, int material_idx, Vertex* dst)
+	{
+#if FM_SIMD_AVAILABLE
+		const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+		const __m128 material = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, material_idx));
+
+		// `_mm_loadu_ps` reads 4 floats. The 4th is the padding of a SIMD `fm::vec3` or the next member and is masked away.
+		const auto load_xyz = [&xyz_mask](fm::vec3 const& v)
+		{
+			return _mm_and_ps(_mm_loadu_ps(&v[0]), xyz_mask);
+		};
+		const auto store = [](void* address, __m128 v)
+		{
+			_mm_storeu_ps(reinterpret_cast<float*>(address), v);
+		};
+
+		if (identity)
+		{
+			for (auto i = begin; i < end; i++)
+			{
+				rlr::Vertex const& v = src[i];
+				store(&dst[i].position, _mm_or_ps(load_xyz(v.m_pos), material));
+				store(&dst[i].normal, load_xyz(v.m_normal));
+				store(&dst[i].uv, _mm_castpd_ps(_mm_load_sd(reinterpret_cast<double const*>(&v.m_texCoord))));
+			}
+			return;
+		}
+
+		// Column vectors so a point transforms with 3 multiply adds instead of 3 dot products.
+		__m128 c0 = transform.rows[0], c1 = transform.rows[1], c2 = transform.rows[2], c3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		c0 = _mm_and_ps(c0, xyz_mask);
+		c1 = _mm_and_ps(c1, xyz_mask);
+		c2 = _mm_and_ps(c2, xyz_mask);
+		c3 = _mm_and_ps(c3, xyz_mask);
+		__m128 n0 = normal_transform.rows[0], n1 = normal_transform.rows[1], n2 = normal_transform.rows[2], n3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+
+		for (auto i = begin; i < end; i++)
+		{
+			rlr::Vertex const& v = src[i];
+
+			const __m128 p = load_xyz(v.m_pos);
+			__m128 position = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))), c3);
+			position = _mm_add_ps(position, _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+			position = _mm_add_ps(position, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			const __m128 n = load_xyz(v.m_normal);
+			__m128 normal = _mm_mul_ps(n0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0)));
+			normal = _mm_add_ps(normal, _mm_mul_ps(n1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+			normal = _mm_add_ps(normal, _mm_mul_ps(n2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2))));
+			const __m128 squares = _mm_mul_ps(normal, normal);
+			__m128 length = _mm_add_ss(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(1, 1, 1, 1)));
+			length = _mm_sqrt_ss(_mm_add_ss(length, _mm_movehl_ps(squares, squares)));
+			normal = _mm_div_ps(normal, _mm_shuffle_ps(length, length, 0));
+
+			store(&dst[i].position, _mm_or_ps(position, material));
+			store(&dst[i].normal, _mm_and_ps(normal, xyz_mask));
+			store(&dst[i].uv, _mm_castpd_ps(_mm_load_sd(reinterpret_cast<double const*>(&v.m_texCoord))));
+		}
+#else
+		for (auto i = begin; i < end; i++)
+		{
+			rlr::Vertex const& v = src[i];
+			Vertex& out = dst[i];
+			out.position = identity ? fm::pvec3(v.m_pos) : fm::pvec3(transform.TransformPoint(v.m_pos));
+			out.material_idx = material_idx;
+			out.normal = identity ? fm::pvec3(v.m_normal) : fm::pvec3(normal_transform.TransformPoint(v.m_normal).Normalized());
+			out.padding0 = 0;
+			out.uv = v.m_texCoord;
+			out.padding1 = fm::vec2(0, 0);
+		}
+#endif
+	}
+
+	void ConvertIndices(std::uint32_t const* src, std::size_t begin, std::size_t end, std::size_t first_vertex, INDICES_TYPE* dst)
+	{
+		const auto offset = static_cast<std::uint32_t>(first_vertex);
+		for (auto i = begin; i < end; i++)
+		{
+			dst[i] = static_cast<INDICES_TYPE>(src[i] + offset);
+		}
+	}
+
+} /* anonymous */
+
+void SceneBuilder::AddModel(rlr::Model const& model, MaterialCallback const& material, bool apply_node_transforms)
+{
+	if (!apply_node_transforms)
+	{
+		for (std::size_t i = 0; i < model.meshes.size(); i++)
+		{
+			AddMesh(*model.meshes[i], fm::mat4(), material(i, *model.meshes[i]));
+		}
+		return;
+	}
+
+	for (auto const& instance : model.scene_graph.GetInstances())
+	{
+		auto const& mesh = *model.meshes[instance.mesh];
+		AddMesh(mesh, model.scene_graph.GetWorldTransform(instance.node), material(instance.mesh, mesh));
+	}
+}
+
+void SceneBuilder::AddModel(rlr::Model const& model, MaterialCallback const& material, fm::vec3 const& camera_pos, float cone_spread, float tolerance)
+{
+	// Bounding spheres around the bounding box centers, one per mesh.
+	std::vector<std::pair<fm::vec3, float>> bounds(model.meshes.size());
+	for (std::size_t i = 0; i < model.meshes.size(); i++)
+	{
+		const float big = std::numeric_limits<float>::max();
+		fm::vec3 min(big, big, big);
+		fm::vec3 max(-big, -big, -big);
+		for (auto const& v : model.meshes[i]->vertices)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				min[k] = std::min(min[k], v.m_pos[k]);
+				max[k] = std::max(max[k], v.m_pos[k]);
+			}
+		}
+		if (!model.meshes[i]->vertices.empty())
+		{
+			bounds[i] = { (min + max) * 0.5f, fm::vec3(max - min).Length() * 0.5f };
+		}
+	}
+
+	for (auto const& instance : model.scene_graph.GetInstances())
+	{
+		auto const& mesh = *model.meshes[instance.mesh];
+		auto const& transform = model.scene_graph.GetWorldTransform(instance.node);
+
+		// The largest axis scale bounds the sphere's radius in world space. The error scales the same way.
+		float scale = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			scale = std::max(scale, fm::vec3(transform[0][k], transform[1][k], transform[2][k]).Length());
+		}
+		const fm::vec3 center = transform.TransformPoint(bounds[instance.mesh].first);
+		const float distance = std::max(0.f, fm::vec3(center - camera_pos).Length() - bounds[instance.mesh].second * scale);
+		const auto lod = scale > 0 ? rlr::SelectLod(mesh, distance / scale, cone_spread, tolerance) : 0;
+
+		AddMesh(mesh, transform, material(instance.mesh, mesh), lod);
+	}
+}
+
+void SceneBuilder::AddMesh(rlr::Mesh const& mesh, fm::mat4 const& transform, int material_idx, std::size_t lod)
+{
+	if (!mesh.vertices.empty() && m_num_vertices + mesh.vertices.size() - 1 > std::numeric_limits<INDICES_TYPE>::max())
+	{
+		throw std::runtime_error("Scene vertices can't be addressed by INDICES_TYPE");
+	}
+
+	Instance instance;
+	instance.mesh = &mesh;
+	instance.indices = &rlr::GetLodIndices(mesh, lod);
+	instance.transform = fm::mat3x4(transform);
+	instance.identity = transform == fm::mat4();
+	instance.normal_transform = instance.identity ? fm::mat3x4() : NormalTransform(instance.transform);
+	instance.material_idx = material_idx;
+	instance.first_vertex = m_num_vertices;
+	instance.first_index = m_num_indices;
+	m_instances.push_back(instance);
+
+	m_num_vertices += mesh.vertices.size();
+	m_num_indices += instance.indices->size();
+}
+
+std::size_t SceneBuilder::NumVertices() const
+{
+	return m_num_vertices;
+}
+
+std::size_t SceneBuilder::NumIndices() const
+{
+	return m_num_indices;
+}
+
+void SceneBuilder::Build(Vertex* vertices, INDICES_TYPE* indices, unsigned int num_threads) const
+{
+	std::vector<Chunk> chunks;
+	for (std::size_t i = 0; i < m_instances.size(); i++)
+	{
+		auto const& mesh = *m_instances[i].mesh;
+		for (std::size_t begin = 0; begin < mesh.vertices.size(); begin += vertices_per_chunk)
+		{
+			chunks.push_back({ i, begin, std::min(begin + vertices_per_chunk, mesh.vertices.size()), false });
+		}
+		auto const& indices = *m_instances[i].indices;
+		for (std::size_t begin = 0; begin < indices.size(); begin += indices_per_chunk)
+		{
+			chunks.push_back({ i, begin, std::min(begin + indices_per_chunk, indices.size()), true });
+		}
+	}
+
+	rlr::ParallelFor(chunks.size(), [&](std::size_t i)
+	{
+		auto const& chunk = chunks[i];
+		auto const& instance = m_instances[chunk.instance];
+		if (chunk.indices)
+		{
+			ConvertIndices(instance.indices->data(), chunk.begin, chunk.end, instance.first_vertex, indices + instance.first_index);
+		}
+		else
+		{
+			ConvertVertices(instance.mesh->vertices.data(), chunk.begin, chunk.end, instance.transform, instance.normal_transform,
+				instance.identity, instance.material_idx, vertices + instance.first_vertex);
+		}
+	}, num_threads);
+}
+
+void SceneBuilder::Build(std::vector<Vertex>& vertices, std::vector<INDICES_TYPE>& indices, unsigned int num_threads) const
+{
+	if (vertices.size() < m_num_vertices)
+	{
+		vertices.resize(m_num_vertices);
+	}
+	indices.resize(m_num_indices);
+
+	Build(vertices.data(), indices.data(), num_threads);
+}
+
+void SceneBuilder::Clear()
+{
+	m_instances.clear();
+	m_num_vertices = 0;
+	m_num_indices = 0;
+}
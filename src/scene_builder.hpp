@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "model.hpp"
+#include "ray_tracer.hpp"
+
+/*! Flattens `rlr::Model`s into the tracer's vertex and index buffers.
+ * Meshes are added first so the exact buffer sizes are known up front. `Build` then converts every mesh in one parallel pass
+ * and writes straight into the destination, which can be a vector or a mapped upload buffer.
+ * The added meshes are referenced, not copied, so they have to outlive `Build`.
+ */
+class SceneBuilder
+{
+public:
+	/*! Returns the tracer material of mesh `mesh_idx` of a model. */
+	using MaterialCallback = std::function<int(std::size_t mesh_idx, rlr::Mesh const& mesh)>;
+
+	/*! Adds every mesh of `model` once.
+	 * With `apply_node_transforms` every instance in `rlr::Model::scene_graph` is added instead, moved by its node's world transform.
+	 * The world transforms have to be up to date (`rlr::SceneGraph::UpdateWorldTransforms`).
+	 */
+	void AddModel(rlr::Model const& model, MaterialCallback const& material, bool apply_node_transforms = false);
+
+	/*! Adds every instance of `model` with its node's world transform and the level of detail `rlr::SelectLod` picks for it.
+	 * The distance is measured from `camera_pos` to the instance's bounding sphere.
+	 */
+	void AddModel(rlr::Model const& model, MaterialCallback const& material, fm::vec3 const& camera_pos, float cone_spread, float tolerance = 1.f);
+
+	/*! Adds one mesh. Positions are transformed by `transform` and normals by its inverse transpose.
+	 * `lod` selects the index buffer (see `rlr::GetLodIndices`), the vertices are always the full detail ones.
+	 * Throws `std::runtime_error` if the rebased indices don't fit in `INDICES_TYPE`.
+	 */
+	void AddMesh(rlr::Mesh const& mesh, fm::mat4 const& transform, int material_idx, std::size_t lod = 0);
+
+	std::size_t NumVertices() const;
+	std::size_t NumIndices() const;
+
+	/*! Writes `NumVertices()` vertices and `NumIndices()` indices. Indices are rebased to the combined vertex buffer.
+	 * `num_threads` 0 uses the hardware concurrency.
+	 */
+	void Build(Vertex* vertices, INDICES_TYPE* indices, unsigned int num_threads = 0) const;
+
+	/*! Grows `vertices` to at least `NumVertices()` (a larger buffer keeps its size and tail), sizes `indices` exactly and builds into them. */
+	void Build(std::vector<Vertex>& vertices, std::vector<INDICES_TYPE>& indices, unsigned int num_threads = 0) const;
+
+	void Clear();
+
+private:
+	struct Instance
+	{
+		rlr::Mesh const* mesh;
+		std::vector<std::uint32_t> const* indices;
+		fm::mat3x4 transform;
+		fm::mat3x4 normal_transform; // Inverse transpose of `transform`, no translation.
+		bool identity;
+		int material_idx;
+		std::size_t first_vertex;
+		std::size_t first_index;
+	};
+
+	std::vector<Instance> m_instances;
+	std::size_t m_num_vertices = 0;
+	std::size_t m_num_indices = 0;
+};
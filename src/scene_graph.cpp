@@ -0,0 +1,97 @@
+#include "scene_graph.hpp"
+
+#include <stdexcept>
+
+namespace rlr
+{
+
+	std::int32_t SceneGraph::AddNode(std::int32_t parent, fm::mat4 const& local_transform)
+	{
+		const auto node = static_cast<std::int32_t>(m_parents.size());
+		if (parent >= node)
+		{
+			throw std::runtime_error("Scene graph parents have to be added before their children");
+		}
+
+		m_parents.push_back(parent);
+		m_local_transforms.push_back(local_transform);
+		m_world_transforms.push_back(parent < 0 ? local_transform : m_world_transforms[parent] * local_transform);
+		m_dirty.push_back(0);
+		m_updated.push_back(0);
+		return node;
+	}
+
+	void SceneGraph::AddInstance(std::int32_t node, std::uint32_t mesh)
+	{
+		m_instances.push_back({ node, mesh });
+	}
+
+	void SceneGraph::SetLocalTransform(std::int32_t node, fm::mat4 const& local_transform)
+	{
+		m_local_transforms[node] = local_transform;
+		m_dirty[node] = 1;
+		m_any_dirty = true;
+	}
+
+	fm::mat4 const& SceneGraph::GetLocalTransform(std::int32_t node) const
+	{
+		return m_local_transforms[node];
+	}
+
+	fm::mat4 const& SceneGraph::GetWorldTransform(std::int32_t node) const
+	{
+		return m_world_transforms[node];
+	}
+
+	std::int32_t SceneGraph::GetParent(std::int32_t node) const
+	{
+		return m_parents[node];
+	}
+
+	std::size_t SceneGraph::NumNodes() const
+	{
+		return m_parents.size();
+	}
+
+	std::vector<MeshInstance> const& SceneGraph::GetInstances() const
+	{
+		return m_instances;
+	}
+
+	std::size_t SceneGraph::UpdateWorldTransforms()
+	{
+		if (!m_any_dirty)
+		{
+			return 0;
+		}
+
+		// Parents come first so a single pass sees the parent's state before its children.
+		std::size_t num_updated = 0;
+		for (std::size_t i = 0; i < m_parents.size(); i++)
+		{
+			const auto parent = m_parents[i];
+			m_updated[i] = m_dirty[i] || (parent >= 0 && m_updated[parent]);
+			if (m_updated[i])
+			{
+				m_world_transforms[i] = parent < 0 ? m_local_transforms[i] : m_world_transforms[parent] * m_local_transforms[i];
+				m_dirty[i] = 0;
+				num_updated++;
+			}
+		}
+
+		m_any_dirty = false;
+		return num_updated;
+	}
+
+	void SceneGraph::Clear()
+	{
+		m_parents.clear();
+		m_local_transforms.clear();
+		m_world_transforms.clear();
+		m_dirty.clear();
+		m_updated.clear();
+		m_instances.clear();
+		m_any_dirty = false;
+	}
+
+} /* rlr */
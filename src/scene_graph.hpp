@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "mat.hpp"
+
+namespace rlr
+{
+
+	/*! A mesh placed by a node. Several instances can reference the same mesh. */
+	struct MeshInstance
+	{
+		std::int32_t node;
+		std::uint32_t mesh; // Index into `Model::meshes`.
+	};
+
+	/*! Flattened transform hierarchy.
+	 * Nodes are stored in arrays in depth first order, a parent always comes before its children.
+	 * Changing a local transform only marks the node dirty, `UpdateWorldTransforms` then recomputes the dirty subtrees in one linear pass.
+	 */
+	class SceneGraph
+	{
+	public:
+		/*! Adds a node and returns its index. `parent` is -1 for a root and has to be added already. */
+		std::int32_t AddNode(std::int32_t parent, fm::mat4 const& local_transform);
+		void AddInstance(std::int32_t node, std::uint32_t mesh);
+
+		void SetLocalTransform(std::int32_t node, fm::mat4 const& local_transform);
+		fm::mat4 const& GetLocalTransform(std::int32_t node) const;
+		/*! Only valid after `UpdateWorldTransforms` if a transform changed. */
+		fm::mat4 const& GetWorldTransform(std::int32_t node) const;
+		std::int32_t GetParent(std::int32_t node) const;
+
+		std::size_t NumNodes() const;
+		std::vector<MeshInstance> const& GetInstances() const;
+
+		/*! Recomputes the world transforms of dirty nodes and their descendants. Returns the number of recomputed nodes. */
+		std::size_t UpdateWorldTransforms();
+
+		void Clear();
+
+	private:
+		std::vector<std::int32_t> m_parents;
+		std::vector<fm::mat4> m_local_transforms;
+		std::vector<fm::mat4> m_world_transforms;
+		std::vector<std::uint8_t> m_dirty; // Set when the local transform changed. Cleared by `UpdateWorldTransforms`.
+		std::vector<std::uint8_t> m_updated; // Scratch space of `UpdateWorldTransforms`.
+		std::vector<MeshInstance> m_instances;
+		bool m_any_dirty = false;
+	};
+
+} /* rlr */
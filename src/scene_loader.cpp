@@ -0,0 +1,345 @@
+#include "scene_loader.hpp"
+
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#include "mesh_optimizer.hpp"
+
+namespace
+{
+
+	void BuildBVH(SceneSnapshot& snapshot, std::vector<INDICES_TYPE> const& indices)
+	{
+		snapshot.bvh = std::make_unique<SceneBVH>();
+		snapshot.bvh->Construct(snapshot.vertices, indices);
+#ifdef USE_CLUSTERED_LEAVES
+		snapshot.bvh->BuildClusters(snapshot.vertices);
+#endif
+#ifdef USE_WOOP_TRIANGLES
+		snapshot.bvh->BuildWoopTriangles(snapshot.vertices);
+#endif
+#ifdef USE_THREADED_BVH
+		snapshot.bvh->BuildThreadedLayout();
+#endif
+	}
+
+	std::shared_ptr<SceneSnapshot> BuildSnapshot(SceneBuilder const& builder)
+	{
+		auto snapshot = std::make_shared<SceneSnapshot>();
+		std::vector<INDICES_TYPE> indices;
+		snapshot->vertices.resize(NUM_VERTICES);
+		builder.Build(snapshot->vertices, indices);
+		snapshot->num_vertices = builder.NumVertices();
+		BuildBVH(*snapshot, indices);
+		return snapshot;
+	}
+
+} /* anonymous */
+
+SceneLoader::~SceneLoader()
+{
+	Cancel();
+}
+
+void SceneLoader::Load(std::string const& path, SceneBuilder::MaterialCallback material)
+{
+	Cancel();
+
+	m_path = path;
+	m_material = std::move(material);
+	m_cancel = false;
+	m_loading = true;
+	m_thread = std::thread(&SceneLoader::Run, this, m_path, m_material);
+}
+
+void SceneLoader::Reload()
+{
+	if (m_path.empty())
+	{
+		return;
+	}
+
+	Cancel();
+
+	m_cancel = false;
+	m_loading = true;
+	m_thread = std::thread(&SceneLoader::RunReload, this, m_path, m_material);
+}
+
+void SceneLoader::Cancel()
+{
+	m_cancel = true;
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+	m_loading = false;
+}
+
+std::shared_ptr<const SceneSnapshot> SceneLoader::GetSnapshot()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_error)
+	{
+		auto error = m_error;
+		m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+	return m_snapshot;
+}
+
+bool SceneLoader::IsLoading() const
+{
+	return m_loading;
+}
+
+void SceneLoader::Publish(std::shared_ptr<SceneSnapshot> snapshot)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	snapshot->version = ++m_version;
+	m_snapshot = std::move(snapshot);
+}
+
+void SceneLoader::Run(std::string path, SceneBuilder::MaterialCallback material)
+{
+	try
+	{
+		m_cache.clear();
+		m_base = nullptr;
+
+		SceneBuilder builder;
+		Publish(BuildSnapshot(builder));
+
+		rlr::Model model;
+		rlr::Load(model, path);
+
+		// The imported meshes are immutable. Each is copied out for optimizing and released right away, so only one is held twice.
+		std::vector<CachedMesh> cache(model.meshes.size());
+		std::vector<rlr::Mesh> meshes(model.meshes.size());
+		for (std::size_t i = 0; i < model.meshes.size(); i++)
+		{
+			cache[i].hash = rlr::HashMesh(*model.meshes[i]);
+			cache[i].material_idx = material(i, *model.meshes[i]);
+			meshes[i] = *model.meshes[i];
+			model.meshes[i] = nullptr;
+		}
+
+		rlr::OptimizeMeshes(meshes);
+		for (std::size_t i = 0; i < meshes.size(); i++)
+		{
+			cache[i].mesh = std::make_shared<const rlr::Mesh>(std::move(meshes[i]));
+		}
+
+		// Coarse meshes first, they are cheap to build and give the scene its rough shape.
+		std::vector<std::size_t> order(cache.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&cache](std::size_t a, std::size_t b)
+		{
+			return cache[a].mesh->vertices.size() < cache[b].mesh->vertices.size();
+		});
+
+		std::size_t published_vertices = 0;
+		for (std::size_t i = 0; i < order.size() && !m_cancel; i++)
+		{
+			auto& cached = cache[order[i]];
+			cached.first_vertex = builder.NumVertices();
+			cached.capacity = cached.mesh->vertices.size();
+			builder.AddMesh(*cached.mesh, fm::mat4(), cached.material_idx);
+
+			const bool last = i + 1 == order.size();
+			if (!last && builder.NumVertices() < published_vertices * 2)
+			{
+				continue;
+			}
+
+			auto snapshot = BuildSnapshot(builder);
+			snapshot->num_meshes = i + 1;
+			snapshot->total_meshes = order.size();
+			snapshot->complete = last;
+			published_vertices = builder.NumVertices();
+			Publish(snapshot);
+
+			if (last)
+			{
+				m_cache = std::move(cache);
+				m_base = std::move(snapshot);
+			}
+		}
+
+		if (order.empty())
+		{
+			auto done = BuildSnapshot(builder);
+			done->complete = true;
+			Publish(done);
+			m_base = std::move(done);
+		}
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_error = std::current_exception();
+	}
+
+	m_loading = false;
+}
+
+void SceneLoader::RunReload(std::string path, SceneBuilder::MaterialCallback material)
+{
+	if (!m_base)
+	{
+		Run(std::move(path), std::move(material));
+		return;
+	}
+
+	try
+	{
+		rlr::Model model;
+		rlr::Load(model, path);
+
+		// Unchanged meshes are taken over as they are, the others are optimized together.
+		std::vector<CachedMesh> cache(model.meshes.size());
+		std::vector<bool> is_changed(model.meshes.size(), false);
+		std::vector<std::size_t> changed;
+		std::vector<rlr::Mesh> changed_meshes;
+		for (std::size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const auto hash = rlr::HashMesh(*model.meshes[i]);
+			const auto material_idx = material(i, *model.meshes[i]);
+			if (i < m_cache.size() && m_cache[i].hash == hash && m_cache[i].material_idx == material_idx)
+			{
+				cache[i] = m_cache[i];
+				continue;
+			}
+
+			cache[i].hash = hash;
+			cache[i].material_idx = material_idx;
+			is_changed[i] = true;
+			changed.push_back(i);
+			changed_meshes.push_back(*model.meshes[i]);
+			model.meshes[i] = nullptr;
+		}
+
+		if (m_cancel || (changed.empty() && cache.size() == m_cache.size()))
+		{
+			m_loading = false;
+			return;
+		}
+
+		rlr::OptimizeMeshes(changed_meshes);
+		for (std::size_t i = 0; i < changed.size(); i++)
+		{
+			cache[changed[i]].mesh = std::make_shared<const rlr::Mesh>(std::move(changed_meshes[i]));
+		}
+
+		// Changed meshes are written over their old range if they still fit. The others go behind the last range still in use.
+		std::vector<std::size_t> moved;
+		std::size_t end = 0;
+		for (std::size_t i = 0; i < cache.size(); i++)
+		{
+			auto& cached = cache[i];
+			if (is_changed[i])
+			{
+				if (i >= m_cache.size() || cached.mesh->vertices.size() > m_cache[i].capacity)
+				{
+					moved.push_back(i);
+					continue;
+				}
+				cached.first_vertex = m_cache[i].first_vertex;
+				cached.capacity = m_cache[i].capacity;
+			}
+			end = std::max(end, cached.first_vertex + cached.capacity);
+		}
+		for (auto i : moved)
+		{
+			cache[i].first_vertex = end;
+			cache[i].capacity = cache[i].mesh->vertices.size();
+			end += cache[i].capacity;
+		}
+
+		// Moved and removed meshes leave their old range unused. Compact once the end runs past the vertex buffer.
+		const bool compact = end > NUM_VERTICES;
+		if (compact)
+		{
+			end = 0;
+			for (auto& cached : cache)
+			{
+				cached.first_vertex = end;
+				cached.capacity = cached.mesh->vertices.size();
+				end += cached.capacity;
+			}
+			if (end > NUM_VERTICES)
+			{
+				throw std::runtime_error("Scene vertices don't fit in the vertex buffer");
+			}
+		}
+
+		SceneBuilder builder;
+		for (auto i : changed)
+		{
+			builder.AddMesh(*cache[i].mesh, fm::mat4(), cache[i].material_idx);
+		}
+		std::vector<Vertex> converted;
+		std::vector<INDICES_TYPE> unused;
+		builder.Build(converted, unused);
+
+		auto snapshot = std::make_shared<SceneSnapshot>();
+		snapshot->vertices.resize(NUM_VERTICES);
+		auto const& base = m_base->vertices;
+		if (compact)
+		{
+			for (std::size_t i = 0; i < cache.size(); i++)
+			{
+				if (!is_changed[i])
+				{
+					auto first = base.begin() + m_cache[i].first_vertex;
+					std::copy(first, first + cache[i].mesh->vertices.size(), snapshot->vertices.begin() + cache[i].first_vertex);
+				}
+			}
+			snapshot->changed_vertices.emplace_back(0, end);
+		}
+		else
+		{
+			std::copy(base.begin(), base.begin() + std::min(base.size(), snapshot->vertices.size()), snapshot->vertices.begin());
+			snapshot->base_version = m_base->version;
+		}
+
+		std::size_t offset = 0;
+		for (auto i : changed)
+		{
+			const auto count = cache[i].mesh->vertices.size();
+			std::copy(converted.begin() + offset, converted.begin() + offset + count, snapshot->vertices.begin() + cache[i].first_vertex);
+			offset += count;
+			if (!compact)
+			{
+				snapshot->changed_vertices.emplace_back(cache[i].first_vertex, cache[i].first_vertex + count);
+			}
+		}
+
+		std::vector<INDICES_TYPE> indices;
+		for (auto const& cached : cache)
+		{
+			for (auto index : cached.mesh->indices)
+			{
+				indices.push_back(static_cast<INDICES_TYPE>(cached.first_vertex + index));
+			}
+		}
+		BuildBVH(*snapshot, indices);
+
+		snapshot->num_vertices = end;
+		snapshot->num_meshes = cache.size();
+		snapshot->total_meshes = cache.size();
+		snapshot->complete = true;
+		Publish(snapshot);
+
+		m_cache = std::move(cache);
+		m_base = std::move(snapshot);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_error = std::current_exception();
+	}
+
+	m_loading = false;
+}
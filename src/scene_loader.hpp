@@ -0,0 +1,103 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <exception>
+
+#include "bvh.hpp"
+#include "scene_builder.hpp"
+
+using SceneBVH = BVH<NUM_INDICES / 3>;
+
+/*! Geometry the loader has finished so far. Never modified after it is published. */
+struct SceneSnapshot
+{
+	std::uint64_t version = 0; // Increases with every published snapshot.
+	std::size_t num_meshes = 0; // Meshes in this snapshot.
+	std::size_t total_meshes = 0; // Meshes in the scene. 0 while the import is still running.
+	bool complete = false; // No further snapshot will follow.
+	std::uint64_t base_version = 0; // Snapshot a reload patched, 0 if this one was built from scratch.
+	std::vector<std::pair<std::size_t, std::size_t>> changed_vertices; // `[first, last)` ranges of `vertices` that differ from the base snapshot.
+
+	std::vector<Vertex> vertices; // At least `NUM_VERTICES` long so it can be uploaded as is.
+	std::size_t num_vertices = 0; // End of the used part of `vertices`, the rest is padding.
+	std::unique_ptr<SceneBVH> bvh; // Built with the layouts `main` uploads (threaded, clusters, Woop triangles), also for an empty scene.
+};
+
+/*! Imports, converts and builds a scene on a background thread.
+ * An empty snapshot is published right away so the renderer can trace the sky and floor while Assimp is still importing.
+ * After the import the meshes are welded and reordered for locality (`rlr::OptimizeMeshes`), then added from the smallest
+ * to the largest. A new snapshot is published every time the vertex count doubled, which keeps the total rebuild cost linear in the scene size.
+ * The renderer polls `GetSnapshot` and uploads when the version changed.
+ *
+ * `Reload` re-imports the same file after it changed and only processes the meshes whose content hash changed.
+ * Unchanged meshes keep their optimized data and their range of the vertex buffer.
+ */
+class SceneLoader
+{
+public:
+	SceneLoader() = default;
+	~SceneLoader();
+
+	SceneLoader(const SceneLoader&) = delete;
+	SceneLoader& operator=(const SceneLoader&) = delete;
+
+	/*! Starts loading `path`. A load that is still running is cancelled first. */
+	void Load(std::string const& path, SceneBuilder::MaterialCallback material);
+
+	/*! Re-imports the file of the last `Load` and publishes one complete snapshot.
+	 * Meshes are matched by their import order and `rlr::HashMesh`. Only new or changed meshes are optimized and converted.
+	 * They are written over their previous vertex range if they still fit, or behind the last used vertex otherwise.
+	 * The snapshot's `base_version` then names the complete snapshot it was patched from, so a renderer that still shows that one
+	 * only has to upload `changed_vertices`. The vertex buffer is compacted (and `base_version` is 0) once the appended ranges run past `NUM_VERTICES`.
+	 * Does a full load if no load completed since the last `Load`. Nothing is published if no mesh changed.
+	 */
+	void Reload();
+
+	/*! Stops publishing and waits for the thread. The Assimp import itself can't be interrupted. */
+	void Cancel();
+
+	/*! Latest published snapshot, nullptr before the first one.
+	 * Rethrows an exception thrown by the loader thread once.
+	 */
+	std::shared_ptr<const SceneSnapshot> GetSnapshot();
+
+	bool IsLoading() const;
+
+private:
+	/*! Mesh of the last complete snapshot. */
+	struct CachedMesh
+	{
+		std::uint64_t hash; // Of the imported mesh, before optimizing.
+		int material_idx;
+		std::shared_ptr<const rlr::Mesh> mesh; // Optimized.
+		std::size_t first_vertex;
+		std::size_t capacity; // Vertices reserved at `first_vertex`, at least `mesh->vertices.size()`.
+	};
+
+	void Run(std::string path, SceneBuilder::MaterialCallback material);
+	void RunReload(std::string path, SceneBuilder::MaterialCallback material);
+	void Publish(std::shared_ptr<SceneSnapshot> snapshot);
+
+	std::string m_path;
+	SceneBuilder::MaterialCallback m_material;
+
+	// Only used by the loader thread. Cleared when a load starts and set once it completed.
+	std::vector<CachedMesh> m_cache;
+	std::shared_ptr<const SceneSnapshot> m_base;
+
+	std::thread m_thread;
+	std::atomic<bool> m_cancel = false;
+	std::atomic<bool> m_loading = false;
+
+	mutable std::mutex m_mutex;
+	std::shared_ptr<const SceneSnapshot> m_snapshot;
+	std::exception_ptr m_error;
+	std::uint64_t m_version = 0;
+};
@@ -10,36 +10,66 @@ namespace rlr
 	{
 	}
 
-	Skeleton::Skeleton(std::vector<Bone> bones, aiMatrix4x4 global_invere_transform)
+	Skeleton::Skeleton(std::vector<Bone> bones, fm::mat4 global_invere_transform)
 	{
 		Init(bones, global_invere_transform);
 	}
 
-	void Skeleton::Init(std::vector<Bone> bones, aiMatrix4x4 global_invere_transform)
+	Skeleton::Skeleton(const Skeleton& rhs)
+	{
+		*this = rhs;
+	}
+
+	Skeleton& Skeleton::operator=(const Skeleton& rhs)
+	{
+		bones = rhs.bones;
+		global_invere_transform = rhs.global_invere_transform;
+		bone_mats = rhs.bone_mats;
+		anim_time = rhs.anim_time;
+		lerp_anim_time = rhs.lerp_anim_time;
+		just_switched = rhs.just_switched;
+		begin_interp = rhs.begin_interp;
+		anim_loop = rhs.anim_loop;
+		current_anim = rhs.current_anim;
+
+		LinkBones();
+
+		return *this;
+	}
+
+	void Skeleton::Init(std::vector<Bone> bones, fm::mat4 global_invere_transform)
 	{
 		this->bones = bones;
 		this->global_invere_transform = global_invere_transform;
 
-		for (int i = 0; i < this->bones.size(); i++)
+		LinkBones();
+	}
+
+	// Point the bones at this skeleton and their parents at our own copy of the bones.
+	void Skeleton::LinkBones()
+	{
+		for (int i = 0; i < bones.size(); i++)
 		{
-			this->bones.at(i).parent_skeleton = this;
+			Bone& bone = bones.at(i);
+			bone.parent_skeleton = this;
+			bone.parent_bone = bone.parent_idx >= 0 ? &bones.at(bone.parent_idx) : nullptr;
 		}
 	}
 
 	void Skeleton::UpdateBoneMatrices()
 	{
-		bone_mats.clear();
+		bone_mats.resize(100);
 
 		for (int i = 0; i < 100; i++)
 		{
 			if (i > bones.size() - 1)
 			{ // if we are out of bones pass identity matrices
-				bone_mats.push_back(aiMatrix4x4()); // Identity Matrix
+				bone_mats[i] = fm::mat4(); // Identity Matrix
 			}
 			else
 			{
-				aiMatrix4x4 concatenated_transformation = bones.at(i).node->mTransformation * bones.at(i).GetParentTransforms();
-				bone_mats.push_back(bones.at(i).offset_matrix * concatenated_transformation * global_invere_transform);
+				fm::mat4 concatenated_transformation = bones.at(i).local_transform * bones.at(i).GetParentTransforms();
+				bone_mats[i] = bones.at(i).offset_matrix * concatenated_transformation * global_invere_transform;
 			}
 		}
 	}
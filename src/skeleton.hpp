@@ -2,8 +2,6 @@
 
 #include <string>
 #include <vector>
-
-#include <assimp/scene.h>
 #include <iostream>
 
 #include "bone.hpp"
@@ -18,11 +16,12 @@ namespace rlr
 	{
 	private:
 		void UpdateBoneMatrices();
+		void LinkBones();
 
 	public:
 		std::vector<Bone> bones;
-		aiMatrix4x4 global_invere_transform;
-		std::vector<aiMatrix4x4> bone_mats;
+		fm::mat4 global_invere_transform;
+		std::vector<fm::mat4> bone_mats;
 
 		float anim_time = 0;
 		float lerp_anim_time = 0;
@@ -32,9 +31,11 @@ namespace rlr
 		Animation* current_anim = nullptr;
 
 		Skeleton();
-		Skeleton(std::vector<Bone> bones, aiMatrix4x4 global_inverese_transform);
+		Skeleton(std::vector<Bone> bones, fm::mat4 global_inverese_transform);
+		Skeleton(const Skeleton& rhs);
+		Skeleton& operator=(const Skeleton& rhs);
 
-		void Init(std::vector<Bone> bones, aiMatrix4x4 global_inverese_transform);
+		void Init(std::vector<Bone> bones, fm::mat4 global_inverese_transform);
 		void PlayAnimation(Animation* anim, bool loop = true, bool reset = true);
 		void StopAnimation();
 
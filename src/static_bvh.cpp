@@ -0,0 +1,37 @@
+#include "static_bvh.hpp"
+
+namespace baked
+{
+
+	// Debug floor. 10x10 quad split in 4 so the tree has more than one leaf.
+	constexpr std::array<fm::pvec3, 9> debug_floor_positions = {
+		fm::pvec3(-5, 0, -5), fm::pvec3(0, 0, -5), fm::pvec3(5, 0, -5),
+		fm::pvec3(-5, 0, 0), fm::pvec3(0, 0, 0), fm::pvec3(5, 0, 0),
+		fm::pvec3(-5, 0, 5), fm::pvec3(0, 0, 5), fm::pvec3(5, 0, 5),
+	};
+
+	constexpr std::array<std::uint16_t, 24> debug_floor_indices = {
+		0, 3, 1, 1, 3, 4,
+		1, 4, 2, 2, 4, 5,
+		3, 6, 4, 4, 6, 7,
+		4, 7, 5, 5, 7, 8,
+	};
+
+	constexpr auto debug_floor_bvh = BuildStaticBVH(debug_floor_positions, debug_floor_indices);
+
+	static_assert(debug_floor_bvh.node_pool[0].bbox[0][0] == -5 && debug_floor_bvh.node_pool[0].bbox[1][2] == 5, "Debug floor root bounds are wrong");
+	static_assert(debug_floor_bvh.node_pool[0].count == 8, "Debug floor root should contain every triangle");
+	static_assert(debug_floor_bvh.node_pool[0].left_first != -1, "Debug floor root should have been subdivided");
+	static_assert(debug_floor_bvh.num_nodes <= debug_floor_bvh.node_pool.size(), "Debug floor used more nodes than allocated");
+
+	std::array<fm::pvec3, 9> const& DebugFloorPositions()
+	{
+		return debug_floor_positions;
+	}
+
+	StaticBVH<8> const& DebugFloorBVH()
+	{
+		return debug_floor_bvh;
+	}
+
+} /* baked */
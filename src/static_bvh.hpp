@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "../structs.hlsl"
+#include "../raytracer.hlsl"
+
+/*! Compile time BVH
+ * Output of `BuildStaticBVH`. Uses the same node and leaf layout as `BVH<N>`.
+ */
+template<std::uint32_t T>
+struct StaticBVH
+{
+	std::array<BVHNode, T * 2 - 1> node_pool = {};
+	std::array<std::uint16_t, T * 3> big_index_buffer = {};
+	std::uint32_t num_nodes = 0;
+};
+
+namespace detail
+{
+
+	template<std::size_t V, std::uint32_t T>
+	struct StaticBVHBuilder
+	{
+		std::array<fm::pvec3, V> const& positions;
+		StaticBVH<T>& bvh;
+
+		constexpr fm::pvec3 Centroid(std::uint32_t i) const
+		{
+			auto const& a = positions[bvh.big_index_buffer[i]];
+			auto const& b = positions[bvh.big_index_buffer[i + 1]];
+			auto const& c = positions[bvh.big_index_buffer[i + 2]];
+			return fm::pvec3((a[0] + b[0] + c[0]) / 3.f, (a[1] + b[1] + c[1]) / 3.f, (a[2] + b[2] + c[2]) / 3.f);
+		}
+
+		constexpr std::array<fm::pvec3, 2> CalculateBoundingBox(std::uint32_t first, std::uint32_t last) const
+		{
+			constexpr float lowest = std::numeric_limits<float>::lowest();
+			constexpr float highest = std::numeric_limits<float>::max();
+
+			std::array<fm::pvec3, 2> bounds = { fm::pvec3(highest, highest, highest), fm::pvec3(lowest, lowest, lowest) };
+			for (auto i = first; i < last; i++)
+			{
+				auto const& p = positions[bvh.big_index_buffer[i]];
+				for (auto axis = 0; axis < 3; axis++)
+				{
+					bounds[0][axis] = std::min(bounds[0][axis], p[axis]);
+					bounds[1][axis] = std::max(bounds[1][axis], p[axis]);
+				}
+			}
+
+			return bounds;
+		}
+
+		/*! Same split as the lazy builder: centroid midpoint of the largest axis with a even split as fallback. */
+		constexpr std::uint32_t Partition(std::uint32_t first, std::uint32_t last)
+		{
+			constexpr float lowest = std::numeric_limits<float>::lowest();
+			constexpr float highest = std::numeric_limits<float>::max();
+
+			fm::pvec3 min(highest, highest, highest);
+			fm::pvec3 max(lowest, lowest, lowest);
+			for (auto i = first; i < last; i += 3)
+			{
+				auto c = Centroid(i);
+				for (auto axis = 0; axis < 3; axis++)
+				{
+					min[axis] = std::min(min[axis], c[axis]);
+					max[axis] = std::max(max[axis], c[axis]);
+				}
+			}
+
+			const fm::pvec3 extent = max - min;
+			const int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+			const float split = min[axis] + extent[axis] * 0.5f;
+
+			auto mid = first;
+			for (auto i = first; i < last; i += 3)
+			{
+				if (Centroid(i)[axis] < split)
+				{
+					for (auto j = 0u; j < 3; j++) // `std::swap` isn't constexpr in C++17.
+					{
+						auto tmp = bvh.big_index_buffer[i + j];
+						bvh.big_index_buffer[i + j] = bvh.big_index_buffer[mid + j];
+						bvh.big_index_buffer[mid + j] = tmp;
+					}
+					mid += 3;
+				}
+			}
+
+			if (mid == first || mid == last)
+			{
+				mid = first + ((last - first) / 6) * 3;
+			}
+
+			return mid;
+		}
+
+		constexpr void Subdivide(std::uint32_t idx, std::uint32_t first, std::uint32_t last)
+		{
+			auto& node = bvh.node_pool[idx];
+			node.bbox = CalculateBoundingBox(first, last);
+			node.count = (last - first) / 3;
+			node.miss_link = -1;
+
+			// Stop subdividing if we have less than 3 primitives, same as `BVH<N>`.
+			if (node.count < 3)
+			{
+				node.left_first = -1;
+				node.bib_start = first;
+				node.num_indices = last;
+				return;
+			}
+
+			const auto mid = Partition(first, last);
+			const auto pair = bvh.num_nodes;
+			bvh.num_nodes += 2;
+
+			node.left_first = pair;
+			node.bib_start = 0;
+			node.num_indices = 0;
+
+			Subdivide(pair, first, mid);
+			Subdivide(pair + 1, mid, last);
+		}
+	};
+
+} /* detail */
+
+/*! Builds a BVH at compile time.
+ * Meant for small static assets (debug geometry, UI props) so they require no startup build and no heap.
+ * The result can be validated with `static_assert`s. Keep the assets small since compilers limit the amount of constexpr evaluation.
+ * Note that only `operator[]` can be used on the vectors in constant expressions, `.x`/`.y`/`.z` access a inactive union member.
+ */
+template<std::size_t V, std::size_t I>
+constexpr StaticBVH<I / 3> BuildStaticBVH(std::array<fm::pvec3, V> const& positions, std::array<std::uint16_t, I> const& indices)
+{
+	static_assert(I % 3 == 0 && I > 0, "`BuildStaticBVH` requires a non empty triangle list");
+
+	StaticBVH<I / 3> bvh;
+	bvh.big_index_buffer = indices;
+	bvh.num_nodes = 1;
+
+	detail::StaticBVHBuilder<V, I / 3> builder = { positions, bvh };
+	builder.Subdivide(0, 0, I);
+
+	return bvh;
+}
+
+/*! Finds the closest triangle of a `StaticBVH` hit by a ray. Same traversal and triangle test as `BVH<N>::Intersect`. */
+template<std::size_t V, std::uint32_t T>
+Intersection IntersectStaticBVH(StaticBVH<T> const& bvh, std::array<fm::pvec3, V> const& positions, fm::vec3 origin, fm::vec3 direction, float min_t, float max_t)
+{
+	Intersection retval;
+	retval.closest_t = inf;
+
+	// Sized like the node pool, see `BVH<N>::Intersect`.
+	std::array<std::int32_t, T * 2 - 1> stack;
+	std::uint32_t stack_ptr = 0;
+	stack[stack_ptr++] = 0;
+
+	while (stack_ptr > 0)
+	{
+		auto const& node = bvh.node_pool[stack[--stack_ptr]];
+		if (!IntersectBVH(origin, direction, node))
+		{
+			continue;
+		}
+
+		if (node.left_first != -1)
+		{
+			stack[stack_ptr++] = static_cast<std::int32_t>(node.left_first);
+			stack[stack_ptr++] = static_cast<std::int32_t>(node.left_first) + 1;
+			continue;
+		}
+
+		for (auto i = static_cast<std::size_t>(node.bib_start); i < static_cast<std::size_t>(node.num_indices); i += 3)
+		{
+			Triangle tri;
+			tri.a = positions[bvh.big_index_buffer[i]];
+			tri.b = positions[bvh.big_index_buffer[i + 1]];
+			tri.c = positions[bvh.big_index_buffer[i + 2]];
+
+			const float t = IntersectRayTriangle(origin, direction, tri);
+			if (t < retval.closest_t && t > min_t && t < max_t)
+			{
+				retval.closest_t = t;
+				retval.closest = tri;
+			}
+		}
+	}
+
+	return retval;
+}
+
+namespace baked
+{
+
+	/*! 10x10 debug floor at y = 0 around the origin, built at compile time. */
+	std::array<fm::pvec3, 9> const& DebugFloorPositions();
+	StaticBVH<8> const& DebugFloorBVH();
+
+} /* baked */
@@ -0,0 +1,409 @@
+#include "texture_cache.hpp"
+
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace rlr
+{
+
+	namespace
+	{
+
+		constexpr std::uint32_t tiled_texture_magic = 0x54524C52; // "RLRT"
+		constexpr std::uint32_t tiled_texture_version = 2;
+
+		struct TiledTextureHeader
+		{
+			std::uint32_t magic;
+			std::uint32_t version;
+			std::uint32_t width;
+			std::uint32_t height;
+			std::uint32_t tile_size;
+			std::uint32_t num_mips;
+			TextureFormat format;
+		};
+
+		/*! Decoded block of a compressed texture, `cache_id` 0 is unused. */
+		struct DecodedBlock
+		{
+			std::uint32_t cache_id = 0;
+			TextureId texture;
+			std::uint32_t tile;
+			std::uint32_t block;
+			std::uint32_t texels[16];
+		};
+
+		constexpr std::size_t num_decoded_blocks = 256; // Indexed by the top 8 bits of a hash.
+		thread_local std::array<DecodedBlock, num_decoded_blocks> decoded_blocks;
+		std::atomic<std::uint32_t> next_cache_id = 1;
+
+		std::uint32_t NumTiles(std::uint32_t size, std::uint32_t tile_size)
+		{
+			return (size + tile_size - 1) / tile_size;
+		}
+
+		std::size_t TileBytes(TextureFormat format, std::uint32_t tile_size)
+		{
+			if (format == TextureFormat::rgba8)
+			{
+				return std::size_t(tile_size + 1) * (tile_size + 1) * sizeof(std::uint32_t);
+			}
+			return std::size_t(tile_size / 4) * (tile_size / 4) * BlockBytes(format);
+		}
+
+		bool IsValidTileSize(TextureFormat format, std::uint32_t tile_size)
+		{
+			return tile_size > 0 && (format == TextureFormat::rgba8 || tile_size % 4 == 0);
+		}
+
+		/*! Averages 2x2 texels per channel, clamping at the edge of odd sized levels. */
+		std::vector<std::uint32_t> Downsample(std::vector<std::uint32_t> const& src, std::uint32_t width, std::uint32_t height)
+		{
+			const std::uint32_t dst_width = std::max(1u, width / 2);
+			const std::uint32_t dst_height = std::max(1u, height / 2);
+			std::vector<std::uint32_t> dst(std::size_t(dst_width) * dst_height);
+
+			for (std::uint32_t y = 0; y < dst_height; y++)
+			{
+				const std::uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+				for (std::uint32_t x = 0; x < dst_width; x++)
+				{
+					const std::uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+					const std::uint32_t texels[4] = {
+						src[std::size_t(y0) * width + x0], src[std::size_t(y0) * width + x1],
+						src[std::size_t(y1) * width + x0], src[std::size_t(y1) * width + x1] };
+
+					std::uint32_t result = 0;
+					for (std::uint32_t shift = 0; shift < 32; shift += 8)
+					{
+						std::uint32_t sum = 2;
+						for (auto texel : texels)
+						{
+							sum += (texel >> shift) & 0xFF;
+						}
+						result |= (sum / 4) << shift;
+					}
+					dst[std::size_t(y) * dst_width + x] = result;
+				}
+			}
+
+			return dst;
+		}
+
+		fm::vec4 Unpack(std::uint32_t texel)
+		{
+			return fm::vec4(float(texel & 0xFF), float((texel >> 8) & 0xFF), float((texel >> 16) & 0xFF), float(texel >> 24)) * (1.f / 255.f);
+		}
+
+		std::uint32_t Wrap(float coord, std::uint32_t size)
+		{
+			const auto i = static_cast<std::int64_t>(coord) % static_cast<std::int64_t>(size);
+			return static_cast<std::uint32_t>(i < 0 ? i + size : i);
+		}
+
+	} /* anonymous */
+
+	void SaveTiledTexture(std::string const& path, std::uint32_t width, std::uint32_t height,
+		std::vector<std::uint32_t> const& pixels, std::uint32_t tile_size, TextureFormat format)
+	{
+		if (width == 0 || height == 0 || !IsValidTileSize(format, tile_size) || pixels.size() != std::size_t(width) * height)
+		{
+			throw std::runtime_error("Invalid texture dimensions for " + path);
+		}
+
+		std::vector<std::vector<std::uint32_t>> levels = { pixels };
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> sizes = { { width, height } };
+		while (sizes.back().first > 1 || sizes.back().second > 1)
+		{
+			const auto [w, h] = sizes.back();
+			levels.push_back(Downsample(levels.back(), w, h));
+			sizes.emplace_back(std::max(1u, w / 2), std::max(1u, h / 2));
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		const TiledTextureHeader header = { tiled_texture_magic, tiled_texture_version, width, height, tile_size, static_cast<std::uint32_t>(levels.size()), format };
+		file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+		const bool compressed = format != TextureFormat::rgba8;
+		const std::uint32_t stride = compressed ? tile_size : tile_size + 1;
+		const std::size_t block_bytes = BlockBytes(format);
+		std::vector<std::uint32_t> texels(std::size_t(stride) * stride);
+		std::vector<std::uint8_t> blocks(TileBytes(format, tile_size));
+		for (std::size_t level = 0; level < levels.size(); level++)
+		{
+			const auto [w, h] = sizes[level];
+			for (std::uint32_t ty = 0; ty < NumTiles(h, tile_size); ty++)
+			{
+				for (std::uint32_t tx = 0; tx < NumTiles(w, tile_size); tx++)
+				{
+					for (std::uint32_t y = 0; y < stride; y++)
+					{
+						const std::uint32_t src_y = (ty * tile_size + y) % h;
+						for (std::uint32_t x = 0; x < stride; x++)
+						{
+							texels[std::size_t(y) * stride + x] = levels[level][std::size_t(src_y) * w + (tx * tile_size + x) % w];
+						}
+					}
+
+					if (!compressed)
+					{
+						file.write(reinterpret_cast<char const*>(texels.data()), texels.size() * sizeof(std::uint32_t));
+						continue;
+					}
+
+					for (std::uint32_t by = 0; by < tile_size / 4; by++)
+					{
+						for (std::uint32_t bx = 0; bx < tile_size / 4; bx++)
+						{
+							std::uint32_t block[16];
+							for (std::uint32_t i = 0; i < 16; i++)
+							{
+								block[i] = texels[std::size_t(by * 4 + i / 4) * stride + bx * 4 + i % 4];
+							}
+							EncodeBlock(format, block, &blocks[(by * (tile_size / 4) + bx) * block_bytes]);
+						}
+					}
+					file.write(reinterpret_cast<char const*>(blocks.data()), blocks.size());
+				}
+			}
+		}
+
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write " + path);
+		}
+	}
+
+	void ComputeUvDifferentials(fm::vec3 const& p0, fm::vec3 const& p1, fm::vec3 const& p2,
+		fm::vec2 const& uv0, fm::vec2 const& uv1, fm::vec2 const& uv2,
+		fm::vec3 const& dpdx, fm::vec3 const& dpdy, fm::vec2& duv_dx, fm::vec2& duv_dy)
+	{
+		// Least squares fit of the differentials to the triangle's edges, which gives their barycentric offsets.
+		const fm::vec3 e1 = p1 - p0;
+		const fm::vec3 e2 = p2 - p0;
+		const float a = e1.Dot(e1), b = e1.Dot(e2), c = e2.Dot(e2);
+		const float det = a * c - b * b;
+		if (std::abs(det) < 1e-20f)
+		{
+			duv_dx = fm::vec2(0, 0);
+			duv_dy = fm::vec2(0, 0);
+			return;
+		}
+
+		fm::vec2 duv1 = uv1 - uv0;
+		fm::vec2 duv2 = uv2 - uv0;
+		auto to_uv = [&](fm::vec3 const& dp)
+		{
+			const float r1 = e1.Dot(dp), r2 = e2.Dot(dp);
+			const float b1 = (c * r1 - b * r2) / det;
+			const float b2 = (a * r2 - b * r1) / det;
+			return duv1 * b1 + duv2 * b2;
+		};
+		duv_dx = to_uv(dpdx);
+		duv_dy = to_uv(dpdy);
+	}
+
+	TextureCache::TextureCache(std::size_t budget_bytes, std::uint32_t tile_size, TextureFormat format)
+		: m_id(next_cache_id.fetch_add(1, std::memory_order_relaxed)), m_tile_size(tile_size), m_format(format),
+		m_pages(budget_bytes, IsValidTileSize(format, tile_size) ? TileBytes(format, tile_size) : 0)
+	{
+		if (!IsValidTileSize(format, tile_size))
+		{
+			throw std::runtime_error("Invalid texture cache tile size");
+		}
+	}
+
+	TextureId TextureCache::AddTexture(std::string const& path)
+	{
+		TiledTextureHeader header;
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.magic != tiled_texture_magic || header.version != tiled_texture_version)
+		{
+			throw std::runtime_error(path + " is not a tiled texture");
+		}
+		if (header.tile_size != m_tile_size || header.format != m_format)
+		{
+			throw std::runtime_error(path + " doesn't match the texture cache's tile size or format");
+		}
+
+		Texture texture;
+		texture.width = header.width;
+		texture.height = header.height;
+		std::uint32_t num_tiles = 0;
+		for (std::uint32_t level = 0; level < header.num_mips; level++)
+		{
+			Mip mip;
+			mip.width = std::max(1u, header.width >> level);
+			mip.height = std::max(1u, header.height >> level);
+			mip.tiles_x = NumTiles(mip.width, m_tile_size);
+			mip.first_tile = num_tiles;
+			num_tiles += mip.tiles_x * NumTiles(mip.height, m_tile_size);
+			texture.mips.push_back(mip);
+		}
+
+		texture.file = m_pages.AddFile(path, sizeof(TiledTextureHeader), num_tiles);
+		m_textures.push_back(std::move(texture));
+		return static_cast<TextureId>(m_textures.size() - 1);
+	}
+
+	fm::vec4 TextureCache::Sample(TextureId texture, fm::vec2 const& uv, fm::vec2 const& duv_dx, fm::vec2 const& duv_dy)
+	{
+		return SampleLevel(texture, uv, ComputeLod(texture, duv_dx, duv_dy));
+	}
+
+	fm::vec4 TextureCache::SampleLevel(TextureId texture, fm::vec2 const& uv, float lod)
+	{
+		const auto max_level = static_cast<float>(m_textures[texture].mips.size() - 1);
+		lod = std::clamp(lod, 0.f, max_level);
+
+		const float level = std::floor(lod);
+		const float blend = lod - level;
+		const fm::vec4 fine = SampleBilinear(texture, static_cast<std::uint32_t>(level), uv);
+		if (blend == 0)
+		{
+			return fine;
+		}
+
+		const fm::vec4 coarse = SampleBilinear(texture, static_cast<std::uint32_t>(level) + 1, uv);
+		return fine + (coarse - fine) * blend;
+	}
+
+	float TextureCache::ComputeLod(TextureId texture, fm::vec2 const& duv_dx, fm::vec2 const& duv_dy) const
+	{
+		auto const& tex = m_textures[texture];
+		const fm::vec2 size(float(tex.width), float(tex.height));
+		const float footprint = std::max(fm::vec2(duv_dx * size).Length(), fm::vec2(duv_dy * size).Length());
+		return footprint > 0 ? std::log2(footprint) : 0.f;
+	}
+
+	void TextureCache::NextFrame()
+	{
+		m_pages.NextFrame();
+	}
+
+	std::uint32_t TextureCache::GetWidth(TextureId texture) const
+	{
+		return m_textures[texture].width;
+	}
+
+	std::uint32_t TextureCache::GetHeight(TextureId texture) const
+	{
+		return m_textures[texture].height;
+	}
+
+	std::uint32_t TextureCache::GetNumMips(TextureId texture) const
+	{
+		return static_cast<std::uint32_t>(m_textures[texture].mips.size());
+	}
+
+	TextureFormat TextureCache::GetFormat() const
+	{
+		return m_format;
+	}
+
+	std::size_t TextureCache::NumSlots() const
+	{
+		return m_pages.NumSlots();
+	}
+
+	std::size_t TextureCache::NumResidentTiles() const
+	{
+		return m_pages.NumResidentPages();
+	}
+
+	std::size_t TextureCache::NumMisses() const
+	{
+		return m_pages.NumMisses();
+	}
+
+	std::size_t TextureCache::NumEvictions() const
+	{
+		return m_pages.NumEvictions();
+	}
+
+	std::size_t TextureCache::MemoryUsage() const
+	{
+		return m_pages.MemoryUsage();
+	}
+
+	fm::vec4 TextureCache::SampleBilinear(TextureId texture, std::uint32_t level, fm::vec2 const& uv)
+	{
+		auto const& mip = m_textures[texture].mips[level];
+		const float x = (uv.x - std::floor(uv.x)) * mip.width - 0.5f;
+		const float y = (uv.y - std::floor(uv.y)) * mip.height - 0.5f;
+		const float x0 = std::floor(x);
+		const float y0 = std::floor(y);
+		const float fx = x - x0;
+		const float fy = y - y0;
+
+		const std::uint32_t tx = Wrap(x0, mip.width);
+		const std::uint32_t ty = Wrap(y0, mip.height);
+
+		std::uint32_t t00, t10, t01, t11;
+		if (m_format == TextureFormat::rgba8)
+		{
+			// The tile's extra row and column hold the right and bottom neighbours, so all four texels are in one slot.
+			const std::uint32_t tile = mip.first_tile + (ty / m_tile_size) * mip.tiles_x + tx / m_tile_size;
+			const std::size_t stride = m_tile_size + 1;
+			const auto slot = m_pages.Acquire(m_textures[texture].file, tile);
+			std::uint32_t const* texels = static_cast<std::uint32_t const*>(m_pages.GetData(slot)) + (ty % m_tile_size) * stride + tx % m_tile_size;
+			t00 = texels[0], t10 = texels[1], t01 = texels[stride], t11 = texels[stride + 1];
+			m_pages.Release(slot);
+		}
+		else
+		{
+			const std::uint32_t tx1 = (tx + 1) % mip.width;
+			const std::uint32_t ty1 = (ty + 1) % mip.height;
+			t00 = FetchCompressed(texture, mip, tx, ty);
+			t10 = FetchCompressed(texture, mip, tx1, ty);
+			t01 = FetchCompressed(texture, mip, tx, ty1);
+			t11 = FetchCompressed(texture, mip, tx1, ty1);
+		}
+
+		const fm::vec4 top = Unpack(t00) + (Unpack(t10) - Unpack(t00)) * fx;
+		const fm::vec4 bottom = Unpack(t01) + (Unpack(t11) - Unpack(t01)) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	std::uint32_t TextureCache::FetchCompressed(TextureId texture, Mip const& mip, std::uint32_t x, std::uint32_t y)
+	{
+		const std::uint32_t tile = mip.first_tile + (y / m_tile_size) * mip.tiles_x + x / m_tile_size;
+		const std::uint32_t block = ((y % m_tile_size) / 4) * (m_tile_size / 4) + (x % m_tile_size) / 4;
+
+		const std::uint64_t hash = ((std::uint64_t(texture) << 40) ^ (std::uint64_t(tile) << 10) ^ block) * 0x9E3779B97F4A7C15ull;
+		auto& entry = decoded_blocks[hash >> 56];
+		if (entry.cache_id != m_id || entry.texture != texture || entry.tile != tile || entry.block != block)
+		{
+			// Only the block is copied while the slot is pinned, decoding happens after the release.
+			const std::size_t block_bytes = BlockBytes(m_format);
+			std::uint8_t data[16];
+			const auto slot = m_pages.Acquire(m_textures[texture].file, tile);
+			std::memcpy(data, static_cast<std::uint8_t const*>(m_pages.GetData(slot)) + block * block_bytes, block_bytes);
+			m_pages.Release(slot);
+
+			DecodeBlock(m_format, data, entry.texels);
+			entry.cache_id = m_id;
+			entry.texture = texture;
+			entry.tile = tile;
+			entry.block = block;
+		}
+
+		return entry.texels[(y % 4) * 4 + x % 4];
+	}
+
+} /* rlr */
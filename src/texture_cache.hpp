@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vec.hpp"
+#include "page_cache.hpp"
+#include "block_compression.hpp"
+
+namespace rlr
+{
+
+	using TextureId = std::uint32_t;
+
+	constexpr std::uint32_t default_tile_size = 64;
+
+	/*! Writes `pixels` (`width` * `height` RGBA8, red in the lowest byte) as a tiled texture file with a full box filtered mip chain.
+	 * An `rgba8` tile is stored as `tile_size` + 1 texels squared. The extra row and column repeat the first texels
+	 * of the neighbouring tile (wrapping at the texture edge), so a bilinear lookup never needs a second tile.
+	 * A block compressed tile is stored as its `tile_size` / 4 squared blocks in row order, `tile_size` has to be a multiple of 4.
+	 * Throws `std::runtime_error` if the file can't be written.
+	 */
+	void SaveTiledTexture(std::string const& path, std::uint32_t width, std::uint32_t height,
+		std::vector<std::uint32_t> const& pixels, std::uint32_t tile_size = default_tile_size, TextureFormat format = TextureFormat::rgba8);
+
+	/*! Texture coordinate differentials of a hit on the triangle `p0`, `p1`, `p2` from the ray differentials `dpdx` and `dpdy`
+	 * (the offsets of the neighbouring pixels' rays on the surface), for `TextureCache::Sample`.
+	 */
+	void ComputeUvDifferentials(fm::vec3 const& p0, fm::vec3 const& p1, fm::vec3 const& p2,
+		fm::vec2 const& uv0, fm::vec2 const& uv1, fm::vec2 const& uv2,
+		fm::vec3 const& dpdx, fm::vec3 const& dpdy, fm::vec2& duv_dx, fm::vec2& duv_dy);
+
+	/*! Fixed size tile cache for tiled textures (`SaveTiledTexture`) shared by all render threads.
+	 * Tiles are loaded from disk the first time they are sampled, so the memory stays within the budget however large the texture set is.
+	 * Every tile is a page of a `PageCache`, so lookups don't lock and misses evict the least recently used tile.
+	 * All textures of a cache share one format. Block compressed tiles stay compressed in the cache, sampled blocks are
+	 * decoded into a small cache per thread so neighbouring samples don't decode or pin again
+	 * (and don't refresh the tile's recency).
+	 */
+	class TextureCache
+	{
+	public:
+		/*! Throws `std::runtime_error` if `budget_bytes` holds fewer than `PageCache::min_slots` tiles. */
+		explicit TextureCache(std::size_t budget_bytes, std::uint32_t tile_size = default_tile_size, TextureFormat format = TextureFormat::rgba8);
+
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		/*! Opens a tiled texture. Only the header is read.
+		 * Not thread safe, add the textures before sampling.
+		 * Throws `std::runtime_error` if the file can't be read or its tile size or format doesn't match the cache.
+		 */
+		TextureId AddTexture(std::string const& path);
+
+		/*! Trilinear sample with wrapping. The mip level is picked from the uv differentials between neighbouring pixels. */
+		fm::vec4 Sample(TextureId texture, fm::vec2 const& uv, fm::vec2 const& duv_dx, fm::vec2 const& duv_dy);
+
+		/*! Trilinear sample of the fractional mip level `lod`. */
+		fm::vec4 SampleLevel(TextureId texture, fm::vec2 const& uv, float lod);
+
+		/*! Mip level whose texels match the larger of the two uv differentials. */
+		float ComputeLod(TextureId texture, fm::vec2 const& duv_dx, fm::vec2 const& duv_dy) const;
+
+		/*! Advances the recency counter. Tiles sampled before the call are older than the ones sampled after it. */
+		void NextFrame();
+
+		std::uint32_t GetWidth(TextureId texture) const;
+		std::uint32_t GetHeight(TextureId texture) const;
+		std::uint32_t GetNumMips(TextureId texture) const;
+		TextureFormat GetFormat() const;
+
+		std::size_t NumSlots() const;
+		std::size_t NumResidentTiles() const;
+		std::size_t NumMisses() const;
+		std::size_t NumEvictions() const;
+		/*! Bytes of tile memory, which is allocated up front. */
+		std::size_t MemoryUsage() const;
+
+	private:
+		struct Mip
+		{
+			std::uint32_t width;
+			std::uint32_t height;
+			std::uint32_t tiles_x;
+			std::uint32_t first_tile;
+		};
+
+		struct Texture
+		{
+			std::uint32_t file; // In `m_pages`.
+			std::uint32_t width;
+			std::uint32_t height;
+			std::vector<Mip> mips;
+		};
+
+		/*! Bilinear sample of mip `level`. */
+		fm::vec4 SampleBilinear(TextureId texture, std::uint32_t level, fm::vec2 const& uv);
+		/*! Texel of a block compressed mip through the calling thread's decoded blocks. */
+		std::uint32_t FetchCompressed(TextureId texture, Mip const& mip, std::uint32_t x, std::uint32_t y);
+
+		std::uint32_t m_id; // Distinguishes the caches in the per thread decoded blocks.
+		std::uint32_t m_tile_size;
+		TextureFormat m_format;
+		PageCache m_pages;
+		std::vector<Texture> m_textures;
+	};
+
+} /* rlr */
@@ -2,23 +2,54 @@
 
 #include <cmath>
 #include <cstring>
+#include <type_traits>
+
+// SSE2 is always available on x64. SSE4.1 is only used when the compiler is allowed to (`-msse4.1`, `/arch:AVX` and up).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FM_SIMD_AVAILABLE 1
+#include <immintrin.h>
+#else
+#define FM_SIMD_AVAILABLE 0
+#endif
+
+#if FM_SIMD_AVAILABLE && (defined(__SSE4_1__) || defined(__AVX__))
+#define FM_SSE41_AVAILABLE 1
+#else
+#define FM_SSE41_AVAILABLE 0
+#endif
 
 /*! Fast Math
  * This class contains a vector implementation for any size.
- * SIMD/unrolling is only supported by 3D vectors.
+ * SIMD/unrolling is only supported by 3D and 4D float vectors.
  * Define `FM_USE_SIMD` to always use SIMD instead of unrolling.
  * The third `Vec` template argument is used to force SIMD as well.
+ * SIMD 3D vectors are padded to 16 bytes. Use `pvec3`/`pvec4` for data that has to match the HLSL struct layout.
+ * When the target has no SSE the SIMD vectors fall back to the scalar implementation.
+ * The SIMD operations perform the same IEEE operations in the same order as the scalar code so the results are identical.
  */
 namespace fm
 {
 
+#ifdef FM_USE_SIMD
+	constexpr bool use_simd = true;
+#else
+	constexpr bool use_simd = false;
+#endif
+
+	namespace detail
+	{
+		/*! Whether a vector is backed by a SSE register. */
+		template<class T, unsigned int R, bool SIMD>
+		constexpr bool is_sse = FM_SIMD_AVAILABLE && SIMD && std::is_same_v<T, float> && (R == 3 || R == 4);
+	}
+
 	/*! Storage classes
 	 *  These classes define the different access types like `rgb`, `xyz` and etc.
 	 */
 	namespace storage
 	{
 		/*! Fallback storage structure */
-		template<class T, int R>
+		template<class T, int R, bool SIMD = false>
 		struct Vec
 		{
 			union
@@ -28,8 +59,8 @@ namespace fm
 		};
 
 		/*! 4D vector storage structure */
-		template<class T>
-		struct Vec<T, 4>
+		template<class T, bool SIMD>
+		struct Vec<T, 4, SIMD>
 		{
 		public:
 			union
@@ -41,8 +72,8 @@ namespace fm
 		};
 
 		/*! 3D vector storage structure */
-		template<class T>
-		struct Vec<T, 3>
+		template<class T, bool SIMD>
+		struct Vec<T, 3, SIMD>
 		{
 		public:
 			union
@@ -54,8 +85,8 @@ namespace fm
 		};
 
 		/*! 2D vector storage structure */
-		template<class T>
-		struct Vec<T, 2>
+		template<class T, bool SIMD>
+		struct Vec<T, 2, SIMD>
 		{
 			union
 			{
@@ -63,38 +94,77 @@ namespace fm
 				struct { T x, y; };
 			};
 		};
+
+#if FM_SIMD_AVAILABLE
+		/*! SIMD 4D vector storage structure */
+		template<>
+		struct alignas(16) Vec<float, 4, true>
+		{
+		public:
+			union
+			{
+				float data[4];
+				__m128 simd;
+				struct { float x, y, z, w; };
+				struct { float r, g, b, a; };
+			};
+		};
+
+		/*! SIMD 3D vector storage structure. Padded to 16 bytes, the padding is kept at 0. */
+		template<>
+		struct alignas(16) Vec<float, 3, true>
+		{
+		public:
+			union
+			{
+				float data[4];
+				__m128 simd;
+				struct { float x, y, z; };
+				struct { float r, g, b; };
+			};
+		};
+#endif
 	}
 
 	/*! Main Vector class
 	 *  Supports automatic unrolling for 3D vectors.
-	 *  and SIMD for 3D vectors.
+	 *  and SIMD for 3D and 4D float vectors.
 	 */
-	template<class T = float, unsigned int R = 3, bool SIMD = false>
-	class Vec : public storage::Vec<T, R>
+	template<class T = float, unsigned int R = 3, bool SIMD = use_simd>
+	class Vec : public storage::Vec<T, R, detail::is_sse<T, R, SIMD>>
 	{
+		using Storage = storage::Vec<T, R, detail::is_sse<T, R, SIMD>>;
+		static constexpr bool sse = detail::is_sse<T, R, SIMD>;
+
 	public:
-		using storage::Vec<T, R>::data;
+		using Storage::data;
 
 		// Constructors for multiple dimensions
-		constexpr Vec(T x, T y) : storage::Vec<T, R>{ x, y } {}
-		constexpr Vec(T x, T y, T z) : storage::Vec<T, R>{ x, y, z } {}
-		constexpr Vec(T x, T y, T z, T w) : storage::Vec<T, R>{ x, y, z, w } {}
+		constexpr Vec(T x, T y) : Storage{ x, y } {}
+		constexpr Vec(T x, T y, T z) : Storage{ x, y, z } {}
+		constexpr Vec(T x, T y, T z, T w) : Storage{ x, y, z, w } {}
 
 		/*! Default constructor initializes the data to 0 */
-		constexpr Vec()
+		constexpr Vec() : Storage{}
 		{
-			for (decltype(R) i = 0; i < R; i++)
-			{
-				data[i] = 0;
-			}
 		}
 
 		/*! Constructs a vector from an array */
-		constexpr explicit Vec(T data[R])
+		constexpr explicit Vec(T data[R]) : Storage{}
 		{
 			std::memcpy(this->data, data, sizeof(T) * R);
 		}
 
+		/*! Converts between the SIMD and non SIMD version of a vector. */
+		template<bool OTHER_SIMD, typename = std::enable_if_t<OTHER_SIMD != SIMD>>
+		constexpr Vec(Vec<T, R, OTHER_SIMD> const& other) : Storage{}
+		{
+			for (decltype(R) i = 0; i < R; i++)
+			{
+				data[i] = other.data[i];
+			}
+		}
+
 		~Vec() = default;
 
 		/*!
@@ -106,9 +176,21 @@ namespace fm
 			return data[i];
 		}
 
+		constexpr T const& operator[] (int i) const
+		{
+			return data[i];
+		}
+
 		/*! Addition assignment operator */
 		constexpr Vec& operator+=(const Vec& rhs)
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				this->simd = _mm_add_ps(this->simd, rhs.simd);
+				return *this;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				data[i] += rhs.data[i];
@@ -119,6 +201,13 @@ namespace fm
 		/*! Subtraction assignment operator */
 		constexpr Vec& operator-=(const Vec& rhs)
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				this->simd = _mm_sub_ps(this->simd, rhs.simd);
+				return *this;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				data[i] -= rhs.data[i];
@@ -129,6 +218,13 @@ namespace fm
 		/*! Multiplication assignment operator */
 		constexpr Vec& operator*=(const Vec& rhs)
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				this->simd = _mm_mul_ps(this->simd, rhs.simd);
+				return *this;
+			}
+#endif
 			if constexpr (R == 3)
 			{
 				data[0] *= rhs.data[0];
@@ -156,6 +252,13 @@ namespace fm
 		constexpr Vec operator*(const T& scalar)
 		{
 			Vec r = *this;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				r.simd = _mm_mul_ps(r.simd, _mm_set1_ps(scalar));
+				return r;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				r.data[i] *= scalar;
@@ -167,6 +270,13 @@ namespace fm
 		constexpr Vec operator/(const T& scalar)
 		{
 			Vec r = *this;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				r.simd = _mm_div_ps(r.simd, _mm_set1_ps(scalar));
+				return r;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				r.data[i] /= scalar;
@@ -174,22 +284,27 @@ namespace fm
 			return r;
 		}
 
-		/*! Addition operator */
-		constexpr friend Vec operator+(Vec lhs, const Vec& rhs)
+		/*! Addition operator
+		 * The right hand side can be the SIMD or non SIMD version, the result has the type of the left hand side.
+		 */
+		template<bool RHS_SIMD>
+		constexpr friend Vec operator+(Vec lhs, const Vec<T, R, RHS_SIMD>& rhs)
 		{
 			lhs += rhs;
 			return lhs;
 		}
 
 		/*! Subtraction operator */
-		constexpr friend Vec operator-(Vec lhs, const Vec& rhs)
+		template<bool RHS_SIMD>
+		constexpr friend Vec operator-(Vec lhs, const Vec<T, R, RHS_SIMD>& rhs)
 		{
 			lhs -= rhs;
 			return lhs;
 		}
 
 		/*! Multiply operator */
-		constexpr friend Vec operator*(Vec lhs, const Vec& rhs)
+		template<bool RHS_SIMD>
+		constexpr friend Vec operator*(Vec lhs, const Vec<T, R, RHS_SIMD>& rhs)
 		{
 			lhs *= rhs;
 			return lhs;
@@ -198,6 +313,13 @@ namespace fm
 		/*! Equal to operator */
 		constexpr bool operator==(const Vec& other) const
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				constexpr int mask = (1 << R) - 1;
+				return (_mm_movemask_ps(_mm_cmpeq_ps(this->simd, other.simd)) & mask) == mask;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				if (data[i] != other.data[i])
@@ -212,6 +334,12 @@ namespace fm
 		/*! Not equal to operator */
 		constexpr bool operator!=(const Vec& other) const
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				return !(*this == other);
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				if (data[i] != other.data[i])
@@ -226,6 +354,12 @@ namespace fm
 		/*! Returns the square root length of the vector. */
 		constexpr T SqrtLength()
 		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				return Dot(*this);
+			}
+#endif
 			T retval = 0;
 
 			for (decltype(R) i = 0; i < R; i++)
@@ -248,6 +382,13 @@ namespace fm
 			Vec retval;
 			const T l = Length();
 
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_div_ps(this->simd, _mm_set1_ps(l));
+				return retval;
+			}
+#endif
 			for (decltype(R) i = 0; i < R; i++)
 			{
 				retval.data[i] = data[i] / l;
@@ -259,15 +400,7 @@ namespace fm
 		/*! Returns a normalized version of `v`. */
 		constexpr static Vec Normalize(Vec v)
 		{
-			Vec retval;
-			const T l = v.Length();
-
-			for (decltype(R) i = 0; i < R; i++)
-			{
-				retval.data[i] = v.data[i] / l;
-			}
-
-			return retval;
+			return v.Normalized();
 		}
 
 		/*! 3D Dot product between itself and another vector. */
@@ -275,6 +408,20 @@ namespace fm
 		{
 			static_assert(R > 2, "`Dot` is only valid for 3D vectors");
 
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				// Sum the products one by one (((x + y) + z) + w) to match the scalar order. Faster than dpps, which is several uops on most CPUs.
+				const __m128 products = _mm_mul_ps(this->simd, other.simd);
+				__m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+				sum = _mm_add_ss(sum, _mm_movehl_ps(products, products));
+				if constexpr (R == 4)
+				{
+					sum = _mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(3, 3, 3, 3)));
+				}
+				return _mm_cvtss_f32(sum);
+			}
+#endif
 			T retval = 0;
 
 			for (decltype(R) i = 0; i < R; i++)
@@ -292,12 +439,66 @@ namespace fm
 
 			Vec retval;
 
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				// a.yzx * b.zxy - a.zxy * b.yzx. The w component ends up as w * w - w * w.
+				const __m128 a_yzx = _mm_shuffle_ps(this->simd, this->simd, _MM_SHUFFLE(3, 0, 2, 1));
+				const __m128 a_zxy = _mm_shuffle_ps(this->simd, this->simd, _MM_SHUFFLE(3, 1, 0, 2));
+				const __m128 b_yzx = _mm_shuffle_ps(other.simd, other.simd, _MM_SHUFFLE(3, 0, 2, 1));
+				const __m128 b_zxy = _mm_shuffle_ps(other.simd, other.simd, _MM_SHUFFLE(3, 1, 0, 2));
+				const __m128 cross = _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+				// Clear w in the register, same as the scalar version. Also keeps 3D padding at 0 if w * w overflowed.
+				retval.simd = _mm_and_ps(cross, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+				return retval;
+			}
+#endif
 			retval.data[0] = data[1] * other.data[2] - data[2] * other.data[1];
 			retval.data[1] = data[2] * other.data[0] - data[0] * other.data[2];
 			retval.data[2] = data[0] * other.data[1] - data[1] * other.data[0];
 
 			return retval;
 		}
+
+		/*! Component wise minimum. Picks `a` unless `b` is smaller, like `std::min(a, b)`. */
+		constexpr static Vec Min(const Vec& a, const Vec& b)
+		{
+			Vec retval;
+
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_min_ps(b.simd, a.simd); // minps returns the second operand unless the first is smaller.
+				return retval;
+			}
+#endif
+			for (decltype(R) i = 0; i < R; i++)
+			{
+				retval.data[i] = b.data[i] < a.data[i] ? b.data[i] : a.data[i];
+			}
+
+			return retval;
+		}
+
+		/*! Component wise maximum. Picks `a` unless `b` is larger, like `std::max(a, b)`. */
+		constexpr static Vec Max(const Vec& a, const Vec& b)
+		{
+			Vec retval;
+
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_max_ps(b.simd, a.simd);
+				return retval;
+			}
+#endif
+			for (decltype(R) i = 0; i < R; i++)
+			{
+				retval.data[i] = a.data[i] < b.data[i] ? b.data[i] : a.data[i];
+			}
+
+			return retval;
+		}
 	};
 
 	// float typedefs.
@@ -306,6 +507,14 @@ namespace fm
 	using vec3 = Vec<float, 3>;
 	using vec4 = Vec<float, 4>;
 
+	// Packed float typedefs. Never use SIMD so the layout always matches the HLSL structs.
+	using pvec3 = Vec<float, 3, false>;
+	using pvec4 = Vec<float, 4, false>;
+
+	// SIMD float typedefs. Always use SIMD even if `FM_USE_SIMD` isn't defined.
+	using svec3 = Vec<float, 3, true>;
+	using svec4 = Vec<float, 4, true>;
+
 	// double typedefs.
 	using dvec = Vec<double, 3>;
 	using dvec2 = Vec<double, 2>;
@@ -318,4 +527,4 @@ namespace fm
 	using ivec3 = Vec<int, 3>;
 	using ivec4 = Vec<int, 4>;
 
-} /* fm */
\ No newline at end of file
+} /* fm */
@@ -0,0 +1,759 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "vec.hpp"
+
+#if FM_SIMD_AVAILABLE && defined(__AVX__)
+#define FM_AVX_AVAILABLE 1
+#else
+#define FM_AVX_AVAILABLE 0
+#endif
+
+/*! Fast Math batches
+ * Structure of arrays versions of the vector types: `Vec3x<N>` stores N 3D vectors as one `Floatx<N>` per component.
+ * The 4 wide batches use SSE and the 8 wide batches use AVX when the target supports it, otherwise they fall back to loops.
+ * Comparisons return a `Mask<N>` instead of a bool. Branches in ported kernels become `Select` calls or masked stores.
+ * The operator surface matches `fm::Vec` (and the free functions match HLSL) so kernels from `intersects.hlsl`
+ * and `util.hlsl` can be written once and instantiated at any width.
+ */
+namespace fm
+{
+
+	namespace detail
+	{
+		/*! Whether a batch is backed by a SSE register. */
+		template<unsigned int N>
+		constexpr bool is_sse_batch = FM_SIMD_AVAILABLE && N == 4;
+
+		/*! Whether a batch is backed by an AVX register. */
+		template<unsigned int N>
+		constexpr bool is_avx_batch = FM_AVX_AVAILABLE && N == 8;
+	}
+
+	namespace storage
+	{
+		/*! Fallback batch storage structure */
+		template<unsigned int N, bool SSE = detail::is_sse_batch<N>, bool AVX = detail::is_avx_batch<N>>
+		struct Batch
+		{
+			union
+			{
+				float data[N];
+				std::uint32_t bits[N];
+			};
+		};
+
+#if FM_SIMD_AVAILABLE
+		/*! SSE batch storage structure */
+		template<>
+		struct alignas(16) Batch<4, true, false>
+		{
+			union
+			{
+				float data[4];
+				std::uint32_t bits[4];
+				__m128 simd;
+			};
+		};
+#endif
+
+#if FM_AVX_AVAILABLE
+		/*! AVX batch storage structure */
+		template<>
+		struct alignas(32) Batch<8, false, true>
+		{
+			union
+			{
+				float data[8];
+				std::uint32_t bits[8];
+				__m256 simd;
+			};
+		};
+#endif
+	}
+
+	/*! Lane mask returned by batch comparisons. A lane is either all bits set or all bits cleared. */
+	template<unsigned int N>
+	class Mask : public storage::Batch<N>
+	{
+		using Storage = storage::Batch<N>;
+		static constexpr bool sse = detail::is_sse_batch<N>;
+		static constexpr bool avx = detail::is_avx_batch<N>;
+
+	public:
+		using Storage::bits;
+
+		/*! Default constructor clears all lanes */
+		Mask() : Storage{}
+		{
+		}
+
+		/*! Sets or clears all lanes */
+		explicit Mask(bool value) : Storage{}
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				bits[i] = value ? ~0u : 0u;
+			}
+		}
+
+		/*! Returns whether lane `i` is set. */
+		bool operator[](int i) const
+		{
+			return bits[i] != 0;
+		}
+
+		/*! Sets or clears lane `i`. */
+		void Set(int i, bool value)
+		{
+			bits[i] = value ? ~0u : 0u;
+		}
+
+		/*! Returns the lanes as a bit mask where bit `i` is lane `i`. */
+		int Bits() const
+		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				return _mm_movemask_ps(this->simd);
+			}
+#endif
+#if FM_AVX_AVAILABLE
+			if constexpr (avx)
+			{
+				return _mm256_movemask_ps(this->simd);
+			}
+#endif
+			int retval = 0;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval |= (bits[i] >> 31) << i;
+			}
+			return retval;
+		}
+
+		/*! Returns true if any lane is set. */
+		bool Any() const
+		{
+			return Bits() != 0;
+		}
+
+		/*! Returns true if all lanes are set. */
+		bool All() const
+		{
+			return Bits() == (1 << N) - 1;
+		}
+
+		/*! Returns true if no lane is set. */
+		bool None() const
+		{
+			return Bits() == 0;
+		}
+
+		/*! Returns the number of set lanes. */
+		int Count() const
+		{
+			int retval = 0;
+			for (int b = Bits(); b; b &= b - 1)
+			{
+				retval++;
+			}
+			return retval;
+		}
+
+		friend Mask operator&(Mask lhs, const Mask& rhs)
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				lhs.bits[i] &= rhs.bits[i];
+			}
+			return lhs;
+		}
+
+		friend Mask operator|(Mask lhs, const Mask& rhs)
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				lhs.bits[i] |= rhs.bits[i];
+			}
+			return lhs;
+		}
+
+		friend Mask operator^(Mask lhs, const Mask& rhs)
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				lhs.bits[i] ^= rhs.bits[i];
+			}
+			return lhs;
+		}
+
+		Mask operator~() const
+		{
+			Mask retval = *this;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.bits[i] = ~retval.bits[i];
+			}
+			return retval;
+		}
+
+		Mask& operator&=(const Mask& rhs) { return *this = *this & rhs; }
+		Mask& operator|=(const Mask& rhs) { return *this = *this | rhs; }
+	};
+
+	/*! N floats in one register. The scalar equivalent of a `Vec` component. */
+	template<unsigned int N>
+	class Floatx : public storage::Batch<N>
+	{
+		using Storage = storage::Batch<N>;
+		static constexpr bool sse = detail::is_sse_batch<N>;
+		static constexpr bool avx = detail::is_avx_batch<N>;
+
+	public:
+		using Storage::data;
+		static constexpr unsigned int width = N;
+
+		/*! Default constructor initializes all lanes to 0 */
+		Floatx() : Storage{}
+		{
+		}
+
+		/*! Broadcasts `value` to all lanes */
+		Floatx(float value) : Storage{}
+		{
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				this->simd = _mm_set1_ps(value);
+				return;
+			}
+#endif
+#if FM_AVX_AVAILABLE
+			if constexpr (avx)
+			{
+				this->simd = _mm256_set1_ps(value);
+				return;
+			}
+#endif
+			for (unsigned int i = 0; i < N; i++)
+			{
+				data[i] = value;
+			}
+		}
+
+		/*! Loads N consecutive floats. */
+		static Floatx Load(float const* src)
+		{
+			Floatx retval;
+			std::memcpy(retval.data, src, sizeof(float) * N);
+			return retval;
+		}
+
+		/*! Stores N consecutive floats. */
+		void Store(float* dst) const
+		{
+			std::memcpy(dst, data, sizeof(float) * N);
+		}
+
+		float& operator[](int i)
+		{
+			return data[i];
+		}
+
+		float const& operator[](int i) const
+		{
+			return data[i];
+		}
+
+#if FM_SIMD_AVAILABLE
+#define FM_BATCH_OP(op, sse_fn, avx_fn)                      \
+		Floatx& operator op##=(const Floatx& rhs)            \
+		{                                                    \
+			if constexpr (sse)                               \
+			{                                                \
+				this->simd = sse_fn(this->simd, rhs.simd);   \
+				return *this;                                \
+			}                                                \
+			FM_BATCH_AVX(this->simd = avx_fn(this->simd, rhs.simd); return *this;) \
+			for (unsigned int i = 0; i < N; i++)             \
+			{                                                \
+				data[i] op##= rhs.data[i];                   \
+			}                                                \
+			return *this;                                    \
+		}
+#else
+#define FM_BATCH_OP(op, sse_fn, avx_fn)                      \
+		Floatx& operator op##=(const Floatx& rhs)            \
+		{                                                    \
+			for (unsigned int i = 0; i < N; i++)             \
+			{                                                \
+				data[i] op##= rhs.data[i];                   \
+			}                                                \
+			return *this;                                    \
+		}
+#endif
+
+#if FM_AVX_AVAILABLE
+#define FM_BATCH_AVX(...) if constexpr (avx) { __VA_ARGS__ }
+#else
+#define FM_BATCH_AVX(...)
+#endif
+
+		FM_BATCH_OP(+, _mm_add_ps, _mm256_add_ps)
+		FM_BATCH_OP(-, _mm_sub_ps, _mm256_sub_ps)
+		FM_BATCH_OP(*, _mm_mul_ps, _mm256_mul_ps)
+		FM_BATCH_OP(/, _mm_div_ps, _mm256_div_ps)
+
+#undef FM_BATCH_OP
+
+		friend Floatx operator+(Floatx lhs, const Floatx& rhs) { return lhs += rhs; }
+		friend Floatx operator-(Floatx lhs, const Floatx& rhs) { return lhs -= rhs; }
+		friend Floatx operator*(Floatx lhs, const Floatx& rhs) { return lhs *= rhs; }
+		friend Floatx operator/(Floatx lhs, const Floatx& rhs) { return lhs /= rhs; }
+
+		Floatx operator-() const
+		{
+			return Floatx(0.f) - *this;
+		}
+
+#if FM_SIMD_AVAILABLE
+#define FM_BATCH_CMP(op, sse_fn, avx_pred)                   \
+		friend Mask<N> operator op(const Floatx& lhs, const Floatx& rhs) \
+		{                                                    \
+			Mask<N> retval;                                  \
+			if constexpr (sse)                               \
+			{                                                \
+				retval.simd = sse_fn(lhs.simd, rhs.simd);    \
+				return retval;                               \
+			}                                                \
+			FM_BATCH_AVX(retval.simd = _mm256_cmp_ps(lhs.simd, rhs.simd, avx_pred); return retval;) \
+			for (unsigned int i = 0; i < N; i++)             \
+			{                                                \
+				retval.Set(i, lhs.data[i] op rhs.data[i]);   \
+			}                                                \
+			return retval;                                   \
+		}
+#else
+#define FM_BATCH_CMP(op, sse_fn, avx_pred)                   \
+		friend Mask<N> operator op(const Floatx& lhs, const Floatx& rhs) \
+		{                                                    \
+			Mask<N> retval;                                  \
+			for (unsigned int i = 0; i < N; i++)             \
+			{                                                \
+				retval.Set(i, lhs.data[i] op rhs.data[i]);   \
+			}                                                \
+			return retval;                                   \
+		}
+#endif
+
+		FM_BATCH_CMP(<, _mm_cmplt_ps, _CMP_LT_OQ)
+		FM_BATCH_CMP(<=, _mm_cmple_ps, _CMP_LE_OQ)
+		FM_BATCH_CMP(>, _mm_cmpgt_ps, _CMP_GT_OQ)
+		FM_BATCH_CMP(>=, _mm_cmpge_ps, _CMP_GE_OQ)
+		FM_BATCH_CMP(==, _mm_cmpeq_ps, _CMP_EQ_OQ)
+		FM_BATCH_CMP(!=, _mm_cmpneq_ps, _CMP_NEQ_UQ)
+
+#undef FM_BATCH_CMP
+
+		/*! Returns `a` in the lanes where `mask` is set and `b` elsewhere. */
+		static Floatx Select(const Mask<N>& mask, const Floatx& a, const Floatx& b)
+		{
+			Floatx retval;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				const __m128 m = mask.simd;
+#if FM_SSE41_AVAILABLE
+				retval.simd = _mm_blendv_ps(b.simd, a.simd, m);
+#else
+				retval.simd = _mm_or_ps(_mm_and_ps(m, a.simd), _mm_andnot_ps(m, b.simd));
+#endif
+				return retval;
+			}
+#endif
+			FM_BATCH_AVX(retval.simd = _mm256_blendv_ps(b.simd, a.simd, mask.simd); return retval;)
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.data[i] = mask[i] ? a.data[i] : b.data[i];
+			}
+			return retval;
+		}
+
+		/*! Assigns `value` to the lanes where `mask` is set. */
+		void Assign(const Mask<N>& mask, const Floatx& value)
+		{
+			*this = Select(mask, value, *this);
+		}
+
+		/*! Adds all lanes in order (lane 0 first). */
+		float HorizontalSum() const
+		{
+			float retval = data[0];
+			for (unsigned int i = 1; i < N; i++)
+			{
+				retval += data[i];
+			}
+			return retval;
+		}
+
+		/*! Returns the smallest lane. */
+		float HorizontalMin() const
+		{
+			return *std::min_element(data, data + N);
+		}
+
+		/*! Returns the largest lane. */
+		float HorizontalMax() const
+		{
+			return *std::max_element(data, data + N);
+		}
+
+		/*! Returns the sum of the lanes where `mask` is set. */
+		float HorizontalSum(const Mask<N>& mask) const
+		{
+			return Select(mask, *this, Floatx(0.f)).HorizontalSum();
+		}
+
+		/*! Returns the smallest lane where `mask` is set, or `fallback` if no lane is set. */
+		float HorizontalMin(const Mask<N>& mask, float fallback) const
+		{
+			return mask.Any() ? Select(mask, *this, Floatx(HUGE_VALF)).HorizontalMin() : fallback;
+		}
+
+		/*! Returns the largest lane where `mask` is set, or `fallback` if no lane is set. */
+		float HorizontalMax(const Mask<N>& mask, float fallback) const
+		{
+			return mask.Any() ? Select(mask, *this, Floatx(-HUGE_VALF)).HorizontalMax() : fallback;
+		}
+
+		/*! Per lane minimum. */
+		friend Floatx min(const Floatx& a, const Floatx& b)
+		{
+			Floatx retval;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_min_ps(a.simd, b.simd);
+				return retval;
+			}
+#endif
+			FM_BATCH_AVX(retval.simd = _mm256_min_ps(a.simd, b.simd); return retval;)
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.data[i] = a.data[i] < b.data[i] ? a.data[i] : b.data[i];
+			}
+			return retval;
+		}
+
+		/*! Per lane maximum. */
+		friend Floatx max(const Floatx& a, const Floatx& b)
+		{
+			Floatx retval;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_max_ps(a.simd, b.simd);
+				return retval;
+			}
+#endif
+			FM_BATCH_AVX(retval.simd = _mm256_max_ps(a.simd, b.simd); return retval;)
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.data[i] = a.data[i] > b.data[i] ? a.data[i] : b.data[i];
+			}
+			return retval;
+		}
+
+		/*! Per lane square root. */
+		friend Floatx sqrt(const Floatx& a)
+		{
+			Floatx retval;
+#if FM_SIMD_AVAILABLE
+			if constexpr (sse)
+			{
+				retval.simd = _mm_sqrt_ps(a.simd);
+				return retval;
+			}
+#endif
+			FM_BATCH_AVX(retval.simd = _mm256_sqrt_ps(a.simd); return retval;)
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.data[i] = std::sqrt(a.data[i]);
+			}
+			return retval;
+		}
+
+		/*! Per lane absolute value. */
+		friend Floatx abs(const Floatx& a)
+		{
+			Floatx retval = a;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.bits[i] &= 0x7fffffffu;
+			}
+			return retval;
+		}
+
+#undef FM_BATCH_AVX
+	};
+
+	/*! N 3D vectors stored as one `Floatx<N>` per component. */
+	template<unsigned int N>
+	class Vec3x
+	{
+	public:
+		using Lane = Floatx<N>;
+		static constexpr unsigned int width = N;
+
+		Lane x, y, z;
+
+		/*! Default constructor initializes all lanes to 0 */
+		Vec3x() = default;
+
+		Vec3x(Lane x, Lane y, Lane z) : x(x), y(y), z(z)
+		{
+		}
+
+		/*! Broadcasts `v` to all lanes */
+		template<bool SIMD>
+		explicit Vec3x(const Vec<float, 3, SIMD>& v) : x(v.data[0]), y(v.data[1]), z(v.data[2])
+		{
+		}
+
+		/*! Returns lane `i` as a regular vector. */
+		Vec<float, 3> Get(int i) const
+		{
+			return Vec<float, 3>(x[i], y[i], z[i]);
+		}
+
+		/*! Sets lane `i` from a regular vector. */
+		template<bool SIMD>
+		void Set(int i, const Vec<float, 3, SIMD>& v)
+		{
+			x[i] = v.data[0];
+			y[i] = v.data[1];
+			z[i] = v.data[2];
+		}
+
+		/*! Loads N consecutive vectors from an array of structures. */
+		template<bool SIMD>
+		static Vec3x Gather(Vec<float, 3, SIMD> const* src)
+		{
+			Vec3x retval;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.Set(i, src[i]);
+			}
+			return retval;
+		}
+
+		/*! Loads `src[indices[i]]` into lane `i`. */
+		template<bool SIMD, class I>
+		static Vec3x Gather(Vec<float, 3, SIMD> const* src, I const* indices)
+		{
+			Vec3x retval;
+			for (unsigned int i = 0; i < N; i++)
+			{
+				retval.Set(i, src[indices[i]]);
+			}
+			return retval;
+		}
+
+		/*! Loads `src[indices[i]]` into the lanes where `mask` is set. The other lanes are 0. */
+		template<bool SIMD, class I>
+		static Vec3x Gather(Vec<float, 3, SIMD> const* src, I const* indices, const Mask<N>& mask)
+		{
+			Vec3x retval;
+			for (int b = mask.Bits(); b; b &= b - 1)
+			{
+				const int i = LowestBit(b);
+				retval.Set(i, src[indices[i]]);
+			}
+			return retval;
+		}
+
+		/*! Stores the lanes to N consecutive vectors of an array of structures. */
+		template<bool SIMD>
+		void Scatter(Vec<float, 3, SIMD>* dst) const
+		{
+			for (unsigned int i = 0; i < N; i++)
+			{
+				dst[i] = Vec<float, 3, SIMD>(x[i], y[i], z[i]);
+			}
+		}
+
+		/*! Stores lane `i` to `dst[indices[i]]` for the lanes where `mask` is set. */
+		template<bool SIMD, class I>
+		void Scatter(Vec<float, 3, SIMD>* dst, I const* indices, const Mask<N>& mask) const
+		{
+			for (int b = mask.Bits(); b; b &= b - 1)
+			{
+				const int i = LowestBit(b);
+				dst[indices[i]] = Vec<float, 3, SIMD>(x[i], y[i], z[i]);
+			}
+		}
+
+		Vec3x& operator+=(const Vec3x& rhs)
+		{
+			x += rhs.x;
+			y += rhs.y;
+			z += rhs.z;
+			return *this;
+		}
+
+		Vec3x& operator-=(const Vec3x& rhs)
+		{
+			x -= rhs.x;
+			y -= rhs.y;
+			z -= rhs.z;
+			return *this;
+		}
+
+		Vec3x& operator*=(const Vec3x& rhs)
+		{
+			x *= rhs.x;
+			y *= rhs.y;
+			z *= rhs.z;
+			return *this;
+		}
+
+		/*! Multiplication operator. Every lane can have its own scalar. */
+		Vec3x operator*(const Lane& scalar) const
+		{
+			return Vec3x(x * scalar, y * scalar, z * scalar);
+		}
+
+		/*! Division operator. Every lane can have its own scalar. */
+		Vec3x operator/(const Lane& scalar) const
+		{
+			return Vec3x(x / scalar, y / scalar, z / scalar);
+		}
+
+		Vec3x operator-() const
+		{
+			return Vec3x(-x, -y, -z);
+		}
+
+		friend Vec3x operator+(Vec3x lhs, const Vec3x& rhs) { return lhs += rhs; }
+		friend Vec3x operator-(Vec3x lhs, const Vec3x& rhs) { return lhs -= rhs; }
+		friend Vec3x operator*(Vec3x lhs, const Vec3x& rhs) { return lhs *= rhs; }
+
+		/*! Per lane equal to operator */
+		Mask<N> operator==(const Vec3x& other) const
+		{
+			return (x == other.x) & (y == other.y) & (z == other.z);
+		}
+
+		/*! Per lane not equal to operator */
+		Mask<N> operator!=(const Vec3x& other) const
+		{
+			return (x != other.x) | (y != other.y) | (z != other.z);
+		}
+
+		/*! Returns the square root length of every lane. */
+		Lane SqrtLength() const
+		{
+			return Dot(*this);
+		}
+
+		/*! Returns the length/magnitude of every lane. */
+		Lane Length() const
+		{
+			return sqrt(SqrtLength());
+		}
+
+		/*! Returns a normalized version of itself. */
+		Vec3x Normalized() const
+		{
+			return *this / Length();
+		}
+
+		/*! Returns a normalized version of `v`. */
+		static Vec3x Normalize(Vec3x v)
+		{
+			return v.Normalized();
+		}
+
+		/*! Per lane dot product, summed in the same order as `Vec::Dot`. */
+		Lane Dot(const Vec3x& other) const
+		{
+			return x * other.x + y * other.y + z * other.z;
+		}
+
+		/*! Per lane cross product. */
+		Vec3x Cross(const Vec3x& other) const
+		{
+			return Vec3x(
+				y * other.z - z * other.y,
+				z * other.x - x * other.z,
+				x * other.y - y * other.x);
+		}
+
+		/*! Returns `a` in the lanes where `mask` is set and `b` elsewhere. */
+		static Vec3x Select(const Mask<N>& mask, const Vec3x& a, const Vec3x& b)
+		{
+			return Vec3x(Lane::Select(mask, a.x, b.x), Lane::Select(mask, a.y, b.y), Lane::Select(mask, a.z, b.z));
+		}
+
+		/*! Assigns `value` to the lanes where `mask` is set. */
+		void Assign(const Mask<N>& mask, const Vec3x& value)
+		{
+			*this = Select(mask, value, *this);
+		}
+
+		/*! Adds all lanes together. */
+		Vec<float, 3> HorizontalSum() const
+		{
+			return Vec<float, 3>(x.HorizontalSum(), y.HorizontalSum(), z.HorizontalSum());
+		}
+
+		/*! Component wise minimum over all lanes. */
+		Vec<float, 3> HorizontalMin() const
+		{
+			return Vec<float, 3>(x.HorizontalMin(), y.HorizontalMin(), z.HorizontalMin());
+		}
+
+		/*! Component wise maximum over all lanes. */
+		Vec<float, 3> HorizontalMax() const
+		{
+			return Vec<float, 3>(x.HorizontalMax(), y.HorizontalMax(), z.HorizontalMax());
+		}
+
+		/*! Per lane component wise minimum. */
+		friend Vec3x min(const Vec3x& a, const Vec3x& b)
+		{
+			return Vec3x(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z));
+		}
+
+		/*! Per lane component wise maximum. */
+		friend Vec3x max(const Vec3x& a, const Vec3x& b)
+		{
+			return Vec3x(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z));
+		}
+
+	private:
+		static int LowestBit(int b)
+		{
+			int i = 0;
+			while (!(b & (1 << i)))
+			{
+				i++;
+			}
+			return i;
+		}
+	};
+
+	// Batch typedefs.
+	using Floatx4 = Floatx<4>;
+	using Floatx8 = Floatx<8>;
+	using Mask4 = Mask<4>;
+	using Mask8 = Mask<8>;
+	using Vec3x4 = Vec3x<4>;
+	using Vec3x8 = Vec3x<8>;
+
+} /* fm */
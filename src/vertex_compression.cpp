@@ -0,0 +1,78 @@
+#include "vertex_compression.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+static_assert(sizeof(CompressedVertex) == 16, "The compressed vertex layout has to match the HLSL structured buffer");
+
+CompressedVertices CompressVertices(std::vector<Vertex> const& vertices)
+{
+	return CompressVertices(vertices.data(), vertices.size());
+}
+
+CompressedVertices CompressVertices(Vertex const* vertices, std::size_t count)
+{
+	CompressedVertices retval;
+	retval.vertices.reserve(count);
+	retval.positions.reserve(count);
+
+	const float big = std::numeric_limits<float>::max();
+	fm::vec3 min(big, big, big);
+	fm::vec3 max(-big, -big, -big);
+	for (std::size_t j = 0; j < count; j++)
+	{
+		for (auto i = 0; i < 3; i++)
+		{
+			min[i] = std::min(min[i], vertices[j].position[i]);
+			max[i] = std::max(max[i], vertices[j].position[i]);
+		}
+	}
+	if (count == 0)
+	{
+		min = max = fm::vec3(0, 0, 0);
+	}
+
+	fm::vec3 extent = max - min;
+	retval.quantization = {};
+	retval.quantization.quantization_min = min;
+	retval.quantization.quantization_scale = extent / 65535.f;
+
+	for (std::size_t j = 0; j < count; j++)
+	{
+		auto const& v = vertices[j];
+		if (v.material_idx < 0 || v.material_idx > 0xffff)
+		{
+			throw std::runtime_error("Material index doesn't fit in a compressed vertex");
+		}
+
+		std::uint32_t q[3];
+		for (auto i = 0; i < 3; i++)
+		{
+			q[i] = extent[i] > 0 ? fm::PackUnorm16((v.position[i] - min[i]) / extent[i]) : 0;
+		}
+
+		CompressedVertex cv;
+		cv.normal = fm::PackOctahedral(fm::vec3(v.normal.x, v.normal.y, v.normal.z));
+		cv.uv = fm::PackHalf2(v.uv.x, v.uv.y);
+		cv.position_xy = q[0] | (q[1] << 16);
+		cv.position_z_material = q[2] | (static_cast<std::uint32_t>(v.material_idx) << 16);
+
+		retval.vertices.push_back(cv);
+		retval.positions.push_back(v.position);
+	}
+
+	return retval;
+}
+
+Vertex DecompressVertex(CompressedVertex const& vertex, RTVertexQuantization const& quantization)
+{
+	const fm::pvec3 q(static_cast<float>(vertex.position_xy & 0xffff), static_cast<float>(vertex.position_xy >> 16), static_cast<float>(vertex.position_z_material & 0xffff));
+	const fm::vec3 n = fm::UnpackOctahedral(vertex.normal);
+
+	Vertex v = {};
+	v.position = quantization.quantization_min + q * quantization.quantization_scale;
+	v.material_idx = static_cast<std::int32_t>(vertex.position_z_material >> 16);
+	v.normal = fm::pvec3(n.x, n.y, n.z);
+	v.uv = fm::vec2(fm::HalfToFloat(static_cast<std::uint16_t>(vertex.uv)), fm::HalfToFloat(static_cast<std::uint16_t>(vertex.uv >> 16)));
+	return v;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "packing.hpp"
+#include "../raytracer.hlsl"
+
+/*! Vertex streams used by `USE_COMPRESSED_VERTICES`. */
+struct CompressedVertices
+{
+	std::vector<CompressedVertex> vertices; // Shading attributes.
+	std::vector<fm::pvec3> positions; // Full precision positions. Only used for intersection.
+	RTVertexQuantization quantization;
+};
+
+/*! Splits `vertices` into compressed shading attributes and full precision positions.
+ * Positions are quantized against the bounds of all vertices. Throws if a material index doesn't fit in 16 bits.
+ */
+CompressedVertices CompressVertices(std::vector<Vertex> const& vertices);
+
+/*! Compresses `count` vertices starting at `vertices`, e.g. only the used part of a padded vertex buffer. */
+CompressedVertices CompressVertices(Vertex const* vertices, std::size_t count);
+
+/*! CPU version of `LoadVertex` in `raytracer.hlsl`. */
+Vertex DecompressVertex(CompressedVertex const& vertex, RTVertexQuantization const& quantization);
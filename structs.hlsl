@@ -5,16 +5,17 @@
 #ifndef GPU
 #include "src/vec.hpp"
 #include "src/math_util.hpp"
+#include "src/approx.hpp"
 
 #include <array>
 
-#define float3 fm::vec3
+#define float3 fm::pvec3
 #define float2 fm::vec2
-#define float4 fm::vec4
+#define float4 fm::pvec4
 #define constant static constexpr
 #define cbuffer struct
 #define length(v) v.Length()
-#define normalize(v) fm::Vec<float, 3>::Normalize(v);
+#define normalize(v) fm::pvec3::Normalize(v);
 #define dot(a, b) a.Dot(b)
 #define cross(a, b) a.Cross(b)
 #define clamp(a, b, c) fm::clamp(a, b, c)
@@ -57,7 +58,8 @@ cbuffer RTProperties REGISTER_B(0)
 	float3 floor_color;
 	int use_cpu;
 	float exposure;
-	float3 padding;
+	int fast_math; // CPU only. Use the `fm` approximations for the shading transcendentals.
+	float2 padding;
 };
 
 struct Triangle
@@ -109,11 +111,53 @@ struct BVHNode
 {
 	ARRAY(float3, bbox, 2);
 	float left_first;
-	float count;
+	float count; // Triangles in the node's subtree, for leaves as well as interior nodes.
 
 	float num_indices;
 	float bib_start;
-	float2 padding;
+	float miss_link; // Only used by the threaded layout. Next node to visit when the ray misses this node or its subtree is done.
+	float first_cluster; // Only used by the clustered leaf format. The leaf's clusters follow until all its triangles are covered.
+};
+
+// Small mesh cluster used by the clustered leaf format.
+// The triangles use 8 bit indices local to the cluster's own vertex block.
+struct BVHCluster
+{
+	uint vertex_offset; // First vertex in `cluster_vertices`.
+	uint index_offset; // Byte offset of the first local index in `cluster_indices`.
+	uint num_vertices;
+	uint num_triangles;
+};
+
+struct ClusterVertex
+{
+	float3 position;
+	uint vertex_idx; // Index into `vertices`. Only fetched when shading a hit.
+};
+
+// Precomputed triangle used by `IntersectRayWoopTriangle`.
+// The rows are the inverse of the affine transform that maps the unit triangle (0,0,0), (1,0,0), (0,1,0) onto the triangle,
+// so a point in world space transforms to (u, v, distance to the triangle plane). The last row is scaled by the squared normal length
+// (it is the unnormalized plane equation) so the ray direction's dot product with it is the Moller-Trumbore determinant.
+struct WoopTriangle
+{
+	float3 row0;
+	float offset0;
+	float3 row1;
+	float offset1;
+	float3 row2;
+	float offset2;
+};
+
+// Compressed shading attributes used by `USE_COMPRESSED_VERTICES`. 16 instead of 48 bytes per vertex.
+// The position is quantized against the scene bounds and only precise enough for shading,
+// intersection uses the full precision positions in `vertex_positions` (or the Woop triangles and clusters).
+struct CompressedVertex
+{
+	uint normal; // Octahedral encoded, 2x 16 bit snorm.
+	uint uv; // 2x half.
+	uint position_xy; // 2x 16 bit unorm.
+	uint position_z_material; // 16 bit unorm z and a 16 bit material index.
 };
 
 static const float inf = 9999999;
@@ -130,12 +174,38 @@ static float3 sky_color(0, 0, 0);
 static float3 floor_color(1, 1, 1);
 static float gamma = 1;
 static float exposure = 1;
+static int fast_math = 0;
+#endif
+
+// Transcendentals used by the shading code. The GPU always uses the intrinsics.
+// The CPU switches acos and the inverse length to the `fm` approximations when `fast_math` is set, without it the results match the GPU. The scalar `FastPow` and `FastSinCos` are slower than libm
+// one value at a time (they only pay off batched through `Floatx`), so pow, sin and cos always use libm.
+#ifndef GPU
+FUNC float ShadingPow(float x, float y) { return std::pow(x, y); }
+FUNC float ShadingSin(float x) { return std::sin(x); }
+FUNC float ShadingCos(float x) { return std::cos(x); }
+FUNC float ShadingAcos(float x) { return fast_math ? fm::FastAcos(x) : std::acos(x); }
+// `x / (length_a * length(b))`, with `fast_math` the length of `b` comes from a reciprocal square root.
+FUNC float ShadingDivideByLengths(float x, float length_a, float3 b) { return fast_math ? x * fm::FastRsqrt(dot(b, b)) / length_a : x / (length_a * length(b)); }
+FUNC float frac(float x) { return x - std::floor(x); }
+#else
+#define ShadingPow(x, y) pow(x, y)
+#define ShadingSin(x) sin(x)
+#define ShadingCos(x) cos(x)
+#define ShadingAcos(x) acos(x)
+#define ShadingDivideByLengths(x, length_a, b) ((x) / ((length_a) * length(b)))
 #endif
 
 #ifdef GPU
 const StructuredBuffer<BVHNode> bvh_nodes : register(t5);
 const StructuredBuffer<Vertex> vertices : register(t3);
 const ByteAddressBuffer indices : register(t4);
+const StructuredBuffer<BVHCluster> clusters : register(t6);
+const StructuredBuffer<ClusterVertex> cluster_vertices : register(t7);
+const ByteAddressBuffer cluster_indices : register(t8);
+const StructuredBuffer<WoopTriangle> woop_triangles : register(t9);
+const StructuredBuffer<CompressedVertex> compressed_vertices : register(t10);
+const StructuredBuffer<float3> vertex_positions : register(t11);
 #endif
 
 cbuffer RTMaterials REGISTER_B(1)
@@ -143,6 +213,15 @@ cbuffer RTMaterials REGISTER_B(1)
 	ARRAY(Material, materials, 3);
 };
 
+// Maps the quantized positions of `CompressedVertex` back to world space: position = quantization_min + q * quantization_scale.
+cbuffer RTVertexQuantization REGISTER_B(2)
+{
+	float3 quantization_min;
+	float quantization_padding0;
+	float3 quantization_scale;
+	float quantization_padding1;
+};
+
 struct Sphere
 {
 	float3 center;
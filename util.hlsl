@@ -30,6 +30,30 @@ FUNC uint3 Load3x16BitIndices(uint offsetBytes)
     return retval;
 }
 
+// Load three 8 bit cluster local indices from a byte addressed buffer.
+FUNC uint3 Load3x8BitIndices(uint offsetBytes)
+{
+    // Same as `Load3x16BitIndices`. Three bytes can span two dwords so load 8 bytes and shift the wanted bytes down.
+    const uint dwordAlignedOffset = offsetBytes & ~3;
+    const uint2 eight8BitIndices = cluster_indices.Load2(dwordAlignedOffset);
+
+    const uint shift = (offsetBytes & 3) * 8;
+    const uint packed = shift == 0 ? eight8BitIndices.x : (eight8BitIndices.x >> shift) | (eight8BitIndices.y << (32 - shift));
+
+    return uint3(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff);
+}
+
+// Inverse of `fm::PackOctahedral`.
+FUNC float3 DecodeOctahedral(uint packed)
+{
+	const float2 e = max(float2(asint(uint2(packed << 16, packed)) >> 16) / 32767.f, -1.f); // Sign extend the 16 bit snorms.
+	float3 n = float3(e.x, e.y, 1.f - abs(e.x) - abs(e.y));
+	const float t = saturate(-n.z);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return normalize(n);
+}
+
 FUNC Material GetMaterial(int idx)
 {
 	return materials[idx];